@@ -0,0 +1,274 @@
+#define __STDC_FORMAT_MACROS 1
+#include "stdafx.h"
+#include "BenchInput.h"
+#include "TsLayer.h"
+#include "ES_AAC.h"
+#include "ES_AC3.h"
+#include "ES_h264.h"
+#include "ES_hevc.h"
+#include "ES_MPEGAudio.h"
+#include "ES_MPEGVideo.h"
+#include "ES_Subtitle.h"
+#include "ES_Teletext.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <set>
+
+namespace GYJ {
+
+bool loadFile(const std::string &path, std::vector<unsigned char> &data) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        return false;
+    }
+    unsigned char buffer[65536];
+    size_t n = 0;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    fclose(file);
+    return true;
+}
+
+// same sizes and score as the TS layer
+static bool detectPacketSize(const std::vector<unsigned char> &data, size_t &packetSize, size_t &offset) {
+    static const size_t sizes[] = { FLUTS_NORMAL_TS_PACKETSIZE, FLUTS_M2TS_TS_PACKETSIZE, FLUTS_DVB_ASI_TS_PACKETSIZE, FLUTS_ATSC_TS_PACKETSIZE };
+    for (size_t pos = 0; pos < data.size() && pos < 65536; pos++) {
+        if (data[pos] != 0x47) {
+            continue;
+        }
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            int score = 0;
+            for (size_t p = pos + sizes[s]; p < data.size() && data[p] == 0x47 && score < TS_CHECK_MAX_SCORE; p += sizes[s]) {
+                score++;
+            }
+            if (score >= TS_CHECK_MAX_SCORE) {
+                packetSize = sizes[s];
+                offset = pos;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// next sync byte from pos that the packets after it confirm, as at the start; the end of the data if none
+static size_t resync(const std::vector<unsigned char> &data, size_t pos, size_t packetSize) {
+    for (; pos < data.size(); pos++) {
+        if (data[pos] != 0x47) {
+            continue;
+        }
+        int score = 0;
+        size_t p = pos + packetSize;
+        for (; p < data.size() && data[p] == 0x47 && score < TS_CHECK_MAX_SCORE; p += packetSize) {
+            score++;
+        }
+        if (score >= TS_CHECK_MAX_SCORE || p >= data.size()) {
+            return pos;
+        }
+    }
+    return data.size();
+}
+
+static uint64_t decodePts(const unsigned char *p) {
+    return ((uint64_t)(p[0] & 0x0e) << 29) | ((uint64_t)p[1] << 22) | ((uint64_t)(p[2] & 0xfe) << 14)
+        | ((uint64_t)p[3] << 7) | ((uint64_t)p[4] >> 1);
+}
+
+TSDemux::ElementaryStream *createParser(uint16_t pid, TSDemux::STREAM_TYPE type, TSDemux::Logger *logger) {
+    TSDemux::ElementaryStream *es = NULL;
+    switch (type) {
+    case TSDemux::STREAM_TYPE_VIDEO_MPEG1:
+    case TSDemux::STREAM_TYPE_VIDEO_MPEG2:
+        es = new TSDemux::ES_MPEG2Video(pid);
+        break;
+    case TSDemux::STREAM_TYPE_AUDIO_MPEG1:
+    case TSDemux::STREAM_TYPE_AUDIO_MPEG2:
+        es = new TSDemux::ES_MPEG2Audio(pid);
+        break;
+    case TSDemux::STREAM_TYPE_AUDIO_AAC:
+    case TSDemux::STREAM_TYPE_AUDIO_AAC_ADTS:
+    case TSDemux::STREAM_TYPE_AUDIO_AAC_LATM:
+        es = new TSDemux::ES_AAC(pid);
+        break;
+    case TSDemux::STREAM_TYPE_VIDEO_H264:
+        es = new TSDemux::ES_h264(pid);
+        break;
+    case TSDemux::STREAM_TYPE_VIDEO_HEVC:
+        es = new TSDemux::ES_hevc(pid);
+        break;
+    case TSDemux::STREAM_TYPE_AUDIO_AC3:
+    case TSDemux::STREAM_TYPE_AUDIO_EAC3:
+        es = new TSDemux::ES_AC3(pid);
+        break;
+    case TSDemux::STREAM_TYPE_DVB_SUBTITLE:
+        es = new TSDemux::ES_Subtitle(pid);
+        break;
+    case TSDemux::STREAM_TYPE_DVB_TELETEXT:
+        es = new TSDemux::ES_Teletext(pid);
+        break;
+    default:
+        es = new TSDemux::ElementaryStream(pid);
+        es->has_stream_info = true;
+        break;
+    }
+    es->stream_type = type;
+    es->logger = logger;
+    return es;
+}
+
+void beginUnit(TSDemux::ElementaryStream *es, bool hasPts, uint64_t pts, uint64_t dts) {
+    if (hasPts) {
+        es->p_dts = es->c_dts;
+        es->p_pts = es->c_pts;
+        es->c_dts = dts;
+        es->c_pts = pts;
+    }
+}
+
+static uint64_t countFrames(TSDemux::ElementaryStream *es, void *) {
+    uint64_t count = 0;
+    TSDemux::STREAM_PKT pkt;
+    while (es->GetStreamPacket(&pkt)) {
+        count++;
+    }
+    return count;
+}
+
+uint64_t feedPayloads(TSDemux::ElementaryStream *es, const EsTrack &track, bool poll, BenchTakeFrames take, void *opaque, uint64_t &appends) {
+    if (take == NULL) {
+        take = countFrames;
+    }
+    uint64_t count = 0;
+    for (std::vector<EsChunk>::const_iterator it = track.chunks.begin(); it != track.chunks.end(); ++it) {
+        if (it->unitStart) {
+            count += take(es, opaque);
+            beginUnit(es, it->hasPts, it->pts, it->dts);
+        }
+        es->Append(it->data, it->size, it->unitStart && it->hasPts);
+        appends++;
+        if (poll) {
+            count += take(es, opaque);
+        }
+    }
+    return count + take(es, opaque);
+}
+
+BenchTimes benchTimes(const std::vector<int64_t> &times) {
+    std::vector<int64_t> sorted(times);
+    std::sort(sorted.begin(), sorted.end());
+    BenchTimes result;
+    result.median = sorted.empty() ? 1 : std::max((double)sorted[sorted.size() / 2], 1.0);
+    result.best = sorted.empty() ? 1 : std::max((double)sorted[0], 1.0);
+    return result;
+}
+
+bool prepareInput(BenchInput &input, TSDemux::Logger *logger) {
+    if (!detectPacketSize(input.data, input.packetSize, input.offset)) {
+        return false;
+    }
+    TsMemoryInput memory(&input.data[0], input.data.size());
+    TsLayer demux(&memory, TSDemux::ProgramSelection(), 0, logger);
+    demux.setKeepParseredData(false);
+    demux.doDemux();
+    input.programs = demux.getPrograms();
+
+    std::set<uint16_t> psiPids;
+    psiPids.insert(0x0000);
+    for (uint16_t pid = 0x0010; pid <= 0x0014; pid++) {
+        psiPids.insert(pid);
+    }
+    std::map<uint16_t, size_t> trackIndex;
+    for (std::vector<TSDemux::Program>::const_iterator pg = input.programs.begin(); pg != input.programs.end(); ++pg) {
+        psiPids.insert(pg->pmt_pid);
+        for (std::vector<TSDemux::PROGRAM_STREAM>::const_iterator it = pg->streams.begin(); it != pg->streams.end(); ++it) {
+            if (trackIndex.find(it->pid) == trackIndex.end()) {
+                trackIndex[it->pid] = input.tracks.size();
+                input.tracks.push_back(EsTrack());
+                input.tracks.back().pid = it->pid;
+                input.tracks.back().type = it->stream_type;
+            }
+        }
+    }
+
+    // continuations are dropped up to the first unit start, and after one that is dropped
+    std::vector<bool> skipping(input.tracks.size(), true);
+    input.packets = 0;
+    input.skippedBytes = 0;
+    input.psiPackets = 0;
+    size_t pos = input.offset;
+    while (pos + input.packetSize <= input.data.size()) {
+        const unsigned char *p = &input.data[pos];
+        if (p[0] != 0x47) {
+            size_t next = resync(input.data, pos + 1, input.packetSize);
+            input.skippedBytes += next - pos;
+            pos = next;
+            continue;
+        }
+        pos += input.packetSize;
+        input.packets++;
+        if ((p[1] & 0x80) != 0) {
+            continue;
+        }
+        uint16_t pid = ((p[1] & 0x1f) << 8) | p[2];
+        if (psiPids.find(pid) != psiPids.end()) {
+            input.psi.insert(input.psi.end(), p, p + input.packetSize);
+            input.psiPackets++;
+            continue;
+        }
+        std::map<uint16_t, size_t>::iterator idx = trackIndex.find(pid);
+        if (idx == trackIndex.end() || (p[3] & 0x10) == 0) {
+            continue;
+        }
+        EsTrack &track = input.tracks[idx->second];
+        std::vector<bool>::reference skip = skipping[idx->second];
+        size_t start = 4 + ((p[3] & 0x20) ? (size_t)p[4] + 1 : 0);
+        if (start >= FLUTS_NORMAL_TS_PACKETSIZE) {
+            skip = skip || (p[1] & 0x40) != 0;
+            continue;
+        }
+        EsChunk chunk;
+        chunk.data = p + start;
+        chunk.size = FLUTS_NORMAL_TS_PACKETSIZE - start;
+        chunk.unitStart = (p[1] & 0x40) != 0;
+        chunk.hasPts = false;
+        chunk.pts = chunk.dts = PTS_UNSET;
+        if (chunk.unitStart) {
+            // PES header, the rare one split over two TS packets is dropped with its unit
+            const unsigned char *h = chunk.data;
+            skip = true;
+            if (chunk.size < 9 || h[0] != 0 || h[1] != 0 || h[2] != 1) {
+                continue;
+            }
+            size_t headerSize = 6;
+            if (h[3] == 0xbd || (h[3] >= 0xc0 && h[3] <= 0xef)) {
+                headerSize = 9 + h[8];
+                if ((h[7] & 0x80) && headerSize >= 14) {
+                    chunk.hasPts = true;
+                    chunk.pts = chunk.dts = decodePts(h + 9);
+                    if ((h[7] & 0x40) && headerSize >= 19) {
+                        chunk.dts = decodePts(h + 14);
+                    }
+                }
+            }
+            if (headerSize > chunk.size) {
+                continue;
+            }
+            chunk.data += headerSize;
+            chunk.size -= headerSize;
+            skip = false;
+        } else if (skip) {
+            continue;
+        }
+        track.chunks.push_back(chunk);
+        track.packets++;
+        track.bytes += chunk.size;
+    }
+    if (input.skippedBytes > 0) {
+        fprintf(stderr, "warning: %" PRIu64 " bytes out of sync skipped \n", input.skippedBytes);
+    }
+    return true;
+}
+}
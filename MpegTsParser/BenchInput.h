@@ -0,0 +1,68 @@
+#pragma once
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include "debug.h"
+#include "elementaryStream.h"
+#include "tsProgram.h"
+
+#define BENCH_WARMUP            2
+#define BENCH_REPS              10
+
+namespace GYJ {
+
+// TS payload of one PID, the PES header already taken off
+typedef struct EsChunk {
+    const unsigned char *data;
+    size_t size;
+    bool unitStart;
+    bool hasPts;
+    uint64_t pts;
+    uint64_t dts;
+} EsChunk;
+
+typedef struct EsTrack {
+    EsTrack() : pid(0), type(TSDemux::STREAM_TYPE_UNKNOWN), packets(0), bytes(0) {}
+    uint16_t pid;
+    TSDemux::STREAM_TYPE type;
+    std::vector<EsChunk> chunks;
+    uint64_t packets;
+    uint64_t bytes;
+} EsTrack;
+
+// TS files loaded in memory, and what the benchmarks need of them
+typedef struct BenchInput {
+    BenchInput() : packetSize(0), offset(0), packets(0), skippedBytes(0), psiPackets(0) {}
+    std::vector<unsigned char> data;
+    size_t packetSize;
+    size_t offset;                      // of the first sync byte
+    uint64_t packets;                   // walked, in sync
+    uint64_t skippedBytes;              // out of sync, between the packets
+    std::vector<TSDemux::Program> programs;
+    std::vector<unsigned char> psi;     // the PSI packets alone
+    uint64_t psiPackets;
+    std::vector<EsTrack> tracks;        // selected streams
+} BenchInput;
+
+// median and best of the timed runs, us, at least 1
+typedef struct BenchTimes {
+    double median;
+    double best;
+} BenchTimes;
+
+// the frames the parser has, returns their count
+typedef uint64_t (*BenchTakeFrames)(TSDemux::ElementaryStream *es, void *opaque);
+
+// appends the file to data
+bool loadFile(const std::string &path, std::vector<unsigned char> &data);
+// programs from a first demux, then the PSI packets and the PES payloads of the streams
+bool prepareInput(BenchInput &input, TSDemux::Logger *logger);
+// the parser the PMT would give the stream
+TSDemux::ElementaryStream *createParser(uint16_t pid, TSDemux::STREAM_TYPE type, TSDemux::Logger *logger);
+// timestamps of a PES start, as the TS layer sets them
+void beginUnit(TSDemux::ElementaryStream *es, bool hasPts, uint64_t pts, uint64_t dts);
+// the track as the TS layer feeds it: frames taken at each unit start, before its payload, and after
+// each Append with poll; counted if take is NULL
+uint64_t feedPayloads(TSDemux::ElementaryStream *es, const EsTrack &track, bool poll, BenchTakeFrames take, void *opaque, uint64_t &appends);
+BenchTimes benchTimes(const std::vector<int64_t> &times);
+}
@@ -0,0 +1,122 @@
+#include "BitrateMeter.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace TSDemux;
+
+BitrateMeter::BitrateMeter(int bucketMs)
+    : mBucketMs(bucketMs > 0 ? bucketMs : BITRATE_BUCKET_MS)
+    , mErrored(0)
+    , mClockPid(0xffff)
+    , mHasPcr(false)
+    , mLastPcr(0)
+    , mMuxTime(0)
+    , mTicksPerPacket(0.0)
+    , mPendingLimit(BITRATE_MAX_PENDING)
+    , mSpreadPackets(0)
+    , mSpreadTicks(0)
+    , mLogger(&Logger::Default()) {
+    memset(mPackets, 0, sizeof(mPackets));
+    memset(mPayloadBytes, 0, sizeof(mPayloadBytes));
+    memset(mScrambled, 0, sizeof(mScrambled));
+    memset(mPidIndex, 0xff, sizeof(mPidIndex));
+    mPending.reserve(4096);
+}
+
+void BitrateMeter::addPcr(uint16_t pid, uint64_t pcr, bool discontinuity) {
+    // the first PCR PID found clocks the whole mux
+    if (mClockPid == 0xffff) {
+        mClockPid = pid;
+    }
+    if (pid != mClockPid) {
+        return;
+    }
+
+    if (!mHasPcr) {
+        // packets before the first PCR go to the first bucket
+        spread(0);
+        mLastPcr = pcr;
+        mHasPcr = true;
+        return;
+    }
+
+    int64_t duration = (int64_t)(pcr - mLastPcr);
+    size_t count = mPending.size();
+    uint64_t total = count + mSpreadPackets;
+    if (discontinuity || duration <= 0 || duration > BITRATE_MAX_PCR_GAP) {
+        // new time base: the mux time carries on at the last rate
+        duration = (int64_t)(mTicksPerPacket * count);
+        DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: PCR %.4x time base change, %u packets at last rate\n", __FUNCTION__, pid, (unsigned)count);
+    } else {
+        if (total > 0) {
+            mTicksPerPacket = (double)duration / total;
+            int64_t limit = (int64_t)(2 * (int64_t)mBucketMs * 27000 / mTicksPerPacket);
+            mPendingLimit = (size_t)std::max(limit, (int64_t)1024);
+        }
+        // what was spread ahead of this PCR is already on the mux time
+        duration = std::max(duration - mSpreadTicks, (int64_t)0);
+    }
+    spread(duration);
+    mSpreadPackets = 0;
+    mSpreadTicks = 0;
+    mLastPcr = pcr;
+}
+
+void BitrateMeter::finish() {
+    spread((int64_t)(mTicksPerPacket * mPending.size()));
+}
+
+void BitrateMeter::spreadPending() {
+    int64_t duration = (int64_t)(mTicksPerPacket * mPending.size());
+    if (mHasPcr) {
+        mSpreadPackets += mPending.size();
+        mSpreadTicks += duration;
+    }
+    spread(duration);
+}
+
+void BitrateMeter::spread(int64_t duration) {
+    size_t count = mPending.size();
+    int64_t bucketTicks = (int64_t)mBucketMs * 27000;
+    for (size_t i = 0; i < count; i++) {
+        uint16_t pid = mPending[i];
+        int64_t time = mMuxTime + (count > 1 ? duration * (int64_t)i / (int64_t)count : 0);
+        size_t bucket = (size_t)(time / bucketTicks);
+        if (bucket >= mBuckets.size()) {
+            mBuckets.resize(bucket + 1);
+        }
+        if (mPidIndex[pid] < 0) {
+            mPidIndex[pid] = (int16_t)mIndexPid.size();
+            mIndexPid.push_back(pid);
+        }
+        std::vector<uint32_t> &packets = mBuckets[bucket];
+        if (packets.size() <= (size_t)mPidIndex[pid]) {
+            packets.resize(mIndexPid.size(), 0);
+        }
+        packets[mPidIndex[pid]]++;
+    }
+    mPending.clear();
+    mMuxTime += duration;
+}
+
+uint64_t BitrateMeter::getTotalPackets() const {
+    uint64_t total = mErrored;
+    for (int pid = 0; pid < BITRATE_PID_COUNT; pid++) {
+        total += mPackets[pid];
+    }
+    return total;
+}
+
+uint32_t BitrateMeter::getBucketPackets(size_t bucket, uint16_t pid) const {
+    int index = mPidIndex[pid & 0x1fff];
+    if (bucket >= mBuckets.size() || index < 0 || (size_t)index >= mBuckets[bucket].size()) {
+        return 0;
+    }
+    return mBuckets[bucket][index];
+}
+
+double BitrateMeter::getBucketBitrate(size_t bucket, uint16_t pid) const {
+    return getBucketPackets(bucket, pid) * (double)BITRATE_PACKET_BITS * 1000.0 / mBucketMs;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <inttypes.h>
+#include <cstddef>
+#include <vector>
+#include "debug.h"
+
+#define BITRATE_PID_COUNT           8192
+#define BITRATE_NULL_PID            0x1fff
+#define BITRATE_BUCKET_MS           100
+#define BITRATE_PACKET_BITS         (188 * 8)
+#define BITRATE_MAX_PCR_GAP         270000000LL  // 10s of 27MHz
+#define BITRATE_MAX_PENDING         16384        // packets queued for a PCR while the rate is unknown
+
+namespace TSDemux
+{
+  /*
+   * Per PID accounting of every TS packet of the input, and bitrate over
+   * time. Counters are flat arrays indexed by PID so the packet loop only
+   * does increments. Packets are queued until the next PCR of the clock
+   * PID, then spread linearly between the two PCRs into fixed time buckets.
+   * A queue longer than two buckets at the last rate (the PCR is missing or
+   * on another PID) is spread at that rate without waiting.
+   */
+  class BitrateMeter
+  {
+  public:
+    explicit BitrateMeter(int bucketMs = BITRATE_BUCKET_MS);
+
+    inline void countPacket(uint16_t pid, size_t payloadLen, bool scrambled)
+    {
+      pid &= 0x1fff;
+      mPackets[pid]++;
+      mPayloadBytes[pid] += payloadLen;
+      mScrambled[pid] += scrambled;
+      mPending.push_back(pid);
+      if (mPending.size() >= mPendingLimit)
+        spreadPending();
+    }
+
+    // transport error: the PID cannot be trusted, counted in the total only
+    void countErrored() { mErrored++; }
+
+    // pcr on 27MHz (extended timeline), only the PCR of the clock PID is used
+    void addPcr(uint16_t pid, uint64_t pcr, bool discontinuity);
+    void setClockPid(uint16_t pid) { mClockPid = pid; }
+    // spread the packets after the last PCR at the last known rate
+    void finish();
+    void setLogger(Logger *logger) { mLogger = logger; }
+
+    uint64_t getPackets(uint16_t pid) const { return mPackets[pid & 0x1fff]; }
+    uint64_t getPayloadBytes(uint16_t pid) const { return mPayloadBytes[pid & 0x1fff]; }
+    uint64_t getScrambled(uint16_t pid) const { return mScrambled[pid & 0x1fff]; }
+    uint64_t getNullPackets() const { return mPackets[BITRATE_NULL_PID]; }
+    uint64_t getErroredPackets() const { return mErrored; }
+    uint64_t getTotalPackets() const;
+
+    int getBucketMs() const { return mBucketMs; }
+    size_t getBucketCount() const { return mBuckets.size(); }
+    uint32_t getBucketPackets(size_t bucket, uint16_t pid) const;
+    double getBucketBitrate(size_t bucket, uint16_t pid) const;
+    double getDurationMs() const { return mMuxTime / 27000.0; }
+    bool hasClock() const { return mHasPcr; }
+
+  private:
+    BitrateMeter(const BitrateMeter&);
+    BitrateMeter& operator=(const BitrateMeter&);
+
+    void spread(int64_t duration);
+    void spreadPending();
+
+    int mBucketMs;
+    uint64_t mPackets[BITRATE_PID_COUNT];
+    uint64_t mPayloadBytes[BITRATE_PID_COUNT];
+    uint64_t mScrambled[BITRATE_PID_COUNT];
+    uint64_t mErrored;
+
+    // mux clock
+    uint16_t mClockPid;
+    bool mHasPcr;
+    uint64_t mLastPcr;
+    int64_t mMuxTime;                   ///< 27MHz since the first PCR
+    double mTicksPerPacket;
+    std::vector<uint16_t> mPending;     ///< PIDs of the packets since the last PCR
+    size_t mPendingLimit;
+    uint64_t mSpreadPackets;            ///< spread at the last rate since the last PCR
+    int64_t mSpreadTicks;
+    Logger *mLogger;
+
+    // packets per bucket, by compact PID index
+    int16_t mPidIndex[BITRATE_PID_COUNT];
+    std::vector<uint16_t> mIndexPid;
+    std::vector<std::vector<uint32_t> > mBuckets;
+  };
+}
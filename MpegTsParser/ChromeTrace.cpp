@@ -0,0 +1,157 @@
+#include "ChromeTrace.h"
+#include "mutex.h"
+
+#include <cstdio>
+#include <vector>
+
+#if defined(_MSC_VER)
+#define TRACE_THREAD_LOCAL          __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL          __thread
+#endif
+
+using namespace TSDemux;
+
+typedef struct TRACE_EVENT
+{
+    const char *name;
+    const char *category;
+    int64_t start;                  ///< us since enable()
+    int64_t duration;
+    int detail;                     ///< index in the details of the thread, -1 for none
+} TRACE_EVENT;
+
+// spans of one thread, appended by that thread only
+struct ThreadBuffer
+{
+    int tid;
+    std::string name;
+    std::vector<TRACE_EVENT> events;
+    std::vector<std::string> details;
+    uint64_t dropped;
+};
+
+// kept when their thread ends, freed by write()
+static std::vector<ThreadBuffer*> g_buffers;
+static PLATFORM::CMutex g_buffersMutex;
+static int64_t g_startUs = 0;
+static int64_t g_minSpanUs = 0;
+static TRACE_THREAD_LOCAL ThreadBuffer *t_buffer = NULL;
+
+static ThreadBuffer *threadBuffer() {
+    if (t_buffer == NULL) {
+        ThreadBuffer *buffer = new ThreadBuffer();
+        buffer->dropped = 0;
+        PLATFORM::CLockObject lock(g_buffersMutex);
+        buffer->tid = (int)g_buffers.size() + 1;
+        g_buffers.push_back(buffer);
+        t_buffer = buffer;
+    }
+    return t_buffer;
+}
+
+// the other threads are joined, nothing is recorded any more
+static void freeBuffers() {
+    for (size_t i = 0; i < g_buffers.size(); i++) {
+        delete g_buffers[i];
+    }
+    g_buffers.clear();
+    t_buffer = NULL;
+}
+
+static void writeJsonString(FILE *file, const std::string &text) {
+    fputc('"', file);
+    for (std::string::const_iterator it = text.begin(); it != text.end(); ++it) {
+        unsigned char c = (unsigned char)*it;
+        if (c == '"' || c == '\\') {
+            fprintf(file, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+bool ChromeTrace::sEnabled = false;
+
+void ChromeTrace::enable(int64_t minSpanUs) {
+    g_startUs = PLATFORM::GetTimeUs();
+    g_minSpanUs = minSpanUs;
+    sEnabled = true;
+}
+
+void ChromeTrace::setThreadName(const std::string &name) {
+    if (enabled()) {
+        threadBuffer()->name = name;
+    }
+}
+
+void ChromeTrace::record(const char *name, const char *category, int64_t startUs, int64_t endUs, const std::string *detail) {
+    // a span still open when the trace was written
+    if (!enabled() || endUs - startUs < g_minSpanUs) {
+        return;
+    }
+    ThreadBuffer *buffer = threadBuffer();
+    if (buffer->events.size() >= TRACE_MAX_EVENTS) {
+        buffer->dropped++;
+        return;
+    }
+    TRACE_EVENT event;
+    event.name = name;
+    event.category = category;
+    event.start = startUs - g_startUs;
+    event.duration = endUs - startUs;
+    event.detail = -1;
+    if (detail != NULL) {
+        event.detail = (int)buffer->details.size();
+        buffer->details.push_back(*detail);
+    }
+    buffer->events.push_back(event);
+}
+
+uint64_t ChromeTrace::dropped() {
+    PLATFORM::CLockObject lock(g_buffersMutex);
+    uint64_t dropped = 0;
+    for (size_t i = 0; i < g_buffers.size(); i++) {
+        dropped += g_buffers[i]->dropped;
+    }
+    return dropped;
+}
+
+bool ChromeTrace::write(const std::string &path) {
+    PLATFORM::CLockObject lock(g_buffersMutex);
+    sEnabled = false;
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == NULL) {
+        freeBuffers();
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"MpegTsParser\"}}");
+    for (size_t i = 0; i < g_buffers.size(); i++) {
+        const ThreadBuffer *buffer = g_buffers[i];
+        if (!buffer->name.empty()) {
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", buffer->tid);
+            writeJsonString(file, buffer->name);
+            fprintf(file, "}}");
+        }
+        for (std::vector<TRACE_EVENT>::const_iterator it = buffer->events.begin(); it != buffer->events.end(); ++it) {
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld",
+                it->name, it->category, buffer->tid, (long long)it->start, (long long)it->duration);
+            if (it->detail >= 0) {
+                fprintf(file, ",\"args\":{\"detail\":");
+                writeJsonString(file, buffer->details[it->detail]);
+                fprintf(file, "}");
+            }
+            fprintf(file, "}");
+        }
+    }
+    fprintf(file, "\n]}\n");
+    freeBuffers();
+
+    bool ok = ferror(file) == 0;
+    return fclose(file) == 0 && ok;
+}
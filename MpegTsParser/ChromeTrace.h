@@ -0,0 +1,92 @@
+#pragma once
+#include <inttypes.h>
+#include <string>
+#include "timeutils.h"
+
+/*
+ * Trace spans are compiled out when defined to 0: ChromeTrace::enabled() is
+ * then constant false and a TraceSpan costs nothing.
+ */
+#ifndef DEMUX_TRACE_SPANS
+#define DEMUX_TRACE_SPANS           1
+#endif
+
+#define TRACE_MIN_SPAN_US           10          // shorter spans are not recorded
+#define TRACE_MAX_EVENTS            1000000     // per thread, later spans are dropped
+#define TRACE_BATCH_PACKETS         8192        // TS packets of a demux span
+
+// span categories, I/O waits apart from CPU work
+#define TRACE_IO                    "io"
+#define TRACE_CPU                   "cpu"
+
+namespace TSDemux
+{
+  /*
+   * Timeline of the run for chrome://tracing and Perfetto: begin and end of
+   * the stages as complete events, one buffer per thread so that recording
+   * takes no lock. Enabled once at startup, before any thread is started;
+   * write() is called once the threads are joined.
+   */
+  class ChromeTrace
+  {
+  public:
+    static void enable(int64_t minSpanUs = TRACE_MIN_SPAN_US);
+    static bool enabled() { return DEMUX_TRACE_SPANS && sEnabled; }
+
+    // names the calling thread in the timeline
+    static void setThreadName(const std::string &name);
+    // a span of the calling thread, detail is shown as its argument
+    static void record(const char *name, const char *category, int64_t startUs, int64_t endUs, const std::string *detail = NULL);
+    // Chrome trace JSON of every thread, then the spans are freed and recording stops
+    static bool write(const std::string &path);
+    // spans over TRACE_MAX_EVENTS, all threads
+    static uint64_t dropped();
+
+  private:
+    static bool sEnabled;
+  };
+
+  // records its block as a span, begin and end on the calling thread
+  class TraceSpan
+  {
+  public:
+    TraceSpan(const char *name, const char *category)
+      : mName(ChromeTrace::enabled() ? name : NULL), mCategory(category), mStart(0)
+    {
+      if (mName)
+        mStart = PLATFORM::GetTimeUs();
+    }
+
+    ~TraceSpan()
+    {
+      if (mName)
+        ChromeTrace::record(mName, mCategory, mStart, PLATFORM::GetTimeUs(), mDetail.empty() ? NULL : &mDetail);
+    }
+
+    bool active() const { return mName != NULL; }
+    void setDetail(const std::string &detail) { if (mName) mDetail = detail; }
+
+    // ends the span here and begins the next one, for the batches of a loop
+    void restart()
+    {
+      if (!mName)
+        return;
+      int64_t now = PLATFORM::GetTimeUs();
+      ChromeTrace::record(mName, mCategory, mStart, now);
+      mStart = now;
+    }
+
+  private:
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+
+    const char *mName;
+    const char *mCategory;
+    int64_t mStart;
+    std::string mDetail;
+  };
+}
+
+#define TRACE_CONCAT_(a, b)         a##b
+#define TRACE_CONCAT(a, b)          TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name, category)  TSDemux::TraceSpan TRACE_CONCAT(trace_span_, __LINE__)((name), (category))
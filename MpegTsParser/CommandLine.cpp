@@ -1,27 +0,0 @@
-#include "StdAfx.h"
-#include "CommandLine.h"
-
-namespace GYJ {
-
-CommandLine *CommandLine::sInstance = NULL;
-
-
-CommandLine::CommandLine(void){
-}
-
-CommandLine::~CommandLine(void){
-}
-
-CommandLine *CommandLine::getInstance() {
-    if (sInstance == NULL) {
-        sInstance = new CommandLine;
-    }
-
-    return sInstance;
-}
-
-void CommandLine::setCommandLineParam(CommandLineParam param) {
-    mParam = param;
-}
-
-}
\ No newline at end of file
@@ -3,30 +3,43 @@
 #include "ParserdDataContainer.h"
 namespace GYJ {
 typedef struct CommandLineParam {
-    CommandLineParam() : printMediaType(PRINT_MEDIA_ALL), printPtsType(PRINT_PARTLY_PTS), checkPacketBufferOut(0), printPcr(0) {}
+    CommandLineParam() : printMediaType(PRINT_MEDIA_ALL), printPtsType(PRINT_PARTLY_PTS), checkPacketBufferOut(0), printPcr(0), printSi(0), pcrAnalysis(0), pcrWallClock(0), bitrate(0), bitrateCsv(0), bitrateBucketMs(100), gop(0), duration(0), durationOnly(0), fromTrace(0), recursive(0), watch(0), follow(0), followIdle(0), counters(0), perfReport(0) {}
     int printMediaType;
     int printPtsType;
     int checkPtsDtsDistance;
     int checkPacketBufferOut;
     int printPcr;
+    int printSi;
+    int pcrAnalysis;
+    int pcrWallClock;
+    int bitrate;
+    int bitrateCsv;
+    int bitrateBucketMs;
+    int gop;
+    int duration;
+    int durationOnly;
+    int fromTrace;
+    int recursive;
+    int watch;
+    int follow;
+    int followIdle;                     // seconds, 0: until stopped
+    int counters;
+    int perfReport;
 
     std::string filePath;
-} CommandLineParam;
-
-class CommandLine
-{
-public:
-    CommandLine(void);
-    ~CommandLine(void);
-
+    std::string traceDir;
+    std::string cacheFile;
+    std::string chromeTrace;
 
-    static CommandLine *getInstance();
-
-    void setCommandLineParam(CommandLineParam param);
-    const CommandLineParam getCommandLineParam() { return mParam; }
-private:
-    CommandLineParam mParam;
-    static CommandLine *sInstance;
-};
+    // report options of a ParseredDataContainer
+    printParam getPrintParam() const {
+        printParam pp(printMediaType, printPtsType);
+        pp.printPcr = printPcr;
+        pp.checkPacketBufferOut = checkPacketBufferOut;
+        pp.bitrateCsv = bitrateCsv;
+        pp.durationOnly = durationOnly;
+        return pp;
+    }
+} CommandLineParam;
 
 }
\ No newline at end of file
@@ -0,0 +1,259 @@
+#include "stdafx.h"
+#include "DirScanner.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <io.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace GYJ {
+
+enum EntryKind {
+    ENTRY_SKIP,
+    ENTRY_FILE,
+    ENTRY_DIR
+};
+
+#if !defined(_MSC_VER)
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+// stat only for the file systems without d_type and for the links to a wanted name
+static EntryKind entryKind(int dirfd, const char *name, unsigned char type, bool wanted, bool recursive) {
+    struct stat st;
+    switch (type) {
+    case DT_REG:
+        return ENTRY_FILE;
+    case DT_DIR:
+        return ENTRY_DIR;
+    case DT_LNK:
+        // links are followed to files, never to directories
+        if (wanted && fstatat(dirfd, name, &st, 0) == 0 && S_ISREG(st.st_mode)) {
+            return ENTRY_FILE;
+        }
+        return ENTRY_SKIP;
+    case DT_UNKNOWN:
+        if (!wanted && !recursive) {
+            return ENTRY_SKIP;
+        }
+        if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            return ENTRY_SKIP;
+        }
+        if (S_ISREG(st.st_mode)) {
+            return ENTRY_FILE;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            return ENTRY_DIR;
+        }
+        if (S_ISLNK(st.st_mode) && wanted && fstatat(dirfd, name, &st, 0) == 0 && S_ISREG(st.st_mode)) {
+            return ENTRY_FILE;
+        }
+        return ENTRY_SKIP;
+    default:
+        return ENTRY_SKIP;
+    }
+}
+#endif
+
+#if defined(__linux__)
+// record of getdents64, d_name is NUL terminated within d_reclen
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+#endif
+
+DirScanner::DirScanner(const std::set<std::string> &extensions, bool recursive, int threads)
+    : mRecursive(recursive), mThreads(threads), mBusy(0) {
+    for (std::set<std::string>::const_iterator it = extensions.begin(); it != extensions.end(); ++it) {
+        std::string ext = *it;
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        mExtensions.insert(ext);
+    }
+}
+
+DirScanner::~DirScanner() {
+}
+
+bool DirScanner::matches(const char *name) const {
+    const char *dot = strrchr(name, '.');
+    if (dot == NULL || dot == name) {
+        return false;
+    }
+    std::string ext(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return mExtensions.find(ext) != mExtensions.end();
+}
+
+bool DirScanner::scanDir(const std::string &rel, std::vector<std::string> &files, std::vector<std::string> &subdirs, std::vector<char> &buffer) {
+    std::string path = mRoot + rel;
+
+#if defined(_MSC_VER)
+    _finddata_t findData;
+    intptr_t handle = _findfirst((path + "*").c_str(), &findData);
+    if (handle == -1) {
+        return false;
+    }
+    do {
+        const char *name = findData.name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        if (findData.attrib & _A_SUBDIR) {
+            if (mRecursive) {
+                subdirs.push_back(rel + name + "/");
+            }
+        } else if (matches(name)) {
+            files.push_back(rel + name);
+        }
+    } while (_findnext(handle, &findData) == 0);
+    _findclose(handle);
+    return true;
+#else
+    int fd = open(path.empty() ? "." : path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+#if defined(__linux__)
+    if (buffer.empty()) {
+        buffer.resize(SCAN_BUFFER_SIZE);
+    }
+    while (true) {
+        long n = syscall(SYS_getdents64, fd, &buffer[0], buffer.size());
+        if (n <= 0) {
+            break;
+        }
+        for (long pos = 0; pos < n; ) {
+            const linux_dirent64 *entry = (const linux_dirent64*)&buffer[pos];
+            pos += entry->d_reclen;
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            bool wanted = matches(name);
+            EntryKind kind = entryKind(fd, name, entry->d_type, wanted, mRecursive);
+            if (kind == ENTRY_DIR && mRecursive) {
+                subdirs.push_back(rel + name + "/");
+            } else if (kind == ENTRY_FILE && wanted) {
+                files.push_back(rel + name);
+            }
+        }
+    }
+    close(fd);
+#else
+    (void)buffer;
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        close(fd);
+        return false;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        bool wanted = matches(name);
+        EntryKind kind = entryKind(dirfd(dir), name, entry->d_type, wanted, mRecursive);
+        if (kind == ENTRY_DIR && mRecursive) {
+            subdirs.push_back(rel + name + "/");
+        } else if (kind == ENTRY_FILE && wanted) {
+            files.push_back(rel + name);
+        }
+    }
+    closedir(dir);
+#endif
+    return true;
+#endif
+}
+
+void DirScanner::work(std::vector<std::string> &files) {
+    std::vector<char> buffer;
+    std::vector<std::string> subdirs;
+
+    TSDemux::PLATFORM::CLockObject lock(mMutex);
+    while (true) {
+        while (mPending.empty() && mBusy > 0) {
+            mCondition.Wait(mMutex);
+        }
+        if (mPending.empty()) {
+            // nothing queued and nobody left to queue more
+            return;
+        }
+        std::string rel = mPending.front();
+        mPending.pop_front();
+        mBusy++;
+
+        lock.Unlock();
+        subdirs.clear();
+        // an unreadable subdirectory is skipped
+        scanDir(rel, files, subdirs, buffer);
+        lock.Lock();
+
+        mPending.insert(mPending.end(), subdirs.begin(), subdirs.end());
+        mBusy--;
+        mCondition.Broadcast();
+    }
+}
+
+bool DirScanner::scan(const std::string &dir, std::vector<std::string> &files) {
+    mRoot = dir;
+    if (!mRoot.empty() && mRoot[mRoot.size() - 1] != '/' && mRoot[mRoot.size() - 1] != '\\') {
+        mRoot.append("/");
+    }
+
+    std::vector<std::string> found;
+    std::vector<std::string> subdirs;
+    std::vector<char> buffer;
+    if (!scanDir("", found, subdirs, buffer)) {
+        return false;
+    }
+
+    if (!subdirs.empty()) {
+        mPending.assign(subdirs.begin(), subdirs.end());
+        mBusy = 0;
+
+        std::vector<Worker*> workers;
+        for (int i = 0; i < mThreads; i++) {
+            Worker *worker = new Worker(*this);
+            if (!worker->Start()) {
+                delete worker;
+                break;
+            }
+            workers.push_back(worker);
+        }
+        if (workers.empty()) {
+            // no thread: walk in place
+            work(found);
+        }
+        for (std::vector<Worker*>::iterator it = workers.begin(); it != workers.end(); ++it) {
+            (*it)->Join();
+            found.insert(found.end(), (*it)->mFiles.begin(), (*it)->mFiles.end());
+            delete *it;
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+    return true;
+}
+}
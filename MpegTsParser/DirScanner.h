@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <set>
+#include <deque>
+#include "thread.h"
+
+namespace GYJ {
+
+#define SCAN_THREADS            4
+#define SCAN_BUFFER_SIZE        (1 << 20)   // directory entries read per system call on Linux
+
+/*
+ * Lists the files of a directory with one of the given extensions. The
+ * entries are read in large batches (getdents64 on Linux), the file type
+ * comes from the directory entry, stat is only called when the file system
+ * does not report it. A recursive scan walks the subdirectories on worker
+ * threads; symbolic links to directories are not followed.
+ */
+class DirScanner
+{
+public:
+    // extensions without the dot, matched case insensitively
+    DirScanner(const std::set<std::string> &extensions, bool recursive = false, int threads = SCAN_THREADS);
+    ~DirScanner();
+
+    // appends the sorted paths relative to dir, false if dir cannot be read
+    bool scan(const std::string &dir, std::vector<std::string> &files);
+
+private:
+    class Worker : public TSDemux::PLATFORM::CThread
+    {
+    public:
+        explicit Worker(DirScanner &scanner) : mScanner(scanner) {}
+        virtual ~Worker() { Join(); }
+        std::vector<std::string> mFiles;
+    protected:
+        virtual void Process() { mScanner.work(mFiles); }
+    private:
+        DirScanner &mScanner;
+    };
+
+    void work(std::vector<std::string> &files);
+    // rel is "" or ends with '/', subdirectories are added as rel paths too
+    bool scanDir(const std::string &rel, std::vector<std::string> &files, std::vector<std::string> &subdirs, std::vector<char> &buffer);
+    bool matches(const char *name) const;
+
+    std::set<std::string> mExtensions;
+    bool mRecursive;
+    int mThreads;
+    std::string mRoot;
+    std::deque<std::string> mPending;   // subdirectories to scan
+    int mBusy;                          // workers scanning a directory
+    TSDemux::PLATFORM::CMutex mMutex;
+    TSDemux::PLATFORM::CCondition mCondition;
+};
+}
@@ -0,0 +1,80 @@
+#define __STDC_FORMAT_MACROS 1
+#include "DurationCounter.h"
+#include "debug.h"
+
+#include <inttypes.h>
+
+using namespace TSDemux;
+
+MEDIA_DURATION::MEDIA_DURATION()
+    : video(false), frames(0), ticks(0), samples(0), sampleSeconds(0.0)
+    , sampleRate(0), rateChanges(0), ptsMin(PTS_UNSET), ptsMax(PTS_UNSET), lastDuration(0) {
+}
+
+double MEDIA_DURATION::seconds() const {
+    if (!video && samples > 0) {
+        return sampleSeconds;
+    }
+    return ticks / 90000.0;
+}
+
+double MEDIA_DURATION::ptsSpan() const {
+    if (ptsMin == PTS_UNSET) {
+        return 0.0;
+    }
+    return (ptsMax - ptsMin + lastDuration) / 90000.0;
+}
+
+DurationCounter::DurationCounter() {
+}
+
+void DurationCounter::addFrame(const STREAM_PKT *pkt, bool video, int sampleRate) {
+    MEDIA_DURATION &stats = mPids[pkt->pid];
+    stats.video = video;
+    stats.frames++;
+
+    uint64_t duration = pkt->duration <= DURATION_MAX_FRAME ? pkt->duration : 0;
+    stats.ticks += duration;
+    if (!video && pkt->samples > 0 && sampleRate > 0) {
+        if (stats.sampleRate != 0 && stats.sampleRate != sampleRate) {
+            stats.rateChanges++;
+        }
+        stats.sampleRate = sampleRate;
+        stats.samples += pkt->samples;
+        stats.sampleSeconds += (double)pkt->samples / sampleRate;
+    }
+
+    if (pkt->pts != PTS_UNSET) {
+        if (stats.ptsMin == PTS_UNSET || pkt->pts < stats.ptsMin) {
+            stats.ptsMin = pkt->pts;
+        }
+        if (stats.ptsMax == PTS_UNSET || pkt->pts >= stats.ptsMax) {
+            stats.ptsMax = pkt->pts;
+            stats.lastDuration = duration;
+        }
+    }
+}
+
+std::vector<uint16_t> DurationCounter::getPids() const {
+    std::vector<uint16_t> pids;
+    for (std::map<uint16_t, MEDIA_DURATION>::const_iterator it = mPids.begin(); it != mPids.end(); ++it) {
+        pids.push_back(it->first);
+    }
+    return pids;
+}
+
+const MEDIA_DURATION *DurationCounter::getStats(uint16_t pid) const {
+    std::map<uint16_t, MEDIA_DURATION>::const_iterator it = mPids.find(pid);
+    return it == mPids.end() ? NULL : &it->second;
+}
+
+void DurationCounter::dump(uint16_t pid, const MEDIA_DURATION &stats, Logger *logger) {
+    if (stats.video) {
+        DEMUX_LOG(logger, DEMUX_DBG_INFO, "[DURATION] pid:0x%.4x video frames:%" PRIu64 " duration:%.6fs pts span:%.6fs \n", pid,
+            stats.frames, stats.seconds(), stats.ptsSpan());
+    } else {
+        DEMUX_LOG(logger, DEMUX_DBG_INFO, "[DURATION] pid:0x%.4x audio frames:%" PRIu64 " samples:%" PRIu64 " rate:%d duration:%.6fs pts span:%.6fs%s \n", pid,
+            stats.frames, stats.samples, stats.sampleRate, stats.seconds(), stats.ptsSpan(),
+            stats.rateChanges ? " (sample rate changed)" : "");
+    }
+}
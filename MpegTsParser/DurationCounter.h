@@ -0,0 +1,53 @@
+#pragma once
+#include <inttypes.h>
+#include <map>
+#include <vector>
+#include "elementaryStream.h"
+#include "debug.h"
+
+#define DURATION_MAX_FRAME          180000  // frame durations above 2s are dropped (90kHz)
+
+namespace TSDemux
+{
+  struct MEDIA_DURATION
+  {
+    MEDIA_DURATION();
+
+    // summed media duration in seconds, sample exact for audio
+    double seconds() const;
+    // presentation span in seconds, up to the end of the last frame
+    double ptsSpan() const;
+
+    bool video;
+    uint64_t frames;
+    uint64_t ticks;                 ///< sum of the frame durations (90kHz)
+    uint64_t samples;               ///< audio samples per channel
+    double sampleSeconds;           ///< samples over their sample rate
+    int sampleRate;                 ///< of the last audio frame, 0 for video
+    int rateChanges;
+    uint64_t ptsMin;                ///< extended PTS (90kHz), PTS_UNSET without frame
+    uint64_t ptsMax;
+    uint64_t lastDuration;          ///< duration of the frame at ptsMax
+  };
+
+  /*
+   * Media duration of the streams, summed frame by frame as the ES parsers
+   * emit them: audio from the samples of each frame over the sample rate,
+   * video from the frame durations of the parser timing. Nothing is buffered.
+   */
+  class DurationCounter
+  {
+  public:
+    DurationCounter();
+
+    // frame of an ES parser, extended timestamps
+    void addFrame(const STREAM_PKT *pkt, bool video, int sampleRate);
+
+    std::vector<uint16_t> getPids() const;
+    const MEDIA_DURATION *getStats(uint16_t pid) const;
+    static void dump(uint16_t pid, const MEDIA_DURATION &stats, Logger *logger = &Logger::Default());
+
+  private:
+    std::map<uint16_t, MEDIA_DURATION> mPids;
+  };
+}
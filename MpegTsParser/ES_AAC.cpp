@@ -39,6 +39,7 @@ ES_AAC::ES_AAC(uint16_t pes_pid)
   m_PTS                         = 0;
   m_DTS                         = 0;
   m_FrameSize                   = 0;
+  m_Samples                     = 0;
   m_SampleRate                  = 0;
   m_Channels                    = 0;
   m_BitRate                     = 0;
@@ -66,10 +67,14 @@ void ES_AAC::Parse(STREAM_PKT* pkt)
   if (es_found_frame && l >= m_FrameSize)
   {
     bool streamChange = SetAudioInformation(m_Channels, m_SampleRate, m_BitRate, 0, 0);
+    // Bn of ISO/IEC 13818-1 2.4.2.3 for ISO/IEC 13818-7 audio
+    buffer_size = m_Channels > 2 ? 8976 : 3584;
+    max_bitrate = m_BitRate;
     pkt->pid            = pid;
     pkt->data           = &es_buf[p];
     pkt->size           = m_FrameSize;
-    pkt->duration       = 1024 * 90000 / (!m_SampleRate ? aac_sample_rates[4] : m_SampleRate);
+    pkt->duration       = m_Samples * 90000 / (!m_SampleRate ? aac_sample_rates[4] : m_SampleRate);
+    pkt->samples        = m_Samples;
     pkt->dts            = m_DTS;
     pkt->pts            = m_PTS;
     pkt->streamChange   = streamChange;
@@ -110,10 +115,11 @@ int ES_AAC::FindHeaders(uint8_t *buf, int buf_size)
       if (!ParseLATMAudioMuxElement(&bs))
         return 0;
 
+      m_Samples = 1024;
       es_found_frame = true;
       m_DTS = c_pts;
       m_PTS = c_pts;
-      c_pts += 90000 * 1024 / (!m_SampleRate ? aac_sample_rates[4] : m_SampleRate);
+      c_pts += 90000 * m_Samples / (!m_SampleRate ? aac_sample_rates[4] : m_SampleRate);
       return -1;
     }
   }
@@ -141,12 +147,14 @@ int ES_AAC::FindHeaders(uint8_t *buf, int buf_size)
       bs.skipBits(4);
 
       m_FrameSize = bs.readBits(13);
+      bs.skipBits(11); // adts_buffer_fullness
+      m_Samples = 1024 * (bs.readBits(2) + 1); // number_of_raw_data_blocks_in_frame + 1
       m_SampleRate    = aac_sample_rates[SampleRateIndex & 0x0F];
 
       es_found_frame = true;
       m_DTS = c_pts;
       m_PTS = c_pts;
-      c_pts += 90000 * 1024 / (!m_SampleRate ? aac_sample_rates[4] : m_SampleRate);
+      c_pts += 90000 * m_Samples / (!m_SampleRate ? aac_sample_rates[4] : m_SampleRate);
       return -1;
     }
   }
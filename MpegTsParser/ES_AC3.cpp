@@ -111,10 +111,12 @@ ES_AC3::ES_AC3(uint16_t pid)
   m_PTS                       = 0;
   m_DTS                       = 0;
   m_FrameSize                 = 0;
+  m_Samples                   = 0;
   m_SampleRate                = 0;
   m_Channels                  = 0;
   m_BitRate                   = 0;
   es_alloc_init               = 1920*2;
+  buffer_size                 = 5696;   // Bn of ATSC A/52 Annex A
 }
 
 ES_AC3::~ES_AC3()
@@ -136,10 +138,12 @@ void ES_AC3::Parse(STREAM_PKT* pkt)
   if (es_found_frame && l >= m_FrameSize)
   {
     bool streamChange = SetAudioInformation(m_Channels, m_SampleRate, m_BitRate, 0, 0);
+    max_bitrate = m_BitRate;
     pkt->pid            = pid;
     pkt->data           = &es_buf[p];
     pkt->size           = m_FrameSize;
-    pkt->duration       = 90000 * 1536 / m_SampleRate;
+    pkt->duration       = 90000 * m_Samples / m_SampleRate;
+    pkt->samples        = m_Samples;
     pkt->dts            = m_DTS;
     pkt->pts            = m_PTS;
     pkt->streamChange   = streamChange;
@@ -200,6 +204,7 @@ int ES_AC3::FindHeaders(uint8_t *buf, int buf_size)
       m_BitRate     = (AC3BitrateTable[frmsizecod>>1] * 1000) >> srShift;
       m_Channels    = AC3ChannelsTable[acmod] + lfeon;
       m_FrameSize   = AC3FrameSizeTable[frmsizecod][fscod] * 2;
+      m_Samples     = 1536;
     }
     else
     {
@@ -234,11 +239,12 @@ int ES_AC3::FindHeaders(uint8_t *buf, int buf_size)
 
       m_BitRate  = (uint32_t)(8.0 * m_FrameSize * m_SampleRate / (numBlocks * 256.0));
       m_Channels = AC3ChannelsTable[channelMode] + lfeon;
+      m_Samples  = numBlocks * 256;
     }
     es_found_frame = true;
     m_DTS = c_pts;
     m_PTS = c_pts;
-    c_pts += 90000 * 1536 / m_SampleRate;
+    c_pts += 90000 * m_Samples / m_SampleRate;
     return -1;
   }
   return 0;
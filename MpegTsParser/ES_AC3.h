@@ -32,6 +32,7 @@ namespace TSDemux
     int         m_Channels;
     int         m_BitRate;
     int         m_FrameSize;
+    int         m_Samples;            /* samples per channel of the current frame */
 
     int64_t     m_PTS;                /* pts of the current frame */
     int64_t     m_DTS;                /* dts of the current frame */
@@ -44,10 +44,12 @@ ES_MPEG2Audio::ES_MPEG2Audio(uint16_t pid)
   m_PTS                       = 0;
   m_DTS                       = 0;
   m_FrameSize                 = 0;
+  m_Samples                   = 0;
   m_SampleRate                = 0;
   m_Channels                  = 0;
   m_BitRate                   = 0;
   es_alloc_init               = 2048;
+  buffer_size                 = 3584;   // Bn of ISO/IEC 13818-1 2.4.2.3
 }
 
 ES_MPEG2Audio::~ES_MPEG2Audio()
@@ -69,10 +71,12 @@ void ES_MPEG2Audio::Parse(STREAM_PKT* pkt)
   if (es_found_frame && l >= m_FrameSize)
   {
     bool streamChange = SetAudioInformation(m_Channels, m_SampleRate, m_BitRate, 0, 0);
+    max_bitrate = m_BitRate;
     pkt->pid            = pid;
     pkt->data           = &es_buf[p];
     pkt->size           = m_FrameSize;
-    pkt->duration       = 90000 * 1152 / m_SampleRate;
+    pkt->duration       = 90000 * m_Samples / m_SampleRate;
+    pkt->samples        = m_Samples;
     pkt->dts            = m_DTS;
     pkt->pts            = m_PTS;
     pkt->streamChange   = streamChange;
@@ -134,10 +138,18 @@ int ES_MPEG2Audio::FindHeaders(uint8_t *buf, int buf_size)
     else
       m_FrameSize = 144 * m_BitRate / m_SampleRate + padding;
 
+    // Layer I 384, Layer II 1152, Layer III 1152 (MPEG-1) or 576 (MPEG-2/2.5)
+    if (layer == 1)
+      m_Samples = 384;
+    else if (layer == 3 && mpeg2)
+      m_Samples = 576;
+    else
+      m_Samples = 1152;
+
     es_found_frame = true;
     m_DTS = c_pts;
     m_PTS = c_pts;
-    c_pts += 90000 * 1152 / m_SampleRate;
+    c_pts += 90000 * m_Samples / m_SampleRate;
     return -1;
   }
   return 0;
@@ -68,6 +68,12 @@ ES_MPEG2Video::ES_MPEG2Video(uint16_t pid)
   m_TrLastTime        = 0;
   m_PicNumber         = 0;
   m_FpsScale          = 0;
+  m_SeqHeader         = false;
+  m_GopHeader         = false;
+  m_GopClosed         = false;
+  m_FrameType         = FRAME_TYPE_UNKNOWN;
+  m_RandomAccess      = false;
+  m_ClosedGop         = false;
   es_alloc_init       = 80000;
   Reset();
 }
@@ -121,6 +127,9 @@ void ES_MPEG2Video::Parse(STREAM_PKT *pkt)
       pkt->pts          = m_PTS;
       pkt->duration     = m_FrameDuration;
       pkt->streamChange = streamChange;
+      pkt->frame_type   = m_FrameType;
+      pkt->random_access = m_RandomAccess;
+      pkt->closed_gop   = m_ClosedGop;
     }
     m_StartCode = 0xffffffff;
     es_parsed = es_consumed;
@@ -135,6 +144,8 @@ void ES_MPEG2Video::Reset()
   m_StartCode = 0xffffffff;
   m_NeedIFrame = true;
   m_NeedSPS = true;
+  m_SeqHeader = false;
+  m_GopHeader = false;
 }
 
 int ES_MPEG2Video::Parse_MPEG2Video(uint32_t startcode, int buf_ptr, bool &complete)
@@ -207,6 +218,21 @@ int ES_MPEG2Video::Parse_MPEG2Video(uint32_t startcode, int buf_ptr, bool &compl
     if (!Parse_MPEG2Video_SeqStart(buf))
       return 0;
 
+    m_SeqHeader = true;
+    break;
+  }
+
+  case 0xb8: // group of pictures start code
+  {
+    if (es_found_frame)
+    {
+      complete = true;
+      es_consumed = buf_ptr - 4;
+      return -1;
+    }
+    if (len < 4)
+      return -1;
+    Parse_MPEG2Video_GopStart(buf);
     break;
   }
 
@@ -253,15 +279,18 @@ bool ES_MPEG2Video::Parse_MPEG2Video_SeqStart(uint8_t *buf)
       m_Dar = 2.21f;
       break;
     default:
-      DBG(DEMUX_DBG_ERROR, "invalid / forbidden DAR in sequence header !\n");
+      DEMUX_LOG(logger, DEMUX_DBG_ERROR, "invalid / forbidden DAR in sequence header !\n");
       return false;
   }
 
   m_FrameDuration = mpeg2video_framedurations[bs.readBits(4)];
-  bs.skipBits(18);
+  int bitRate = bs.readBits(18); /* bit_rate_value, 400 bit/s units */
   bs.skipBits(1);
 
   m_vbvSize = bs.readBits(10) * 16 * 1024 / 8;
+  /* T-STD (ISO/IEC 13818-1 2.4.2.3): EBn is the VBV, Rbx the sequence bit rate */
+  buffer_size = m_vbvSize;
+  max_bitrate = bitRate != 0x3ffff ? bitRate * 400 : 0;
   m_NeedSPS = false;
 
   return true;
@@ -280,6 +309,13 @@ bool ES_MPEG2Video::Parse_MPEG2Video_PicStart(uint8_t *buf)
   if (pct == PKT_I_FRAME)
     m_NeedIFrame = false;
 
+  // the headers before the picture apply to it
+  m_FrameType = (FRAME_TYPE)pct;
+  m_RandomAccess = pct == PKT_I_FRAME && m_SeqHeader;
+  m_ClosedGop = pct == PKT_I_FRAME && m_GopHeader && m_GopClosed;
+  m_SeqHeader = false;
+  m_GopHeader = false;
+
   int vbvDelay = bs.readBits(16); /* vbv_delay */
   if (vbvDelay  == 0xffff)
     m_vbvDelay = -1;
@@ -288,3 +324,15 @@ bool ES_MPEG2Video::Parse_MPEG2Video_PicStart(uint8_t *buf)
 
   return true;
 }
+
+void ES_MPEG2Video::Parse_MPEG2Video_GopStart(uint8_t *buf)
+{
+  CBitstream bs(buf, 4 * 8);
+
+  bs.skipBits(25); /* time_code */
+  int closedGop = bs.readBits1();
+  int brokenLink = bs.readBits1();
+
+  m_GopHeader = true;
+  m_GopClosed = closedGop || brokenLink;
+}
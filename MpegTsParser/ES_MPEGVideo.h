@@ -44,10 +44,17 @@ namespace TSDemux
     int             m_TrLastTime;
     int             m_PicNumber;
     int             m_FpsScale;
+    bool            m_SeqHeader;      /* sequence header before the picture */
+    bool            m_GopHeader;
+    bool            m_GopClosed;      /* closed_gop or broken_link of the last GOP header */
+    FRAME_TYPE      m_FrameType;
+    bool            m_RandomAccess;
+    bool            m_ClosedGop;
 
     int Parse_MPEG2Video(uint32_t startcode, int buf_ptr, bool &complete);
     bool Parse_MPEG2Video_SeqStart(uint8_t *buf);
     bool Parse_MPEG2Video_PicStart(uint8_t *buf);
+    void Parse_MPEG2Video_GopStart(uint8_t *buf);
 
   public:
     ES_MPEG2Video(uint16_t pid);
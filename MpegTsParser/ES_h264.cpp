@@ -46,6 +46,43 @@ static const int h264_lev2cpbsize[][2] =
   {-1, -1},
 };
 
+static const int h264_lev2maxbr[][2] =
+{
+  {10, 64},
+  {11, 192},
+  {12, 384},
+  {13, 768},
+  {20, 2000},
+  {21, 4000},
+  {22, 4000},
+  {30, 10000},
+  {31, 14000},
+  {32, 20000},
+  {40, 20000},
+  {41, 50000},
+  {42, 50000},
+  {50, 135000},
+  {51, 240000},
+  {-1, -1},
+};
+
+/* cpbBrNalFactor of Table A-2 */
+static int h264_nal_factor(int profile_idc)
+{
+  switch (profile_idc)
+  {
+    case 100:
+      return 1500;
+    case 110:
+      return 3600;
+    case 122:
+    case 244:
+      return 4800;
+    default:
+      return 1200;
+  }
+}
+
 ES_h264::ES_h264(uint16_t pes_pid)
  : ElementaryStream(pes_pid)
 {
@@ -61,6 +98,10 @@ ES_h264::ES_h264(uint16_t pes_pid)
   m_DTS                         = 0;
   m_PTS                         = 0;
   m_Interlaced                  = false;
+  m_FrameType                   = FRAME_TYPE_UNKNOWN;
+  m_RandomAccess                = false;
+  m_ClosedGop                   = false;
+  m_RecoveryPoint               = false;
   es_alloc_init                 = 240000;
   Reset();
 }
@@ -96,8 +137,8 @@ void ES_h264::Parse(STREAM_PKT* pkt)
     {
       double PAR = (double)m_PixelAspect.num/(double)m_PixelAspect.den;
       double DAR = (PAR * m_Width) / m_Height;
-      DBG(DEMUX_DBG_PARSE, "H.264 SPS: PAR %i:%i\n", m_PixelAspect.num, m_PixelAspect.den);
-      DBG(DEMUX_DBG_PARSE, "H.264 SPS: DAR %.2f\n", DAR);
+      DEMUX_LOG(logger, DEMUX_DBG_PARSE, "H.264 SPS: PAR %i:%i\n", m_PixelAspect.num, m_PixelAspect.den);
+      DEMUX_LOG(logger, DEMUX_DBG_PARSE, "H.264 SPS: DAR %.2f\n", DAR);
 
       uint64_t duration;
       if (c_dts != PTS_UNSET && p_dts != PTS_UNSET && c_dts > p_dts)
@@ -115,6 +156,9 @@ void ES_h264::Parse(STREAM_PKT* pkt)
 
       pkt->pid            = pid;
       pkt->slice_type     = m_streamData.vcl_nal.slice_type;
+      pkt->frame_type     = m_FrameType;
+      pkt->random_access  = m_RandomAccess;
+      pkt->closed_gop     = m_ClosedGop;
       pkt->size           = es_consumed - frame_ptr;
       pkt->data           = &es_buf[frame_ptr];
       pkt->dts            = m_DTS;
@@ -136,6 +180,7 @@ void ES_h264::Reset()
   m_NeedIFrame = true;
   m_NeedSPS = true;
   m_NeedPPS = true;
+  m_RecoveryPoint = false;
   memset(&m_streamData, 0, sizeof(m_streamData));
 }
 
@@ -175,6 +220,8 @@ int ES_h264::Parse_H264(uint32_t startcode, int buf_ptr, bool &complete)
       return -1;
     }
 
+    // slice_type 0: P, 1: B, 2: I
+    FRAME_TYPE slice_frame_type = vcl.slice_type == 1 ? FRAME_TYPE_B : vcl.slice_type == 0 ? FRAME_TYPE_P : FRAME_TYPE_I;
     if (!es_found_frame)
     {
       if (buf_ptr - 4 >= (int)es_pts_pointer)
@@ -187,7 +234,16 @@ int ES_h264::Parse_H264(uint32_t startcode, int buf_ptr, bool &complete)
         m_DTS = p_dts;
         m_PTS = p_pts;
       }
+      // an I picture with a recovery point SEI is an open GOP entry
+      m_FrameType = slice_frame_type;
+      m_ClosedGop = vcl.nal_unit_type == NAL_IDR;
+      m_RandomAccess = m_ClosedGop || m_RecoveryPoint;
+      m_RecoveryPoint = false;
     }
+    else if (slice_frame_type > m_FrameType)
+      m_FrameType = slice_frame_type;
+    if (m_FrameType != FRAME_TYPE_I && !m_ClosedGop)
+      m_RandomAccess = false;
 
     m_streamData.vcl_nal = vcl;
     es_found_frame = true;
@@ -201,6 +257,17 @@ int ES_h264::Parse_H264(uint32_t startcode, int buf_ptr, bool &complete)
       es_consumed = buf_ptr - 4;
       return -1;
     }
+    // first SEI message only: payload_type 6 is recovery_point
+    if (len >= 2)
+    {
+      int payload_type = 0;
+      int i = 0;
+      while (i < len - 1 && buf[i] == 0xff)
+        payload_type += buf[i++];
+      payload_type += buf[i];
+      if (payload_type == 6)
+        m_RecoveryPoint = true;
+    }
     break;
 
   case NAL_SPS:
@@ -383,6 +450,17 @@ bool ES_h264::Parse_SPS(uint8_t *buf, int len)
   if (cbpsize < 0)
     return false;
 
+  /* T-STD (ISO/IEC 13818-1 2.14.3.1): EBn is the NAL CPB, Rbx the NAL MaxBR */
+  for (i = 0; h264_lev2maxbr[i][0] != -1; i++)
+  {
+    if (h264_lev2maxbr[i][0] >= level_idc)
+    {
+      buffer_size = cbpsize * h264_nal_factor(profile_idc) / 8;
+      max_bitrate = h264_lev2maxbr[i][1] * h264_nal_factor(profile_idc);
+      break;
+    }
+  }
+
   memset(&m_streamData.sps[seq_parameter_set_id], 0, sizeof(h264_private::SPS));
   m_streamData.sps[seq_parameter_set_id].cbpsize = cbpsize * 125; /* Convert from kbit to bytes */
 
@@ -445,9 +523,9 @@ bool ES_h264::Parse_SPS(uint8_t *buf, int len)
   m_Height /* mbs */ = bs.readGolombUE() + 1;
   frame_mbs_only     = bs.readBits1();
   m_streamData.sps[seq_parameter_set_id].frame_mbs_only_flag = frame_mbs_only;
-  DBG(DEMUX_DBG_PARSE, "H.264 SPS: pic_width:  %u mbs\n", (unsigned) m_Width);
-  DBG(DEMUX_DBG_PARSE, "H.264 SPS: pic_height: %u mbs\n", (unsigned) m_Height);
-  DBG(DEMUX_DBG_PARSE, "H.264 SPS: frame only flag: %d\n", frame_mbs_only);
+  DEMUX_LOG(logger, DEMUX_DBG_PARSE, "H.264 SPS: pic_width:  %u mbs\n", (unsigned) m_Width);
+  DEMUX_LOG(logger, DEMUX_DBG_PARSE, "H.264 SPS: pic_height: %u mbs\n", (unsigned) m_Height);
+  DEMUX_LOG(logger, DEMUX_DBG_PARSE, "H.264 SPS: frame only flag: %d\n", frame_mbs_only);
 
   m_Width  *= 16;
   m_Height *= 16 * (2-frame_mbs_only);
@@ -455,7 +533,7 @@ bool ES_h264::Parse_SPS(uint8_t *buf, int len)
   if (!frame_mbs_only)
   {
     if (bs.readBits1())     /* mb_adaptive_frame_field_flag */
-      DBG(DEMUX_DBG_PARSE, "H.264 SPS: MBAFF\n");
+      DEMUX_LOG(logger, DEMUX_DBG_PARSE, "H.264 SPS: MBAFF\n");
   }
   bs.skipBits(1);           /* direct_8x8_inference_flag    */
   if (bs.readBits1())       /* frame_cropping_flag */
@@ -464,7 +542,7 @@ bool ES_h264::Parse_SPS(uint8_t *buf, int len)
     uint32_t crop_right  = bs.readGolombUE();
     uint32_t crop_top    = bs.readGolombUE();
     uint32_t crop_bottom = bs.readGolombUE();
-    DBG(DEMUX_DBG_PARSE, "H.264 SPS: cropping %d %d %d %d\n", crop_left, crop_top, crop_right, crop_bottom);
+    DEMUX_LOG(logger, DEMUX_DBG_PARSE, "H.264 SPS: cropping %d %d %d %d\n", crop_left, crop_top, crop_right, crop_bottom);
 
     m_Width -= 2*(crop_left + crop_right);
     if (frame_mbs_only)
@@ -480,13 +558,13 @@ bool ES_h264::Parse_SPS(uint8_t *buf, int len)
     if (bs.readBits1())  /* aspect_ratio_info_present */
     {
       uint32_t aspect_ratio_idc = bs.readBits(8);
-      DBG(DEMUX_DBG_PARSE, "H.264 SPS: aspect_ratio_idc %d\n", aspect_ratio_idc);
+      DEMUX_LOG(logger, DEMUX_DBG_PARSE, "H.264 SPS: aspect_ratio_idc %d\n", aspect_ratio_idc);
 
       if (aspect_ratio_idc == 255 /* Extended_SAR */)
       {
         m_PixelAspect.num = bs.readBits(16); /* sar_width */
         m_PixelAspect.den = bs.readBits(16); /* sar_height */
-        DBG(DEMUX_DBG_PARSE, "H.264 SPS: -> sar %dx%d\n", m_PixelAspect.num, m_PixelAspect.den);
+        DEMUX_LOG(logger, DEMUX_DBG_PARSE, "H.264 SPS: -> sar %dx%d\n", m_PixelAspect.num, m_PixelAspect.den);
       }
       else
       {
@@ -502,11 +580,11 @@ bool ES_h264::Parse_SPS(uint8_t *buf, int len)
         if (aspect_ratio_idc < sizeof(aspect_ratios)/sizeof(aspect_ratios[0]))
         {
           memcpy(&m_PixelAspect, &aspect_ratios[aspect_ratio_idc], sizeof(mpeg_rational_t));
-          DBG(DEMUX_DBG_PARSE, "H.264 SPS: PAR %d / %d\n", m_PixelAspect.num, m_PixelAspect.den);
+          DEMUX_LOG(logger, DEMUX_DBG_PARSE, "H.264 SPS: PAR %d / %d\n", m_PixelAspect.num, m_PixelAspect.den);
         }
         else
         {
-          DBG(DEMUX_DBG_PARSE, "H.264 SPS: aspect_ratio_idc out of range !\n");
+          DEMUX_LOG(logger, DEMUX_DBG_PARSE, "H.264 SPS: aspect_ratio_idc out of range !\n");
         }
       }
     }
@@ -542,7 +620,7 @@ bool ES_h264::Parse_SPS(uint8_t *buf, int len)
     }
   }
 
-  DBG(DEMUX_DBG_PARSE, "H.264 SPS: -> video size %dx%d, aspect %d:%d\n", m_Width, m_Height, m_PixelAspect.num, m_PixelAspect.den);
+  DEMUX_LOG(logger, DEMUX_DBG_PARSE, "H.264 SPS: -> video size %dx%d, aspect %d:%d\n", m_Width, m_Height, m_PixelAspect.num, m_PixelAspect.den);
   return true;
 }
 
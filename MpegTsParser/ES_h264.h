@@ -74,6 +74,7 @@ namespace TSDemux
     enum
     {
       NAL_SLH     = 0x01, // Slice Header
+      NAL_IDR     = 0x05, // Coded slice of an IDR picture
       NAL_SEI     = 0x06, // Supplemental Enhancement Information
       NAL_SPS     = 0x07, // Sequence Parameter Set
       NAL_PPS     = 0x08, // Picture Parameter Set
@@ -97,6 +98,10 @@ namespace TSDemux
     int64_t         m_DTS;
     int64_t         m_PTS;
     bool            m_Interlaced;
+    FRAME_TYPE      m_FrameType;
+    bool            m_RandomAccess;
+    bool            m_ClosedGop;
+    bool            m_RecoveryPoint;  /* recovery point SEI before the access unit */
 
     int Parse_H264(uint32_t startcode, int buf_ptr, bool &complete);
     bool Parse_PPS(uint8_t *buf, int len);
@@ -39,6 +39,9 @@ ES_hevc::ES_hevc(uint16_t pes_pid)
   m_DTS               = PTS_UNSET;
   m_PTS               = PTS_UNSET;
   m_Interlaced        = false;
+  m_FrameType         = FRAME_TYPE_UNKNOWN;
+  m_RandomAccess      = false;
+  m_ClosedGop         = false;
   es_alloc_init       = 240000;
   Reset();
 }
@@ -47,6 +50,39 @@ ES_hevc::~ES_hevc()
 {
 }
 
+/* Table A.8: MaxCPB (main, high tier) and MaxBR (main, high tier) in 1000 bits */
+static const int hevc_level_limits[][5] =
+{
+  {30, 350, 350, 128, 128},
+  {60, 1500, 1500, 1500, 1500},
+  {63, 3000, 3000, 3000, 3000},
+  {90, 6000, 6000, 6000, 6000},
+  {93, 10000, 10000, 10000, 10000},
+  {120, 12000, 30000, 12000, 30000},
+  {123, 20000, 50000, 20000, 50000},
+  {150, 25000, 100000, 25000, 100000},
+  {153, 40000, 160000, 40000, 160000},
+  {156, 60000, 240000, 60000, 240000},
+  {180, 60000, 240000, 60000, 240000},
+  {183, 120000, 480000, 120000, 480000},
+  {186, 240000, 800000, 240000, 800000},
+  {-1, -1, -1, -1, -1},
+};
+
+// T-STD (ISO/IEC 13818-1 2.17.2): EBn is the NAL CPB, Rbx the NAL MaxBR (CpbNalFactor 1100)
+void ES_hevc::SetBufferModel(int tier, int level)
+{
+  for (int i = 0; hevc_level_limits[i][0] != -1; i++)
+  {
+    if (hevc_level_limits[i][0] >= level)
+    {
+      buffer_size = hevc_level_limits[i][1 + (tier ? 1 : 0)] * 1100 / 8;
+      max_bitrate = hevc_level_limits[i][3 + (tier ? 1 : 0)] * 1100;
+      return;
+    }
+  }
+}
+
 void ES_hevc::Parse(STREAM_PKT* pkt)
 {
   if (es_parsed + 10 > es_len) // 2*startcode + header + trail bits
@@ -78,8 +114,8 @@ void ES_hevc::Parse(STREAM_PKT* pkt)
     {
       double PAR = (double)m_PixelAspect.num/(double)m_PixelAspect.den;
       double DAR = (PAR * m_Width) / m_Height;
-      DBG(DEMUX_DBG_DEBUG, "HEVC SPS: PAR %i:%i\n", m_PixelAspect.num, m_PixelAspect.den);
-      DBG(DEMUX_DBG_DEBUG, "HEVC SPS: DAR %.2f\n", DAR);
+      DEMUX_LOG(logger, DEMUX_DBG_DEBUG, "HEVC SPS: PAR %i:%i\n", m_PixelAspect.num, m_PixelAspect.den);
+      DEMUX_LOG(logger, DEMUX_DBG_DEBUG, "HEVC SPS: DAR %.2f\n", DAR);
 
       uint64_t duration;
       if (c_dts != PTS_UNSET && p_dts != PTS_UNSET && c_dts > p_dts)
@@ -102,6 +138,9 @@ void ES_hevc::Parse(STREAM_PKT* pkt)
       pkt->pts      = m_PTS;
       pkt->duration = duration;
       pkt->streamChange = streamChange;
+      pkt->frame_type = m_FrameType;
+      pkt->random_access = m_RandomAccess;
+      pkt->closed_gop = m_ClosedGop;
     }
     m_StartCode = 0xffffffff;
     m_LastStartPos = -1;
@@ -167,6 +206,12 @@ void ES_hevc::Parse_HEVC(int buf_ptr, unsigned int NumBytesInNalUnit, bool &comp
         m_DTS = p_dts;
         m_PTS = p_pts;
       }
+      // IRAP: CRA and BLA_W_LP may be followed by RASL pictures referencing the previous GOP
+      m_RandomAccess = hdr.nal_unit_type >= NAL_BLA_W_LP && hdr.nal_unit_type <= NAL_CRA_NUT;
+      m_ClosedGop = hdr.nal_unit_type >= NAL_BLA_W_RADL && hdr.nal_unit_type <= NAL_IDR_N_LP;
+      // slice_type 0: B, 1: P, 2: I
+      m_FrameType = vcl.slice_type == 0 ? FRAME_TYPE_B : vcl.slice_type == 1 ? FRAME_TYPE_P :
+                    vcl.slice_type == 2 ? FRAME_TYPE_I : FRAME_TYPE_UNKNOWN;
     }
 
     m_streamData.vcl_nal = vcl;
@@ -236,7 +281,7 @@ void ES_hevc::Parse_HEVC(int buf_ptr, unsigned int NumBytesInNalUnit, bool &comp
        break;
 
     default:
-      DBG(DEMUX_DBG_INFO, "HEVC fixme: nal unknown %i\n", hdr.nal_unit_type);
+      DEMUX_LOG(logger, DEMUX_DBG_INFO, "HEVC fixme: nal unknown %i\n", hdr.nal_unit_type);
       break;
     }
   }
@@ -250,6 +295,8 @@ void ES_hevc::Parse_PPS(uint8_t *buf, int len)
   int sps_id = bs.readGolombUE();
   m_streamData.pps[pps_id].sps = sps_id;
   m_streamData.pps[pps_id].dependent_slice_segments_enabled_flag = bs.readBits(1);
+  bs.skipBits(1); // output_flag_present_flag
+  m_streamData.pps[pps_id].num_extra_slice_header_bits = bs.readBits(3);
 }
 
 void ES_hevc::Parse_SLH(uint8_t *buf, int len, HDR_NAL hdr, hevc_private::VCL_NAL &vcl)
@@ -264,6 +311,14 @@ void ES_hevc::Parse_SLH(uint8_t *buf, int len, HDR_NAL hdr, hevc_private::VCL_NA
     bs.skipBits(1); // no_output_of_prior_pics_flag
 
   vcl.pic_parameter_set_id = bs.readGolombUE();
+
+  // slice_segment_address of the next segments needs the picture size in CTBs
+  vcl.slice_type = -1;
+  if (vcl.first_slice_segment_in_pic_flag && vcl.pic_parameter_set_id < 64)
+  {
+    bs.skipBits(m_streamData.pps[vcl.pic_parameter_set_id].num_extra_slice_header_bits);
+    vcl.slice_type = bs.readGolombUE();
+  }
 }
 
 // 7.3.2.2.1 General sequence parameter set RBSP syntax
@@ -278,8 +333,12 @@ void ES_hevc::Parse_SPS(uint8_t *buf, int len, HDR_NAL hdr)
   unsigned int sps_max_sub_layers_minus1 = bs.readBits(3);
   bs.skipBits(1); // sps_temporal_id_nesting_flag
 
-  // skip over profile_tier_level
-  bs.skipBits(8 + 32 + 4 + 43 + 1 +8);
+  // profile_tier_level: general tier and level only
+  bs.skipBits(2); // general_profile_space
+  int general_tier_flag = bs.readBits(1);
+  bs.skipBits(5 + 32 + 4 + 43 + 1);
+  int general_level_idc = bs.readBits(8);
+  SetBufferModel(general_tier_flag, general_level_idc);
   for (i=0; i<sps_max_sub_layers_minus1; i++)
   {
     sub_layer_profile_present_flag[i] = bs.readBits(1);
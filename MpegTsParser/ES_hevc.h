@@ -36,6 +36,7 @@ namespace TSDemux
       {
         int sps;
         int dependent_slice_segments_enabled_flag;
+        int num_extra_slice_header_bits;
       } pps[64];
 
       struct VCL_NAL
@@ -43,6 +44,7 @@ namespace TSDemux
         int pic_parameter_set_id; // slice
         unsigned int first_slice_segment_in_pic_flag;
         unsigned int nal_unit_type;
+        int slice_type; // first slice segment only, -1 otherwise
       } vcl_nal;
 
     } hevc_private_t;
@@ -73,6 +75,10 @@ namespace TSDemux
       NAL_RASL_R   = 0x09, // Coded slice segment of RASL picture
 
       NAL_BLA_W_LP = 0x10, // Coded slice segment of a BLA picture
+      NAL_BLA_W_RADL = 0x11, // Coded slice segment of a BLA picture
+      NAL_BLA_N_LP = 0x12, // Coded slice segment of a BLA picture
+      NAL_IDR_W_RADL = 0x13, // Coded slice segment of an IDR picture
+      NAL_IDR_N_LP = 0x14, // Coded slice segment of an IDR picture
       NAL_CRA_NUT  = 0x15, // Coded slice segment of a CRA picture
       NAL_RSV_IRAP_VCL22 = 0x16, // Reserved IRAP VCL NAL unit types
       NAL_RSV_IRAP_VCL23 = 0x17, // Reserved IRAP VCL NAL unit types
@@ -101,6 +107,9 @@ namespace TSDemux
     int64_t         m_DTS;
     int64_t         m_PTS;
     bool            m_Interlaced;
+    FRAME_TYPE      m_FrameType;
+    bool            m_RandomAccess;
+    bool            m_ClosedGop;
 
     void Parse_HEVC(int buf_ptr, unsigned int NumBytesInNalUnit, bool &complete);
     void Parse_PPS(uint8_t *buf, int len);
@@ -108,6 +117,8 @@ namespace TSDemux
     void Parse_SPS(uint8_t *buf, int len, HDR_NAL hdr);
     bool IsFirstVclNal(hevc_private::VCL_NAL &vcl);
 
+    void SetBufferModel(int tier, int level);
+
   public:
     ES_hevc(uint16_t pes_pid);
     virtual ~ES_hevc();
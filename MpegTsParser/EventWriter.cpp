@@ -0,0 +1,254 @@
+#include "stdafx.h"
+#include "EventWriter.h"
+#include "ChromeTrace.h"
+
+#include <cstring>
+
+namespace GYJ {
+
+#define EVENT_RING_MASK         (EVENT_RING_SIZE - 1)
+#define EVENT_RELEASE_BATCH     1024    // events formatted before the ring space is released
+
+// fields of each event type, in column order
+enum {
+    FIELD_PTS = 0x01,
+    FIELD_DTS = 0x02,
+    FIELD_PCR = 0x04,
+    FIELD_PREV = 0x08,
+    FIELD_DISTANCE = 0x10
+};
+
+static const struct {
+    const char *name;
+    int fields;
+} sEventTypes[EVENT_TYPE_COUNT] = {
+    { "segment",                0 },
+    { "video_ts",               FIELD_PTS | FIELD_DTS },
+    { "audio_ts",               FIELD_PTS | FIELD_DTS },
+    { "pcr",                    FIELD_PCR | FIELD_DTS },
+    { "video_discontinuity",    FIELD_PTS | FIELD_DTS | FIELD_PREV | FIELD_DISTANCE },
+    { "audio_discontinuity",    FIELD_PTS | FIELD_DTS | FIELD_PREV | FIELD_DISTANCE },
+    { "pcr_discontinuity",      FIELD_PCR | FIELD_PREV | FIELD_DTS },
+    { "pts_dts_range",          FIELD_PTS | FIELD_DTS | FIELD_DISTANCE },
+};
+
+EventWriter::EventWriter() : mFile(NULL), mFormat(EVENT_FORMAT_JSON), mWorker(NULL), mStop(0), mHead(0), mTail(0) {
+}
+
+EventWriter::~EventWriter() {
+    close();
+}
+
+bool EventWriter::open(const std::string &path, EventFormat format) {
+    close();
+    mFile = fopen(path.c_str(), "wb");
+    if (mFile == NULL) {
+        printf("cannot create event output: '%s'\n", path.c_str());
+        return false;
+    }
+
+    mFormat = format;
+    mRing.resize(EVENT_RING_SIZE);
+    mBuffer.reserve(EVENT_WRITE_BUFFER + 1024);
+    mHead = mTail = 0;
+    mStop = 0;
+    if (mFormat == EVENT_FORMAT_CSV) {
+        append("event,segment,program,pid,pts,dts,pcr,prev,distance,file\n");
+    }
+
+    mWorker = new Worker(*this);
+    if (!mWorker->Start()) {
+        delete mWorker;
+        mWorker = NULL;
+        fclose(mFile);
+        mFile = NULL;
+        return false;
+    }
+    return true;
+}
+
+void EventWriter::close() {
+    if (mWorker != NULL) {
+        TSDemux::PLATFORM::AtomicStoreRelease(&mStop, 1);
+        mWorker->Join();
+        delete mWorker;
+        mWorker = NULL;
+    }
+    if (mFile != NULL) {
+        flush();
+        fclose(mFile);
+        mFile = NULL;
+    }
+}
+
+void EventWriter::beginSegment(int32_t segment, const std::string &name) {
+    if (mWorker == NULL) {
+        return;
+    }
+    {
+        TSDemux::PLATFORM::CLockObject lock(mNamesMutex);
+        if (segment >= 0 && (size_t)segment >= mNames.size()) {
+            mNames.resize(segment + 1);
+        }
+        if (segment >= 0) {
+            mNames[segment] = name;
+        }
+    }
+    post(EVENT_SEGMENT, segment, 0, 0, 0, 0);
+}
+
+void EventWriter::post(EventType type, int32_t segment, uint16_t program, uint16_t pid,
+    int64_t pts, int64_t dts, int64_t pcr, int64_t prev, int64_t distance) {
+    TsEvent event;
+    event.type = (uint8_t)type;
+    event.segment = segment;
+    event.program = program;
+    event.pid = pid;
+    event.pts = pts;
+    event.dts = dts;
+    event.pcr = pcr;
+    event.prev = prev;
+    event.distance = distance;
+    post(event);
+}
+
+void EventWriter::post(const TsEvent &event) {
+    if (mWorker == NULL) {
+        return;
+    }
+
+    // only this thread writes the head
+    uint32_t head = mHead;
+    while (head - TSDemux::PLATFORM::AtomicLoadAcquire(&mTail) >= EVENT_RING_SIZE) {
+        TSDemux::PLATFORM::ThreadSleep(1);
+    }
+    mRing[head & EVENT_RING_MASK] = event;
+    TSDemux::PLATFORM::AtomicStoreRelease(&mHead, head + 1);
+}
+
+void EventWriter::work() {
+    TSDemux::ChromeTrace::setThreadName("event writer");
+    uint32_t tail = mTail;
+    while (true) {
+        uint32_t head = TSDemux::PLATFORM::AtomicLoadAcquire(&mHead);
+        if (tail == head) {
+            // idle: write out what is formatted, so a follower sees it at once; stop once drained
+            if (!mBuffer.empty()) {
+                flush();
+                fflush(mFile);
+            }
+            if (TSDemux::PLATFORM::AtomicLoadAcquire(&mStop) && TSDemux::PLATFORM::AtomicLoadAcquire(&mHead) == tail) {
+                break;
+            }
+            TSDemux::PLATFORM::ThreadSleep(1);
+            continue;
+        }
+
+        while (tail != head) {
+            format(mRing[tail & EVENT_RING_MASK]);
+            tail++;
+            if ((tail & (EVENT_RELEASE_BATCH - 1)) == 0) {
+                TSDemux::PLATFORM::AtomicStoreRelease(&mTail, tail);
+            }
+            if (mBuffer.size() >= EVENT_WRITE_BUFFER) {
+                flush();
+            }
+        }
+        TSDemux::PLATFORM::AtomicStoreRelease(&mTail, tail);
+    }
+}
+
+void EventWriter::format(const TsEvent &event) {
+    if (event.type >= EVENT_TYPE_COUNT) {
+        return;
+    }
+
+    const char *name = sEventTypes[event.type].name;
+    int fields = sEventTypes[event.type].fields;
+    const int64_t values[] = { event.pts, event.dts, event.pcr, event.prev, event.distance };
+    const char *keys[] = { "pts", "dts", "pcr", "prev", "distance" };
+    char text[64];
+
+    if (mFormat == EVENT_FORMAT_JSON) {
+        sprintf(text, "{\"event\":\"%s\",\"segment\":%d", name, (int)event.segment);
+        append(text);
+        if (event.type == EVENT_SEGMENT) {
+            append(",\"file\":");
+            TSDemux::PLATFORM::CLockObject lock(mNamesMutex);
+            appendJsonString(event.segment >= 0 && (size_t)event.segment < mNames.size() ? mNames[event.segment] : "");
+        } else {
+            sprintf(text, ",\"program\":%u,\"pid\":%u", event.program, event.pid);
+            append(text);
+            for (int i = 0; i < 5; i++) {
+                if (fields & (1 << i)) {
+                    sprintf(text, ",\"%s\":%lld", keys[i], (long long)values[i]);
+                    append(text);
+                }
+            }
+        }
+        append("}\n");
+    } else {
+        sprintf(text, "%s,%d,", name, (int)event.segment);
+        append(text);
+        if (event.type != EVENT_SEGMENT) {
+            sprintf(text, "%u,%u", event.program, event.pid);
+            append(text);
+        } else {
+            append(",");
+        }
+        for (int i = 0; i < 5; i++) {
+            if (fields & (1 << i)) {
+                sprintf(text, ",%lld", (long long)values[i]);
+                append(text);
+            } else {
+                append(",");
+            }
+        }
+        append(",");
+        if (event.type == EVENT_SEGMENT) {
+            // RFC 4180: quoted, quotes doubled
+            TSDemux::PLATFORM::CLockObject lock(mNamesMutex);
+            const std::string &file = event.segment >= 0 && (size_t)event.segment < mNames.size() ? mNames[event.segment] : std::string();
+            mBuffer.push_back('"');
+            for (std::string::const_iterator it = file.begin(); it != file.end(); ++it) {
+                if (*it == '"') {
+                    mBuffer.push_back('"');
+                }
+                mBuffer.push_back(*it);
+            }
+            mBuffer.push_back('"');
+        }
+        append("\n");
+    }
+}
+
+void EventWriter::append(const char *text) {
+    mBuffer.insert(mBuffer.end(), text, text + strlen(text));
+}
+
+void EventWriter::appendJsonString(const std::string &text) {
+    mBuffer.push_back('"');
+    for (std::string::const_iterator it = text.begin(); it != text.end(); ++it) {
+        unsigned char c = *it;
+        if (c == '"' || c == '\\') {
+            mBuffer.push_back('\\');
+            mBuffer.push_back(c);
+        } else if (c < 0x20) {
+            char escape[8];
+            sprintf(escape, "\\u%04x", c);
+            append(escape);
+        } else {
+            mBuffer.push_back(c);
+        }
+    }
+    mBuffer.push_back('"');
+}
+
+void EventWriter::flush() {
+    if (!mBuffer.empty() && mFile != NULL) {
+        TRACE_SPAN("flush", TRACE_IO);
+        fwrite(&mBuffer[0], 1, mBuffer.size(), mFile);
+    }
+    mBuffer.clear();
+}
+}
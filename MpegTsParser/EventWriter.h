@@ -0,0 +1,92 @@
+#pragma once
+#include <inttypes.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "thread.h"
+
+namespace GYJ {
+
+#define EVENT_RING_SIZE         65536   // events, power of 2
+#define EVENT_WRITE_BUFFER      65536   // bytes formatted before a write
+
+enum EventFormat { EVENT_FORMAT_JSON, EVENT_FORMAT_CSV };
+
+enum EventType {
+    EVENT_SEGMENT,                  // segment: file name of the segment
+    EVENT_VIDEO_TS,                 // pts, dts
+    EVENT_AUDIO_TS,                 // pts, dts
+    EVENT_PCR,                      // pcr, dts
+    EVENT_VIDEO_DISCONTINUITY,      // pts, dts, prev (pts), distance
+    EVENT_AUDIO_DISCONTINUITY,      // pts, dts, prev (pts), distance
+    EVENT_PCR_DISCONTINUITY,        // pcr, prev, dts
+    EVENT_PTS_DTS_RANGE,            // pts, dts, distance
+    EVENT_TYPE_COUNT
+};
+
+// fixed size, formatted by the writer thread
+typedef struct TsEvent {
+    uint8_t type;
+    uint16_t program;
+    uint16_t pid;
+    int32_t segment;
+    int64_t pts;
+    int64_t dts;
+    int64_t pcr;
+    int64_t prev;
+    int64_t distance;
+} TsEvent;
+
+/*
+ * Structured event output, JSON lines or CSV. The analysis thread posts
+ * binary events into a single producer/single consumer ring, a writer
+ * thread formats and writes them in large blocks. post() waits while the
+ * ring is full, no event is dropped.
+ */
+class EventWriter
+{
+public:
+    EventWriter();
+    ~EventWriter();
+
+    bool open(const std::string &path, EventFormat format);
+    // drains the ring, stops the writer and closes the file
+    void close();
+
+    void beginSegment(int32_t segment, const std::string &name);
+    void post(const TsEvent &event);
+    void post(EventType type, int32_t segment, uint16_t program, uint16_t pid,
+        int64_t pts, int64_t dts, int64_t pcr = 0, int64_t prev = 0, int64_t distance = 0);
+
+private:
+    class Worker : public TSDemux::PLATFORM::CThread
+    {
+    public:
+        explicit Worker(EventWriter &writer) : mWriter(writer) {}
+        virtual ~Worker() { Join(); }
+    protected:
+        virtual void Process() { mWriter.work(); }
+    private:
+        EventWriter &mWriter;
+    };
+
+    void work();
+    void format(const TsEvent &event);
+    void flush();
+    void append(const char *text);
+    void appendJsonString(const std::string &text);
+
+    FILE *mFile;
+    EventFormat mFormat;
+    Worker *mWorker;
+    volatile uint32_t mStop;
+
+    std::vector<TsEvent> mRing;
+    volatile uint32_t mHead;        // next event to post, written by the producer
+    volatile uint32_t mTail;        // next event to format, written by the writer
+
+    std::vector<char> mBuffer;
+    TSDemux::PLATFORM::CMutex mNamesMutex;
+    std::vector<std::string> mNames;    // by segment
+};
+}
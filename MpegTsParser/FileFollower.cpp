@@ -0,0 +1,111 @@
+#include "stdafx.h"
+#include "FileFollower.h"
+#include "thread.h"
+#include "timeutils.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+namespace GYJ {
+
+FileFollower::FileFollower() : mSize(0), mFd(-1) {
+}
+
+FileFollower::~FileFollower() {
+    close();
+}
+
+bool FileFollower::open(const std::string &path) {
+    close();
+    mPath = path;
+    if (!readSize(mSize)) {
+        return false;
+    }
+#if defined(__linux__)
+    // without inotify the size checks alone find the growth
+    mFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (mFd >= 0 && inotify_add_watch(mFd, path.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+        ::close(mFd);
+        mFd = -1;
+    }
+#endif
+    return true;
+}
+
+void FileFollower::close() {
+#if defined(__linux__)
+    if (mFd >= 0) {
+        ::close(mFd);
+    }
+#endif
+    mFd = -1;
+}
+
+bool FileFollower::readSize(uint64_t &size) {
+#if defined(_MSC_VER)
+    struct _stat64 st;
+    if (_stat64(mPath.c_str(), &st) != 0) {
+        return false;
+    }
+#else
+    struct stat st;
+    if (stat(mPath.c_str(), &st) != 0) {
+        return false;
+    }
+#endif
+    size = st.st_size;
+    return true;
+}
+
+void FileFollower::sleep(int ms) {
+#if defined(__linux__)
+    if (mFd >= 0) {
+        struct pollfd pfd;
+        pfd.fd = mFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, ms) > 0) {
+            // the events only wake the wait, the size tells what happened
+            char buffer[4096];
+            while (read(mFd, buffer, sizeof(buffer)) > 0) {
+            }
+        }
+        return;
+    }
+#endif
+    TSDemux::PLATFORM::ThreadSleep(ms);
+}
+
+FollowResult FileFollower::wait(int timeoutMs) {
+    int64_t start = TSDemux::PLATFORM::GetTimeUs();
+    int backoff = FOLLOW_POLL_MIN_MS;
+    while (true) {
+        uint64_t size = 0;
+        if (!readSize(size) || size < mSize) {
+            return FOLLOW_GONE;
+        }
+        if (size > mSize) {
+            mSize = size;
+            return FOLLOW_GROWN;
+        }
+
+        int ms = backoff;
+        if (timeoutMs >= 0) {
+            int64_t left = timeoutMs - (TSDemux::PLATFORM::GetTimeUs() - start) / 1000;
+            if (left <= 0) {
+                return FOLLOW_IDLE;
+            }
+            if (left < ms) {
+                ms = (int)left;
+            }
+        }
+        sleep(ms);
+        backoff = backoff * 2 > FOLLOW_POLL_MAX_MS ? FOLLOW_POLL_MAX_MS : backoff * 2;
+    }
+}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <inttypes.h>
+#include <string>
+
+namespace GYJ {
+
+#define FOLLOW_POLL_MIN_MS      10      // first size check after the end was reached
+#define FOLLOW_POLL_MAX_MS      1000    // backoff limit of the size checks
+
+enum FollowResult {
+    FOLLOW_GROWN,                   // new data past the last known size
+    FOLLOW_IDLE,                    // no growth within the timeout
+    FOLLOW_GONE                     // removed, renamed away or truncated
+};
+
+/*
+ * Waits for a file being written to grow, like tail -f. The size is checked
+ * with a backoff from FOLLOW_POLL_MIN_MS to FOLLOW_POLL_MAX_MS; on Linux an
+ * inotify watch on the file wakes the wait as soon as it is modified.
+ */
+class FileFollower
+{
+public:
+    FileFollower();
+    ~FileFollower();
+
+    bool open(const std::string &path);
+    void close();
+    // waits up to timeoutMs (-1 for ever) for the file to grow past its size at the last call
+    FollowResult wait(int timeoutMs);
+    uint64_t getSize() const { return mSize; }
+
+private:
+    bool readSize(uint64_t &size);
+    // sleeps up to ms, woken early by a modification of the file
+    void sleep(int ms);
+
+    std::string mPath;
+    uint64_t mSize;
+    int mFd;
+};
+}
@@ -0,0 +1,120 @@
+#include "stdafx.h"
+#include "FolderWatcher.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+namespace GYJ {
+
+FolderWatcher::FolderWatcher() : mFd(-1), mWatch(-1), mOverflow(false) {
+}
+
+FolderWatcher::~FolderWatcher() {
+    close();
+}
+
+#if defined(__linux__)
+bool FolderWatcher::open(const std::string &dir) {
+    close();
+    mFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (mFd < 0) {
+        return false;
+    }
+    // segments renamed into place once complete are reported by IN_MOVED_TO
+    mWatch = inotify_add_watch(mFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+    if (mWatch < 0) {
+        close();
+        return false;
+    }
+    mBuffer.resize(WATCH_BUFFER_SIZE);
+    return true;
+}
+
+void FolderWatcher::close() {
+    closeWatch();
+    mReady.clear();
+}
+
+void FolderWatcher::closeWatch() {
+    if (mFd >= 0) {
+        ::close(mFd);
+    }
+    mFd = -1;
+    mWatch = -1;
+}
+
+WatchResult FolderWatcher::next(std::string &name, int timeoutMs) {
+    while (mReady.empty()) {
+        if (mFd < 0) {
+            return WATCH_ERROR;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = mFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ret = poll(&pfd, 1, timeoutMs);
+        if (ret == 0 || (ret < 0 && errno == EINTR)) {
+            return WATCH_TIMEOUT;
+        }
+        if (ret < 0) {
+            return WATCH_ERROR;
+        }
+
+        ssize_t len = read(mFd, &mBuffer[0], mBuffer.size());
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                continue;
+            }
+            return WATCH_ERROR;
+        }
+
+        for (ssize_t pos = 0; pos < len; ) {
+            const struct inotify_event *event = (const struct inotify_event*)&mBuffer[pos];
+            pos += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                mOverflow = true;
+            }
+            if (event->mask & IN_IGNORED) {
+                // the directory was removed or unmounted: the files completed
+                // before are returned first, the error on the call after them
+                closeWatch();
+                break;
+            }
+            if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && !(event->mask & IN_ISDIR) && event->len > 0) {
+                mReady.push_back(event->name);
+            }
+        }
+    }
+
+    name = mReady.front();
+    mReady.pop_front();
+    return WATCH_FILE;
+}
+#else
+bool FolderWatcher::open(const std::string &dir) {
+    return false;
+}
+
+void FolderWatcher::close() {
+    mReady.clear();
+}
+
+void FolderWatcher::closeWatch() {
+}
+
+WatchResult FolderWatcher::next(std::string &name, int timeoutMs) {
+    return WATCH_ERROR;
+}
+#endif
+
+bool FolderWatcher::overflowed() {
+    bool overflow = mOverflow;
+    mOverflow = false;
+    return overflow;
+}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+
+namespace GYJ {
+
+#define WATCH_BUFFER_SIZE       65536   // inotify events read at once
+
+enum WatchResult {
+    WATCH_FILE,                     // a file was completed
+    WATCH_TIMEOUT,                  // nothing within the timeout, or interrupted by a signal
+    WATCH_ERROR                     // the directory is gone or the watch failed
+};
+
+/*
+ * Files completed in a directory: closed after a write or moved into it,
+ * in the order the kernel reports them. Based on inotify, no rescan of the
+ * directory; open() fails on the platforms without it.
+ */
+class FolderWatcher
+{
+public:
+    FolderWatcher();
+    ~FolderWatcher();
+
+    bool open(const std::string &dir);
+    void close();
+    // name relative to the directory, waits up to timeoutMs (-1 for ever)
+    WatchResult next(std::string &name, int timeoutMs);
+    // events dropped by the kernel since the last call
+    bool overflowed();
+
+private:
+    // the names already read stay queued
+    void closeWatch();
+
+    int mFd;
+    int mWatch;
+    bool mOverflow;
+    std::deque<std::string> mReady;
+    std::vector<char> mBuffer;
+};
+}
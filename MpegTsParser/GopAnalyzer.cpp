@@ -0,0 +1,169 @@
+#define __STDC_FORMAT_MACROS 1
+#include "GopAnalyzer.h"
+#include "debug.h"
+
+#include <cstdio>
+#include <inttypes.h>
+#include <cstring>
+
+using namespace TSDemux;
+
+GOP_STATS::GOP_STATS()
+    : frames(0), randomAccess(0), closedGops(0), openGops(0)
+    , gops(0), gopFramesMin(0), gopFramesMax(0), gopFramesSum(0)
+    , gopTimed(0), gopMsMin(0.0), gopMsMax(0.0), gopMsSum(0.0)
+    , startsWithRandomAccess(false), ptsMin(PTS_UNSET), ptsMax(PTS_UNSET), frameDuration(0) {
+    memset(typeFrames, 0, sizeof(typeFrames));
+    memset(typeBytes, 0, sizeof(typeBytes));
+    memset(typeSizeMin, 0, sizeof(typeSizeMin));
+    memset(typeSizeMax, 0, sizeof(typeSizeMax));
+    memset(typeSizes, 0, sizeof(typeSizes));
+}
+
+GopAnalyzer::GopAnalyzer() {
+}
+
+void GopAnalyzer::addFrame(const STREAM_PKT *pkt) {
+    PidState &state = mPids[pkt->pid];
+    GOP_STATS &stats = state.stats;
+    FRAME_TYPE type = pkt->frame_type < FRAME_TYPE_COUNT ? pkt->frame_type : FRAME_TYPE_UNKNOWN;
+
+    if (stats.frames++ == 0) {
+        stats.startsWithRandomAccess = pkt->random_access;
+    }
+    if (pkt->pts != PTS_UNSET) {
+        if (stats.ptsMin == PTS_UNSET || pkt->pts < stats.ptsMin) {
+            stats.ptsMin = pkt->pts;
+        }
+        if (stats.ptsMax == PTS_UNSET || pkt->pts > stats.ptsMax) {
+            stats.ptsMax = pkt->pts;
+        }
+    }
+    stats.frameDuration = pkt->duration;
+
+    uint64_t size = pkt->size;
+    if (stats.typeFrames[type] == 0 || size < stats.typeSizeMin[type]) {
+        stats.typeSizeMin[type] = size;
+    }
+    if (size > stats.typeSizeMax[type]) {
+        stats.typeSizeMax[type] = size;
+    }
+    stats.typeFrames[type]++;
+    stats.typeBytes[type] += size;
+    int bucket = 0;
+    for (uint64_t edge = 1024; size >= edge && bucket < GOP_SIZE_BUCKETS - 1; edge *= 4) {
+        bucket++;
+    }
+    stats.typeSizes[type][bucket]++;
+
+    if (pkt->random_access) {
+        if (state.inGop) {
+            closeGop(state, pkt->dts);
+        }
+        stats.randomAccess++;
+        stats.randomAccessPts.push_back(pkt->pts);
+        if (pkt->closed_gop) {
+            stats.closedGops++;
+        } else {
+            stats.openGops++;
+        }
+        state.inGop = true;
+        state.gopFrames = 0;
+        state.gopDts = pkt->dts;
+    }
+    if (!state.inGop) {
+        return;
+    }
+
+    state.gopFrames++;
+    if (!state.patternDone && state.pattern.size() < GOP_PATTERN_MAX) {
+        state.pattern += typeName(type);
+    }
+}
+
+void GopAnalyzer::closeGop(PidState &state, uint64_t dts) {
+    GOP_STATS &stats = state.stats;
+
+    if (stats.gops == 0 || state.gopFrames < stats.gopFramesMin) {
+        stats.gopFramesMin = state.gopFrames;
+    }
+    if (state.gopFrames > stats.gopFramesMax) {
+        stats.gopFramesMax = state.gopFrames;
+    }
+    stats.gopFramesSum += state.gopFrames;
+
+    // time of the GOP up to the next random access point, the last frame duration included
+    if (dts != PTS_UNSET && state.gopDts != PTS_UNSET && dts > state.gopDts) {
+        double ms = (dts - state.gopDts) / 90.0;
+        if (stats.gopTimed == 0 || ms < stats.gopMsMin) {
+            stats.gopMsMin = ms;
+        }
+        if (ms > stats.gopMsMax) {
+            stats.gopMsMax = ms;
+        }
+        stats.gopMsSum += ms;
+        stats.gopTimed++;
+    }
+    stats.gops++;
+
+    if (!state.patternDone) {
+        stats.pattern = state.pattern;
+        state.patternDone = true;
+    }
+}
+
+char GopAnalyzer::typeName(FRAME_TYPE type) {
+    switch (type) {
+    case FRAME_TYPE_I:
+        return 'I';
+    case FRAME_TYPE_P:
+        return 'P';
+    case FRAME_TYPE_B:
+        return 'B';
+    default:
+        return '?';
+    }
+}
+
+std::vector<uint16_t> GopAnalyzer::getPids() const {
+    std::vector<uint16_t> pids;
+    for (std::map<uint16_t, PidState>::const_iterator it = mPids.begin(); it != mPids.end(); ++it) {
+        pids.push_back(it->first);
+    }
+    return pids;
+}
+
+const GOP_STATS *GopAnalyzer::getStats(uint16_t pid) const {
+    std::map<uint16_t, PidState>::const_iterator it = mPids.find(pid);
+    return it != mPids.end() ? &it->second.stats : NULL;
+}
+
+void GopAnalyzer::dump(uint16_t pid, const GOP_STATS &stats, Logger *logger) {
+    DEMUX_LOG(logger, DEMUX_DBG_INFO, "[GOP] pid:0x%04x frames:%" PRIu64 " random access:%" PRIu64 " closed:%" PRIu64 " open:%" PRIu64 " \n",
+        pid, stats.frames, stats.randomAccess, stats.closedGops, stats.openGops);
+    if (stats.gops > 0) {
+        DEMUX_LOG(logger, DEMUX_DBG_INFO, "[GOP] gops:%" PRIu64 " frames min:%" PRIu64 " avg:%.1f max:%" PRIu64 " interval min:%.1fms avg:%.1fms max:%.1fms \n",
+            stats.gops, stats.gopFramesMin, (double)stats.gopFramesSum / stats.gops, stats.gopFramesMax,
+            stats.gopMsMin, stats.gopTimed ? stats.gopMsSum / stats.gopTimed : 0.0, stats.gopMsMax);
+        DEMUX_LOG(logger, DEMUX_DBG_INFO, "[GOP] pattern:%s \n", stats.pattern.c_str());
+    }
+
+    for (int type = 0; type < FRAME_TYPE_COUNT; type++) {
+        if (stats.typeFrames[type] == 0) {
+            continue;
+        }
+        char sizes[GOP_SIZE_BUCKETS * 32] = {0};
+        size_t len = 0;
+        uint64_t edge = 1024;
+        for (int b = 0; b < GOP_SIZE_BUCKETS; b++, edge *= 4) {
+            if (b < GOP_SIZE_BUCKETS - 1) {
+                len += sprintf(sizes + len, " <%" PRIu64 "K:%" PRIu64, edge / 1024, stats.typeSizes[type][b]);
+            } else {
+                len += sprintf(sizes + len, " more:%" PRIu64, stats.typeSizes[type][b]);
+            }
+        }
+        DEMUX_LOG(logger, DEMUX_DBG_INFO, "[GOP] %c frames:%" PRIu64 " size min:%" PRIu64 " avg:%.0f max:%" PRIu64 " sizes%s \n",
+            typeName((FRAME_TYPE)type), stats.typeFrames[type], stats.typeSizeMin[type],
+            (double)stats.typeBytes[type] / stats.typeFrames[type], stats.typeSizeMax[type], sizes);
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <inttypes.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "elementaryStream.h"
+#include "debug.h"
+
+#define GOP_SIZE_BUCKETS            8     // frame sizes by power of 4 from 1KiB
+#define GOP_PATTERN_MAX             64    // frame types kept of the first GOP
+
+namespace TSDemux
+{
+  struct GOP_STATS
+  {
+    GOP_STATS();
+
+    uint64_t frames;
+    uint64_t typeFrames[FRAME_TYPE_COUNT];
+    uint64_t typeBytes[FRAME_TYPE_COUNT];
+    uint64_t typeSizeMin[FRAME_TYPE_COUNT];
+    uint64_t typeSizeMax[FRAME_TYPE_COUNT];
+    uint64_t typeSizes[FRAME_TYPE_COUNT][GOP_SIZE_BUCKETS];
+
+    uint64_t randomAccess;          ///< IDR/IRAP pictures
+    uint64_t closedGops;
+    uint64_t openGops;
+
+    uint64_t gops;                  ///< complete GOPs, from one random access point to the next
+    uint64_t gopFramesMin;
+    uint64_t gopFramesMax;
+    uint64_t gopFramesSum;
+    uint64_t gopTimed;              ///< GOPs with a valid DTS at both ends
+    double gopMsMin;                ///< random access interval on the DTS
+    double gopMsMax;
+    double gopMsSum;
+
+    std::string pattern;            ///< frame types of the first complete GOP, decode order
+
+    bool startsWithRandomAccess;    ///< first frame is a random access point
+    uint64_t ptsMin;                ///< presentation span (90kHz), PTS_UNSET without frame
+    uint64_t ptsMax;
+    uint64_t frameDuration;         ///< duration of the last frame
+    std::vector<uint64_t> randomAccessPts;  ///< PTS of the random access points, decode order
+  };
+
+  /*
+   * GOP structure of the video streams from the frame types the ES parsers
+   * set on their frames: random access cadence in frames and time, open and
+   * closed GOPs, frame counts and size distribution per coding type.
+   * Frames before the first random access point are counted by type only.
+   */
+  class GopAnalyzer
+  {
+  public:
+    GopAnalyzer();
+
+    // frame of a video parser, dts on 90kHz
+    void addFrame(const STREAM_PKT *pkt);
+
+    std::vector<uint16_t> getPids() const;
+    const GOP_STATS *getStats(uint16_t pid) const;
+    static void dump(uint16_t pid, const GOP_STATS &stats, Logger *logger = &Logger::Default());
+    static char typeName(FRAME_TYPE type);
+
+  private:
+    struct PidState
+    {
+      PidState() : inGop(false), gopFrames(0), gopDts(PTS_UNSET), patternDone(false) {}
+
+      bool inGop;
+      uint64_t gopFrames;
+      uint64_t gopDts;
+      std::string pattern;
+      bool patternDone;
+
+      GOP_STATS stats;
+    };
+
+    void closeGop(PidState &state, uint64_t dts);
+
+    std::map<uint16_t, PidState> mPids;
+  };
+}
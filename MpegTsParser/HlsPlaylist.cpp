@@ -0,0 +1,229 @@
+#define __STDC_FORMAT_MACROS 1
+#include "stdafx.h"
+#include "HlsPlaylist.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <inttypes.h>
+#include <cstdlib>
+#include <cstring>
+
+namespace GYJ {
+
+HlsPlaylist::HlsPlaylist(TSDemux::Logger *logger)
+    : mTargetDuration(0), mMediaSequence(0), mEndList(false), mLogger(logger ? logger : &TSDemux::Logger::Default()) {
+}
+
+bool HlsPlaylist::load(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        printf("cannot open playlist: '%s'\n", path.c_str());
+        return false;
+    }
+
+    mPath = path;
+    mTargetDuration = 0;
+    mMediaSequence = 0;
+    mEndList = false;
+    mVariants.clear();
+    mSegments.clear();
+
+    char buf[4096];
+    bool header = false;
+    bool discontinuity = false;
+    bool variant = false;
+    HlsSegment segment;
+    HlsVariant stream;
+    std::string rangeUri;               // of the last byte range, the next one without offset follows it
+    uint64_t rangeEnd = 0;
+    while (fgets(buf, sizeof(buf), file) != NULL) {
+        std::string line(buf);
+        while (!line.empty() && (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r' || line[line.size() - 1] == ' ')) {
+            line.erase(line.size() - 1);
+        }
+        if (!header) {
+            // may start with a UTF-8 BOM
+            header = line.find("#EXTM3U") != std::string::npos;
+            if (!header) {
+                printf("not a playlist: '%s'\n", path.c_str());
+                fclose(file);
+                return false;
+            }
+            continue;
+        }
+        if (line.empty()) {
+            continue;
+        }
+
+        if (line[0] == '#') {
+            if (line.compare(0, 8, "#EXTINF:") == 0) {
+                segment.duration = atof(line.c_str() + 8);
+            } else if (line.compare(0, 22, "#EXT-X-TARGETDURATION:") == 0) {
+                mTargetDuration = atoi(line.c_str() + 22);
+            } else if (line.compare(0, 22, "#EXT-X-MEDIA-SEQUENCE:") == 0) {
+                mMediaSequence = strtoull(line.c_str() + 22, NULL, 10);
+            } else if (line == "#EXT-X-DISCONTINUITY") {
+                discontinuity = true;
+            } else if (line == "#EXT-X-ENDLIST") {
+                mEndList = true;
+            } else if (line.compare(0, 18, "#EXT-X-STREAM-INF:") == 0) {
+                stream = HlsVariant();
+                stream.bandwidth = atoi(attribute(line.substr(18), "BANDWIDTH").c_str());
+                stream.resolution = attribute(line.substr(18), "RESOLUTION");
+                variant = true;
+            } else if (line.compare(0, 17, "#EXT-X-BYTERANGE:") == 0) {
+                // <n>[@<o>]
+                const char *p = line.c_str() + 17;
+                char *end = NULL;
+                segment.byteRange = true;
+                segment.byteLength = strtoull(p, &end, 10);
+                segment.byteOffset = *end == '@' ? strtoull(end + 1, NULL, 10) : UINT64_MAX;
+                if (end == p || segment.byteLength == 0) {
+                    printf("[HLS] %s: invalid %s \n", path.c_str(), line.c_str());
+                    fclose(file);
+                    return false;
+                }
+            } else if (line.compare(0, 11, "#EXT-X-MAP:") == 0) {
+                DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[HLS] %s: %s not supported \n", path.c_str(), line.c_str());
+            }
+            continue;
+        }
+
+        // URI line
+        if (variant) {
+            stream.uri = line;
+            stream.path = resolve(path, line);
+            mVariants.push_back(stream);
+            variant = false;
+        } else {
+            segment.uri = line;
+            segment.path = resolve(path, line);
+            if (segment.byteRange) {
+                if (segment.byteOffset == UINT64_MAX) {
+                    // no offset: right after the previous range, of the same resource
+                    if (rangeUri != line) {
+                        printf("[HLS] %s: byte range of %s without offset \n", path.c_str(), line.c_str());
+                        fclose(file);
+                        return false;
+                    }
+                    segment.byteOffset = rangeEnd;
+                }
+                rangeUri = line;
+                rangeEnd = segment.byteOffset + segment.byteLength;
+            } else {
+                rangeUri.clear();
+            }
+            segment.discontinuity = discontinuity;
+            segment.sequence = mMediaSequence + mSegments.size();
+            mSegments.push_back(segment);
+            segment = HlsSegment();
+            discontinuity = false;
+        }
+    }
+    fclose(file);
+
+    if (!header) {
+        printf("not a playlist: '%s'\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::string HlsPlaylist::resolve(const std::string &base, const std::string &uri) {
+    if (uri.find("://") != std::string::npos || uri[0] == '/' || (uri.size() > 1 && uri[1] == ':')) {
+        return uri;
+    }
+    std::string::size_type pos = base.find_last_of("/\\");
+    return pos == std::string::npos ? uri : base.substr(0, pos + 1) + uri;
+}
+
+std::string HlsPlaylist::attribute(const std::string &attributes, const char *name) {
+    // NAME=value or NAME="quoted, value" in a comma separated list
+    std::string key = std::string(name) + "=";
+    std::string::size_type pos = 0;
+    while ((pos = attributes.find(key, pos)) != std::string::npos) {
+        if (pos == 0 || attributes[pos - 1] == ',') {
+            break;
+        }
+        pos += key.size();
+    }
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos += key.size();
+    if (pos < attributes.size() && attributes[pos] == '"') {
+        std::string::size_type end = attributes.find('"', pos + 1);
+        return attributes.substr(pos + 1, end == std::string::npos ? std::string::npos : end - pos - 1);
+    }
+    return attributes.substr(pos, attributes.find(',', pos) - pos);
+}
+
+double HlsPlaylist::measureDuration(const tsParam *tsSegment) {
+    uint16_t videoPid = 0xffff;
+    uint16_t audioPid = 0xffff;
+    for (std::vector<TSDemux::Program>::const_iterator pg = tsSegment->programs.begin(); pg != tsSegment->programs.end(); ++pg) {
+        if (pg->selected) {
+            videoPid = pg->GetVideoPid();
+            audioPid = pg->GetAudioPid();
+            break;
+        }
+    }
+
+    // counted media duration: audio to the sample, else the video frames
+    std::map<uint16_t, TSDemux::MEDIA_DURATION>::const_iterator counted = tsSegment->durations.find(audioPid);
+    if (counted != tsSegment->durations.end() && counted->second.samples > 0) {
+        return counted->second.seconds();
+    }
+    counted = tsSegment->durations.find(videoPid);
+    if (counted != tsSegment->durations.end() && counted->second.frames > 0) {
+        return counted->second.seconds();
+    }
+
+    uint16_t pid = videoPid != 0xffff ? videoPid : audioPid;
+    if (pid == 0xffff) {
+        return 0.0;
+    }
+
+    std::vector<uint64_t> pts;
+    for (std::list<TSDemux::STREAM_PKT*>::const_iterator it = tsSegment->packets->begin(); it != tsSegment->packets->end(); ++it) {
+        if ((*it)->pid == pid && (*it)->pts != PTS_UNSET) {
+            pts.push_back((*it)->pts);
+        }
+    }
+    if (pts.size() < 2) {
+        return 0.0;
+    }
+
+    // the last PES lasts as long as the one before it
+    std::sort(pts.begin(), pts.end());
+    uint64_t last = pts[pts.size() - 1] - pts[pts.size() - 2];
+    return (pts.back() - pts.front() + last) / 90000.0;
+}
+
+bool HlsPlaylist::validateSegment(const HlsSegment &segment, const tsParam *tsSegment) const {
+    double measured = measureDuration(tsSegment);
+    bool valid = true;
+
+    DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[HLS] #%" PRIu64 " %s EXTINF:%.3fs measured:%.3fs%s \n", segment.sequence, segment.uri.c_str(),
+        segment.duration, measured, segment.discontinuity ? " (discontinuity)" : "");
+    if (measured <= 0.0) {
+        return valid;
+    }
+
+    if ((measured - segment.duration) * 1000.0 > HLS_DURATION_TOLERANCE_MS || (segment.duration - measured) * 1000.0 > HLS_DURATION_TOLERANCE_MS) {
+        DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[HLS] #%" PRIu64 " %s EXTINF %.3fs differs from the measured %.3fs \n", segment.sequence,
+            segment.uri.c_str(), segment.duration, measured);
+        printf("[HLS] #%" PRIu64 " %s EXTINF %.3fs, measured %.3fs \n", segment.sequence, segment.uri.c_str(), segment.duration, measured);
+        valid = false;
+    }
+    // rounded to the nearest integer, no segment may exceed the target duration
+    if (mTargetDuration > 0 && (int)(measured + 0.5) > mTargetDuration) {
+        DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[HLS] #%" PRIu64 " %s measured %.3fs above EXT-X-TARGETDURATION %d \n", segment.sequence,
+            segment.uri.c_str(), measured, mTargetDuration);
+        printf("[HLS] #%" PRIu64 " %s %.3fs above target duration %d \n", segment.sequence, segment.uri.c_str(), measured, mTargetDuration);
+        valid = false;
+    }
+    return valid;
+}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "ParserdDataContainer.h"
+
+namespace GYJ {
+
+#define HLS_DURATION_TOLERANCE_MS   100     // EXTINF against the measured duration
+
+typedef struct HlsSegment {
+    HlsSegment() : duration(0.0), discontinuity(false), sequence(0), byteRange(false), byteOffset(0), byteLength(0) {}
+    std::string uri;
+    std::string path;                   // local path, resolved against the playlist
+    double duration;                    // EXTINF, seconds
+    bool discontinuity;                 // EXT-X-DISCONTINUITY before the segment
+    uint64_t sequence;                  // media sequence number
+    bool byteRange;                     // EXT-X-BYTERANGE: byteLength bytes at byteOffset of the file
+    uint64_t byteOffset;
+    uint64_t byteLength;
+} HlsSegment;
+
+typedef struct HlsVariant {
+    HlsVariant() : bandwidth(0) {}
+    std::string uri;
+    std::string path;
+    int bandwidth;
+    std::string resolution;
+} HlsVariant;
+
+/*
+ * Local HLS playlist (RFC 8216): the variants of a master playlist or the
+ * segments of a media playlist, in playlist order.
+ */
+class HlsPlaylist
+{
+public:
+    // no logger: the default one
+    explicit HlsPlaylist(TSDemux::Logger *logger = NULL);
+
+    bool load(const std::string &path);
+
+    bool isMaster() const { return !mVariants.empty(); }
+    const std::string &getPath() const { return mPath; }
+    const std::vector<HlsVariant> &getVariants() const { return mVariants; }
+    const std::vector<HlsSegment> &getSegments() const { return mSegments; }
+    int getTargetDuration() const { return mTargetDuration; }
+    bool hasEndList() const { return mEndList; }
+
+    // media duration of the first selected program in seconds: counted audio samples, else
+    // counted video frames, else the PES span (video, else audio)
+    static double measureDuration(const tsParam *tsSegment);
+    // EXTINF and target duration against the measured duration, returns false on mismatch
+    bool validateSegment(const HlsSegment &segment, const tsParam *tsSegment) const;
+
+private:
+    static std::string resolve(const std::string &base, const std::string &uri);
+    static std::string attribute(const std::string &attributes, const char *name);
+
+    std::string mPath;
+    int mTargetDuration;
+    uint64_t mMediaSequence;
+    bool mEndList;
+    std::vector<HlsVariant> mVariants;
+    std::vector<HlsSegment> mSegments;
+    TSDemux::Logger *mLogger;
+};
+}
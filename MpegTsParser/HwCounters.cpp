@@ -0,0 +1,163 @@
+#include "stdafx.h"
+#include "HwCounters.h"
+
+#include <cstring>
+#if defined(__linux__)
+#include <cerrno>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace GYJ {
+
+HwSample::HwSample() : scaled(false), packets(0), frames(0) {
+    memset(counted, 0, sizeof(counted));
+    memset(values, 0, sizeof(values));
+}
+
+void HwSample::add(const HwSample &other) {
+    for (int i = 0; i < HW_EVENT_COUNT; i++) {
+        counted[i] = counted[i] || other.counted[i];
+        values[i] += other.values[i];
+    }
+    scaled = scaled || other.scaled;
+    packets += other.packets;
+    frames += other.frames;
+}
+
+HwCounters::HwCounters() {
+    for (int i = 0; i < HW_EVENT_COUNT; i++) {
+        mFds[i] = -1;
+    }
+}
+
+HwCounters::~HwCounters() {
+    close();
+}
+
+const char *HwCounters::eventName(int event) {
+    switch (event) {
+    case HW_CYCLES:
+        return "cycles";
+    case HW_INSTRUCTIONS:
+        return "instructions";
+    case HW_CACHE_REFERENCES:
+        return "cache references";
+    case HW_CACHE_MISSES:
+        return "cache misses";
+    case HW_BRANCHES:
+        return "branches";
+    case HW_BRANCH_MISSES:
+        return "branch misses";
+    case HW_TASK_CLOCK:
+        return "task clock";
+    case HW_PAGE_FAULTS:
+        return "page faults";
+    default:
+        return "?";
+    }
+}
+
+#if defined(__linux__)
+bool HwCounters::open() {
+    static const uint32_t types[HW_EVENT_COUNT] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE
+    };
+    static const uint64_t configs[HW_EVENT_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS
+    };
+
+    close();
+    int opened = 0;
+    int error = 0;
+    std::string missing;
+    for (int i = 0; i < HW_EVENT_COUNT; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[i];
+        attr.config = configs[i];
+        attr.disabled = 1;
+        // user space only: allowed at the default perf_event_paranoid level
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        mFds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (mFds[i] >= 0) {
+            opened++;
+            continue;
+        }
+        if (error == 0) {
+            error = errno;
+        }
+        missing += missing.empty() ? eventName(i) : std::string(", ") + eventName(i);
+    }
+    if (opened == 0) {
+        mError = std::string("perf_event_open: ") + strerror(error);
+        return false;
+    }
+    mError = opened < HW_EVENT_COUNT ? "no " + missing + ": " + strerror(error) : "";
+    return true;
+}
+
+void HwCounters::close() {
+    for (int i = 0; i < HW_EVENT_COUNT; i++) {
+        if (mFds[i] >= 0) {
+            ::close(mFds[i]);
+            mFds[i] = -1;
+        }
+    }
+}
+
+void HwCounters::start() {
+    for (int i = 0; i < HW_EVENT_COUNT; i++) {
+        if (mFds[i] >= 0) {
+            ioctl(mFds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(mFds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+HwSample HwCounters::stop() {
+    HwSample sample;
+    for (int i = 0; i < HW_EVENT_COUNT; i++) {
+        if (mFds[i] >= 0) {
+            ioctl(mFds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (int i = 0; i < HW_EVENT_COUNT; i++) {
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (mFds[i] < 0 || read(mFds[i], data, sizeof(data)) != (ssize_t)sizeof(data) || data[2] == 0) {
+            continue;
+        }
+        sample.counted[i] = true;
+        sample.values[i] = data[0];
+        if (data[2] < data[1]) {
+            sample.values[i] = (uint64_t)((double)data[0] * data[1] / data[2]);
+            sample.scaled = true;
+        }
+    }
+    return sample;
+}
+#else
+bool HwCounters::open() {
+    mError = "hardware counters need Linux perf_event";
+    return false;
+}
+
+void HwCounters::close() {
+}
+
+void HwCounters::start() {
+}
+
+HwSample HwCounters::stop() {
+    return HwSample();
+}
+#endif
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <inttypes.h>
+#include <string>
+
+namespace GYJ {
+
+enum HwEvent {
+    HW_CYCLES = 0,
+    HW_INSTRUCTIONS,
+    HW_CACHE_REFERENCES,
+    HW_CACHE_MISSES,
+    HW_BRANCHES,
+    HW_BRANCH_MISSES,
+    HW_TASK_CLOCK,                  // software, ns on the CPU
+    HW_PAGE_FAULTS,                 // software
+    HW_EVENT_COUNT
+};
+
+typedef struct HwSample {
+    HwSample();
+    void add(const HwSample &other);
+
+    bool counted[HW_EVENT_COUNT];   // the event could be opened
+    uint64_t values[HW_EVENT_COUNT];
+    bool scaled;                    // multiplexed on the PMU, the values are estimates
+    uint64_t packets;               // the work measured, to normalise by
+    uint64_t frames;
+} HwSample;
+
+/*
+ * CPU counters of the calling thread in user space, perf_event_open(2) on
+ * Linux. Each event is opened on its own, so a PMU lacking some of them or a
+ * virtual machine without one still counts the rest; multiplexed events are
+ * scaled by their running time. Elsewhere open() fails and nothing is counted.
+ */
+class HwCounters
+{
+public:
+    HwCounters();
+    ~HwCounters();
+
+    // false when no event can be counted, see getError()
+    bool open();
+    void close();
+    void start();
+    // counts since start()
+    HwSample stop();
+    const std::string &getError() const { return mError; }
+
+    static const char *eventName(int event);
+
+private:
+    HwCounters(const HwCounters&);
+    HwCounters& operator=(const HwCounters&);
+
+    int mFds[HW_EVENT_COUNT];
+    std::string mError;
+};
+}
@@ -1,13 +1,39 @@
-#include "StdAfx.h"
+#define __STDC_FORMAT_MACROS 1
+#include "stdafx.h"
 #include "ParserdDataContainer.h"
 #include "debug.h"
 #include "Tool.h"
-#include "CommandLine.h"
+#include "EventWriter.h"
+#include "ChromeTrace.h"
+#include "tsTimeline.h"
+
+#include <algorithm>
+#include <cstring>
+#include <inttypes.h>
+
+#define PCR_WRAP                (PTS_WRAP * 300)
 
 namespace GYJ{
 
-ParseredDataContainer::ParseredDataContainer(printParam pp) : mLastVideoDts(0), mLastAudioDts(0), mLastVideoPts(0), mPrintParam(pp), mVideoPid(256), mAudioPid(257),
-    mLastPCR(0), mCurrentTsSegmentIndex(0){
+/*
+ * Each file has a timeline of its own: what brings a timestamp of the next
+ * segment within half a wrap of the last one of the previous segment, a
+ * multiple of the wrap, so the continuity checks and the ordering go on
+ * across the 33 bit wrap.
+ */
+static int64_t unwrapShift(int64_t value, int64_t last, int64_t wrap) {
+    int64_t delta = (value - last) % wrap;
+    if (delta < 0) {
+        delta += wrap;
+    }
+    if (delta >= wrap / 2) {
+        delta -= wrap;
+    }
+    return last + delta - value;
+}
+
+ParseredDataContainer::ParseredDataContainer(printParam pp, TSDemux::Logger *logger)
+    : mPrintParam(pp), mCurrentTsSegmentIndex(0), mLastStartTime(-1), mEvents(NULL), mLogger(logger ? logger : &TSDemux::Logger::Default()) {
 }
 
 ParseredDataContainer::~ParseredDataContainer(){
@@ -20,7 +46,19 @@ void ParseredDataContainer::addData(int64_t startTime, const tsParam *tsInfo) {
     mTsSegments.insert(std::make_pair(startTime, tsInfo));
 }
 
+void ParseredDataContainer::addSegment(const tsParam *tsInfo) {
+    int64_t startTime = tsInfo->tsStartTime;
+    if (startTime >= 0) {
+        if (mLastStartTime >= 0) {
+            startTime += unwrapShift(startTime, mLastStartTime, PTS_WRAP);
+        }
+        mLastStartTime = startTime;
+    }
+    addData(startTime, tsInfo);
+}
+
 void ParseredDataContainer::printInfo() {
+     TRACE_SPAN("analysis", TRACE_CPU);
      std::map<int64_t, const tsParam*>::iterator it = mTsSegments.begin();
      int i = 0;
      while(it != mTsSegments.end()) {
@@ -28,7 +66,7 @@ void ParseredDataContainer::printInfo() {
          if (tsSegment != NULL) {
              printCurrentList(tsSegment);
 
-             it = mTsSegments.erase(it);
+             mTsSegments.erase(it++);
              delete tsSegment->packets;
              delete tsSegment;
          }
@@ -60,7 +98,7 @@ bool ParseredDataContainer::checkCurrentPrint(int currentIndex, int totalCount)
 }
 
 bool ParseredDataContainer::checkPrintPcr(int currentIndex, int totalPkt) {
-    if (CommandLine::getInstance()->getCommandLineParam().printPcr != 0) {
+    if (mPrintParam.printPcr != 0) {
         return true;
     } else {
         return currentIndex < 3 || currentIndex > totalPkt - 3;
@@ -73,141 +111,612 @@ void ParseredDataContainer::printTimeStamp(const tsParam *tsSegment){
     }
 
     std::list<TSDemux::STREAM_PKT*> *lst = tsSegment->packets;
- 
-    mVideoData.clear();
-    mAudioData.clear();
-    mPcrData.clear();
 
-    dispatchPackets(lst);
+    int segment = mCurrentTsSegmentIndex++;
+    DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "###:) \n");
+    DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[%d] file name:%s \n", segment, tsSegment->fileName.c_str());
+    DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "###:) \n");
+    if (mEvents != NULL) {
+        mEvents->beginSegment(segment, tsSegment->fileName);
+    }
 
-    bool videoStreamValidate = true;
-    bool audioStreamValidate = true;
+    // unchanged segment of an earlier run: only its summary goes through the continuity checks
+    if (tsSegment->cached) {
+        for (std::vector<ProgramSummary>::const_iterator it = tsSegment->summaries.begin(); it != tsSegment->summaries.end(); ++it) {
+            ProgramTrack &track = beginTrack(it->program, it->name, it->videoPid, it->audioPid, segment,
+                tsSegment->summaries.size() > 1, tsSegment->discontinuity);
+            processSummary(track, *it);
+        }
+        return;
+    }
 
-    int currentIndex = 0;
-    int packetCount = mVideoData.size();
+    int selectedCount = 0;
+    for (std::vector<TSDemux::Program>::const_iterator pg = tsSegment->programs.begin(); pg != tsSegment->programs.end(); ++pg) {
+        if (pg->selected) {
+            selectedCount++;
+        }
+    }
+
+    processMuxBitrate(tsSegment);
 
-    TSDemux::DBG(DEMUX_DBG_INFO, "###:) \n");
-    TSDemux::DBG(DEMUX_DBG_INFO, "[%d] file name:%s \n", mCurrentTsSegmentIndex++, tsSegment->fileName.c_str());
-    TSDemux::DBG(DEMUX_DBG_INFO, "###:) \n");
+    for (std::vector<TSDemux::Program>::const_iterator pg = tsSegment->programs.begin(); pg != tsSegment->programs.end(); ++pg) {
+        if (!pg->selected) {
+            continue;
+        }
+
+        uint16_t videoPid = pg->GetVideoPid();
+        uint16_t audioPid = pg->GetAudioPid();
+        ProgramTrack &track = beginTrack(pg->program_number, pg->service_name, videoPid == 0xffff ? -1 : videoPid,
+            audioPid == 0xffff ? -1 : audioPid, segment, selectedCount > 1, tsSegment->discontinuity);
+
+        // --duration_only keeps no PES timestamps
+        if (mPrintParam.durationOnly == 0) {
+            dispatchPackets(lst, track);
+
+            processVideo(track);
+            processAudio(track);
+            processPCR(track);
+        }
+        processPcrStats(tsSegment, pg->pcr_pid);
+        processBitrate(tsSegment, *pg);
+        processBufferModel(tsSegment, *pg);
+        processGop(tsSegment, *pg);
+        processDuration(tsSegment, *pg);
+    }
+
+    for (std::list<TSDemux::STREAM_PKT*>::iterator it = lst->begin(); it != lst->end(); ++it) {
+        delete *it;
+    }
+    lst->clear();
+}
+
+ParseredDataContainer::ProgramTrack &ParseredDataContainer::beginTrack(uint16_t program, const std::string &name, int videoPid, int audioPid,
+    int segment, bool mpts, bool discontinuity) {
+    ProgramTrack &track = mPrograms[program];
+    track.videoPid = videoPid;
+    track.audioPid = audioPid;
+    track.name = name;
+    track.program = program;
+    track.segment = segment;
+
+    // MPTS: one analysis block per program
+    if (mpts) {
+        DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[program %u] %s video pid:%d audio pid:%d \n", program, track.name.c_str(), track.videoPid, track.audioPid);
+        printf("[program %u] %s ", program, track.name.c_str());
+    }
+
+    track.videoData.clear();
+    track.audioData.clear();
+    track.pcrData.clear();
+
+    // no continuity check across a signaled discontinuity
+    if (discontinuity) {
+        track.lastVideoPts = 0;
+        track.lastAudioDts = 0;
+        track.lastPCR = 0;
+    }
+    return track;
+}
+
+void ParseredDataContainer::summarize(const tsParam *tsSegment, std::vector<ProgramSummary> &summaries) {
+    for (std::vector<TSDemux::Program>::const_iterator pg = tsSegment->programs.begin(); pg != tsSegment->programs.end(); ++pg) {
+        if (!pg->selected) {
+            continue;
+        }
 
-    processVideo();
-    processAudio();
-    processPCR();
+        ProgramSummary summary;
+        uint16_t videoPid = pg->GetVideoPid();
+        uint16_t audioPid = pg->GetAudioPid();
+        summary.program = pg->program_number;
+        summary.name = pg->service_name;
+        summary.videoPid = videoPid == 0xffff ? -1 : videoPid;
+        summary.audioPid = audioPid == 0xffff ? -1 : audioPid;
+
+        // same ordering and de-duplication as dispatchPackets()
+        std::map<int64_t, const TSDemux::STREAM_PKT*> video;
+        std::map<int64_t, const TSDemux::STREAM_PKT*> audio;
+        std::map<int64_t, const TSDemux::STREAM_PKT*> pcr;
+        int64_t preVideoDts = -1;
+        int64_t preAudioDts = -1;
+        for (std::list<TSDemux::STREAM_PKT*>::const_iterator it = tsSegment->packets->begin(); it != tsSegment->packets->end(); ++it) {
+            const TSDemux::STREAM_PKT *pkt = *it;
+            if (pkt->pid == summary.videoPid) {
+                video.insert(std::make_pair((int64_t)pkt->pts, pkt));
+                pcr.insert(std::make_pair((int64_t)pkt->dts, pkt));
+                if (preVideoDts != -1) {
+                    summary.videoDtsSteps.insert(pkt->dts - preVideoDts);
+                }
+                preVideoDts = pkt->dts;
+            } else if (pkt->pid == summary.audioPid) {
+                if (preAudioDts != -1) {
+                    summary.audioDtsSteps.insert(pkt->dts - preAudioDts);
+                }
+                audio.insert(std::make_pair((int64_t)pkt->pts, pkt));
+                preAudioDts = pkt->dts;
+            }
+        }
+
+        int64_t prev = 0;
+        for (std::map<int64_t, const TSDemux::STREAM_PKT*>::iterator it = video.begin(); it != video.end(); ++it) {
+            if (it == video.begin()) {
+                summary.videoFirstPts = it->first;
+                summary.videoFirstDts = it->second->dts;
+            } else {
+                summary.videoPtsSteps[it->first - prev]++;
+            }
+            if (it->first - (int64_t)it->second->dts >= 90000) {
+                summary.ptsDtsErrors++;
+            }
+            prev = it->first;
+        }
+        summary.videoFrames = video.size();
+        summary.videoLastPts = prev;
+
+        prev = 0;
+        for (std::map<int64_t, const TSDemux::STREAM_PKT*>::iterator it = audio.begin(); it != audio.end(); ++it) {
+            if (it == audio.begin()) {
+                summary.audioFirstPts = it->first;
+                summary.audioFirstDts = it->second->dts;
+            } else {
+                summary.audioPtsSteps[it->first - prev]++;
+            }
+            prev = it->first;
+        }
+        summary.audioFrames = audio.size();
+        summary.audioLastPts = prev;
+
+        uint64_t prevPcr = 0;
+        for (std::map<int64_t, const TSDemux::STREAM_PKT*>::iterator it = pcr.begin(); it != pcr.end(); ++it) {
+            uint64_t value = it->second->pcr.pcr;
+            if (it == pcr.begin()) {
+                summary.pcrFirst = value;
+                summary.pcrFirstDts = it->first;
+            } else if (prevPcr != 0 && value != 0 && isPcrValidate(prevPcr, value)) {
+                summary.pcrErrors++;
+            }
+            prevPcr = value;
+        }
+        summary.pcrCount = pcr.size();
+        summary.pcrLast = prevPcr;
+
+        summaries.push_back(summary);
+    }
+}
+
+void ParseredDataContainer::processSummary(ProgramTrack &track, const ProgramSummary &summary) {
+    // the frame durations of the segment are known before its pts steps are checked, as in dispatchPackets()
+    if (isEnableVideoPrint()) {
+        track.videoFrameDistanceSets.insert(summary.videoDtsSteps.begin(), summary.videoDtsSteps.end());
+    }
+    if (isEnableAudioPrint() && summary.audioFrames > 0) {
+        track.audioFrameDistanceSets.insert(summary.audioDtsSteps.begin(), summary.audioDtsSteps.end());
+    }
+
+    if (isEnableVideoPrint()) {
+        uint32_t discontinuities = 0;
+        int64_t shift = 0;
+        if (summary.videoFrames > 0 && track.lastVideoPts != 0) {
+            shift = unwrapShift(summary.videoFirstPts, track.lastVideoPts, PTS_WRAP);
+            int64_t distance = summary.videoFirstPts + shift - track.lastVideoPts;
+            if (track.videoFrameDistanceSets.find(distance) == track.videoFrameDistanceSets.end()) {
+                DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "video pts is discontinuity, distance:%" PRId64 ", cur_pts=%" PRId64 ", cur_dts=%" PRId64 ", pre_pts:%" PRId64 " \n",
+                    distance, summary.videoFirstPts + shift, summary.videoFirstDts + shift, track.lastVideoPts);
+                if (mEvents != NULL) {
+                    mEvents->post(EVENT_VIDEO_DISCONTINUITY, track.segment, track.program, summary.videoPid,
+                        summary.videoFirstPts + shift, summary.videoFirstDts + shift, 0, track.lastVideoPts, distance);
+                }
+                discontinuities++;
+            }
+        }
+        for (std::map<int64_t, uint32_t>::const_iterator it = summary.videoPtsSteps.begin(); it != summary.videoPtsSteps.end(); ++it) {
+            if (track.videoFrameDistanceSets.find(it->first) == track.videoFrameDistanceSets.end()) {
+                discontinuities += it->second;
+            }
+        }
+        DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[V] cached frames:%u pts %" PRId64 "..%" PRId64 " discontinuities:%u pts-dts out of range:%u \n",
+            summary.videoFrames, summary.videoFirstPts, summary.videoLastPts, discontinuities, summary.ptsDtsErrors);
+        if (summary.videoFrames > 0) {
+            track.lastVideoPts = summary.videoLastPts + shift;
+        }
+        printf("video stream pts : %s ", discontinuities == 0 ? "validate" : "invalidate!!");
+        printFrameDistance(track.videoFrameDistanceSets, "video");
+    }
+
+    if (isEnableAudioPrint() && summary.audioFrames > 0) {
+        uint32_t discontinuities = 0;
+        int64_t shift = 0;
+        if (track.lastAudioDts != 0) {
+            shift = unwrapShift(summary.audioFirstPts, track.lastAudioDts, PTS_WRAP);
+            int64_t distance = summary.audioFirstPts + shift - track.lastAudioDts;
+            if (track.audioFrameDistanceSets.find(distance) == track.audioFrameDistanceSets.end()) {
+                DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "audio pts is discontinuity, distance:%" PRId64 ", cur pts:%" PRId64 ", pre pts:%" PRId64 " \n",
+                    distance, summary.audioFirstPts + shift, track.lastAudioDts);
+                if (mEvents != NULL) {
+                    mEvents->post(EVENT_AUDIO_DISCONTINUITY, track.segment, track.program, summary.audioPid,
+                        summary.audioFirstPts + shift, summary.audioFirstDts + shift, 0, track.lastAudioDts, distance);
+                }
+                discontinuities++;
+            }
+        }
+        for (std::map<int64_t, uint32_t>::const_iterator it = summary.audioPtsSteps.begin(); it != summary.audioPtsSteps.end(); ++it) {
+            if (track.audioFrameDistanceSets.find(it->first) == track.audioFrameDistanceSets.end()) {
+                discontinuities += it->second;
+            }
+        }
+        DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[A] cached frames:%u pts %" PRId64 "..%" PRId64 " discontinuities:%u \n",
+            summary.audioFrames, summary.audioFirstPts, summary.audioLastPts, discontinuities);
+        track.lastAudioDts = summary.audioLastPts + shift;
+        printf("audio stream pts : %s \n", discontinuities == 0 ? "validate" : "invalidate!!");
+        printFrameDistance(track.audioFrameDistanceSets, "audio");
+    }
+
+    if (isEnableVideoPrint() && summary.pcrCount > 0) {
+        uint32_t errors = summary.pcrErrors;
+        int64_t shift = 0;
+        if (track.lastPCR != 0 && summary.pcrFirst != 0) {
+            shift = unwrapShift(summary.pcrFirst, track.lastPCR, PCR_WRAP);
+        }
+        int64_t pcrFirst = summary.pcrFirst + shift;
+        int64_t pcrFirstDts = summary.pcrFirstDts + shift / 300;
+        if (track.lastPCR != 0 && summary.pcrFirst != 0 && isPcrValidate(track.lastPCR, pcrFirst)) {
+            DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "pcr is discontinuity, current dts:%" PRId64 ",  current pcr:%" PRId64 ", pre pcr:%" PRId64 " \n",
+                pcrFirstDts, pcrFirst, track.lastPCR);
+            printf("pcr is discontinuity, current dts:%" PRId64 ",  current pcr:%" PRId64 ", pre pcr:%" PRId64 " \n", pcrFirstDts, pcrFirst, track.lastPCR);
+            if (mEvents != NULL) {
+                mEvents->post(EVENT_PCR_DISCONTINUITY, track.segment, track.program, summary.videoPid, 0, pcrFirstDts, pcrFirst, track.lastPCR);
+            }
+            errors++;
+        }
+        if (errors > 0) {
+            DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[V-PCR] cached pcr discontinuities:%u \n", errors);
+        }
+        track.lastPCR = summary.pcrLast != 0 ? summary.pcrLast + shift : 0;
+    }
 }
 
-void ParseredDataContainer::processVideo() {
+void ParseredDataContainer::processVideo(ProgramTrack &track) {
     int currentIndex = 0;
-    int packetCount = mVideoData.size();
+    int packetCount = track.videoData.size();
     bool videoStreamValidate = true;
 
-    mapIndex it = mVideoData.begin();
-    while (it != mVideoData.end()) {
+    // onto the timeline of the previous segment
+    int64_t shift = 0;
+    if (track.lastVideoPts != 0 && !track.videoData.empty()) {
+        shift = unwrapShift(track.videoData.begin()->first, track.lastVideoPts, PTS_WRAP);
+    }
+
+    mapIndex it = track.videoData.begin();
+    while (it != track.videoData.end()) {
         TSDemux::STREAM_PKT *packet = it->second;
         if (packet == NULL) {
             continue;
         }
 
-        int64_t pts = it->first;
-        int64_t dts = packet->dts;
+        int64_t pts = it->first + shift;
+        int64_t dts = packet->dts + shift;
 
-        if (mLastVideoPts != 0) {
-            int64_t distance = it->first - mLastVideoPts;
-            if (mVideoFrameDistanceSets.find(distance) == mVideoFrameDistanceSets.end()) {
-                TSDemux::DBG(DEMUX_DBG_INFO, "video pts is discontinuity, distance:%lld, cur_pts=%lld, cur_dts=%lld, pre_pts:%lld \n", distance, pts, dts, mLastVideoPts);
+        if (track.lastVideoPts != 0) {
+            int64_t distance = pts - track.lastVideoPts;
+            if (track.videoFrameDistanceSets.find(distance) == track.videoFrameDistanceSets.end()) {
+                DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "video pts is discontinuity, distance:%" PRId64 ", cur_pts=%" PRId64 ", cur_dts=%" PRId64 ", pre_pts:%" PRId64 " \n", distance, pts, dts, track.lastVideoPts);
+                if (mEvents != NULL) {
+                    mEvents->post(EVENT_VIDEO_DISCONTINUITY, track.segment, track.program, packet->pid, pts, dts, 0, track.lastVideoPts, distance);
+                }
                 videoStreamValidate = false;
             }
         }
 
-        int64_t distance = it->first - dts;
+        int64_t distance = pts - dts;
         if (distance >= 90000) {
-            TSDemux::DBG(DEMUX_DBG_INFO, "video pts:%lld - dts:%lld > 90000 \n", it->first, dts);
-            if (CommandLine::getInstance()->getCommandLineParam().checkPacketBufferOut > 0){
-                printf("[V] pts(%lld)-dts(%lld)=%lld, out of range (90K)!!!! \n", it->first, dts, distance);
+            DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "video pts:%" PRId64 " - dts:%" PRId64 " > 90000 \n", pts, dts);
+            if (mEvents != NULL) {
+                mEvents->post(EVENT_PTS_DTS_RANGE, track.segment, track.program, packet->pid, pts, dts, 0, 0, distance);
+            }
+            if (mPrintParam.checkPacketBufferOut > 0){
+                printf("[V] pts(%" PRId64 ")-dts(%" PRId64 ")=%" PRId64 ", out of range (90K)!!!! \n", pts, dts, distance);
             }
         }
 
         if (checkCurrentPrint(currentIndex, packetCount)) {
-            TSDemux::DBG(DEMUX_DBG_INFO, "[V] pts=%lld, dts=%lld\n", pts, dts);
-            //printf("[video-%lld] pts=%lld, dts=%lld \n", tsSegment->tsStartTime, pts, dts);
+            if (mEvents != NULL) {
+                mEvents->post(EVENT_VIDEO_TS, track.segment, track.program, packet->pid, pts, dts);
+            } else {
+                DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[V] pts=%" PRId64 ", dts=%" PRId64 "\n", pts, dts);
+            }
+            //printf("[video-%" PRId64 "] pts=%" PRId64 ", dts=%" PRId64 " \n", tsSegment->tsStartTime, pts, dts);
         }
 
-        mLastVideoPts = it->first;
+        track.lastVideoPts = pts;
         currentIndex++;
         it++;
     }
 
     printf("video stream pts : %s ", videoStreamValidate ? "validate" : "invalidate!!");
 
-    printFrameDistance(mVideoFrameDistanceSets, "video");
+    printFrameDistance(track.videoFrameDistanceSets, "video");
 }
 
-void ParseredDataContainer::processAudio() {
-    if (mAudioData.empty()) {
+void ParseredDataContainer::processAudio(ProgramTrack &track) {
+    if (track.audioData.empty()) {
         return;
     }
 
     bool audioStreamValidate = true;
     int currentIndex = 0;
-    int packetCount = mAudioData.size();
-    mapIndex it = mAudioData.begin();
-    while (it != mAudioData.end()) {
+    int packetCount = track.audioData.size();
+    int64_t shift = track.lastAudioDts != 0 ? unwrapShift(track.audioData.begin()->first, track.lastAudioDts, PTS_WRAP) : 0;
+    mapIndex it = track.audioData.begin();
+    while (it != track.audioData.end()) {
         TSDemux::STREAM_PKT *packet = it->second;
         if (packet == NULL) {
             continue;
         }
 
-        int64_t distance = it->first - mLastAudioDts;
-        if (mLastAudioDts != 0 && mAudioFrameDistanceSets.find(distance) == mAudioFrameDistanceSets.end()) {
-            TSDemux::DBG(DEMUX_DBG_INFO, "audio pts is discontinuity, distance:%lld, cur pts:%lld, pre pts:%lld \n", distance,  it->first, mLastAudioDts);
+        int64_t pts = it->first + shift;
+        int64_t dts = packet->dts + shift;
+        int64_t distance = pts - track.lastAudioDts;
+        if (track.lastAudioDts != 0 && track.audioFrameDistanceSets.find(distance) == track.audioFrameDistanceSets.end()) {
+            DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "audio pts is discontinuity, distance:%" PRId64 ", cur pts:%" PRId64 ", pre pts:%" PRId64 " \n", distance,  pts, track.lastAudioDts);
+            if (mEvents != NULL) {
+                mEvents->post(EVENT_AUDIO_DISCONTINUITY, track.segment, track.program, packet->pid, pts, dts, 0, track.lastAudioDts, distance);
+            }
             audioStreamValidate = false;
         }
 
         if (checkCurrentPrint(currentIndex, packetCount)) {
-            TSDemux::DBG(DEMUX_DBG_INFO, "[A] pts=%lld, dts=%lld \n", it->first, packet->dts);
-            //printf("[audio-%lld] pts=%lld, dts=%lld \n", tsSegment->tsStartTime, mapIndex->first, mapIndex->second);
+            if (mEvents != NULL) {
+                mEvents->post(EVENT_AUDIO_TS, track.segment, track.program, packet->pid, pts, dts);
+            } else {
+                DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[A] pts=%" PRId64 ", dts=%" PRId64 " \n", pts, dts);
+            }
+            //printf("[audio-%" PRId64 "] pts=%" PRId64 ", dts=%" PRId64 " \n", tsSegment->tsStartTime, mapIndex->first, mapIndex->second);
         }
-        mLastAudioDts = it->first;
+        track.lastAudioDts = pts;
 
         currentIndex++;
         it++;
-        delete packet;
     }
 
     printf("audio stream pts : %s \n",  audioStreamValidate ? "validate" : "invalidate!!");
-    printFrameDistance(mAudioFrameDistanceSets, "audio");
+    printFrameDistance(track.audioFrameDistanceSets, "audio");
 }
 
-void ParseredDataContainer::processPCR() {
-    if (mPcrData.empty()) {
+void ParseredDataContainer::processPCR(ProgramTrack &track) {
+    if (track.pcrData.empty()) {
         return;
     }
 
     int curIndex = 0; 
-    int totalPacket = mPcrData.size();
-    mapIndex it = mPcrData.begin();
-    while (it != mPcrData.end()){
+    int totalPacket = track.pcrData.size();
+    // taken at the first PCR of the segment, modulo the 27MHz wrap
+    int64_t shift = 0;
+    bool shiftKnown = track.lastPCR == 0;
+    mapIndex it = track.pcrData.begin();
+    while (it != track.pcrData.end()){
         TSDemux::STREAM_PKT *packet = it->second;
         if (packet == NULL) {
             continue;
         }
 
+        int64_t pcr = packet->pcr.pcr;
+        if (pcr != 0) {
+            if (!shiftKnown) {
+                shift = unwrapShift(pcr, track.lastPCR, PCR_WRAP);
+                shiftKnown = true;
+            }
+            pcr += shift;
+        }
+        int64_t dts = it->first + shift / 300;
+
         if (checkPrintPcr(curIndex++, totalPacket)) {
             //double time = pcrToTime(packet->pcr.pcr_base);
-            TSDemux::DBG(DEMUX_DBG_INFO, "[V-PCR]pcr:%lld, time:%s \n", packet->pcr.pcr, pcrToTime(packet->pcr.pcr_base));
+            if (mEvents != NULL) {
+                mEvents->post(EVENT_PCR, track.segment, track.program, packet->pid, 0, dts, pcr);
+            } else {
+                DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[V-PCR]pcr:%" PRId64 ", time:%s \n", pcr, pcrToTime(pcr / 300));
+            }
         }
 
-        if (mLastPCR != 0 && packet->pcr.pcr != 0 && isPcrValidate(mLastPCR, packet->pcr.pcr)) {
-            TSDemux::DBG(DEMUX_DBG_INFO, "pcr is discontinuity, current dts:%lld,  current pcr:%lld, pre pcr:%lld \n", it->first, packet->pcr.pcr, mLastPCR);
-            printf("pcr is discontinuity, current dts:%lld,  current pcr:%lld, pre pcr:%lld \n", it->first, packet->pcr.pcr, mLastPCR);
+        if (track.lastPCR != 0 && pcr != 0 && isPcrValidate(track.lastPCR, pcr)) {
+            DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "pcr is discontinuity, current dts:%" PRId64 ",  current pcr:%" PRId64 ", pre pcr:%" PRId64 " \n", dts, pcr, track.lastPCR);
+            printf("pcr is discontinuity, current dts:%" PRId64 ",  current pcr:%" PRId64 ", pre pcr:%" PRId64 " \n", dts, pcr, track.lastPCR);
+            if (mEvents != NULL) {
+                mEvents->post(EVENT_PCR_DISCONTINUITY, track.segment, track.program, packet->pid, 0, dts, pcr, track.lastPCR);
+            }
         }
-        mLastPCR = packet->pcr.pcr;
+        track.lastPCR = pcr;
         it++;
-        delete packet;
     }
 }
 
+void ParseredDataContainer::processPcrStats(const tsParam *tsSegment, uint16_t pcrPid) {
+    std::map<uint16_t, TSDemux::PCR_STATS>::const_iterator it = tsSegment->pcrStats.find(pcrPid);
+    if (it == tsSegment->pcrStats.end()) {
+        return;
+    }
+
+    const TSDemux::PCR_STATS &stats = it->second;
+    TSDemux::PcrAnalyzer::dump(pcrPid, stats, mLogger);
+    printf("pcr interval max:%.2fms PCR_AC max:%" PRId64 "ns PCR_OJ max:%" PRId64 "ns ", stats.intervalMaxMs,
+        std::max(stats.accuracyMaxNs, -stats.accuracyMinNs), std::max(stats.jitterMaxNs, -stats.jitterMinNs));
+    if (stats.hasFrequency) {
+        printf("PCR_FO:%.3fppm PCR_DR:%.3fppm/h ", stats.frequencyOffsetPpm, stats.driftRateMaxPpmH);
+    }
+    printf("errors repetition:%" PRIu64 " accuracy:%" PRIu64 " discontinuity:%" PRIu64 " \n", stats.repetitionErrors, stats.accuracyErrors, stats.discontinuityErrors);
+}
+
+void ParseredDataContainer::processMuxBitrate(const tsParam *tsSegment) {
+    const TSDemux::BitrateMeter *meter = tsSegment->bitrate;
+    if (meter == NULL) {
+        return;
+    }
+
+    uint64_t total = meter->getTotalPackets();
+    double seconds = meter->getDurationMs() / 1000.0;
+    double muxRate = seconds > 0.0 ? total * (double)BITRATE_PACKET_BITS / seconds : 0.0;
+    DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[BITRATE] mux packets:%" PRIu64 " null:%" PRIu64 " (%.2f%%) duration:%.3fs rate:%.0f bit/s \n",
+        total, meter->getNullPackets(), total ? meter->getNullPackets() * 100.0 / total : 0.0, seconds, muxRate);
+}
+
+void ParseredDataContainer::processBufferModel(const tsParam *tsSegment, const TSDemux::Program &program) {
+    for (std::vector<TSDemux::PROGRAM_STREAM>::const_iterator it = program.streams.begin(); it != program.streams.end(); ++it) {
+        std::map<uint16_t, TSDemux::TSTD_STATS>::const_iterator st = tsSegment->bufferStats.find(it->pid);
+        if (st == tsSegment->bufferStats.end()) {
+            continue;
+        }
+
+        const TSDemux::TSTD_STATS &stats = st->second;
+        TSDemux::TStdModel::dump(it->pid, stats, mLogger);
+        printf("T-STD pid:0x%04x %s max:%.0f/%d overflow:%" PRIu64 " underflow:%" PRIu64 " ", it->pid, stats.video ? "EB" : "B",
+            stats.ebMax, stats.ebSize, stats.tbOverflows + stats.mbOverflows + stats.ebOverflows, stats.ebUnderflows + stats.lateFrames);
+        if (stats.firstOverflow >= 0) {
+            printf("first overflow:%.3fs ", stats.firstOverflow / 27000000.0);
+        }
+        if (stats.firstUnderflow >= 0) {
+            printf("first underflow:%.3fs ", stats.firstUnderflow / 27000000.0);
+        }
+        printf("\n");
+    }
+}
+
+void ParseredDataContainer::processGop(const tsParam *tsSegment, const TSDemux::Program &program) {
+    for (std::vector<TSDemux::PROGRAM_STREAM>::const_iterator it = program.streams.begin(); it != program.streams.end(); ++it) {
+        std::map<uint16_t, TSDemux::GOP_STATS>::const_iterator st = tsSegment->gopStats.find(it->pid);
+        if (st == tsSegment->gopStats.end()) {
+            continue;
+        }
+
+        const TSDemux::GOP_STATS &stats = st->second;
+        TSDemux::GopAnalyzer::dump(it->pid, stats, mLogger);
+        printf("GOP pid:0x%04x random access:%" PRIu64 " closed:%" PRIu64 " open:%" PRIu64 " I:%" PRIu64 " P:%" PRIu64 " B:%" PRIu64 " ", it->pid,
+            stats.randomAccess, stats.closedGops, stats.openGops, stats.typeFrames[TSDemux::FRAME_TYPE_I],
+            stats.typeFrames[TSDemux::FRAME_TYPE_P], stats.typeFrames[TSDemux::FRAME_TYPE_B]);
+        if (stats.gopTimed > 0) {
+            printf("interval min:%.1fms avg:%.1fms max:%.1fms ", stats.gopMsMin, stats.gopMsSum / stats.gopTimed, stats.gopMsMax);
+        }
+        printf("\n");
+    }
+}
+
+void ParseredDataContainer::processDuration(const tsParam *tsSegment, const TSDemux::Program &program) {
+    for (std::vector<TSDemux::PROGRAM_STREAM>::const_iterator it = program.streams.begin(); it != program.streams.end(); ++it) {
+        std::map<uint16_t, TSDemux::MEDIA_DURATION>::const_iterator st = tsSegment->durations.find(it->pid);
+        if (st == tsSegment->durations.end()) {
+            continue;
+        }
+
+        const TSDemux::MEDIA_DURATION &stats = st->second;
+        TSDemux::DurationCounter::dump(it->pid, stats, mLogger);
+        printf("duration pid:0x%04x %s frames:%" PRIu64 " %.6fs pts span:%.6fs ", it->pid, stats.video ? "video" : "audio",
+            stats.frames, stats.seconds(), stats.ptsSpan());
+        if (!stats.video && stats.samples > 0) {
+            printf("samples:%" PRIu64 "@%dHz ", stats.samples, stats.sampleRate);
+        }
+        printf("\n");
+    }
+}
+
+void ParseredDataContainer::processBitrate(const tsParam *tsSegment, const TSDemux::Program &program) {
+    const TSDemux::BitrateMeter *meter = tsSegment->bitrate;
+    if (meter == NULL) {
+        return;
+    }
+
+    std::vector<uint16_t> pids;
+    pids.push_back(program.pmt_pid);
+    for (std::vector<TSDemux::PROGRAM_STREAM>::const_iterator it = program.streams.begin(); it != program.streams.end(); ++it) {
+        pids.push_back(it->pid);
+    }
+    if (program.pcr_pid != 0x1fff && std::find(pids.begin(), pids.end(), program.pcr_pid) == pids.end()) {
+        pids.push_back(program.pcr_pid);
+    }
+
+    // the last bucket is partial, keep it out of min/max
+    size_t buckets = meter->getBucketCount();
+    size_t fullBuckets = buckets > 2 ? buckets - 1 : buckets;
+    double seconds = meter->getDurationMs() / 1000.0;
+    double programPeak = 0.0;
+    uint64_t programPackets = 0;
+    for (size_t b = 0; b < fullBuckets; b++) {
+        double rate = 0.0;
+        for (std::vector<uint16_t>::iterator it = pids.begin(); it != pids.end(); ++it) {
+            rate += meter->getBucketBitrate(b, *it);
+        }
+        programPeak = std::max(programPeak, rate);
+    }
+
+    for (std::vector<uint16_t>::iterator it = pids.begin(); it != pids.end(); ++it) {
+        double minRate = 0.0;
+        double maxRate = 0.0;
+        for (size_t b = 0; b < fullBuckets; b++) {
+            double rate = meter->getBucketBitrate(b, *it);
+            minRate = b == 0 ? rate : std::min(minRate, rate);
+            maxRate = std::max(maxRate, rate);
+        }
+        uint64_t packets = meter->getPackets(*it);
+        programPackets += packets;
+        DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[BITRATE] pid:0x%04x packets:%" PRIu64 " payload:%" PRIu64 " scrambled:%" PRIu64 " avg:%.0f min:%.0f max:%.0f bit/s \n",
+            *it, packets, meter->getPayloadBytes(*it), meter->getScrambled(*it),
+            seconds > 0.0 ? packets * (double)BITRATE_PACKET_BITS / seconds : 0.0, minRate, maxRate);
+    }
+
+    double programRate = seconds > 0.0 ? programPackets * (double)BITRATE_PACKET_BITS / seconds : 0.0;
+    printf("bitrate avg:%.0f bit/s peak(%dms):%.0f bit/s \n", programRate, meter->getBucketMs(), programPeak);
+
+    if (mPrintParam.bitrateCsv != 0) {
+        writeBitrateCsv(tsSegment, program, pids);
+    }
+}
+
+void ParseredDataContainer::writeBitrateCsv(const tsParam *tsSegment, const TSDemux::Program &program, const std::vector<uint16_t> &pids) {
+    const TSDemux::BitrateMeter *meter = tsSegment->bitrate;
+
+    std::string name = tsSegment->fileName;
+    size_t slash = name.find_last_of("/\\");
+    if (slash != std::string::npos) {
+        name = name.substr(slash + 1);
+    }
+    size_t dot = name.find_last_of(".");
+    if (dot != std::string::npos) {
+        name = name.substr(0, dot);
+    }
+    char csvName[512];
+    sprintf(csvName, "%s_program%u_bitrate.csv", name.c_str(), program.program_number);
+
+    FILE *csv = fopen(csvName, "w");
+    if (csv == NULL) {
+        printf("cannot write bitrate file: '%s'\n", csvName);
+        return;
+    }
+
+    fprintf(csv, "time_ms,mux,program");
+    for (std::vector<uint16_t>::const_iterator it = pids.begin(); it != pids.end(); ++it) {
+        fprintf(csv, ",pid_0x%04x", *it);
+    }
+    fprintf(csv, "\n");
+
+    for (size_t b = 0; b < meter->getBucketCount(); b++) {
+        double mux = 0.0;
+        for (int pid = 0; pid < BITRATE_PID_COUNT; pid++) {
+            mux += meter->getBucketPackets(b, pid);
+        }
+        double programRate = 0.0;
+        for (std::vector<uint16_t>::const_iterator it = pids.begin(); it != pids.end(); ++it) {
+            programRate += meter->getBucketBitrate(b, *it);
+        }
+        fprintf(csv, "%" PRIu64 ",%.0f,%.0f", (uint64_t)b * meter->getBucketMs(),
+            mux * BITRATE_PACKET_BITS * 1000.0 / meter->getBucketMs(), programRate);
+        for (std::vector<uint16_t>::const_iterator it = pids.begin(); it != pids.end(); ++it) {
+            fprintf(csv, ",%.0f", meter->getBucketBitrate(b, *it));
+        }
+        fprintf(csv, "\n");
+    }
+    fclose(csv);
+}
+
 bool ParseredDataContainer::isPcrValidate(int64_t prePcr, int64_t curPcr) {
-    return (curPcr - prePcr > 1080000 * 2.5); // 0.1s
+    // both are on the extended timeline, a PCR going back is a real discontinuity
+    return curPcr < prePcr || (curPcr - prePcr > 1080000 * 2.5); // 0.1s
 }
 
 const char *ParseredDataContainer::pcrToTime(int64_t pcr) {
@@ -225,7 +734,7 @@ const char *ParseredDataContainer::pcrToTime(int64_t pcr) {
     return mTimeBuffer;
 }
 
-void ParseredDataContainer::dispatchPackets(const std::list<TSDemux::STREAM_PKT*> *lst) {
+void ParseredDataContainer::dispatchPackets(const std::list<TSDemux::STREAM_PKT*> *lst, ProgramTrack &track) {
     if (lst == NULL) {
         return;
     }
@@ -235,39 +744,38 @@ void ParseredDataContainer::dispatchPackets(const std::list<TSDemux::STREAM_PKT*
     int64_t preAudioDts = -1;
     while(it != lst->end()) {
         TSDemux::STREAM_PKT *pkt = *it;
-        if (isEnableVideoPrint() && pkt->pid == mVideoPid){
-            mVideoData.insert(std::make_pair(pkt->pts, pkt));
-            mPcrData.insert(std::make_pair(pkt->dts, pkt));
+        if (isEnableVideoPrint() && pkt->pid == track.videoPid){
+            track.videoData.insert(std::make_pair(pkt->pts, pkt));
+            track.pcrData.insert(std::make_pair(pkt->dts, pkt));
             if (preVideoDts != -1) {
                 int64_t vDistance = pkt->dts - preVideoDts;
-                if (mVideoFrameDistanceSets.find(vDistance) == mVideoFrameDistanceSets.end()){
-                    mVideoFrameDistanceSets.insert(vDistance);
+                if (track.videoFrameDistanceSets.find(vDistance) == track.videoFrameDistanceSets.end()){
+                    track.videoFrameDistanceSets.insert(vDistance);
                 }
             }
             preVideoDts = pkt->dts;
-        } else if (isEnableAudioPrint() && pkt->pid == mAudioPid) {
+        } else if (isEnableAudioPrint() && pkt->pid == track.audioPid) {
             if (preAudioDts != -1) {
                 int64_t aDistance = pkt->dts - preAudioDts;
-                if (mAudioFrameDistanceSets.find(aDistance) == mAudioFrameDistanceSets.end()) {
-                    mAudioFrameDistanceSets.insert(aDistance);
+                if (track.audioFrameDistanceSets.find(aDistance) == track.audioFrameDistanceSets.end()) {
+                    track.audioFrameDistanceSets.insert(aDistance);
                 }
             }
-            mAudioData.insert(std::make_pair(pkt->pts, pkt));
+            track.audioData.insert(std::make_pair(pkt->pts, pkt));
             preAudioDts = pkt->dts;
         }
         it++;
-        //delete pkt;
     }
 }
 
 void ParseredDataContainer::printFrameDistance(std::set<int64_t> &Distances, std::string tag) {
     if (!Distances.empty()){
 
-        TSDemux::DBG(DEMUX_DBG_INFO, "%s frame duration count:%d ", tag.c_str(), Distances.size());
+        DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "%s frame duration count:%u ", tag.c_str(), (unsigned)Distances.size());
         for(std::set<int64_t>::iterator it = Distances.begin(); it != Distances.end(); it++) {
-            TSDemux::DBG(DEMUX_DBG_INFO, "  duration:%lld ", *it);
+            DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "  duration:%" PRId64 " ", *it);
         }
-        TSDemux::DBG(DEMUX_DBG_INFO, "\n");
+        DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "\n");
     }
 }
 
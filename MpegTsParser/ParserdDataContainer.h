@@ -2,75 +2,156 @@
 #include <list>
 #include <map>
 #include <set>
+#include <string>
+#include <vector>
 #include "elementaryStream.h"
+#include "tsProgram.h"
+#include "PcrAnalyzer.h"
+#include "BitrateMeter.h"
+#include "TStdModel.h"
+#include "GopAnalyzer.h"
+#include "DurationCounter.h"
 
 namespace GYJ{
 
+class EventWriter;
 
 enum printMediaType { PRINT_MEDIA_VIDEO, PRINT_MEDIA_AUDIO, PRINT_MEDIA_ALL };
 enum printPTSLevel { PRINT_ALL_PTS, PRINT_PARTLY_PTS };
 
 typedef struct printParam{
-    printParam(int pt, int pl) : printType(pt), printLevel(pl) {}
+    printParam(int pt, int pl) : printType(pt), printLevel(pl), printPcr(0), checkPacketBufferOut(0), bitrateCsv(0), durationOnly(0) {}
     int printType;
     int printLevel;
+    int printPcr;
+    int checkPacketBufferOut;
+    int bitrateCsv;
+    int durationOnly;
 }printParam;
 
+// timestamp checks of one program over one segment, all the cross-segment checks need of it
+typedef struct ProgramSummary {
+    ProgramSummary() : program(0), videoPid(-1), audioPid(-1), videoFrames(0), videoFirstPts(0), videoFirstDts(0), videoLastPts(0)
+        , audioFrames(0), audioFirstPts(0), audioFirstDts(0), audioLastPts(0), pcrCount(0), pcrFirst(0), pcrFirstDts(0), pcrLast(0)
+        , pcrErrors(0), ptsDtsErrors(0) {}
+    uint16_t program;
+    std::string name;
+    int videoPid;
+    int audioPid;
+    uint32_t videoFrames;               // by pts
+    int64_t videoFirstPts;
+    int64_t videoFirstDts;
+    int64_t videoLastPts;
+    std::map<int64_t, uint32_t> videoPtsSteps;  // pts distance of consecutive frames, count
+    std::set<int64_t> videoDtsSteps;            // frame durations
+    uint32_t audioFrames;
+    int64_t audioFirstPts;
+    int64_t audioFirstDts;
+    int64_t audioLastPts;
+    std::map<int64_t, uint32_t> audioPtsSteps;
+    std::set<int64_t> audioDtsSteps;
+    uint32_t pcrCount;                  // video PES by dts
+    uint64_t pcrFirst;
+    int64_t pcrFirstDts;
+    uint64_t pcrLast;
+    uint32_t pcrErrors;                 // inside the segment
+    uint32_t ptsDtsErrors;              // video pts - dts >= 90000
+} ProgramSummary;
+
 typedef struct tsParam {
-    tsParam(std::string name, int64_t startTime, std::list<TSDemux::STREAM_PKT*> *datas) : fileName(name), tsStartTime(startTime), packets(datas) {}
+    tsParam(std::string name, int64_t startTime, std::list<TSDemux::STREAM_PKT*> *datas, const std::vector<TSDemux::Program> &pgs)
+        : fileName(name), tsStartTime(startTime), packets(datas), programs(pgs), bitrate(NULL), discontinuity(false), cached(false) {}
+    ~tsParam() { delete bitrate; }
     std::string fileName;
     int64_t tsStartTime;
     std::list<TSDemux::STREAM_PKT*> *packets;
+    std::vector<TSDemux::Program> programs;
+    std::map<uint16_t, TSDemux::PCR_STATS> pcrStats;   // by PCR PID, empty without --pcr_analysis
+    TSDemux::BitrateMeter *bitrate;                    // owned, NULL without --bitrate
+    std::map<uint16_t, TSDemux::TSTD_STATS> bufferStats;  // by stream PID, empty without --check_buffer_out
+    std::map<uint16_t, TSDemux::GOP_STATS> gopStats;      // by video PID, empty without --gop
+    std::map<uint16_t, TSDemux::MEDIA_DURATION> durations;  // by stream PID, empty without --duration
+    bool discontinuity;                                  // signaled timestamp discontinuity before the segment (HLS)
+    bool cached;                                         // from the result cache: no packets, the checks run on the summaries
+    std::vector<ProgramSummary> summaries;               // by selected program, set with cached
 }tsParam;
 
 class ParseredDataContainer
 {
 public:
-    explicit ParseredDataContainer(printParam pp);
+    // logger of the report, the default logger if NULL
+    explicit ParseredDataContainer(printParam pp, TSDemux::Logger *logger = NULL);
     ~ParseredDataContainer();
 
     void addData(std::list<TSDemux::STREAM_PKT*> *lstData, int64_t index);
     void addData(int64_t startTime, const tsParam *tsInfo);
+    // ordered by start time, taken across the PTS wrap from the segment added before
+    void addSegment(const tsParam *tsInfo);
     void printInfo();
     void printCurrentList(const tsParam *tsSegment);
+    // summaries of the selected programs of a demuxed segment, as the checks see its packets
+    static void summarize(const tsParam *tsSegment, std::vector<ProgramSummary> &summaries);
+    // timestamps and discontinuities as structured events instead of log lines, not owned
+    void setEventWriter(EventWriter *events) { mEvents = events; }
 private:
+    // analysis state of one program, kept across segments
+    typedef struct ProgramTrack {
+        ProgramTrack() : program(0), segment(0), videoPid(-1), audioPid(-1), lastAudioDts(0), lastVideoDts(0), lastVideoPts(0), lastPCR(0) {}
+        uint16_t program;
+        int segment;                    // of the current segment
+        int videoPid;
+        int audioPid;
+        std::string name;
+        int64_t lastAudioDts;
+        int64_t lastVideoDts;
+        int64_t lastVideoPts;
+        uint64_t lastPCR;
+        std::set<int64_t> videoFrameDistanceSets;
+        std::set<int64_t> audioFrameDistanceSets;
+        std::map<int64_t, TSDemux::STREAM_PKT*> videoData;
+        std::map<int64_t, TSDemux::STREAM_PKT*> audioData;
+        std::map<int64_t, TSDemux::STREAM_PKT*> pcrData;
+    } ProgramTrack;
+
     bool isEnableVideoPrint();
     bool isEnableAudioPrint();
     bool checkCurrentPrint(int audioIndex, int audioCount);
     bool checkPrintPcr(int currentIndex, int totalPkt);
 
     void printTimeStamp(const tsParam *tsSegment);
-    void dispatchPackets(const std::list<TSDemux::STREAM_PKT*> *lst);
+    void dispatchPackets(const std::list<TSDemux::STREAM_PKT*> *lst, ProgramTrack &track);
     void printFrameDistance(std::set<int64_t> &Distances, std::string tag);
 
-    void processVideo();
-    void processAudio();
-    void processPCR();
-    bool isPcrValidate(int64_t prePcr, int64_t curPcr);
+    ProgramTrack &beginTrack(uint16_t program, const std::string &name, int videoPid, int audioPid, int segment, bool mpts, bool discontinuity);
+    void processSummary(ProgramTrack &track, const ProgramSummary &summary);
+    void processVideo(ProgramTrack &track);
+    void processAudio(ProgramTrack &track);
+    void processPCR(ProgramTrack &track);
+    void processPcrStats(const tsParam *tsSegment, uint16_t pcrPid);
+    void processMuxBitrate(const tsParam *tsSegment);
+    void processBufferModel(const tsParam *tsSegment, const TSDemux::Program &program);
+    void processGop(const tsParam *tsSegment, const TSDemux::Program &program);
+    void processDuration(const tsParam *tsSegment, const TSDemux::Program &program);
+    void processBitrate(const tsParam *tsSegment, const TSDemux::Program &program);
+    void writeBitrateCsv(const tsParam *tsSegment, const TSDemux::Program &program, const std::vector<uint16_t> &pids);
+    static bool isPcrValidate(int64_t prePcr, int64_t curPcr);
     const char *pcrToTime(int64_t pcr);
     int roundDouble(double number);
 private:
 
     std::map<int64_t, std::list<TSDemux::STREAM_PKT*>*> mParserdData;
     std::map<int64_t, const tsParam*> mTsSegments;
-    std::set<int64_t> mVideoFrameDistanceSets;
-    std::set<int64_t> mAudioFrameDistanceSets;
+    std::map<uint16_t, ProgramTrack> mPrograms;
 
     printParam mPrintParam;
 
-    int mVideoPid;
-    int mAudioPid;
     int mCurrentTsSegmentIndex;
-    int64_t mLastAudioDts;
-    int64_t mLastVideoDts;
-    int64_t mLastVideoPts;
-    uint64_t mLastPCR;
+    int64_t mLastStartTime;             // of the last segment added, -1 before the first
+    EventWriter *mEvents;
+    TSDemux::Logger *mLogger;
     char mTimeBuffer[128];
 
     typedef std::map<int64_t, TSDemux::STREAM_PKT*>::iterator mapIndex;
-    std::map<int64_t, TSDemux::STREAM_PKT*> mVideoData;
-    std::map<int64_t, TSDemux::STREAM_PKT*> mAudioData;
-    std::map<int64_t, TSDemux::STREAM_PKT*> mPcrData;
 };
 
 }
\ No newline at end of file
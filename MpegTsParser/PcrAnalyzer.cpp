@@ -0,0 +1,262 @@
+#define __STDC_FORMAT_MACROS 1
+#include "PcrAnalyzer.h"
+#include "debug.h"
+
+#include <cstdio>
+#include <inttypes.h>
+#include <cstring>
+#include <string>
+
+using namespace TSDemux;
+
+#define PCR_CLOCK_HZ    27000000.0
+#define PCR_TICKS_MS    27000
+
+static const int64_t s_intervalEdgesMs[] = { 10, 20, 30, 40, 60, 80, 100 };
+static const int64_t s_jitterEdgesNs[] = { 100, 500, 1000, 10000, 100000, 1000000, 10000000 };
+
+static inline int64_t ticksToNs(double ticks) {
+    return (int64_t)(ticks * 1000.0 / 27.0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/////
+/////  Histogram and linear fit
+/////
+
+PcrHistogram::PcrHistogram(const int64_t *e, int n) : edges(e), edgeCount(n) {
+    memset(buckets, 0, sizeof(buckets));
+}
+
+void PcrHistogram::add(int64_t value) {
+    if (value < 0) {
+        value = -value;
+    }
+    int i = 0;
+    while (i < edgeCount && value > edges[i]) {
+        i++;
+    }
+    buckets[i]++;
+}
+
+void PcrLinearFit::add(double x, double y) {
+    n++;
+    double dx = x - meanX;
+    meanX += dx / n;
+    meanY += (y - meanY) / n;
+    m2X += dx * (x - meanX);
+    cXY += dx * (y - meanY);
+}
+
+PCR_STATS::PCR_STATS()
+    : count(0), discontinuities(0), discontinuityErrors(0), repetitionErrors(0), accuracyErrors(0)
+    , intervalMinMs(0.0), intervalMaxMs(0.0), intervalSumMs(0.0), intervalCount(0)
+    , intervalMs(s_intervalEdgesMs, sizeof(s_intervalEdgesMs) / sizeof(s_intervalEdgesMs[0]))
+    , muxRate(0.0), accuracyCount(0), accuracyMinNs(0), accuracyMaxNs(0)
+    , accuracyNs(s_jitterEdgesNs, sizeof(s_jitterEdgesNs) / sizeof(s_jitterEdgesNs[0]))
+    , jitterCount(0), jitterMinNs(0), jitterMaxNs(0)
+    , jitterNs(s_jitterEdgesNs, sizeof(s_jitterEdgesNs) / sizeof(s_jitterEdgesNs[0]))
+    , hasFrequency(false), frequencyOffsetPpm(0.0), frequencyOffsetMaxPpm(0.0), driftRateMaxPpmH(0.0) {
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/////
+/////  PCR analyzer
+/////
+
+PcrAnalyzer::PcrAnalyzer(PCR_ARRIVAL_MODE mode) : mMode(mode), mLogger(&Logger::Default()) {
+}
+
+void PcrAnalyzer::reset() {
+    mPids.clear();
+}
+
+void PcrAnalyzer::restart(PidState &state) {
+    // a new time base: fits and intervals start over, statistics are kept
+    state.hasLast = false;
+    state.hasOrigin = false;
+    state.bytes.reset();
+    state.clock.reset();
+    state.window.reset();
+    state.hasWindowOffset = false;
+}
+
+void PcrAnalyzer::addInterval(PCR_STATS &stats, double interval) {
+    if (stats.intervalCount == 0 || interval < stats.intervalMinMs) {
+        stats.intervalMinMs = interval;
+    }
+    if (stats.intervalCount == 0 || interval > stats.intervalMaxMs) {
+        stats.intervalMaxMs = interval;
+    }
+    stats.intervalSumMs += interval;
+    stats.intervalCount++;
+    stats.intervalMs.add((int64_t)interval);
+    if (interval > PCR_REPETITION_MAX_MS) {
+        stats.repetitionErrors++;
+    }
+}
+
+void PcrAnalyzer::addPcr(uint16_t pid, uint64_t pcr, uint64_t pos, int64_t arrivalUs, bool discontinuity) {
+    PidState &state = mPids[pid];
+    PCR_STATS &stats = state.stats;
+    bool wallClock = mMode == PCR_ARRIVAL_WALLCLOCK && arrivalUs >= 0;
+    int64_t arrival = wallClock ? arrivalUs * 27 : 0;
+
+    stats.count++;
+    if (state.hasLast) {
+        int64_t delta = (int64_t)(pcr - state.lastPcr);
+        if (discontinuity) {
+            stats.discontinuities++;
+            restart(state);
+        } else if (delta < 0 || delta > PCR_DISCONTINUITY_MAX_MS * PCR_TICKS_MS) {
+            stats.discontinuityErrors++;
+            DEMUX_LOG(mLogger, DEMUX_DBG_WARN, "%s: PCR %.4x discontinuity without indicator, %" PRId64 " ticks\n", __FUNCTION__, pid, delta);
+            // still a late PCR when the arrival tells so
+            if (wallClock || delta > 0) {
+                addInterval(stats, (wallClock ? arrival - state.lastArrival : delta) / (double)PCR_TICKS_MS);
+            }
+            restart(state);
+        }
+    }
+
+    if (state.hasLast) {
+        int64_t delta = (int64_t)(pcr - state.lastPcr);
+
+        addInterval(stats, (wallClock ? arrival - state.lastArrival : delta) / (double)PCR_TICKS_MS);
+
+        // PCR_AC: increment against the byte distance at the mux rate
+        if (state.bytes.n >= PCR_FIT_MIN_SAMPLES) {
+            double expected = (double)(pos - state.lastPos) * state.bytes.slope();
+            int64_t accuracy = ticksToNs(delta - expected);
+            if (stats.accuracyCount++ == 0) {
+                stats.accuracyMinNs = stats.accuracyMaxNs = accuracy;
+            }
+            if (accuracy < stats.accuracyMinNs) {
+                stats.accuracyMinNs = accuracy;
+            }
+            if (accuracy > stats.accuracyMaxNs) {
+                stats.accuracyMaxNs = accuracy;
+            }
+            stats.accuracyNs.add(accuracy);
+            if (accuracy > PCR_ACCURACY_MAX_NS || accuracy < -PCR_ACCURACY_MAX_NS) {
+                stats.accuracyErrors++;
+            }
+        }
+    }
+
+    if (!state.hasOrigin) {
+        state.originPcr = pcr;
+        state.originPos = pos;
+        state.originArrival = arrival;
+        state.hasOrigin = true;
+    }
+    double y = (double)(int64_t)(pcr - state.originPcr);
+    double x = (double)(pos - state.originPos);
+    double t = (double)(arrival - state.originArrival);
+
+    // PCR_OJ: PCR against arrival, offset and rate removed by the fit
+    const PcrLinearFit &fit = wallClock ? state.clock : state.bytes;
+    if (fit.n >= PCR_FIT_MIN_SAMPLES) {
+        int64_t jitter = ticksToNs(y - fit.predict(wallClock ? t : x));
+        if (stats.jitterCount++ == 0) {
+            stats.jitterMinNs = stats.jitterMaxNs = jitter;
+        }
+        if (jitter < stats.jitterMinNs) {
+            stats.jitterMinNs = jitter;
+        }
+        if (jitter > stats.jitterMaxNs) {
+            stats.jitterMaxNs = jitter;
+        }
+        stats.jitterNs.add(jitter);
+    }
+
+    state.bytes.add(x, y);
+    if (state.bytes.n >= PCR_FIT_MIN_SAMPLES && state.bytes.slope() > 0.0) {
+        stats.muxRate = 8.0 * PCR_CLOCK_HZ / state.bytes.slope();
+    }
+    if (wallClock) {
+        state.clock.add(t, y);
+        addFrequency(state, y, t, arrival);
+    }
+
+    state.lastPcr = pcr;
+    state.lastPos = pos;
+    state.lastArrival = arrival;
+    state.hasLast = true;
+}
+
+void PcrAnalyzer::addFrequency(PidState &state, double pcr, double arrival, int64_t arrivalTicks) {
+    PCR_STATS &stats = state.stats;
+
+    // PCR_FO: slope of the PCR against the wall clock
+    if (state.clock.n >= PCR_FIT_MIN_SAMPLES) {
+        stats.frequencyOffsetPpm = (state.clock.slope() - 1.0) * 1e6;
+        stats.hasFrequency = true;
+    }
+
+    // PCR_DR: change of PCR_FO from one drift window to the next
+    if (state.window.n == 0) {
+        state.windowStart = arrivalTicks;
+    }
+    state.window.add(arrival, pcr);
+    int64_t length = arrivalTicks - state.windowStart;
+    if (length >= (int64_t)(PCR_DRIFT_WINDOW_S * PCR_CLOCK_HZ) && state.window.n >= PCR_FIT_MIN_SAMPLES) {
+        double offset = (state.window.slope() - 1.0) * 1e6;
+        if (offset > stats.frequencyOffsetMaxPpm || -offset > stats.frequencyOffsetMaxPpm) {
+            stats.frequencyOffsetMaxPpm = offset < 0 ? -offset : offset;
+        }
+        if (state.hasWindowOffset) {
+            double drift = (offset - state.windowOffsetPpm) * 3600.0 * PCR_CLOCK_HZ / length;
+            if (drift > stats.driftRateMaxPpmH || -drift > stats.driftRateMaxPpmH) {
+                stats.driftRateMaxPpmH = drift < 0 ? -drift : drift;
+            }
+        }
+        state.windowOffsetPpm = offset;
+        state.hasWindowOffset = true;
+        state.window.reset();
+    }
+}
+
+std::vector<uint16_t> PcrAnalyzer::getPids() const {
+    std::vector<uint16_t> pids;
+    for (std::map<uint16_t, PidState>::const_iterator it = mPids.begin(); it != mPids.end(); ++it) {
+        pids.push_back(it->first);
+    }
+    return pids;
+}
+
+const PCR_STATS *PcrAnalyzer::getStats(uint16_t pid) const {
+    std::map<uint16_t, PidState>::const_iterator it = mPids.find(pid);
+    return it != mPids.end() ? &it->second.stats : NULL;
+}
+
+static std::string formatHistogram(const PcrHistogram &histogram, const char *unit) {
+    std::string out;
+    char item[64];
+    for (int i = 0; i <= histogram.edgeCount; i++) {
+        if (i < histogram.edgeCount) {
+            sprintf(item, " <=%" PRId64 "%s:%" PRIu64, histogram.edges[i], unit, histogram.buckets[i]);
+        } else {
+            sprintf(item, " >%" PRId64 "%s:%" PRIu64, histogram.edges[i - 1], unit, histogram.buckets[i]);
+        }
+        out += item;
+    }
+    return out;
+}
+
+void PcrAnalyzer::dump(uint16_t pid, const PCR_STATS &stats, Logger *logger) {
+    DEMUX_LOG(logger, DEMUX_DBG_INFO, "[PCR] pid:0x%04x pcr count:%" PRIu64 " discontinuity:%" PRIu64 " discontinuity error:%" PRIu64 " \n",
+        pid, stats.count, stats.discontinuities, stats.discontinuityErrors);
+    DEMUX_LOG(logger, DEMUX_DBG_INFO, "[PCR] interval min:%.2fms avg:%.2fms max:%.2fms repetition error:%" PRIu64 " \n",
+        stats.intervalMinMs, stats.intervalCount ? stats.intervalSumMs / stats.intervalCount : 0.0, stats.intervalMaxMs, stats.repetitionErrors);
+    DEMUX_LOG(logger, DEMUX_DBG_INFO, "[PCR] interval%s \n", formatHistogram(stats.intervalMs, "ms").c_str());
+    DEMUX_LOG(logger, DEMUX_DBG_INFO, "[PCR] mux rate:%.0f bit/s PCR_AC min:%" PRId64 "ns max:%" PRId64 "ns accuracy error:%" PRIu64 " \n",
+        stats.muxRate, stats.accuracyMinNs, stats.accuracyMaxNs, stats.accuracyErrors);
+    DEMUX_LOG(logger, DEMUX_DBG_INFO, "[PCR] PCR_AC%s \n", formatHistogram(stats.accuracyNs, "ns").c_str());
+    DEMUX_LOG(logger, DEMUX_DBG_INFO, "[PCR] PCR_OJ min:%" PRId64 "ns max:%" PRId64 "ns \n", stats.jitterMinNs, stats.jitterMaxNs);
+    DEMUX_LOG(logger, DEMUX_DBG_INFO, "[PCR] PCR_OJ%s \n", formatHistogram(stats.jitterNs, "ns").c_str());
+    if (stats.hasFrequency) {
+        DEMUX_LOG(logger, DEMUX_DBG_INFO, "[PCR] PCR_FO:%.3fppm max:%.3fppm PCR_DR max:%.3fppm/h \n",
+            stats.frequencyOffsetPpm, stats.frequencyOffsetMaxPpm, stats.driftRateMaxPpmH);
+    }
+}
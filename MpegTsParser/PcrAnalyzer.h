@@ -0,0 +1,151 @@
+#pragma once
+#include <inttypes.h>
+#include <map>
+#include <vector>
+#include "debug.h"
+
+// ETSI TR 101 290 limits
+#define PCR_REPETITION_MAX_MS       40
+#define PCR_DISCONTINUITY_MAX_MS    100
+#define PCR_ACCURACY_MAX_NS         500
+#define PCR_FIT_MIN_SAMPLES         8
+#define PCR_DRIFT_WINDOW_S          60
+#define PCR_HISTOGRAM_BUCKETS       8
+
+namespace TSDemux
+{
+  enum PCR_ARRIVAL_MODE
+  {
+    PCR_ARRIVAL_BYTES = 0,    ///< files: arrival time from byte position and estimated mux rate
+    PCR_ARRIVAL_WALLCLOCK     ///< live input: arrival time from the wall clock
+  };
+
+  /*
+   * Counts of values by upper bucket edge, the last bucket takes what is
+   * beyond the last edge. Signed values are counted by magnitude.
+   */
+  class PcrHistogram
+  {
+  public:
+    PcrHistogram(const int64_t *edges, int edgeCount);
+    void add(int64_t value);
+
+    const int64_t *edges;
+    int edgeCount;
+    uint64_t buckets[PCR_HISTOGRAM_BUCKETS];
+  };
+
+  /*
+   * Running least squares fit of y on x (Welford update), stable over a
+   * full day of 27MHz ticks.
+   */
+  struct PcrLinearFit
+  {
+    PcrLinearFit() { reset(); }
+    void reset() { n = 0; meanX = meanY = m2X = cXY = 0.0; }
+    void add(double x, double y);
+    double slope() const { return m2X > 0.0 ? cXY / m2X : 0.0; }
+    double predict(double x) const { return meanY + slope() * (x - meanX); }
+
+    uint64_t n;
+    double meanX;
+    double meanY;
+    double m2X;
+    double cXY;
+  };
+
+  struct PCR_STATS
+  {
+    PCR_STATS();
+
+    uint64_t count;
+    uint64_t discontinuities;         ///< signaled by discontinuity_indicator
+    uint64_t discontinuityErrors;     ///< PCR jump without discontinuity_indicator
+    uint64_t repetitionErrors;        ///< interval above PCR_REPETITION_MAX_MS
+    uint64_t accuracyErrors;          ///< |PCR_AC| above PCR_ACCURACY_MAX_NS
+
+    double intervalMinMs;
+    double intervalMaxMs;
+    double intervalSumMs;
+    uint64_t intervalCount;
+    PcrHistogram intervalMs;
+
+    double muxRate;                   ///< bit/s estimated from byte positions
+    uint64_t accuracyCount;
+    int64_t accuracyMinNs;            ///< PCR_AC
+    int64_t accuracyMaxNs;
+    PcrHistogram accuracyNs;
+    uint64_t jitterCount;
+    int64_t jitterMinNs;              ///< PCR_OJ
+    int64_t jitterMaxNs;
+    PcrHistogram jitterNs;
+
+    bool hasFrequency;                ///< PCR_FO/PCR_DR need the wall clock
+    double frequencyOffsetPpm;        ///< PCR_FO over the whole run
+    double frequencyOffsetMaxPpm;     ///< largest PCR_FO of a drift window
+    double driftRateMaxPpmH;          ///< PCR_DR between drift windows (ppm/hour)
+  };
+
+  /*
+   * PCR accuracy, jitter and repetition analysis per PCR PID (TR 101 290
+   * 1.5, 2.3 and 3.x measurements).
+   * PCR_AC compares each PCR increment with the byte distance at the mux
+   * rate. PCR_OJ is the PCR against its arrival time once the offset and
+   * rate are removed by a running fit: on files the arrival time is the byte
+   * position, so PCR_OJ is the jitter against a constant rate; on live input
+   * it is the wall clock and PCR_FO/PCR_DR are measured as well.
+   */
+  class PcrAnalyzer
+  {
+  public:
+    explicit PcrAnalyzer(PCR_ARRIVAL_MODE mode = PCR_ARRIVAL_BYTES);
+
+    void reset();
+    void setMode(PCR_ARRIVAL_MODE mode) { mMode = mode; reset(); }
+    PCR_ARRIVAL_MODE getMode() const { return mMode; }
+    void setLogger(Logger *logger) { mLogger = logger; }
+
+    // pcr on 27MHz (extended timeline), pos is the byte position of the packet,
+    // arrivalUs the wall clock arrival or -1
+    void addPcr(uint16_t pid, uint64_t pcr, uint64_t pos, int64_t arrivalUs, bool discontinuity);
+
+    std::vector<uint16_t> getPids() const;
+    const PCR_STATS *getStats(uint16_t pid) const;
+    static void dump(uint16_t pid, const PCR_STATS &stats, Logger *logger = &Logger::Default());
+
+  private:
+    struct PidState
+    {
+      PidState() : hasLast(false), lastPcr(0), lastPos(0), lastArrival(0),
+        hasOrigin(false), originPcr(0), originPos(0), originArrival(0),
+        windowStart(0), hasWindowOffset(false), windowOffsetPpm(0.0) {}
+
+      bool hasLast;
+      uint64_t lastPcr;
+      uint64_t lastPos;
+      int64_t lastArrival;            ///< 27MHz ticks
+
+      bool hasOrigin;
+      uint64_t originPcr;
+      uint64_t originPos;
+      int64_t originArrival;
+      PcrLinearFit bytes;             ///< PCR against byte position
+      PcrLinearFit clock;             ///< PCR against wall clock arrival
+
+      int64_t windowStart;
+      PcrLinearFit window;            ///< PCR_FO of the current drift window
+      bool hasWindowOffset;
+      double windowOffsetPpm;
+
+      PCR_STATS stats;
+    };
+
+    void restart(PidState &state);
+    void addInterval(PCR_STATS &stats, double interval);
+    void addFrequency(PidState &state, double pcr, double arrival, int64_t arrivalTicks);
+
+    PCR_ARRIVAL_MODE mMode;
+    Logger *mLogger;
+    std::map<uint16_t, PidState> mPids;
+  };
+}
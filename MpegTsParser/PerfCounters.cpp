@@ -0,0 +1,99 @@
+#include "PerfCounters.h"
+
+#include <cstring>
+
+using namespace TSDemux;
+
+PERF_STATS::PERF_STATS()
+    : packets(0), resyncs(0), resyncBytes(0), ccErrors(0), pesStarts(0)
+    , esAppendBytes(0), esMovedBytes(0), esReallocs(0), clockTicks(0), clockUs(0) {
+    memset(frames, 0, sizeof(frames));
+    memset(stageTicks, 0, sizeof(stageTicks));
+    memset(stageCalls, 0, sizeof(stageCalls));
+}
+
+void PERF_STATS::add(const PERF_STATS &other) {
+    packets += other.packets;
+    resyncs += other.resyncs;
+    resyncBytes += other.resyncBytes;
+    ccErrors += other.ccErrors;
+    pesStarts += other.pesStarts;
+    esAppendBytes += other.esAppendBytes;
+    esMovedBytes += other.esMovedBytes;
+    esReallocs += other.esReallocs;
+    for (int i = 0; i < PERF_STREAM_TYPES; i++) {
+        frames[i] += other.frames[i];
+    }
+    for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+        stageTicks[i] += other.stageTicks[i];
+        stageCalls[i] += other.stageCalls[i];
+    }
+    clockTicks += other.clockTicks;
+    clockUs += other.clockUs;
+}
+
+double PERF_STATS::stageMs(int stage) const {
+    if (stage < 0 || stage >= PERF_STAGE_COUNT || clockTicks == 0) {
+        return 0.0;
+    }
+    return (double)stageTicks[stage] * clockUs / clockTicks / 1000.0;
+}
+
+double PERF_STATS::totalMs() const {
+    double ms = 0.0;
+    for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+        ms += stageMs(i);
+    }
+    return ms;
+}
+
+uint64_t PERF_STATS::totalFrames() const {
+    uint64_t count = 0;
+    for (int i = 0; i < PERF_STREAM_TYPES; i++) {
+        count += frames[i];
+    }
+    return count;
+}
+
+const char *PERF_STATS::stageName(int stage) {
+    switch (stage) {
+    case PERF_STAGE_READ:
+        return "read";
+    case PERF_STAGE_SYNC:
+        return "sync";
+    case PERF_STAGE_PACKET:
+        return "packet";
+    case PERF_STAGE_PSI:
+        return "psi";
+    case PERF_STAGE_PES:
+        return "pes";
+    case PERF_STAGE_ES:
+        return "es parse";
+    case PERF_STAGE_FRAME:
+        return "frame";
+    default:
+        return "?";
+    }
+}
+
+PerfCounters::PerfCounters()
+    : mTimers(false), mActive(NULL), mStartTicks(0), mStartUs(0) {
+}
+
+void PerfCounters::enableTimers() {
+    if (mTimers) {
+        return;
+    }
+    mTimers = true;
+    mStartTicks = PerfTicks();
+    mStartUs = PLATFORM::GetTimeUs();
+}
+
+PERF_STATS PerfCounters::getStats() const {
+    PERF_STATS copy = stats;
+    if (mTimers) {
+        copy.clockTicks = PerfTicks() - mStartTicks;
+        copy.clockUs = PLATFORM::GetTimeUs() - mStartUs;
+    }
+    return copy;
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include <inttypes.h>
+#include <cstddef>
+#include "elementaryStream.h"
+#include "timeutils.h"
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define PERF_TSC                    1
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <x86intrin.h>
+#define PERF_TSC                    1
+#endif
+
+/*
+ * Stage timers are compiled out of the PERF_SCOPE() call sites when defined
+ * to 0, the counters stay.
+ */
+#ifndef DEMUX_PERF_TIMERS
+#define DEMUX_PERF_TIMERS           1
+#endif
+
+#define PERF_STREAM_TYPES           (TSDemux::STREAM_TYPE_PRIVATE_DATA + 1)
+
+namespace TSDemux
+{
+  // stages of the demux loop, timed exclusive of the stages they call
+  enum PERF_STAGE
+  {
+    PERF_STAGE_READ = 0,            ///< input reads refilling the packet buffer
+    PERF_STAGE_SYNC,                ///< sync byte search and packet size detection
+    PERF_STAGE_PACKET,              ///< TS header, adaptation field, PCR, section filters
+    PERF_STAGE_PSI,                 ///< PAT and PMT
+    PERF_STAGE_PES,                 ///< PES headers, payload appended to the ES buffers
+    PERF_STAGE_ES,                  ///< frame parsing of the ES parsers
+    PERF_STAGE_FRAME,               ///< timestamp unwrap and the analyses of each frame
+    PERF_STAGE_COUNT
+  };
+
+  // time stamp counter where there is one, else the microsecond clock
+  inline uint64_t PerfTicks()
+  {
+#if defined(PERF_TSC)
+    return __rdtsc();
+#else
+    return (uint64_t)PLATFORM::GetTimeUs();
+#endif
+  }
+
+  struct PERF_STATS
+  {
+    PERF_STATS();
+
+    // sums of another demux, for the totals of a run
+    void add(const PERF_STATS &other);
+    // exclusive time of a stage, 0 without timers
+    double stageMs(int stage) const;
+    double totalMs() const;
+    uint64_t totalFrames() const;
+    static const char *stageName(int stage);
+
+    uint64_t packets;               ///< TS packets, null and errored ones included
+    uint64_t resyncs;               ///< sync regained after skipped bytes
+    uint64_t resyncBytes;
+    uint64_t ccErrors;              ///< continuity counter mismatches
+    uint64_t pesStarts;             ///< payload unit starts of the selected streams
+    uint64_t esAppendBytes;         ///< copied into the ES buffers
+    uint64_t esMovedBytes;          ///< moved back to the start of the ES buffers by Append()
+    uint64_t esReallocs;
+    uint64_t frames[PERF_STREAM_TYPES];     ///< emitted by the ES parsers, by STREAM_TYPE
+
+    uint64_t stageTicks[PERF_STAGE_COUNT];
+    uint64_t stageCalls[PERF_STAGE_COUNT];
+    uint64_t clockTicks;            ///< ticks and microseconds of the timed window, the tick rate
+    int64_t clockUs;
+  };
+
+  class PerfScope;
+
+  /*
+   * Counters of one demux and its ES parsers, plain increments on the hot
+   * path. The stage timers are off unless enabled: a PERF_SCOPE() then costs
+   * a test of the flag. Not thread safe, a demux runs on one thread.
+   */
+  class PerfCounters
+  {
+  public:
+    PerfCounters();
+
+    void enableTimers();
+    bool timersEnabled() const { return mTimers; }
+    // the counters, with the timed window up to now
+    PERF_STATS getStats() const;
+
+    PERF_STATS stats;
+
+  private:
+    friend class PerfScope;
+
+    bool mTimers;
+    PerfScope *mActive;             ///< innermost running scope
+    uint64_t mStartTicks;
+    int64_t mStartUs;
+  };
+
+  // times its block as one call of a stage, nested scopes are not counted twice
+  class PerfScope
+  {
+  public:
+    PerfScope(PerfCounters &perf, PERF_STAGE stage)
+      : mPerf(perf.mTimers ? &perf : NULL)
+    {
+      if (mPerf)
+        begin(stage);
+    }
+
+    ~PerfScope()
+    {
+      if (mPerf)
+        end();
+    }
+
+  private:
+    PerfScope(const PerfScope&);
+    PerfScope& operator=(const PerfScope&);
+
+    void begin(PERF_STAGE stage)
+    {
+      mStage = stage;
+      mParent = mPerf->mActive;
+      mPerf->mActive = this;
+      mChildTicks = 0;
+      mStart = PerfTicks();
+    }
+
+    void end()
+    {
+      uint64_t elapsed = PerfTicks() - mStart;
+      mPerf->stats.stageTicks[mStage] += elapsed - mChildTicks;
+      mPerf->stats.stageCalls[mStage]++;
+      if (mParent)
+        mParent->mChildTicks += elapsed;
+      mPerf->mActive = mParent;
+    }
+
+    PerfCounters *mPerf;
+    PerfScope *mParent;
+    PERF_STAGE mStage;
+    uint64_t mStart;
+    uint64_t mChildTicks;
+  };
+}
+
+// one variable per line, scopes may nest in the same block
+#define PERF_CONCAT_(a, b)          a##b
+#define PERF_CONCAT(a, b)           PERF_CONCAT_(a, b)
+
+#if DEMUX_PERF_TIMERS
+#define PERF_SCOPE(perf, stage)     TSDemux::PerfScope PERF_CONCAT(perf_scope_, __LINE__)((perf), (stage))
+#else
+#define PERF_SCOPE(perf, stage)     do {} while (0)
+#endif
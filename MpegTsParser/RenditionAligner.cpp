@@ -0,0 +1,288 @@
+#define __STDC_FORMAT_MACROS 1
+#include "stdafx.h"
+#include "RenditionAligner.h"
+#include "TsLayer.h"
+#include "Tool.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <inttypes.h>
+#include <set>
+
+#define ALIGN_PTS_TOLERANCE     90      // 1ms of 90kHz
+#define ALIGN_PTS_WRAP          0x200000000ULL
+#define ALIGN_PTS_MASK          (ALIGN_PTS_WRAP - 1)
+
+namespace GYJ {
+
+static bool segmentStartLess(const SegmentKeys &a, const SegmentKeys &b) {
+    return a.ptsStart < b.ptsStart;
+}
+
+static double ptsMs(int64_t pts) {
+    return pts / 90.0;
+}
+
+RenditionAligner::RenditionAligner(const TSDemux::ProgramSelection &selection, TSDemux::Logger *logger)
+    : mSelection(selection), mLogger(logger ? logger : &TSDemux::Logger::Default()) {
+}
+
+RenditionAligner::~RenditionAligner() {
+}
+
+bool RenditionAligner::addRendition(const std::string &dir) {
+    Rendition rendition;
+    rendition.dir = dir;
+    regulateFilePath(rendition.dir);
+
+    if (!listFiles(rendition.dir, rendition.files)) {
+        printf("cannot read directory: '%s'\n", rendition.dir.c_str());
+        return false;
+    }
+    if (rendition.files.empty()) {
+        printf("cannot find any ts files in '%s'\n", rendition.dir.c_str());
+        return false;
+    }
+    mRenditions.push_back(rendition);
+    return true;
+}
+
+void RenditionAligner::run() {
+    // one worker per rendition, all segments of a rendition on the same worker
+    std::vector<Worker*> workers;
+    for (std::vector<Rendition>::iterator it = mRenditions.begin(); it != mRenditions.end(); ++it) {
+        Worker *worker = new Worker(mSelection, *it, *mLogger);
+        if (!worker->Start()) {
+            // no thread left: demux in place
+            worker->Process();
+        }
+        workers.push_back(worker);
+    }
+    for (std::vector<Worker*>::iterator it = workers.begin(); it != workers.end(); ++it) {
+        (*it)->Join();
+        delete *it;
+    }
+
+    unwrapTimestamps();
+    for (std::vector<Rendition>::iterator it = mRenditions.begin(); it != mRenditions.end(); ++it) {
+        std::sort(it->segments.begin(), it->segments.end(), segmentStartLess);
+    }
+}
+
+/*
+ * The segments of all the renditions on one timeline: each start is taken
+ * within half the 33 bit range of the first segment listed, so a ladder
+ * across the PTS wrap stays in order. The base is moved up a wrap so that
+ * no timestamp goes below 0, the logs print them modulo the wrap.
+ */
+void RenditionAligner::unwrapTimestamps() {
+    uint64_t base = 0;
+    bool found = false;
+    for (std::vector<Rendition>::const_iterator it = mRenditions.begin(); it != mRenditions.end() && !found; ++it) {
+        if (!it->segments.empty()) {
+            base = (it->segments.front().ptsStart & ALIGN_PTS_MASK) + ALIGN_PTS_WRAP;
+            found = true;
+        }
+    }
+    for (std::vector<Rendition>::iterator it = mRenditions.begin(); it != mRenditions.end(); ++it) {
+        for (std::vector<SegmentKeys>::iterator seg = it->segments.begin(); seg != it->segments.end(); ++seg) {
+            int64_t delta = (int64_t)((seg->ptsStart - base) & ALIGN_PTS_MASK);
+            if (delta >= (int64_t)(ALIGN_PTS_WRAP / 2)) {
+                delta -= (int64_t)ALIGN_PTS_WRAP;
+            }
+            uint64_t shift = base + delta - seg->ptsStart;
+            seg->ptsStart += shift;
+            seg->ptsEnd += shift;
+            for (std::vector<uint64_t>::iterator key = seg->keyPts.begin(); key != seg->keyPts.end(); ++key) {
+                *key += shift;
+            }
+        }
+    }
+}
+
+void RenditionAligner::Worker::Process() {
+    for (std::vector<std::string>::const_iterator it = mRendition.files.begin(); it != mRendition.files.end(); ++it) {
+        SegmentKeys segment;
+        segment.name = *it;
+        if (demuxSegment(mSelection, mRendition.dir + *it, segment, &mLogger)) {
+            mRendition.segments.push_back(segment);
+        }
+    }
+}
+
+bool RenditionAligner::demuxSegment(const TSDemux::ProgramSelection &selection, const std::string &path, SegmentKeys &segment, TSDemux::Logger *logger) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        printf("cannot open file: '%s'\n", path.c_str());
+        return false;
+    }
+
+    TsLayer *demux = new TsLayer(file, selection, 0, logger);
+    demux->enableGopAnalysis();
+    demux->doDemux();
+
+    // video of the first selected program
+    uint16_t videoPid = 0xffff;
+    std::vector<TSDemux::Program> programs = demux->getPrograms();
+    for (std::vector<TSDemux::Program>::const_iterator pg = programs.begin(); pg != programs.end() && videoPid == 0xffff; ++pg) {
+        if (pg->selected) {
+            videoPid = pg->GetVideoPid();
+        }
+    }
+
+    std::map<uint16_t, TSDemux::GOP_STATS> gopStats = demux->getGopStats();
+    std::map<uint16_t, TSDemux::GOP_STATS>::const_iterator st = gopStats.find(videoPid);
+    if (st != gopStats.end() && st->second.ptsMin != PTS_UNSET) {
+        const TSDemux::GOP_STATS &stats = st->second;
+        segment.valid = true;
+        segment.startsWithRandomAccess = stats.startsWithRandomAccess;
+        segment.ptsStart = stats.ptsMin;
+        segment.ptsEnd = stats.ptsMax + stats.frameDuration;
+        segment.keyPts = stats.randomAccessPts;
+    }
+
+    std::list<TSDemux::STREAM_PKT*> *lst = demux->getParseredData();
+    for (std::list<TSDemux::STREAM_PKT*>::iterator it = lst->begin(); it != lst->end(); ++it) {
+        delete *it;
+    }
+    delete lst;
+    delete demux;
+    fclose(file);
+    return segment.valid;
+}
+
+int RenditionAligner::report() {
+    if (mRenditions.empty()) {
+        return 0;
+    }
+
+    const Rendition &reference = mRenditions[0];
+    int errors = 0;
+    for (std::vector<Rendition>::const_iterator it = mRenditions.begin(); it != mRenditions.end(); ++it) {
+        size_t keys = 0;
+        for (std::vector<SegmentKeys>::const_iterator seg = it->segments.begin(); seg != it->segments.end(); ++seg) {
+            keys += seg->keyPts.size();
+        }
+        DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[ALIGN] rendition %s segments:%u keyframes:%u \n", it->dir.c_str(), (unsigned)it->segments.size(), (unsigned)keys);
+        if (it == mRenditions.begin()) {
+            continue;
+        }
+
+        int renditionErrors = compareSegments(reference, *it);
+        int keyErrors = compareKeys(reference, *it);
+        printf("[ALIGN] %s: segment misalignments:%d keyframe mismatches:%d \n", it->dir.c_str(), renditionErrors, keyErrors);
+        errors += renditionErrors;
+    }
+    if (mRenditions.size() > 1) {
+        printf("[ALIGN] %u renditions %s\n", (unsigned)mRenditions.size(), errors ? "NOT aligned" : "aligned");
+    }
+    return errors;
+}
+
+/*
+ * Segment boundaries: the segments are paired by start PTS, a segment with
+ * no match in the other rendition is missing. Each pair starts on a random
+ * access point and lasts as long.
+ */
+int RenditionAligner::compareSegments(const Rendition &reference, const Rendition &rendition) {
+    int errors = 0;
+
+    // merge of the two sorted lists
+    std::vector<SegmentKeys>::const_iterator r = reference.segments.begin();
+    std::vector<SegmentKeys>::const_iterator s = rendition.segments.begin();
+    while (r != reference.segments.end() || s != rendition.segments.end()) {
+        bool logged = errors < ALIGN_MAX_REPORTED;
+        int64_t startDelta = 0;
+        if (r != reference.segments.end() && s != rendition.segments.end()) {
+            startDelta = (int64_t)(s->ptsStart - r->ptsStart);
+        }
+
+        if (s == rendition.segments.end() || (r != reference.segments.end() && startDelta > ALIGN_PTS_TOLERANCE)) {
+            if (logged) {
+                DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[ALIGN] %s: no segment at pts %" PRIu64 " of %s%s \n", rendition.dir.c_str(),
+                    (uint64_t)(r->ptsStart & ALIGN_PTS_MASK), reference.dir.c_str(), r->name.c_str());
+            }
+            errors++;
+            ++r;
+            continue;
+        }
+        if (r == reference.segments.end() || startDelta < -ALIGN_PTS_TOLERANCE) {
+            if (logged) {
+                DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[ALIGN] %s%s: starts at pts %" PRIu64 ", no segment there in %s \n", rendition.dir.c_str(),
+                    s->name.c_str(), (uint64_t)(s->ptsStart & ALIGN_PTS_MASK), reference.dir.c_str());
+            }
+            errors++;
+            ++s;
+            continue;
+        }
+
+        if (!s->startsWithRandomAccess) {
+            if (logged) {
+                DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[ALIGN] %s%s: does not start with a random access point \n", rendition.dir.c_str(), s->name.c_str());
+            }
+            errors++;
+        }
+
+        int64_t durationDelta = (int64_t)(s->ptsEnd - s->ptsStart) - (int64_t)(r->ptsEnd - r->ptsStart);
+        if (durationDelta > ALIGN_PTS_TOLERANCE || durationDelta < -ALIGN_PTS_TOLERANCE) {
+            if (logged) {
+                DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[ALIGN] %s%s: duration %.3fms, %.3fms in %s \n", rendition.dir.c_str(), s->name.c_str(),
+                    ptsMs(s->ptsEnd - s->ptsStart), ptsMs(r->ptsEnd - r->ptsStart), r->name.c_str());
+            }
+            errors++;
+        }
+        ++r;
+        ++s;
+    }
+    return errors;
+}
+
+/*
+ * Keyframes inside the common span that are not at the same PTS in both
+ * renditions (scene cuts may differ, only segment boundaries are errors).
+ */
+int RenditionAligner::compareKeys(const Rendition &reference, const Rendition &rendition) {
+    if (reference.segments.empty() || rendition.segments.empty()) {
+        return 0;
+    }
+
+    std::set<uint64_t> refKeys;
+    std::set<uint64_t> keys;
+    for (std::vector<SegmentKeys>::const_iterator seg = reference.segments.begin(); seg != reference.segments.end(); ++seg) {
+        refKeys.insert(seg->keyPts.begin(), seg->keyPts.end());
+    }
+    for (std::vector<SegmentKeys>::const_iterator seg = rendition.segments.begin(); seg != rendition.segments.end(); ++seg) {
+        keys.insert(seg->keyPts.begin(), seg->keyPts.end());
+    }
+
+    uint64_t spanStart = std::max(reference.segments.front().ptsStart, rendition.segments.front().ptsStart);
+    uint64_t spanEnd = std::min(reference.segments.back().ptsEnd, rendition.segments.back().ptsEnd);
+
+    // merge of the two sorted lists
+    int mismatches = 0;
+    std::set<uint64_t>::const_iterator r = refKeys.begin();
+    std::set<uint64_t>::const_iterator k = keys.begin();
+    while (r != refKeys.end() || k != keys.end()) {
+        uint64_t pts;
+        const char *missing;
+        if (k == keys.end() || (r != refKeys.end() && *r < *k)) {
+            pts = *r++;
+            missing = rendition.dir.c_str();
+        } else if (r == refKeys.end() || *k < *r) {
+            pts = *k++;
+            missing = reference.dir.c_str();
+        } else {
+            ++r;
+            ++k;
+            continue;
+        }
+        if (pts < spanStart || pts >= spanEnd) {
+            continue;
+        }
+        if (mismatches++ < ALIGN_MAX_REPORTED) {
+            DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[ALIGN] keyframe at pts %" PRIu64 " (%.3fs) missing in %s \n", (uint64_t)(pts & ALIGN_PTS_MASK), (pts & ALIGN_PTS_MASK) / 90000.0, missing);
+        }
+    }
+    return mismatches;
+}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "tsProgram.h"
+#include "thread.h"
+#include "debug.h"
+
+namespace GYJ {
+
+#define ALIGN_MAX_REPORTED      10      // misalignments logged per rendition
+
+typedef struct SegmentKeys {
+    SegmentKeys() : valid(false), startsWithRandomAccess(false), ptsStart(0), ptsEnd(0) {}
+    std::string name;
+    bool valid;                         // video frames found
+    bool startsWithRandomAccess;
+    uint64_t ptsStart;                  // 90kHz, first presented frame
+    uint64_t ptsEnd;                    // 90kHz, end of the last presented frame
+    std::vector<uint64_t> keyPts;       // random access points
+} SegmentKeys;
+
+typedef struct Rendition {
+    std::string dir;
+    std::vector<std::string> files;
+    std::vector<SegmentKeys> segments;  // by start PTS once demuxed
+} Rendition;
+
+/*
+ * IDR/IRAP alignment of the renditions of an ABR ladder: every rendition
+ * directory is demuxed by its own worker, then the segment boundaries and
+ * keyframe PTS lists are merged against the first rendition.
+ */
+class RenditionAligner
+{
+public:
+    // no logger: the default one
+    explicit RenditionAligner(const TSDemux::ProgramSelection &selection, TSDemux::Logger *logger = NULL);
+    ~RenditionAligner();
+
+    bool addRendition(const std::string &dir);
+    void run();
+    // returns the number of misalignments
+    int report();
+
+private:
+    class Worker : public TSDemux::PLATFORM::CThread
+    {
+    public:
+        // the demuxers of a rendition log through the sink of the aligner, tagged with its directory
+        Worker(const TSDemux::ProgramSelection &selection, Rendition &rendition, const TSDemux::Logger &logger)
+            : mSelection(selection), mRendition(rendition), mLogger(logger) {
+            mLogger.SetTag("[" + rendition.dir + "] ");
+        }
+        virtual ~Worker() { Join(); }
+        virtual void Process();
+    private:
+        const TSDemux::ProgramSelection &mSelection;
+        Rendition &mRendition;
+        TSDemux::Logger mLogger;
+    };
+
+    static bool demuxSegment(const TSDemux::ProgramSelection &selection, const std::string &path, SegmentKeys &segment, TSDemux::Logger *logger);
+    int compareSegments(const Rendition &reference, const Rendition &rendition);
+    int compareKeys(const Rendition &reference, const Rendition &rendition);
+    void unwrapTimestamps();
+
+    TSDemux::ProgramSelection mSelection;
+    std::vector<Rendition> mRenditions;
+    TSDemux::Logger *mLogger;
+};
+}
@@ -0,0 +1,336 @@
+#include "stdafx.h"
+#include "ResultCache.h"
+
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC             "tsparser-cache"
+
+namespace GYJ {
+
+static uint64_t fnv1a(uint64_t hash, const unsigned char *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// one line without its end of line, false at the end of the file
+static bool readLine(FILE *file, std::string &line) {
+    char buffer[4096];
+    line.clear();
+    while (fgets(buffer, sizeof(buffer), file) != NULL) {
+        line.append(buffer);
+        if (!line.empty() && line[line.size() - 1] == '\n') {
+            line.erase(line.size() - 1);
+            return true;
+        }
+    }
+    return !line.empty();
+}
+
+static bool readInt(const char *&p, int64_t &value) {
+    long long v = 0;
+    int n = 0;
+    if (sscanf(p, " %lld%n", &v, &n) != 1) {
+        return false;
+    }
+    p += n;
+    value = v;
+    return true;
+}
+
+static bool readUInt(const char *&p, uint64_t &value) {
+    unsigned long long v = 0;
+    int n = 0;
+    if (sscanf(p, " %llu%n", &v, &n) != 1) {
+        return false;
+    }
+    p += n;
+    value = v;
+    return true;
+}
+
+static bool readUInt32(const char *&p, uint32_t &value) {
+    uint64_t v = 0;
+    if (!readUInt(p, v)) {
+        return false;
+    }
+    value = (uint32_t)v;
+    return true;
+}
+
+// the rest of the line after the separating space
+static std::string readName(const char *p) {
+    return *p == ' ' ? std::string(p + 1) : std::string(p);
+}
+
+static void writeSteps(FILE *file, char tag, const std::map<int64_t, uint32_t> &steps) {
+    fprintf(file, "%c %u", tag, (unsigned)steps.size());
+    for (std::map<int64_t, uint32_t>::const_iterator it = steps.begin(); it != steps.end(); ++it) {
+        fprintf(file, " %lld:%u", (long long)it->first, it->second);
+    }
+    fprintf(file, "\n");
+}
+
+static void writeSteps(FILE *file, char tag, const std::set<int64_t> &steps) {
+    fprintf(file, "%c %u", tag, (unsigned)steps.size());
+    for (std::set<int64_t>::const_iterator it = steps.begin(); it != steps.end(); ++it) {
+        fprintf(file, " %lld", (long long)*it);
+    }
+    fprintf(file, "\n");
+}
+
+static bool readSteps(FILE *file, char tag, std::map<int64_t, uint32_t> &steps) {
+    std::string line;
+    if (!readLine(file, line) || line.size() < 2 || line[0] != tag) {
+        return false;
+    }
+    const char *p = line.c_str() + 1;
+    uint64_t count = 0;
+    if (!readUInt(p, count)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        int64_t distance = 0;
+        uint32_t frames = 0;
+        if (!readInt(p, distance) || *p++ != ':' || !readUInt32(p, frames)) {
+            return false;
+        }
+        steps[distance] = frames;
+    }
+    return true;
+}
+
+static bool readSteps(FILE *file, char tag, std::set<int64_t> &steps) {
+    std::string line;
+    if (!readLine(file, line) || line.size() < 2 || line[0] != tag) {
+        return false;
+    }
+    const char *p = line.c_str() + 1;
+    uint64_t count = 0;
+    if (!readUInt(p, count)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        int64_t distance = 0;
+        if (!readInt(p, distance)) {
+            return false;
+        }
+        steps.insert(distance);
+    }
+    return true;
+}
+
+ResultCache::ResultCache(const std::string &config) : mConfig(config), mDirty(false), mHits(0), mMisses(0) {
+}
+
+ResultCache::~ResultCache() {
+}
+
+bool ResultCache::takeFingerprint(const std::string &path, FileFingerprint &fingerprint) {
+#if defined(_MSC_VER)
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0) {
+        return false;
+    }
+    fingerprint.mtime = (int64_t)st.st_mtime * 1000000000;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+#if defined(__linux__)
+    fingerprint.mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    fingerprint.mtime = (int64_t)st.st_mtime * 1000000000;
+#endif
+#endif
+    fingerprint.size = st.st_size;
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        return false;
+    }
+    std::vector<unsigned char> block(CACHE_HASH_BLOCK);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t n = fread(&block[0], 1, block.size(), file);
+    hash = fnv1a(hash, &block[0], n);
+    if (fingerprint.size > CACHE_HASH_BLOCK && fseek(file, -(long)CACHE_HASH_BLOCK, SEEK_END) == 0) {
+        n = fread(&block[0], 1, block.size(), file);
+        hash = fnv1a(hash, &block[0], n);
+    }
+    fclose(file);
+    fingerprint.hash = hash;
+    return true;
+}
+
+tsParam *ResultCache::lookup(const std::string &path, const std::string &name, FileFingerprint &fingerprint) {
+    fingerprint = FileFingerprint();
+    bool valid = takeFingerprint(path, fingerprint);
+
+    TSDemux::PLATFORM::CLockObject lock(mMutex);
+    std::map<std::string, CacheEntry>::const_iterator it = mEntries.find(path);
+    if (!valid || it == mEntries.end() || !(it->second.fingerprint == fingerprint)) {
+        mMisses++;
+        return NULL;
+    }
+    mHits++;
+
+    tsParam *param = new tsParam(name, it->second.startTime, new std::list<TSDemux::STREAM_PKT*>, std::vector<TSDemux::Program>());
+    param->cached = true;
+    param->summaries = it->second.summaries;
+    return param;
+}
+
+void ResultCache::store(const std::string &path, const FileFingerprint &fingerprint, const tsParam *param) {
+    if (param == NULL || fingerprint.size == 0) {
+        return;
+    }
+
+    CacheEntry entry;
+    entry.fingerprint = fingerprint;
+    entry.startTime = param->tsStartTime;
+    ParseredDataContainer::summarize(param, entry.summaries);
+
+    TSDemux::PLATFORM::CLockObject lock(mMutex);
+    mEntries[path] = entry;
+    mDirty = true;
+}
+
+void ResultCache::writeSummary(FILE *file, const ProgramSummary &s) {
+    fprintf(file, "P %u %d %d %u %lld %lld %lld %u %lld %lld %lld %u %llu %lld %llu %u %u %s\n",
+        s.program, s.videoPid, s.audioPid,
+        s.videoFrames, (long long)s.videoFirstPts, (long long)s.videoFirstDts, (long long)s.videoLastPts,
+        s.audioFrames, (long long)s.audioFirstPts, (long long)s.audioFirstDts, (long long)s.audioLastPts,
+        s.pcrCount, (unsigned long long)s.pcrFirst, (long long)s.pcrFirstDts, (unsigned long long)s.pcrLast,
+        s.pcrErrors, s.ptsDtsErrors, s.name.c_str());
+    writeSteps(file, 'V', s.videoPtsSteps);
+    writeSteps(file, 'v', s.videoDtsSteps);
+    writeSteps(file, 'A', s.audioPtsSteps);
+    writeSteps(file, 'a', s.audioDtsSteps);
+}
+
+bool ResultCache::readSummary(FILE *file, ProgramSummary &s) {
+    std::string line;
+    if (!readLine(file, line) || line.size() < 2 || line[0] != 'P') {
+        return false;
+    }
+    const char *p = line.c_str() + 1;
+    uint32_t program = 0;
+    int64_t videoPid = 0;
+    int64_t audioPid = 0;
+    if (!readUInt32(p, program) || !readInt(p, videoPid) || !readInt(p, audioPid)
+        || !readUInt32(p, s.videoFrames) || !readInt(p, s.videoFirstPts) || !readInt(p, s.videoFirstDts) || !readInt(p, s.videoLastPts)
+        || !readUInt32(p, s.audioFrames) || !readInt(p, s.audioFirstPts) || !readInt(p, s.audioFirstDts) || !readInt(p, s.audioLastPts)
+        || !readUInt32(p, s.pcrCount) || !readUInt(p, s.pcrFirst) || !readInt(p, s.pcrFirstDts) || !readUInt(p, s.pcrLast)
+        || !readUInt32(p, s.pcrErrors) || !readUInt32(p, s.ptsDtsErrors)) {
+        return false;
+    }
+    s.program = (uint16_t)program;
+    s.videoPid = (int)videoPid;
+    s.audioPid = (int)audioPid;
+    s.name = readName(p);
+    return readSteps(file, 'V', s.videoPtsSteps) && readSteps(file, 'v', s.videoDtsSteps)
+        && readSteps(file, 'A', s.audioPtsSteps) && readSteps(file, 'a', s.audioDtsSteps);
+}
+
+bool ResultCache::load(const std::string &file) {
+    FILE *in = fopen(file.c_str(), "r");
+    if (in == NULL) {
+        return true;
+    }
+
+    std::string line;
+    bool valid = readLine(in, line);
+    int version = 0;
+    int n = 0;
+    if (valid) {
+        valid = sscanf(line.c_str(), CACHE_MAGIC " %d%n", &version, &n) == 1 && version == CACHE_VERSION;
+    }
+    if (!valid) {
+        fclose(in);
+        mDirty = true;
+        return false;
+    }
+    if (readName(line.c_str() + n) != mConfig) {
+        // made with another selection, rebuilt from this run
+        fclose(in);
+        mDirty = true;
+        return true;
+    }
+
+    std::map<std::string, CacheEntry> entries;
+    while (valid && readLine(in, line)) {
+        if (line.size() < 2 || line[0] != 'F') {
+            valid = false;
+            break;
+        }
+        const char *p = line.c_str() + 1;
+        CacheEntry entry;
+        uint64_t hash = 0;
+        uint64_t count = 0;
+        if (!readUInt(p, entry.fingerprint.size) || !readInt(p, entry.fingerprint.mtime) || !readUInt(p, hash)
+            || !readInt(p, entry.startTime) || !readUInt(p, count)) {
+            valid = false;
+            break;
+        }
+        entry.fingerprint.hash = hash;
+        std::string path = readName(p);
+        entry.summaries.resize((size_t)count);
+        for (size_t i = 0; valid && i < entry.summaries.size(); i++) {
+            valid = readSummary(in, entry.summaries[i]);
+        }
+        entries[path] = entry;
+    }
+    fclose(in);
+
+    if (!valid) {
+        mDirty = true;
+        return false;
+    }
+    TSDemux::PLATFORM::CLockObject lock(mMutex);
+    mEntries.swap(entries);
+    return true;
+}
+
+bool ResultCache::save(const std::string &file) {
+    TSDemux::PLATFORM::CLockObject lock(mMutex);
+    if (!mDirty) {
+        return true;
+    }
+
+    std::string temp = file + ".tmp";
+    FILE *out = fopen(temp.c_str(), "w");
+    if (out == NULL) {
+        return false;
+    }
+    fprintf(out, CACHE_MAGIC " %d %s\n", CACHE_VERSION, mConfig.c_str());
+    for (std::map<std::string, CacheEntry>::const_iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+        const CacheEntry &entry = it->second;
+        fprintf(out, "F %llu %lld %llu %lld %u %s\n", (unsigned long long)entry.fingerprint.size, (long long)entry.fingerprint.mtime,
+            (unsigned long long)entry.fingerprint.hash, (long long)entry.startTime, (unsigned)entry.summaries.size(), it->first.c_str());
+        for (std::vector<ProgramSummary>::const_iterator s = entry.summaries.begin(); s != entry.summaries.end(); ++s) {
+            writeSummary(out, *s);
+        }
+    }
+    bool written = fflush(out) == 0 && !ferror(out);
+    written = fclose(out) == 0 && written;
+    if (!written) {
+        remove(temp.c_str());
+        return false;
+    }
+
+#if defined(_MSC_VER)
+    remove(file.c_str());
+#endif
+    if (rename(temp.c_str(), file.c_str()) != 0) {
+        remove(temp.c_str());
+        return false;
+    }
+    mDirty = false;
+    return true;
+}
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "ParserdDataContainer.h"
+#include "mutex.h"
+
+namespace GYJ {
+
+#define CACHE_VERSION           1
+#define CACHE_HASH_BLOCK        65536   // bytes hashed at the head and at the tail of a file
+
+// identity of a file content without reading all of it
+typedef struct FileFingerprint {
+    FileFingerprint() : size(0), mtime(0), hash(0) {}
+    bool operator==(const FileFingerprint &other) const {
+        return size == other.size && mtime == other.mtime && hash == other.hash;
+    }
+    uint64_t size;
+    int64_t mtime;                      // ns
+    uint64_t hash;                      // FNV-1a of the head and tail blocks
+} FileFingerprint;
+
+/*
+ * Timestamp check results of the segments of earlier runs, kept in a file
+ * between runs. A segment whose size, modification time and head and tail
+ * blocks are unchanged is not demuxed again: its program summaries go
+ * through the continuity checks of the ParseredDataContainer instead.
+ * The cache is dropped when the program selection differs from the one it
+ * was made with.
+ */
+class ResultCache
+{
+public:
+    // config: the options the summaries depend on
+    explicit ResultCache(const std::string &config);
+    ~ResultCache();
+
+    // a missing file is an empty cache, false if it cannot be parsed
+    bool load(const std::string &file);
+    // written aside and renamed over file, nothing done if unchanged
+    bool save(const std::string &file);
+
+    // the cached segment of path, NULL if unknown or changed; fingerprint is set for store()
+    tsParam *lookup(const std::string &path, const std::string &name, FileFingerprint &fingerprint);
+    // summaries of a demuxed segment, under the fingerprint taken before its demux
+    void store(const std::string &path, const FileFingerprint &fingerprint, const tsParam *param);
+
+    size_t getHits() const { return mHits; }
+    size_t getMisses() const { return mMisses; }
+
+private:
+    typedef struct CacheEntry {
+        CacheEntry() : startTime(0) {}
+        FileFingerprint fingerprint;
+        int64_t startTime;
+        std::vector<ProgramSummary> summaries;
+    } CacheEntry;
+
+    static bool takeFingerprint(const std::string &path, FileFingerprint &fingerprint);
+    static void writeSummary(FILE *file, const ProgramSummary &summary);
+    static bool readSummary(FILE *file, ProgramSummary &summary);
+
+    std::string mConfig;
+    std::map<std::string, CacheEntry> mEntries;     // by path
+    bool mDirty;
+    size_t mHits;
+    size_t mMisses;
+    TSDemux::PLATFORM::CMutex mMutex;               // lookups and stores come from the prefetch workers
+};
+}
@@ -0,0 +1,470 @@
+#include "SectionFilter.h"
+#include "debug.h"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace TSDemux;
+
+static uint32_t s_crcTable[256];
+
+static bool initCrcTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : (crc << 1);
+        }
+        s_crcTable[i] = crc;
+    }
+    return true;
+}
+
+static bool s_crcTableReady = initCrcTable();
+
+static inline bool isEitTable(uint8_t tableId) {
+    return tableId >= 0x4e && tableId <= 0x6f;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/////
+/////  Section buffer pool
+/////
+
+SectionPool::SectionPool() : mAllocated(0), mLogger(&Logger::Default()) {
+    mFree.reserve(SECTION_POOL_PREALLOC);
+    for (int i = 0; i < SECTION_POOL_PREALLOC; i++) {
+        mFree.push_back((Buffer*)malloc(sizeof(Buffer)));
+        mAllocated++;
+    }
+}
+
+SectionPool::~SectionPool() {
+    // buffers still held by a filter are released by SectionDemux before
+    for (std::vector<Buffer*>::iterator it = mFree.begin(); it != mFree.end(); ++it) {
+        free(*it);
+    }
+}
+
+SectionPool::Buffer *SectionPool::acquire() {
+    Buffer *buffer = NULL;
+    if (!mFree.empty()) {
+        buffer = mFree.back();
+        mFree.pop_back();
+    } else {
+        buffer = (Buffer*)malloc(sizeof(Buffer));
+        mAllocated++;
+        DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: section pool grows to %zu buffers\n", __FUNCTION__, mAllocated);
+    }
+    if (buffer) {
+        buffer->len = 0;
+    }
+    return buffer;
+}
+
+void SectionPool::release(Buffer *buffer) {
+    if (buffer) {
+        mFree.push_back(buffer);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/////
+/////  Section demux
+/////
+
+SectionDemux::SectionDemux() : mNextFilterId(1), mLogger(&Logger::Default()) {
+    memset(mPids, 0, sizeof(mPids));
+}
+
+SectionDemux::~SectionDemux() {
+    for (std::map<int, Filter*>::iterator it = mFilters.begin(); it != mFilters.end(); ++it) {
+        releaseFilter(it->second);
+        delete it->second;
+    }
+    mFilters.clear();
+
+    for (int pid = 0; pid < TS_PID_COUNT; pid++) {
+        if (mPids[pid]) {
+            mPool.release(mPids[pid]->current);
+            delete mPids[pid];
+            mPids[pid] = NULL;
+        }
+    }
+}
+
+uint32_t SectionDemux::crc32(const unsigned char *data, size_t len) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc << 8) ^ s_crcTable[((crc >> 24) ^ data[i]) & 0xff];
+    }
+    return crc;
+}
+
+/*
+ * Register a filter for sections of PID whose table_id matches
+ * (table_id & mask) == (tableId & mask). The listener is called from the
+ * demux thread and must not add or remove filters from its callbacks.
+ *
+ * returns the filter id, or -1 on error.
+ */
+int SectionDemux::addFilter(uint16_t pid, uint8_t tableId, uint8_t mask, int flags, SectionListener *listener) {
+    if (pid >= TS_PID_COUNT || listener == NULL || (flags & (SECTION_FILTER_SECTIONS | SECTION_FILTER_TABLES)) == 0) {
+        return -1;
+    }
+
+    Filter *filter = new Filter;
+    filter->id = mNextFilterId++;
+    filter->pid = pid;
+    filter->tableId = tableId;
+    filter->mask = mask;
+    filter->flags = flags;
+    filter->listener = listener;
+    mFilters.insert(std::make_pair(filter->id, filter));
+
+    PidAssembler *assembler = mPids[pid];
+    if (assembler == NULL) {
+        assembler = new PidAssembler;
+        assembler->continuity = 0xff;
+        assembler->waitUnitStart = true;
+        assembler->current = NULL;
+        assembler->expected = 0;
+        mPids[pid] = assembler;
+    }
+    assembler->filters.push_back(filter);
+
+    DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: filter %d on PID %.4x table %.2x/%.2x\n", __FUNCTION__, filter->id, pid, tableId, mask);
+    return filter->id;
+}
+
+void SectionDemux::removeFilter(int filterId) {
+    std::map<int, Filter*>::iterator it = mFilters.find(filterId);
+    if (it == mFilters.end()) {
+        return;
+    }
+
+    Filter *filter = it->second;
+    PidAssembler *assembler = mPids[filter->pid];
+    if (assembler != NULL) {
+        for (std::vector<Filter*>::iterator f = assembler->filters.begin(); f != assembler->filters.end(); ++f) {
+            if (*f == filter) {
+                assembler->filters.erase(f);
+                break;
+            }
+        }
+        if (assembler->filters.empty()) {
+            mPool.release(assembler->current);
+            delete assembler;
+            mPids[filter->pid] = NULL;
+        }
+    }
+
+    releaseFilter(filter);
+    delete filter;
+    mFilters.erase(it);
+}
+
+/*
+ * Drop all partial sections and collected tables, filters stay registered.
+ */
+void SectionDemux::reset() {
+    for (int pid = 0; pid < TS_PID_COUNT; pid++) {
+        PidAssembler *assembler = mPids[pid];
+        if (assembler) {
+            mPool.release(assembler->current);
+            assembler->current = NULL;
+            assembler->continuity = 0xff;
+            assembler->waitUnitStart = true;
+        }
+    }
+    for (std::map<int, Filter*>::iterator it = mFilters.begin(); it != mFilters.end(); ++it) {
+        releaseFilter(it->second);
+    }
+}
+
+void SectionDemux::pushPayload(uint16_t pid, bool unitStart, uint8_t cc, bool discontinuity, const unsigned char *payload, size_t len) {
+    PidAssembler *assembler = mPids[pid & 0x1fff];
+    if (assembler == NULL || payload == NULL || len == 0) {
+        return;
+    }
+
+    if (assembler->continuity != 0xff && !discontinuity) {
+        if (cc == assembler->continuity) {
+            // duplicate packet
+            return;
+        }
+        if (((assembler->continuity + 1) & 0x0f) != cc) {
+            DEMUX_LOG(mLogger, DEMUX_DBG_WARN, "PID %.4x section discontinuity detected: found %u, expected %u\n", pid, cc, (assembler->continuity + 1) & 0x0f);
+            mPool.release(assembler->current);
+            assembler->current = NULL;
+            assembler->waitUnitStart = true;
+        }
+    }
+    assembler->continuity = cc;
+
+    if (!unitStart) {
+        if (!assembler->waitUnitStart && assembler->current) {
+            appendSection(assembler, pid, payload, len);
+        }
+        return;
+    }
+
+    // pointer field: bytes before it end the section started in a previous packet
+    size_t pointer = payload[0];
+    if (pointer + 1 > len) {
+        mPool.release(assembler->current);
+        assembler->current = NULL;
+        assembler->waitUnitStart = true;
+        return;
+    }
+    const unsigned char *p = payload + 1;
+    size_t n = len - 1;
+    if (assembler->current) {
+        if (!assembler->waitUnitStart && pointer > 0) {
+            appendSection(assembler, pid, p, pointer);
+        }
+        // still incomplete: section was truncated
+        mPool.release(assembler->current);
+        assembler->current = NULL;
+    }
+    p += pointer;
+    n -= pointer;
+    assembler->waitUnitStart = false;
+
+    // several sections may start in the same packet, 0xff is stuffing
+    while (n > 0 && p[0] != 0xff) {
+        startSection(assembler);
+        if (assembler->current == NULL) {
+            break;
+        }
+        size_t used = appendSection(assembler, pid, p, n);
+        p += used;
+        n -= used;
+        if (assembler->current) {
+            break;
+        }
+    }
+}
+
+void SectionDemux::startSection(PidAssembler *assembler) {
+    assembler->current = mPool.acquire();
+    assembler->expected = 0;
+}
+
+size_t SectionDemux::appendSection(PidAssembler *assembler, uint16_t pid, const unsigned char *data, size_t len) {
+    SectionPool::Buffer *buffer = assembler->current;
+    size_t used = 0;
+
+    if (buffer == NULL) {
+        return len;
+    }
+
+    if (buffer->len < SECTION_HEADER_SIZE) {
+        size_t n = SECTION_HEADER_SIZE - buffer->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(buffer->data + buffer->len, data, n);
+        buffer->len += n;
+        used += n;
+        if (buffer->len < SECTION_HEADER_SIZE) {
+            return used;
+        }
+
+        assembler->expected = SECTION_HEADER_SIZE + (((buffer->data[1] & 0x0f) << 8) | buffer->data[2]);
+        if (assembler->expected > SECTION_MAX_SIZE) {
+            DEMUX_LOG(mLogger, DEMUX_DBG_WARN, "PID %.4x invalid section length %zu\n", pid, assembler->expected);
+            mPool.release(buffer);
+            assembler->current = NULL;
+            assembler->waitUnitStart = true;
+            return len;
+        }
+    }
+
+    size_t n = assembler->expected - buffer->len;
+    if (n > len - used) {
+        n = len - used;
+    }
+    memcpy(buffer->data + buffer->len, data + used, n);
+    buffer->len += n;
+    used += n;
+
+    if (buffer->len == assembler->expected) {
+        completeSection(assembler, pid);
+    }
+    return used;
+}
+
+void SectionDemux::completeSection(PidAssembler *assembler, uint16_t pid) {
+    SectionPool::Buffer *buffer = assembler->current;
+    assembler->current = NULL;
+
+    PSI_SECTION &section = buffer->section;
+    const unsigned char *data = buffer->data;
+    section.pid = pid;
+    section.table_id = data[0];
+    section.syntax_indicator = (data[1] & 0x80) != 0;
+    section.data = data;
+    section.len = buffer->len;
+
+    bool crcValid = true;
+    if (section.syntax_indicator) {
+        // extension, version, section numbers and CRC32
+        if (buffer->len < SECTION_HEADER_SIZE + 9) {
+            mPool.release(buffer);
+            return;
+        }
+        section.table_id_extension = (data[3] << 8) | data[4];
+        section.version = (data[5] & 0x3e) >> 1;
+        section.current_next = (data[5] & 0x01) != 0;
+        section.section_number = data[6];
+        section.last_section_number = data[7];
+        crcValid = crc32(data, buffer->len) == 0;
+        if (!crcValid) {
+            DEMUX_LOG(mLogger, DEMUX_DBG_WARN, "PID %.4x table %.2x section %u: CRC32 mismatch\n", pid, section.table_id, section.section_number);
+        }
+    } else {
+        section.table_id_extension = 0;
+        section.version = 0;
+        section.current_next = true;
+        section.section_number = 0;
+        section.last_section_number = 0;
+    }
+
+    for (std::vector<Filter*>::iterator it = assembler->filters.begin(); it != assembler->filters.end(); ++it) {
+        Filter *filter = *it;
+        if (((section.table_id ^ filter->tableId) & filter->mask) != 0) {
+            continue;
+        }
+        if (!crcValid && !(filter->flags & SECTION_FILTER_NO_CRC)) {
+            continue;
+        }
+        if (filter->flags & SECTION_FILTER_SECTIONS) {
+            filter->listener->onSection(filter->id, section);
+        }
+        if (filter->flags & SECTION_FILTER_TABLES) {
+            collectSection(filter, section);
+        }
+    }
+
+    mPool.release(buffer);
+}
+
+void SectionDemux::collectSection(Filter *filter, const PSI_SECTION &section) {
+    if (!section.syntax_indicator) {
+        // short form sections (TDT, ...) are complete tables by themselves
+        PSI_TABLE table;
+        table.pid = section.pid;
+        table.table_id = section.table_id;
+        table.table_id_extension = 0;
+        table.version = 0;
+        table.sections.push_back(&section);
+        filter->listener->onTable(filter->id, table);
+        return;
+    }
+
+    if (!section.current_next) {
+        return;
+    }
+
+    uint64_t key = ((uint64_t)section.table_id << 48) | ((uint64_t)section.table_id_extension << 32);
+    if (isEitTable(section.table_id) && section.len >= 14) {
+        // EIT: a service is identified by transport_stream_id and original_network_id too
+        key |= ((uint64_t)section.data[8] << 24) | (section.data[9] << 16) | (section.data[10] << 8) | section.data[11];
+    }
+
+    TableState *table = NULL;
+    std::map<uint64_t, TableState*>::iterator it = filter->tables.find(key);
+    if (it == filter->tables.end()) {
+        table = new TableState;
+        memset(table, 0, sizeof(TableState));
+        table->version = 0xff;
+        table->deliveredVersion = 0xff;
+        filter->tables.insert(std::make_pair(key, table));
+    } else {
+        table = it->second;
+    }
+
+    if ((filter->flags & SECTION_FILTER_VERSION_CHANGE) && section.version == table->deliveredVersion) {
+        return;
+    }
+
+    if (section.version != table->version || section.last_section_number != table->lastSection) {
+        releaseTable(table);
+        table->version = section.version;
+        table->lastSection = section.last_section_number;
+    }
+
+    if (section.section_number > table->lastSection || table->sections[section.section_number] != NULL) {
+        return;
+    }
+
+    SectionPool::Buffer *copy = mPool.acquire();
+    if (copy == NULL) {
+        return;
+    }
+    memcpy(copy->data, section.data, section.len);
+    copy->len = section.len;
+    copy->section = section;
+    copy->section.data = copy->data;
+    table->sections[section.section_number] = copy;
+
+    if (!isTableComplete(table, section.table_id)) {
+        return;
+    }
+
+    PSI_TABLE complete;
+    complete.pid = section.pid;
+    complete.table_id = section.table_id;
+    complete.table_id_extension = section.table_id_extension;
+    complete.version = section.version;
+    for (int i = 0; i <= table->lastSection; i++) {
+        if (table->sections[i]) {
+            complete.sections.push_back(&table->sections[i]->section);
+        }
+    }
+    filter->listener->onTable(filter->id, complete);
+
+    table->deliveredVersion = section.version;
+    releaseTable(table);
+}
+
+bool SectionDemux::isTableComplete(const TableState *table, uint8_t tableId) const {
+    bool eit = isEitTable(tableId);
+    for (int i = 0; i <= table->lastSection; i++) {
+        if (table->sections[i]) {
+            continue;
+        }
+        if (!eit) {
+            return false;
+        }
+        // EIT segments of 8 sections may end early (segment_last_section_number)
+        const SectionPool::Buffer *first = NULL;
+        for (int s = i & ~7; s < ((i & ~7) + 8) && s <= table->lastSection; s++) {
+            if (table->sections[s]) {
+                first = table->sections[s];
+                break;
+            }
+        }
+        if (first == NULL || first->len < 14 || first->data[12] >= i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SectionDemux::releaseTable(TableState *table) {
+    for (int i = 0; i < 256; i++) {
+        if (table->sections[i]) {
+            mPool.release(table->sections[i]);
+            table->sections[i] = NULL;
+        }
+    }
+}
+
+void SectionDemux::releaseFilter(Filter *filter) {
+    for (std::map<uint64_t, TableState*>::iterator it = filter->tables.begin(); it != filter->tables.end(); ++it) {
+        releaseTable(it->second);
+        delete it->second;
+    }
+    filter->tables.clear();
+}
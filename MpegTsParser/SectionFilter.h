@@ -0,0 +1,151 @@
+#pragma once
+#include <inttypes.h>
+#include <cstddef>
+#include <map>
+#include <vector>
+#include "debug.h"
+
+// Private sections may be up to 4096 bytes (ISO/IEC 13818-1 2.4.4.11)
+#define SECTION_MAX_SIZE            4096
+#define SECTION_HEADER_SIZE         3
+#define SECTION_POOL_PREALLOC       16
+#define TS_PID_COUNT                8192
+
+namespace TSDemux
+{
+  enum {
+    SECTION_FILTER_SECTIONS       = 0x01,   ///< deliver every complete section
+    SECTION_FILTER_TABLES         = 0x02,   ///< deliver tables once all their sections are collected
+    SECTION_FILTER_VERSION_CHANGE = 0x04,   ///< deliver a table only when its version changes
+    SECTION_FILTER_NO_CRC         = 0x08    ///< do not drop sections with a bad CRC32
+  };
+
+  struct PSI_SECTION
+  {
+    uint16_t pid;
+    uint8_t table_id;
+    bool syntax_indicator;
+    uint16_t table_id_extension;
+    uint8_t version;
+    bool current_next;
+    uint8_t section_number;
+    uint8_t last_section_number;
+    const unsigned char *data;    ///< whole section, header and CRC32 included
+    size_t len;
+  };
+
+  struct PSI_TABLE
+  {
+    uint16_t pid;
+    uint8_t table_id;
+    uint16_t table_id_extension;
+    uint8_t version;
+    std::vector<const PSI_SECTION*> sections;   ///< ordered by section_number, gaps skipped
+  };
+
+  class SectionListener
+  {
+  public:
+    virtual ~SectionListener() {}
+    virtual void onSection(int /*filterId*/, const PSI_SECTION &/*section*/) {}
+    virtual void onTable(int /*filterId*/, const PSI_TABLE &/*table*/) {}
+  };
+
+  /*
+   * Fixed size section buffers are recycled through a free list, so a long
+   * EIT ingest does not hit the allocator for every section.
+   */
+  class SectionPool
+  {
+  public:
+    struct Buffer
+    {
+      PSI_SECTION section;
+      size_t len;
+      unsigned char data[SECTION_MAX_SIZE];
+    };
+
+    SectionPool();
+    ~SectionPool();
+    Buffer *acquire();
+    void release(Buffer *buffer);
+    void setLogger(Logger *logger) { mLogger = logger; }
+
+  private:
+    SectionPool(const SectionPool&);
+    SectionPool& operator=(const SectionPool&);
+
+    std::vector<Buffer*> mFree;
+    size_t mAllocated;
+    Logger *mLogger;
+  };
+
+  /*
+   * Registerable section filters (PID + table_id/mask). Sections are
+   * reassembled from the TS payload of the filtered PIDs, multi-section
+   * tables are collected using section_number/last_section_number and
+   * delivered to the listener of the filter.
+   */
+  class SectionDemux
+  {
+  public:
+    SectionDemux();
+    ~SectionDemux();
+
+    int addFilter(uint16_t pid, uint8_t tableId, uint8_t mask, int flags, SectionListener *listener);
+    void removeFilter(int filterId);
+    void reset();
+    void setLogger(Logger *logger) { mLogger = logger; mPool.setLogger(logger); }
+
+    bool hasFilter(uint16_t pid) const { return mPids[pid & 0x1fff] != NULL; }
+    void pushPayload(uint16_t pid, bool unitStart, uint8_t cc, bool discontinuity, const unsigned char *payload, size_t len);
+
+    static uint32_t crc32(const unsigned char *data, size_t len);
+
+  private:
+    SectionDemux(const SectionDemux&);
+    SectionDemux& operator=(const SectionDemux&);
+
+    struct TableState
+    {
+      uint8_t version;
+      uint8_t lastSection;
+      uint8_t deliveredVersion;
+      SectionPool::Buffer *sections[256];
+    };
+
+    struct Filter
+    {
+      int id;
+      uint16_t pid;
+      uint8_t tableId;
+      uint8_t mask;
+      int flags;
+      SectionListener *listener;
+      std::map<uint64_t, TableState*> tables;
+    };
+
+    struct PidAssembler
+    {
+      uint8_t continuity;
+      bool waitUnitStart;
+      SectionPool::Buffer *current;   ///< section being reassembled
+      size_t expected;
+      std::vector<Filter*> filters;
+    };
+
+    size_t appendSection(PidAssembler *assembler, uint16_t pid, const unsigned char *data, size_t len);
+    void startSection(PidAssembler *assembler);
+    void completeSection(PidAssembler *assembler, uint16_t pid);
+    void collectSection(Filter *filter, const PSI_SECTION &section);
+    bool isTableComplete(const TableState *table, uint8_t tableId) const;
+    void releaseTable(TableState *table);
+    void releaseFilter(Filter *filter);
+
+    int mNextFilterId;
+    Logger *mLogger;
+    PidAssembler *mPids[TS_PID_COUNT];
+    std::map<int, Filter*> mFilters;
+    SectionPool mPool;
+  };
+}
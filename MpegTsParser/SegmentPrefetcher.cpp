@@ -0,0 +1,88 @@
+#include "stdafx.h"
+#include "SegmentPrefetcher.h"
+#include "ChromeTrace.h"
+
+namespace GYJ {
+
+SegmentPrefetcher::SegmentPrefetcher(SegmentDemuxer &demuxer, size_t count, int threads, size_t window)
+    : mDemuxer(demuxer), mCount(count), mWindow(window > 0 ? window : 1), mNext(0), mConsumed(0), mStop(false)
+    , mResults(count, (tsParam*)NULL), mDone(count, false) {
+    for (int i = 0; i < threads && (size_t)i < count; i++) {
+        Worker *worker = new Worker(*this);
+        if (!worker->Start()) {
+            delete worker;
+            break;
+        }
+        mWorkers.push_back(worker);
+    }
+}
+
+SegmentPrefetcher::~SegmentPrefetcher() {
+    {
+        TSDemux::PLATFORM::CLockObject lock(mMutex);
+        mStop = true;
+        mCondition.Broadcast();
+    }
+    for (std::vector<Worker*>::iterator it = mWorkers.begin(); it != mWorkers.end(); ++it) {
+        (*it)->Join();
+        delete *it;
+    }
+    // segments never taken
+    for (size_t i = 0; i < mCount; i++) {
+        if (mResults[i] != NULL) {
+            std::list<TSDemux::STREAM_PKT*> *lst = mResults[i]->packets;
+            for (std::list<TSDemux::STREAM_PKT*>::iterator it = lst->begin(); it != lst->end(); ++it) {
+                delete *it;
+            }
+            delete lst;
+            delete mResults[i];
+        }
+    }
+}
+
+void SegmentPrefetcher::work() {
+    TSDemux::ChromeTrace::setThreadName("prefetch");
+    TSDemux::PLATFORM::CLockObject lock(mMutex);
+    while (true) {
+        while (!mStop && mNext < mCount && mNext >= mConsumed + mWindow) {
+            mCondition.Wait(mMutex);
+        }
+        if (mStop || mNext >= mCount) {
+            return;
+        }
+        size_t index = mNext++;
+
+        lock.Unlock();
+        tsParam *param = mDemuxer.demux(index);
+        lock.Lock();
+
+        mResults[index] = param;
+        mDone[index] = true;
+        mCondition.Broadcast();
+    }
+}
+
+tsParam *SegmentPrefetcher::take(size_t index) {
+    if (index >= mCount) {
+        return NULL;
+    }
+
+    if (mWorkers.empty()) {
+        // no thread: demux in place
+        mConsumed = index + 1;
+        return mDemuxer.demux(index);
+    }
+
+    TSDemux::PLATFORM::CLockObject lock(mMutex);
+    while (!mDone[index]) {
+        mCondition.Wait(mMutex);
+    }
+    tsParam *param = mResults[index];
+    mResults[index] = NULL;
+    if (index + 1 > mConsumed) {
+        mConsumed = index + 1;
+    }
+    mCondition.Broadcast();
+    return param;
+}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+#include "ParserdDataContainer.h"
+#include "thread.h"
+
+namespace GYJ {
+
+#define PREFETCH_THREADS        4
+#define PREFETCH_WINDOW         8       // segments demuxed ahead of the consumer
+
+// demux of one segment of an ordered list, called from the prefetch workers
+class SegmentDemuxer
+{
+public:
+    virtual ~SegmentDemuxer() {}
+    virtual tsParam *demux(size_t index) = 0;
+};
+
+/*
+ * Demuxes the segments of an ordered list on worker threads, at most
+ * PREFETCH_WINDOW ahead of the consumer, and hands them over in list order.
+ */
+class SegmentPrefetcher
+{
+public:
+    SegmentPrefetcher(SegmentDemuxer &demuxer, size_t count, int threads = PREFETCH_THREADS, size_t window = PREFETCH_WINDOW);
+    ~SegmentPrefetcher();
+
+    // blocks until segment index is demuxed, the caller owns it (NULL on failure)
+    tsParam *take(size_t index);
+
+private:
+    class Worker : public TSDemux::PLATFORM::CThread
+    {
+    public:
+        explicit Worker(SegmentPrefetcher &prefetcher) : mPrefetcher(prefetcher) {}
+        virtual ~Worker() { Join(); }
+    protected:
+        virtual void Process() { mPrefetcher.work(); }
+    private:
+        SegmentPrefetcher &mPrefetcher;
+    };
+
+    void work();
+
+    SegmentDemuxer &mDemuxer;
+    size_t mCount;
+    size_t mWindow;
+    size_t mNext;                   // next segment to demux
+    size_t mConsumed;               // segments taken
+    bool mStop;
+    std::vector<tsParam*> mResults;
+    std::vector<bool> mDone;
+    std::vector<Worker*> mWorkers;
+    TSDemux::PLATFORM::CMutex mMutex;
+    TSDemux::PLATFORM::CCondition mCondition;
+};
+}
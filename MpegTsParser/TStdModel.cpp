@@ -0,0 +1,277 @@
+#define __STDC_FORMAT_MACROS 1
+#include "TStdModel.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <inttypes.h>
+
+using namespace TSDemux;
+
+#define TSTD_CLOCK_HZ   27000000.0
+
+TSTD_STATS::TSTD_STATS()
+    : video(false), rx(0.0), rbx(0.0), mbSize(0), ebSize(0)
+    , packets(0), frames(0), tbMax(0.0), mbMax(0.0), ebMax(0.0)
+    , tbOverflows(0), mbOverflows(0), ebOverflows(0), ebUnderflows(0), lateFrames(0)
+    , firstOverflow(-1), firstUnderflow(-1) {
+}
+
+TStdModel::TStdModel() : mLogger(&Logger::Default()) {
+}
+
+TStdModel::~TStdModel() {
+    for (std::map<uint16_t, Buffer*>::iterator it = mBuffers.begin(); it != mBuffers.end(); ++it) {
+        delete it->second;
+    }
+}
+
+bool TStdModel::isConfigured(uint16_t pid) const {
+    return mBuffers.find(pid) != mBuffers.end();
+}
+
+void TStdModel::configure(uint16_t pid, uint16_t pcrPid, bool video, int bufferSize, int maxBitrate, int channels) {
+    Buffer *&buffer = mBuffers[pid];
+    if (buffer != NULL && buffer->bufferSize == bufferSize && buffer->maxBitrate == maxBitrate && buffer->pcrPid == pcrPid) {
+        return;
+    }
+    if (buffer != NULL) {
+        // new stream parameters: the model starts over on the next PES
+        run(*buffer, true);
+        TSTD_STATS stats = buffer->stats;
+        *buffer = Buffer();
+        buffer->stats = stats;
+    } else {
+        buffer = new Buffer();
+    }
+
+    buffer->pid = pid;
+    buffer->pcrPid = pcrPid;
+    buffer->bufferSize = bufferSize;
+    buffer->maxBitrate = maxBitrate;
+
+    TSTD_STATS &stats = buffer->stats;
+    stats.video = video;
+    stats.ebSize = bufferSize;
+    if (video) {
+        // Rxn = 1.2 Rmax, MBSn = BSmux + BSoh, Rbx = Rmax (leak method)
+        stats.rx = 1.2 * maxBitrate;
+        stats.rbx = maxBitrate;
+        stats.mbSize = (int)((0.004 * maxBitrate + maxBitrate / 750.0) / 8);
+    } else {
+        stats.rx = channels > 2 ? TSTD_AUDIO_RX_MULTICHANNEL : TSTD_AUDIO_RX;
+        stats.rbx = 0.0;
+        stats.mbSize = 0;
+    }
+    DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: pid %.4x %s EB:%d Rx:%.0f Rbx:%.0f MB:%d\n", __FUNCTION__, pid,
+        video ? "video" : "audio", stats.ebSize, stats.rx, stats.rbx, stats.mbSize);
+}
+
+void TStdModel::addPcr(uint16_t pid, uint64_t pcr, uint64_t pos, bool discontinuity) {
+    mClocks[pid].AddPcr(pcr, pos, discontinuity);
+}
+
+void TStdModel::addPacket(uint16_t pid, uint64_t pos, size_t payloadLen, bool unitStart) {
+    std::map<uint16_t, Buffer*>::iterator it = mBuffers.find(pid);
+    if (it == mBuffers.end()) {
+        return;
+    }
+    Buffer &buffer = *it->second;
+    std::map<uint16_t, MuxClock>::const_iterator clock = mClocks.find(buffer.pcrPid);
+    if (clock == mClocks.end() || !clock->second.IsValid()) {
+        return;
+    }
+
+    int64_t time = clock->second.GetTime(pos);
+    if (!buffer.started) {
+        // buffers are known empty at a PES start only
+        if (!unitStart) {
+            return;
+        }
+        buffer.started = true;
+        buffer.startTime = buffer.time = time;
+    }
+
+    Arrival arrival;
+    arrival.time = std::max(time, buffer.lastArrival);
+    arrival.bytes = (uint32_t)payloadLen;
+    arrival.header = 0;
+    buffer.arrivals.push_back(arrival);
+    buffer.lastArrival = arrival.time;
+    buffer.stats.packets++;
+    run(buffer, false);
+}
+
+void TStdModel::addPesHeader(uint16_t pid, size_t len) {
+    std::map<uint16_t, Buffer*>::iterator it = mBuffers.find(pid);
+    if (it == mBuffers.end() || !it->second->started) {
+        return;
+    }
+    Buffer &buffer = *it->second;
+    if (!buffer.arrivals.empty()) {
+        buffer.arrivals.back().header += (uint32_t)len;
+    } else {
+        buffer.tbHeader += len;
+    }
+}
+
+void TStdModel::addFrame(uint16_t pid, uint64_t dts, size_t size) {
+    std::map<uint16_t, Buffer*>::iterator it = mBuffers.find(pid);
+    if (it == mBuffers.end() || !it->second->started) {
+        return;
+    }
+    Buffer &buffer = *it->second;
+
+    AccessUnit unit;
+    unit.dts = (int64_t)dts * 300;
+    unit.size = (uint32_t)size;
+    if (unit.dts < buffer.startTime) {
+        // data arrived before the model start
+        return;
+    }
+    if (unit.dts < buffer.time) {
+        // decode time already simulated without this access unit
+        if (buffer.time - buffer.startTime > TSTD_WARMUP) {
+            buffer.stats.lateFrames++;
+            report(buffer, true, "late access unit", unit.dts, buffer.eb, (double)size);
+        }
+        unit.dts = buffer.time;
+    }
+    buffer.units.push_back(unit);
+    buffer.lastDts = unit.dts;
+    buffer.hasDts = true;
+    buffer.stats.frames++;
+    run(buffer, false);
+}
+
+void TStdModel::finish() {
+    for (std::map<uint16_t, Buffer*>::iterator it = mBuffers.begin(); it != mBuffers.end(); ++it) {
+        run(*it->second, true);
+    }
+}
+
+void TStdModel::run(Buffer &buffer, bool flush) {
+    while (!buffer.arrivals.empty() || !buffer.units.empty()) {
+        if (!buffer.units.empty() && (buffer.arrivals.empty() || buffer.units.front().dts <= buffer.arrivals.front().time)) {
+            // every byte arrived before the decode time must be in first
+            if (!flush && buffer.lastArrival < buffer.units.front().dts) {
+                break;
+            }
+            AccessUnit unit = buffer.units.front();
+            buffer.units.pop_front();
+            remove(buffer, unit);
+        } else {
+            // an access unit decoded before this arrival may not be parsed yet
+            if (!flush && (!buffer.hasDts || buffer.lastDts < buffer.arrivals.front().time) &&
+                buffer.arrivals.size() < TSTD_MAX_ARRIVALS) {
+                break;
+            }
+            Arrival arrival = buffer.arrivals.front();
+            buffer.arrivals.pop_front();
+            arrive(buffer, arrival);
+        }
+    }
+}
+
+void TStdModel::leak(Buffer &buffer, int64_t time) {
+    if (time <= buffer.time) {
+        return;
+    }
+    TSTD_STATS &stats = buffer.stats;
+    double seconds = (time - buffer.time) / TSTD_CLOCK_HZ;
+
+    double out = std::min(buffer.tb, stats.rx / 8 * seconds);
+    buffer.tb -= out;
+    double header = std::min(buffer.tbHeader, out);
+    buffer.tbHeader -= header;
+    out -= header;
+
+    if (stats.video) {
+        buffer.mb += out;
+        double moved = std::min(buffer.mb, stats.rbx / 8 * seconds);
+        buffer.mb -= moved;
+        buffer.eb += moved;
+    } else {
+        buffer.eb += out;
+    }
+    buffer.time = time;
+}
+
+void TStdModel::arrive(Buffer &buffer, const Arrival &arrival) {
+    TSTD_STATS &stats = buffer.stats;
+
+    leak(buffer, arrival.time);
+    buffer.tb += arrival.bytes;
+    buffer.tbHeader += arrival.header;
+
+    stats.tbMax = std::max(stats.tbMax, buffer.tb);
+    stats.mbMax = std::max(stats.mbMax, buffer.mb);
+    stats.ebMax = std::max(stats.ebMax, buffer.eb);
+    if (buffer.tb > TSTD_TB_SIZE) {
+        stats.tbOverflows++;
+        report(buffer, false, "TB overflow", arrival.time, buffer.tb, TSTD_TB_SIZE);
+    }
+    if (stats.video && buffer.mb > stats.mbSize) {
+        stats.mbOverflows++;
+        report(buffer, false, "MB overflow", arrival.time, buffer.mb, stats.mbSize);
+    }
+    if (buffer.eb > stats.ebSize) {
+        stats.ebOverflows++;
+        report(buffer, false, "EB overflow", arrival.time, buffer.eb, stats.ebSize);
+    }
+}
+
+void TStdModel::remove(Buffer &buffer, const AccessUnit &unit) {
+    TSTD_STATS &stats = buffer.stats;
+
+    leak(buffer, unit.dts);
+    stats.ebMax = std::max(stats.ebMax, buffer.eb);
+    if (buffer.eb < unit.size) {
+        // before the warmup, the access unit may have started before the model
+        if (unit.dts - buffer.startTime > TSTD_WARMUP) {
+            stats.ebUnderflows++;
+            report(buffer, true, "EB underflow", unit.dts, buffer.eb, unit.size);
+        }
+        buffer.eb = 0.0;
+    } else {
+        buffer.eb -= unit.size;
+    }
+}
+
+void TStdModel::report(Buffer &buffer, bool underflow, const char *what, int64_t time, double occupancy, double size) {
+    TSTD_STATS &stats = buffer.stats;
+    int64_t &first = underflow ? stats.firstUnderflow : stats.firstOverflow;
+    if (first < 0) {
+        first = time;
+    }
+    if (buffer.events++ < TSTD_MAX_LOGGED_EVENTS) {
+        DEMUX_LOG(mLogger, DEMUX_DBG_INFO, "[T-STD] pid:0x%04x %s at %.3fs (90k:%" PRId64 "), occupancy:%.0f size:%.0f \n",
+            buffer.pid, what, time / TSTD_CLOCK_HZ, time / 300, occupancy, size);
+    }
+}
+
+std::vector<uint16_t> TStdModel::getPids() const {
+    std::vector<uint16_t> pids;
+    for (std::map<uint16_t, Buffer*>::const_iterator it = mBuffers.begin(); it != mBuffers.end(); ++it) {
+        pids.push_back(it->first);
+    }
+    return pids;
+}
+
+const TSTD_STATS *TStdModel::getStats(uint16_t pid) const {
+    std::map<uint16_t, Buffer*>::const_iterator it = mBuffers.find(pid);
+    return it != mBuffers.end() ? &it->second->stats : NULL;
+}
+
+void TStdModel::dump(uint16_t pid, const TSTD_STATS &stats, Logger *logger) {
+    DEMUX_LOG(logger, DEMUX_DBG_INFO, "[T-STD] pid:0x%04x %s packets:%" PRIu64 " frames:%" PRIu64 " Rx:%.0f Rbx:%.0f bit/s \n",
+        pid, stats.video ? "video" : "audio", stats.packets, stats.frames, stats.rx, stats.rbx);
+    if (stats.video) {
+        DEMUX_LOG(logger, DEMUX_DBG_INFO, "[T-STD] TB max:%.0f/%d MB max:%.0f/%d EB max:%.0f/%d bytes \n",
+            stats.tbMax, TSTD_TB_SIZE, stats.mbMax, stats.mbSize, stats.ebMax, stats.ebSize);
+    } else {
+        DEMUX_LOG(logger, DEMUX_DBG_INFO, "[T-STD] TB max:%.0f/%d B max:%.0f/%d bytes \n",
+            stats.tbMax, TSTD_TB_SIZE, stats.ebMax, stats.ebSize);
+    }
+    DEMUX_LOG(logger, DEMUX_DBG_INFO, "[T-STD] overflow TB:%" PRIu64 " MB:%" PRIu64 " EB:%" PRIu64 " underflow EB:%" PRIu64 " late access unit:%" PRIu64 " \n",
+        stats.tbOverflows, stats.mbOverflows, stats.ebOverflows, stats.ebUnderflows, stats.lateFrames);
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <inttypes.h>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <vector>
+#include "tsTimeline.h"
+#include "debug.h"
+
+// ISO/IEC 13818-1 2.4.2
+#define TSTD_TB_SIZE                512
+#define TSTD_AUDIO_RX               2000000     // bit/s, up to 2 channels
+#define TSTD_AUDIO_RX_MULTICHANNEL  5529600     // bit/s, 3 to 8 channels
+#define TSTD_WARMUP                 27000000LL  // 1s of 27MHz: buffers filled before the start are unknown
+#define TSTD_MAX_ARRIVALS           8192        // arrivals held while waiting for the decode times
+#define TSTD_MAX_LOGGED_EVENTS      10
+
+namespace TSDemux
+{
+  struct TSTD_STATS
+  {
+    TSTD_STATS();
+
+    bool video;
+    double rx;                  ///< TBn leak (bit/s)
+    double rbx;                 ///< MBn leak (bit/s), video only
+    int mbSize;                 ///< bytes, video only
+    int ebSize;                 ///< EBn (video) or Bn (audio), bytes
+
+    uint64_t packets;
+    uint64_t frames;
+    double tbMax;
+    double mbMax;
+    double ebMax;
+
+    uint64_t tbOverflows;
+    uint64_t mbOverflows;
+    uint64_t ebOverflows;
+    uint64_t ebUnderflows;      ///< access unit not complete in EBn at its decode time
+    uint64_t lateFrames;        ///< access unit known after its decode time
+    int64_t firstOverflow;      ///< 27MHz, -1 if none
+    int64_t firstUnderflow;
+  };
+
+  /*
+   * T-STD buffer simulator of the elementary streams: TS packets enter TBn
+   * at their arrival time from the mux clock, leak to MBn (video) then EBn,
+   * or to Bn (audio), and access units leave at their DTS. Arrivals and
+   * decode times are merged in time order as they come, so memory is the
+   * packets and frames between arrival and decode.
+   */
+  class TStdModel
+  {
+  public:
+    TStdModel();
+    ~TStdModel();
+
+    bool isConfigured(uint16_t pid) const;
+    // bufferSize/maxBitrate from the ES parser, channels for audio Rx
+    void configure(uint16_t pid, uint16_t pcrPid, bool video, int bufferSize, int maxBitrate, int channels);
+
+    void addPcr(uint16_t pid, uint64_t pcr, uint64_t pos, bool discontinuity);
+    void addPacket(uint16_t pid, uint64_t pos, size_t payloadLen, bool unitStart);
+    void addPesHeader(uint16_t pid, size_t len);
+    // dts on 90kHz (extended timeline)
+    void addFrame(uint16_t pid, uint64_t dts, size_t size);
+    void finish();
+    void setLogger(Logger *logger) { mLogger = logger; }
+
+    std::vector<uint16_t> getPids() const;
+    const TSTD_STATS *getStats(uint16_t pid) const;
+    static void dump(uint16_t pid, const TSTD_STATS &stats, Logger *logger = &Logger::Default());
+
+  private:
+    TStdModel(const TStdModel&);
+    TStdModel& operator=(const TStdModel&);
+
+    struct Arrival
+    {
+      int64_t time;
+      uint32_t bytes;
+      uint32_t header;
+    };
+
+    struct AccessUnit
+    {
+      int64_t dts;
+      uint32_t size;
+    };
+
+    struct Buffer
+    {
+      Buffer() : pid(0xffff), pcrPid(0xffff), bufferSize(0), maxBitrate(0), started(false),
+        startTime(0), time(0), lastArrival(0), lastDts(0), hasDts(false),
+        tb(0.0), tbHeader(0.0), mb(0.0), eb(0.0), events(0) {}
+
+      uint16_t pid;
+      uint16_t pcrPid;
+      int bufferSize;
+      int maxBitrate;
+
+      bool started;
+      int64_t startTime;
+      int64_t time;                   ///< model time (27MHz)
+      int64_t lastArrival;
+      int64_t lastDts;                ///< last known decode time (27MHz)
+      bool hasDts;
+      std::deque<Arrival> arrivals;
+      std::deque<AccessUnit> units;
+
+      double tb;
+      double tbHeader;                ///< PES header bytes in TBn, dropped on the way out
+      double mb;
+      double eb;
+      int events;
+
+      TSTD_STATS stats;
+    };
+
+    void run(Buffer &buffer, bool flush);
+    void leak(Buffer &buffer, int64_t time);
+    void arrive(Buffer &buffer, const Arrival &arrival);
+    void remove(Buffer &buffer, const AccessUnit &unit);
+    void report(Buffer &buffer, bool underflow, const char *what, int64_t time, double occupancy, double size);
+
+    std::map<uint16_t, MuxClock> mClocks;     ///< by PCR PID
+    std::map<uint16_t, Buffer*> mBuffers;
+    Logger *mLogger;
+  };
+}
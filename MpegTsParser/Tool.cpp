@@ -1,6 +1,8 @@
-#include "StdAfx.h"
+#include "stdafx.h"
 #include "Tool.h"
-#include <io.h>
+#include "DirScanner.h"
+#include <algorithm>
+#include <cctype>
 
 namespace GYJ {
 
@@ -43,27 +45,28 @@ namespace GYJ {
 
 
 
-    void listFiles(const char *dir, std::vector<std::string> &localFiles)
+    static const char *tsExtensions[] = { "ts", "dbts", "265ts", "bbts" };
+    static const size_t tsExtensionCount = sizeof(tsExtensions) / sizeof(tsExtensions[0]);
+
+    bool listFiles(const std::string &dir, std::vector<std::string> &localFiles, bool recursive)
     {
-        intptr_t handle;
-        _finddata_t findData;
+        DirScanner scanner(std::set<std::string>(tsExtensions, tsExtensions + tsExtensionCount), recursive);
+        return scanner.scan(dir, localFiles);
+    }
 
-        handle = _findfirst(dir, &findData);
-        if (handle == -1){
-            return;
+    bool isTsFile(const std::string &name)
+    {
+        std::string::size_type dot = name.find_last_of('.');
+        if (dot == std::string::npos || dot == 0) {
+            return false;
         }
-
-        do{
-            if (findData.attrib & _A_SUBDIR || strcmp(findData.name, ".") == 0 || strcmp(findData.name, "..") == 0 ){ 
-                continue;
-            } else {
-                if (strstr(findData.name, ".ts") != NULL || strstr(findData.name, ".dbts") != NULL || strstr(findData.name, ".265ts") != NULL || strstr(findData.name, ".bbts") != NULL) {
-                    localFiles.push_back(findData.name);
-                }
-
+        std::string ext = name.substr(dot + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        for (size_t i = 0; i < tsExtensionCount; i++) {
+            if (ext == tsExtensions[i]) {
+                return true;
             }
-        } while (_findnext(handle, &findData) == 0);
-
-        _findclose(handle); 
+        }
+        return false;
     }
 }
\ No newline at end of file
@@ -6,7 +6,10 @@ namespace GYJ {
     std::string getFileNameFromPath(const std::string &filePath);
     std::string regulateFilePath(std::string &filePath);
 
-    void listFiles(const char *dir, std::vector<std::string> &localFiles);
+    // the .ts, .dbts, .265ts and .bbts files of dir, relative to it and sorted, false if dir cannot be read
+    bool listFiles(const std::string &dir, std::vector<std::string> &localFiles, bool recursive = false);
+    // name has one of the extensions of listFiles
+    bool isTsFile(const std::string &name);
 }
 
 
@@ -0,0 +1,495 @@
+#include "TraceFile.h"
+#include "debug.h"
+
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace TSDemux;
+
+#define TRACE_FLAG_PTS          0x04
+#define TRACE_FLAG_DTS          0x08
+#define TRACE_FLAG_PCR          0x10    // PES
+#define TRACE_FLAG_RATE         0x10    // frame: sample rate follows
+#define TRACE_FLAG_RANDOM       0x20
+#define TRACE_FLAG_CLOSED       0x40
+
+static void put16(std::vector<unsigned char> &buf, uint16_t v) {
+    buf.push_back((unsigned char)v);
+    buf.push_back((unsigned char)(v >> 8));
+}
+
+static void put32(std::vector<unsigned char> &buf, uint32_t v) {
+    put16(buf, (uint16_t)v);
+    put16(buf, (uint16_t)(v >> 16));
+}
+
+static void put64(std::vector<unsigned char> &buf, uint64_t v) {
+    put32(buf, (uint32_t)v);
+    put32(buf, (uint32_t)(v >> 32));
+}
+
+static uint16_t get16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const unsigned char *p) {
+    return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static uint64_t get64(const unsigned char *p) {
+    return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+// LEB128, false past the end
+static bool getVarint(const unsigned char *&p, const unsigned char *end, uint64_t &value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char c = *p++;
+        value |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool getDelta(const unsigned char *&p, const unsigned char *end, uint64_t &last) {
+    uint64_t zz;
+    if (!getVarint(p, end, zz)) {
+        return false;
+    }
+    int64_t delta = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+    last += delta;
+    return true;
+}
+
+TraceWriter::TraceWriter(Logger *logger)
+    : mFile(NULL), mOffset(0), mBlockRecords(0), mLastPosition(0), mWriteError(false), mLogger(logger ? logger : &Logger::Default()) {
+}
+
+TraceWriter::~TraceWriter() {
+    // not closed: the index offset stays 0 and readers reject the trace
+    if (mFile != NULL) {
+        fclose(mFile);
+    }
+}
+
+bool TraceWriter::open(const std::string &path, const std::string &name) {
+    mFile = fopen(path.c_str(), "wb");
+    if (mFile == NULL) {
+        DEMUX_LOG(mLogger, DEMUX_DBG_ERROR, "[TRACE] cannot create %s \n", path.c_str());
+        return false;
+    }
+
+    std::vector<unsigned char> header;
+    header.insert(header.end(), TRACE_MAGIC, TRACE_MAGIC + 4);
+    put16(header, TRACE_VERSION);
+    put16(header, (uint16_t)(TRACE_HEADER_SIZE + 2 + name.size()));
+    put32(header, TRACE_BLOCK_RECORDS);
+    put64(header, 0);           // index offset, set on close
+    put32(header, 0);
+    put16(header, (uint16_t)name.size());
+    header.insert(header.end(), name.begin(), name.end());
+    if (fwrite(&header[0], 1, header.size(), mFile) != header.size()) {
+        DEMUX_LOG(mLogger, DEMUX_DBG_ERROR, "[TRACE] cannot write %s \n", path.c_str());
+        fclose(mFile);
+        mFile = NULL;
+        return false;
+    }
+    mOffset = header.size();
+    mWriteError = false;
+    return true;
+}
+
+void TraceWriter::beginRecord(uint64_t position) {
+    if (mBlockRecords == TRACE_BLOCK_RECORDS) {
+        flushBlock();
+    }
+    if (mBlockRecords == 0) {
+        TRACE_BLOCK block;
+        block.offset = mOffset + mBuffer.size();
+        block.position = position;
+        block.records = 0;
+        mBlocks.push_back(block);
+        mLastPosition = position;
+        mPes.clear();
+        mFrames.clear();
+    }
+    mBlockRecords++;
+    mBlocks.back().records++;
+}
+
+void TraceWriter::flushBlock() {
+    if (!mBuffer.empty()) {
+        if (fwrite(&mBuffer[0], 1, mBuffer.size(), mFile) != mBuffer.size()) {
+            mWriteError = true;
+        }
+        mOffset += mBuffer.size();
+        mBuffer.clear();
+    }
+    mBlockRecords = 0;
+}
+
+void TraceWriter::putVarint(uint64_t value) {
+    while (value >= 0x80) {
+        mBuffer.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    mBuffer.push_back((unsigned char)value);
+}
+
+void TraceWriter::putDelta(uint64_t value, uint64_t &last) {
+    int64_t delta = (int64_t)(value - last);
+    putVarint(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+    last = value;
+}
+
+void TraceWriter::addPes(const STREAM_PKT &pkt, uint64_t position) {
+    if (mFile == NULL) {
+        return;
+    }
+    beginRecord(position);
+    TRACE_DELTA &state = mPes[pkt.pid];
+
+    unsigned char flags = TRACE_RECORD_PES;
+    if (pkt.pts != PTS_UNSET) flags |= TRACE_FLAG_PTS;
+    if (pkt.dts != PTS_UNSET) flags |= TRACE_FLAG_DTS;
+    if (pkt.pcr.present) flags |= TRACE_FLAG_PCR;
+    mBuffer.push_back(flags);
+    putVarint(pkt.pid);
+    putVarint(position - mLastPosition);
+    mLastPosition = position;
+    if (flags & TRACE_FLAG_PTS) putDelta(pkt.pts, state.pts);
+    if (flags & TRACE_FLAG_DTS) putDelta(pkt.dts, state.dts);
+    if (flags & TRACE_FLAG_PCR) putDelta(pkt.pcr.pcr, state.pcr);
+}
+
+void TraceWriter::addFrame(const STREAM_PKT &pkt, int sampleRate) {
+    if (mFile == NULL) {
+        return;
+    }
+    beginRecord(mLastPosition);
+    TRACE_DELTA &state = mFrames[pkt.pid];
+
+    unsigned char flags = TRACE_RECORD_FRAME;
+    if (pkt.pts != PTS_UNSET) flags |= TRACE_FLAG_PTS;
+    if (pkt.dts != PTS_UNSET) flags |= TRACE_FLAG_DTS;
+    if (sampleRate != state.sampleRate) flags |= TRACE_FLAG_RATE;
+    if (pkt.random_access) flags |= TRACE_FLAG_RANDOM;
+    if (pkt.closed_gop) flags |= TRACE_FLAG_CLOSED;
+    mBuffer.push_back(flags);
+    putVarint(pkt.pid);
+    if (flags & TRACE_FLAG_PTS) putDelta(pkt.pts, state.pts);
+    if (flags & TRACE_FLAG_DTS) putDelta(pkt.dts, state.dts);
+    putVarint(pkt.size);
+    putVarint(pkt.duration);
+    putVarint(pkt.samples);
+    mBuffer.push_back((unsigned char)pkt.frame_type);
+    if (flags & TRACE_FLAG_RATE) {
+        putVarint((uint64_t)sampleRate);
+        state.sampleRate = sampleRate;
+    }
+}
+
+bool TraceWriter::close(const std::vector<Program> &programs, int64_t startTime) {
+    if (mFile == NULL) {
+        return false;
+    }
+    flushBlock();
+
+    uint64_t indexOffset = mOffset;
+    std::vector<unsigned char> trailer;
+    put32(trailer, (uint32_t)mBlocks.size());
+    for (std::vector<TRACE_BLOCK>::const_iterator it = mBlocks.begin(); it != mBlocks.end(); ++it) {
+        put64(trailer, it->offset);
+        put64(trailer, it->position);
+        put32(trailer, it->records);
+    }
+    put32(trailer, (uint32_t)programs.size());
+    for (std::vector<Program>::const_iterator pg = programs.begin(); pg != programs.end(); ++pg) {
+        put16(trailer, pg->program_number);
+        put16(trailer, pg->pmt_pid);
+        put16(trailer, pg->pcr_pid);
+        trailer.push_back(pg->selected ? 1 : 0);
+        put16(trailer, (uint16_t)pg->service_name.size());
+        trailer.insert(trailer.end(), pg->service_name.begin(), pg->service_name.end());
+        put16(trailer, (uint16_t)pg->provider_name.size());
+        trailer.insert(trailer.end(), pg->provider_name.begin(), pg->provider_name.end());
+        put16(trailer, (uint16_t)pg->streams.size());
+        for (std::vector<PROGRAM_STREAM>::const_iterator it = pg->streams.begin(); it != pg->streams.end(); ++it) {
+            put16(trailer, it->pid);
+            trailer.push_back((unsigned char)it->stream_type);
+        }
+    }
+    put64(trailer, (uint64_t)startTime);
+    bool ok = !mWriteError && fwrite(&trailer[0], 1, trailer.size(), mFile) == trailer.size();
+
+    // a trace with a block or the trailer missing keeps the index offset 0, readers reject it
+    if (ok) {
+        std::vector<unsigned char> offset;
+        put64(offset, indexOffset);
+        ok = fflush(mFile) == 0 && fseek(mFile, 12, SEEK_SET) == 0 && fwrite(&offset[0], 1, offset.size(), mFile) == offset.size();
+    }
+    ok = fclose(mFile) == 0 && ok;
+    mFile = NULL;
+    if (!ok) {
+        DEMUX_LOG(mLogger, DEMUX_DBG_ERROR, "[TRACE] write error, the trace is incomplete \n");
+    }
+    return ok;
+}
+
+TraceReader::TraceReader(Logger *logger)
+    : mData(NULL), mSize(0), mStartTime(-1), mRecordsEnd(0), mLogger(logger ? logger : &Logger::Default()) {
+#if defined(_MSC_VER)
+    mFileHandle = INVALID_HANDLE_VALUE;
+    mMapping = NULL;
+#endif
+}
+
+TraceReader::~TraceReader() {
+    close();
+}
+
+bool TraceReader::map(const std::string &path) {
+#if defined(_MSC_VER)
+    mFileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mFileHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mFileHandle, &size) || size.QuadPart == 0) {
+        return false;
+    }
+    mMapping = CreateFileMappingA(mFileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mMapping == NULL) {
+        return false;
+    }
+    mData = (const unsigned char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+    mSize = size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    mData = (const unsigned char*)data;
+    mSize = st.st_size;
+#endif
+    return mData != NULL;
+}
+
+void TraceReader::close() {
+#if defined(_MSC_VER)
+    if (mData != NULL) {
+        UnmapViewOfFile(mData);
+    }
+    if (mMapping != NULL) {
+        CloseHandle(mMapping);
+        mMapping = NULL;
+    }
+    if (mFileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(mFileHandle);
+        mFileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (mData != NULL) {
+        munmap((void*)mData, mSize);
+    }
+#endif
+    mData = NULL;
+    mSize = 0;
+    mPrograms.clear();
+    mBlocks.clear();
+}
+
+bool TraceReader::open(const std::string &path) {
+    close();
+    if (!map(path)) {
+        DEMUX_LOG(mLogger, DEMUX_DBG_ERROR, "[TRACE] cannot map %s \n", path.c_str());
+        close();
+        return false;
+    }
+
+    if (mSize < TRACE_HEADER_SIZE + 2 || memcmp(mData, TRACE_MAGIC, 4) != 0 || get16(mData + 4) != TRACE_VERSION) {
+        DEMUX_LOG(mLogger, DEMUX_DBG_ERROR, "[TRACE] %s: not a trace of version %d \n", path.c_str(), TRACE_VERSION);
+        close();
+        return false;
+    }
+    uint16_t headerSize = get16(mData + 6);
+    uint64_t indexOffset = get64(mData + 12);
+    uint16_t nameSize = get16(mData + TRACE_HEADER_SIZE);
+    if (indexOffset == 0 || indexOffset > mSize || headerSize != TRACE_HEADER_SIZE + 2 + nameSize || headerSize > indexOffset) {
+        DEMUX_LOG(mLogger, DEMUX_DBG_ERROR, "[TRACE] %s: incomplete trace \n", path.c_str());
+        close();
+        return false;
+    }
+    mName.assign((const char*)mData + TRACE_HEADER_SIZE + 2, nameSize);
+    mRecordsEnd = indexOffset;
+
+    if (!readTrailer(indexOffset)) {
+        DEMUX_LOG(mLogger, DEMUX_DBG_ERROR, "[TRACE] %s: corrupt index \n", path.c_str());
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool TraceReader::readTrailer(uint64_t offset) {
+    const unsigned char *p = mData + offset;
+    const unsigned char *end = mData + mSize;
+
+#define TRACE_NEED(n) if ((uint64_t)(end - p) < (uint64_t)(n)) return false
+    TRACE_NEED(4);
+    uint32_t blocks = get32(p);
+    p += 4;
+    TRACE_NEED((uint64_t)blocks * 20);
+    for (uint32_t i = 0; i < blocks; i++, p += 20) {
+        TRACE_BLOCK block;
+        block.offset = get64(p);
+        block.position = get64(p + 8);
+        block.records = get32(p + 16);
+        if (block.offset >= mRecordsEnd) {
+            return false;
+        }
+        mBlocks.push_back(block);
+    }
+
+    TRACE_NEED(4);
+    uint32_t programs = get32(p);
+    p += 4;
+    for (uint32_t i = 0; i < programs; i++) {
+        Program program;
+        TRACE_NEED(9);
+        program.program_number = get16(p);
+        program.pmt_pid = get16(p + 2);
+        program.pcr_pid = get16(p + 4);
+        program.selected = p[6] != 0;
+        uint16_t len = get16(p + 7);
+        p += 9;
+        TRACE_NEED(len + 2);
+        program.service_name.assign((const char*)p, len);
+        p += len;
+        len = get16(p);
+        p += 2;
+        TRACE_NEED(len + 2);
+        program.provider_name.assign((const char*)p, len);
+        p += len;
+        uint16_t streams = get16(p);
+        p += 2;
+        TRACE_NEED(streams * 3);
+        for (uint16_t s = 0; s < streams; s++, p += 3) {
+            PROGRAM_STREAM stream;
+            stream.pid = get16(p);
+            stream.stream_type = (STREAM_TYPE)p[2];
+            program.streams.push_back(stream);
+        }
+        mPrograms.push_back(program);
+    }
+    TRACE_NEED(8);
+    mStartTime = (int64_t)get64(p);
+#undef TRACE_NEED
+    return true;
+}
+
+bool TraceReader::replay(TraceListener &listener, size_t first, size_t count) const {
+    std::map<uint16_t, TRACE_DELTA> pes;
+    std::map<uint16_t, TRACE_DELTA> frames;
+
+    for (size_t b = first; b < mBlocks.size() && b - first < count; b++) {
+        const TRACE_BLOCK &block = mBlocks[b];
+        const unsigned char *p = mData + block.offset;
+        const unsigned char *end = mData + mRecordsEnd;
+        uint64_t position = block.position;
+        pes.clear();
+        frames.clear();
+
+        for (uint32_t r = 0; r < block.records; r++) {
+            if (p >= end) {
+                return false;
+            }
+            unsigned char flags = *p++;
+            uint64_t pid;
+            if (!getVarint(p, end, pid)) {
+                return false;
+            }
+
+            STREAM_PKT pkt;
+            pkt.pid = (uint16_t)pid;
+            pkt.slice_type = 0;
+            pkt.frame_type = FRAME_TYPE_UNKNOWN;
+            pkt.random_access = false;
+            pkt.closed_gop = false;
+            pkt.size = 0;
+            pkt.data = NULL;
+            pkt.pts = PTS_UNSET;
+            pkt.dts = PTS_UNSET;
+            pkt.duration = 0;
+            pkt.samples = 0;
+            pkt.streamChange = false;
+            if ((flags & 0x03) == TRACE_RECORD_PES) {
+                TRACE_DELTA &state = pes[pkt.pid];
+                uint64_t delta;
+                if (!getVarint(p, end, delta)) {
+                    return false;
+                }
+                position += delta;
+                if ((flags & TRACE_FLAG_PTS) && !getDelta(p, end, state.pts)) return false;
+                if ((flags & TRACE_FLAG_DTS) && !getDelta(p, end, state.dts)) return false;
+                if ((flags & TRACE_FLAG_PCR) && !getDelta(p, end, state.pcr)) return false;
+                if (flags & TRACE_FLAG_PTS) pkt.pts = state.pts;
+                if (flags & TRACE_FLAG_DTS) pkt.dts = state.dts;
+                if (flags & TRACE_FLAG_PCR) {
+                    pkt.pcr.pcr = state.pcr;
+                    pkt.pcr.pcr_base = state.pcr / 300;
+                    pkt.pcr.pcr_ext = state.pcr % 300;
+                    pkt.pcr.present = true;
+                }
+                listener.onPes(pkt, position);
+            } else {
+                TRACE_DELTA &state = frames[pkt.pid];
+                uint64_t size, duration, samples;
+                if ((flags & TRACE_FLAG_PTS) && !getDelta(p, end, state.pts)) return false;
+                if ((flags & TRACE_FLAG_DTS) && !getDelta(p, end, state.dts)) return false;
+                if (!getVarint(p, end, size) || !getVarint(p, end, duration) || !getVarint(p, end, samples) || p >= end) {
+                    return false;
+                }
+                unsigned char type = *p++;
+                if (flags & TRACE_FLAG_RATE) {
+                    uint64_t rate;
+                    if (!getVarint(p, end, rate)) {
+                        return false;
+                    }
+                    state.sampleRate = (int)rate;
+                }
+                if (flags & TRACE_FLAG_PTS) pkt.pts = state.pts;
+                if (flags & TRACE_FLAG_DTS) pkt.dts = state.dts;
+                pkt.size = (size_t)size;
+                pkt.duration = duration;
+                pkt.samples = (uint32_t)samples;
+                pkt.frame_type = type < FRAME_TYPE_COUNT ? (FRAME_TYPE)type : FRAME_TYPE_UNKNOWN;
+                pkt.random_access = (flags & TRACE_FLAG_RANDOM) != 0;
+                pkt.closed_gop = (flags & TRACE_FLAG_CLOSED) != 0;
+                listener.onFrame(pkt, state.sampleRate);
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <inttypes.h>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "debug.h"
+#include "elementaryStream.h"
+#include "tsProgram.h"
+
+#define TRACE_MAGIC                 "TSTR"
+#define TRACE_VERSION               1
+#define TRACE_HEADER_SIZE           24      // magic, version, header size, block records, index offset, reserved
+#define TRACE_BLOCK_RECORDS         4096    // records per block, delta state restarts on each block
+
+namespace TSDemux
+{
+  enum TRACE_RECORD
+  {
+    TRACE_RECORD_PES = 0,           ///< PES header: position, PTS, DTS, PCR
+    TRACE_RECORD_FRAME = 1          ///< frame of an ES parser: PTS, DTS, size, duration, samples, type
+  };
+
+  // last values of one PID and record kind, the deltas are taken from
+  struct TRACE_DELTA
+  {
+    TRACE_DELTA() : pts(0), dts(0), pcr(0), sampleRate(0) {}
+    uint64_t pts;
+    uint64_t dts;
+    uint64_t pcr;
+    int sampleRate;
+  };
+
+  struct TRACE_BLOCK
+  {
+    uint64_t offset;                ///< of the first record in the trace
+    uint64_t position;              ///< TS byte position of the first PES record
+    uint32_t records;
+  };
+
+  /*
+   * Timestamp trace of one demux: the PES headers and ES frames of the
+   * selected streams as they come out of the demux, with the program table
+   * and the TS start time written on close.
+   *
+   * Records are a kind/flags byte, the PID and LEB128 varints: positions as
+   * deltas, timestamps as zigzag deltas from the previous record of the same
+   * PID and kind. Every TRACE_BLOCK_RECORDS records a new block starts from
+   * a clean delta state, the block index at the end allows random access.
+   */
+  class TraceWriter
+  {
+  public:
+    // no logger: the default one
+    explicit TraceWriter(Logger *logger = NULL);
+    ~TraceWriter();
+
+    bool open(const std::string &path, const std::string &name);
+    void addPes(const STREAM_PKT &pkt, uint64_t position);
+    void addFrame(const STREAM_PKT &pkt, int sampleRate);
+    // writes the index, the program table and the start time
+    bool close(const std::vector<Program> &programs, int64_t startTime);
+
+  private:
+    void beginRecord(uint64_t position);
+    void flushBlock();
+    void putVarint(uint64_t value);
+    void putDelta(uint64_t value, uint64_t &last);
+
+    FILE *mFile;
+    uint64_t mOffset;
+    std::vector<unsigned char> mBuffer;
+    std::vector<TRACE_BLOCK> mBlocks;
+    uint32_t mBlockRecords;
+    uint64_t mLastPosition;
+    bool mWriteError;               ///< a block not written, close() fails
+    std::map<uint16_t, TRACE_DELTA> mPes;
+    std::map<uint16_t, TRACE_DELTA> mFrames;
+    Logger *mLogger;
+  };
+
+  // PES headers and frames in demux order, replayed from a trace or live from a TsLayerContext
+  class TraceListener
+  {
+  public:
+    virtual ~TraceListener() {}
+    virtual void onPes(const STREAM_PKT &pkt, uint64_t position) = 0;
+    virtual void onFrame(const STREAM_PKT &pkt, int sampleRate) = 0;
+  };
+
+  /*
+   * Memory mapped trace: header, index and program table are read on open,
+   * the records are decoded by replay() straight from the mapping.
+   */
+  class TraceReader
+  {
+  public:
+    // no logger: the default one
+    explicit TraceReader(Logger *logger = NULL);
+    ~TraceReader();
+
+    bool open(const std::string &path);
+    void close();
+
+    const std::string &getName() const { return mName; }
+    int64_t getStartTime() const { return mStartTime; }
+    const std::vector<Program> &getPrograms() const { return mPrograms; }
+    const std::vector<TRACE_BLOCK> &getBlocks() const { return mBlocks; }
+
+    // decodes the blocks [first, first + count), all by default
+    bool replay(TraceListener &listener, size_t first = 0, size_t count = (size_t)-1) const;
+
+  private:
+    bool map(const std::string &path);
+    bool readTrailer(uint64_t offset);
+
+    const unsigned char *mData;
+    uint64_t mSize;
+#if defined(_MSC_VER)
+    void *mFileHandle;
+    void *mMapping;
+#endif
+
+    std::string mName;
+    int64_t mStartTime;
+    std::vector<Program> mPrograms;
+    std::vector<TRACE_BLOCK> mBlocks;
+    uint64_t mRecordsEnd;
+    Logger *mLogger;
+  };
+}
@@ -0,0 +1,583 @@
+#include "stdafx.h"
+#include "TsGenerator.h"
+#include "SectionFilter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define TS_PACKET               188
+#define TS_PAYLOAD              184
+#define PTS_WRAP                (1ULL << 33)
+#define PCR_WRAP                (PTS_WRAP * 300)
+#define CLOCK_27MHZ             27000000ULL
+
+// H.264 level_idc and MaxBR (kbit/s, VCL) of Table A-1 up from 3.1, all allow 720p25
+static const int genLevels[][2] = {
+    {31, 14000},
+    {32, 20000},
+    {41, 50000},
+    {51, 240000},
+};
+static const size_t genLevelCount = sizeof(genLevels) / sizeof(genLevels[0]);
+
+namespace GYJ {
+
+// RBSP bits, MSB first
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<unsigned char> &out) : mOut(out), mBits(0), mCount(0) {}
+    void put(uint32_t value, int bits) {
+        for (int i = bits - 1; i >= 0; i--) {
+            mBits = (mBits << 1) | ((value >> i) & 1);
+            if (++mCount == 8) {
+                mOut.push_back((unsigned char)mBits);
+                mBits = 0;
+                mCount = 0;
+            }
+        }
+    }
+    void ue(uint32_t value) {
+        uint32_t code = value + 1;
+        int bits = 0;
+        for (uint32_t v = code; v != 0; v >>= 1) {
+            bits++;
+        }
+        put(0, bits - 1);
+        put(code, bits);
+    }
+    // rbsp_trailing_bits
+    void trailing() {
+        put(1, 1);
+        while (mCount != 0) {
+            put(0, 1);
+        }
+    }
+    // to the next byte with 1 bits, for a slice header followed by raw bytes
+    void align() {
+        while (mCount != 0) {
+            put(1, 1);
+        }
+    }
+private:
+    std::vector<unsigned char> &mOut;
+    uint32_t mBits;
+    int mCount;
+};
+
+// start code, NAL header and the RBSP with its emulation prevention bytes
+static void writeNal(std::vector<unsigned char> &out, unsigned char header, const std::vector<unsigned char> &rbsp) {
+    static const unsigned char startCode[] = { 0x00, 0x00, 0x00, 0x01 };
+    out.insert(out.end(), startCode, startCode + sizeof(startCode));
+    out.push_back(header);
+    int zeros = 0;
+    for (std::vector<unsigned char>::const_iterator it = rbsp.begin(); it != rbsp.end(); ++it) {
+        if (zeros >= 2 && *it <= 3) {
+            out.push_back(0x03);
+            zeros = 0;
+        }
+        out.push_back(*it);
+        zeros = *it == 0 ? zeros + 1 : 0;
+    }
+}
+
+static void writeTimestamp(std::vector<unsigned char> &out, uint8_t prefix, uint64_t ts) {
+    out.push_back((unsigned char)((prefix << 4) | ((ts >> 29) & 0x0e) | 1));
+    out.push_back((unsigned char)(ts >> 22));
+    out.push_back((unsigned char)(((ts >> 14) & 0xfe) | 1));
+    out.push_back((unsigned char)(ts >> 7));
+    out.push_back((unsigned char)(((ts << 1) & 0xfe) | 1));
+}
+
+TsGenerator::TsGenerator(const GeneratorParam &param)
+    : mParam(param), mRandom(0), mPoolPos(0), mPatCc(0), mPmtVersion(0), mVideoLevel(0), mVideoRmax(0), mBaseTime(0), mPackets(0), mBytes(0), mLost(0), mGarbageRuns(0) {
+    mRandom = param.seed * 0x9e3779b97f4a7c15ULL + 1;
+    if (mRandom == 0) {
+        mRandom = 1;
+    }
+
+    // no 0x00 to form a start code, no 0xff to form an ADTS sync word
+    mPool.resize(GEN_POOL_SIZE);
+    for (size_t i = 0; i < mPool.size(); i++) {
+        mPool[i] = (unsigned char)(1 + random() % 254);
+    }
+
+    if (mParam.ptsWrapMs >= 0) {
+        mBaseTime = (PTS_WRAP - GEN_VIDEO_DELAY - mParam.ptsWrapMs * 90) % PTS_WRAP * 300;
+    } else {
+        mBaseTime = 10 * CLOCK_27MHZ;
+    }
+
+    int64_t videoBitrate = mParam.videoBitrate > 0 ? mParam.videoBitrate : mParam.bitrate * 7 / 10 / mParam.programs;
+    // the lowest level whose MaxBR (NAL, 1.2 times the VCL one) leaves room for the IDR frames
+    size_t level = 0;
+    while (level + 1 < genLevelCount && genLevels[level][1] * 1200LL < videoBitrate * 3 / 2) {
+        level++;
+    }
+    mVideoLevel = genLevels[level][0];
+    mVideoRmax = genLevels[level][1] * 1200LL;
+    for (int p = 0; p < mParam.programs; p++) {
+        ProgramState program;
+        program.number = (uint16_t)(p + 1);
+        program.pmtPid = (uint16_t)(0x1000 + p);
+        for (int s = 0; s <= mParam.audioStreams; s++) {
+            Stream stream;
+            stream.pid = (uint16_t)(0x100 + p * 0x10 + s);
+            stream.program = mPrograms.size();
+            stream.video = s == 0;
+            stream.firstGop = mParam.gop - (uint64_t)p * mParam.gop / mParam.programs;
+            stream.frameBytes = (size_t)((stream.video ? videoBitrate * GEN_VIDEO_FRAME : mParam.audioBitrate * GEN_AUDIO_FRAME) / 90000 / 8);
+            stream.delay = stream.video ? GEN_VIDEO_DELAY : audioDelay(stream.frameBytes);
+            stream.spacing = TS_PACKET * 8 * CLOCK_27MHZ / (stream.video ? mVideoRmax : GEN_AUDIO_RX);
+            program.streams.push_back(mStreams.size());
+            mStreams.push_back(stream);
+        }
+        mPrograms.push_back(program);
+    }
+}
+
+TsGenerator::~TsGenerator() {
+}
+
+// the audio sent over the delay, and the frame being sent, stay within the buffer of the decoder
+uint64_t TsGenerator::audioDelay(size_t frameBytes) const {
+    if (2 * frameBytes >= GEN_AUDIO_BUFFER || mParam.audioBitrate <= 0) {
+        return GEN_AUDIO_FRAME;
+    }
+    uint64_t delay = (uint64_t)(GEN_AUDIO_BUFFER - 2 * frameBytes) * 8 * 90000 / mParam.audioBitrate;
+    return std::max(std::min(delay, (uint64_t)GEN_AUDIO_DELAY), (uint64_t)GEN_AUDIO_FRAME);
+}
+
+// xorshift64*, the same sequence on every platform
+uint64_t TsGenerator::random() {
+    mRandom ^= mRandom >> 12;
+    mRandom ^= mRandom << 25;
+    mRandom ^= mRandom >> 27;
+    return mRandom * 2685821657736338717ULL;
+}
+
+uint64_t TsGenerator::randomInterval(uint64_t mean) {
+    return 1 + random() % (2 * mean);
+}
+
+// 27MHz from the first packet, at the TS bitrate
+uint64_t TsGenerator::timeOf(uint64_t packet) const {
+    uint64_t bits = (uint64_t)TS_PACKET * 8 * CLOCK_27MHZ;
+    uint64_t rate = (uint64_t)mParam.bitrate;
+    return packet / rate * bits + packet % rate * bits / rate;
+}
+
+// 27MHz from the first packet, when the frame is due to be sent
+uint64_t TsGenerator::frameTime(const Stream &stream, uint64_t frame) const {
+    return frame * (stream.video ? GEN_VIDEO_FRAME : GEN_AUDIO_FRAME) * 300;
+}
+
+void TsGenerator::fillPayload(std::vector<unsigned char> &out, size_t size) {
+    while (size > 0) {
+        size_t n = std::min(size, mPool.size() - mPoolPos);
+        out.insert(out.end(), mPool.begin() + mPoolPos, mPool.begin() + mPoolPos + n);
+        mPoolPos = (mPoolPos + n) % mPool.size();
+        size -= n;
+    }
+    // the next frame does not repeat this one
+    mPoolPos = (mPoolPos + random() % 4096) % mPool.size();
+}
+
+void TsGenerator::writePesHeader(std::vector<unsigned char> &out, uint8_t streamId, uint64_t pts, uint64_t dts, bool withDts, size_t payload) {
+    size_t headerData = withDts ? 10 : 5;
+    size_t length = 3 + headerData + payload;
+    out.push_back(0x00);
+    out.push_back(0x00);
+    out.push_back(0x01);
+    out.push_back(streamId);
+    // 0 for a video PES too long for the field
+    out.push_back(length > 0xffff ? 0 : (unsigned char)(length >> 8));
+    out.push_back(length > 0xffff ? 0 : (unsigned char)length);
+    out.push_back(0x80);
+    out.push_back(withDts ? 0xc0 : 0x80);
+    out.push_back((unsigned char)headerData);
+    writeTimestamp(out, withDts ? 3 : 2, pts);
+    if (withDts) {
+        writeTimestamp(out, 1, dts);
+    }
+}
+
+// one access unit: AUD, SPS and PPS before an IDR, one slice
+void TsGenerator::buildVideoPes(Stream &stream) {
+    uint64_t frame = stream.frame;
+    uint64_t gopFrame = frame < stream.firstGop ? frame : (frame - stream.firstGop) % mParam.gop;
+    uint64_t gopIndex = frame < stream.firstGop ? 0 : (frame - stream.firstGop) / mParam.gop + 1;
+    bool idr = gopFrame == 0;
+    std::vector<unsigned char> au;
+    std::vector<unsigned char> rbsp;
+
+    rbsp.push_back(0xf0);                   // primary_pic_type 7, trailing bits
+    writeNal(au, 0x09, rbsp);
+
+    if (idr) {
+        rbsp.clear();
+        BitWriter sps(rbsp);
+        sps.put(66, 8);                     // baseline
+        sps.put(0, 8);
+        sps.put(mVideoLevel, 8);            // level_idc
+        sps.ue(0);                          // seq_parameter_set_id
+        sps.ue(0);                          // log2_max_frame_num - 4
+        sps.ue(2);                          // pic_order_cnt_type
+        sps.ue(1);                          // num_ref_frames
+        sps.put(0, 1);                      // gaps_in_frame_num_allowed
+        sps.ue(GEN_VIDEO_WIDTH / 16 - 1);
+        sps.ue(GEN_VIDEO_HEIGHT / 16 - 1);
+        sps.put(1, 1);                      // frame_mbs_only
+        sps.put(1, 1);                      // direct_8x8_inference
+        sps.put(0, 1);                      // frame_cropping
+        sps.put(0, 1);                      // vui_parameters_present
+        sps.trailing();
+        writeNal(au, 0x67, rbsp);
+
+        rbsp.clear();
+        BitWriter pps(rbsp);
+        pps.ue(0);                          // pic_parameter_set_id
+        pps.ue(0);                          // seq_parameter_set_id
+        pps.put(0, 1);                      // entropy_coding_mode
+        pps.put(0, 1);                      // pic_order_present
+        pps.ue(0);                          // num_slice_groups - 1
+        pps.ue(0);                          // num_ref_idx_l0_active - 1
+        pps.ue(0);                          // num_ref_idx_l1_active - 1
+        pps.put(0, 3);                      // weighted_pred, weighted_bipred_idc
+        pps.ue(1);                          // pic_init_qp - 26 = -1
+        pps.ue(0);                          // pic_init_qs - 26
+        pps.ue(0);                          // chroma_qp_index_offset
+        pps.put(1, 1);                      // deblocking_filter_control_present
+        pps.put(0, 2);                      // constrained_intra_pred, redundant_pic_cnt_present
+        pps.trailing();
+        writeNal(au, 0x68, rbsp);
+    }
+
+    // I frames 3 times the P frames, the GOP at the average size, 20% spread
+    size_t pSize = stream.frameBytes * mParam.gop / (mParam.gop + 2);
+    size_t size = idr ? pSize * 3 : pSize;
+    size = size * (80 + random() % 41) / 100;
+
+    rbsp.clear();
+    BitWriter slice(rbsp);
+    slice.ue(0);                            // first_mb_in_slice
+    slice.ue(idr ? 7 : 5);                  // I or P, all the slices of the picture
+    slice.ue(0);                            // pic_parameter_set_id
+    slice.put((uint32_t)gopFrame & 0x0f, 4);   // frame_num
+    if (idr) {
+        slice.ue((uint32_t)gopIndex & 1);   // idr_pic_id
+    }
+    slice.align();
+    fillPayload(rbsp, size > au.size() + rbsp.size() + 32 ? size - au.size() - rbsp.size() : 32);
+    writeNal(au, idr ? 0x65 : 0x41, rbsp);
+
+    // no B frames: the PTS one frame after the DTS
+    uint64_t dts = ((mBaseTime + frameTime(stream, frame)) / 300 + stream.delay) % PTS_WRAP;
+    uint64_t pts = (dts + GEN_VIDEO_FRAME) % PTS_WRAP;
+    stream.pes.clear();
+    writePesHeader(stream.pes, 0xe0, pts, dts, true, au.size());
+    stream.pes.insert(stream.pes.end(), au.begin(), au.end());
+}
+
+// one ADTS frame, AAC LC stereo 48kHz
+void TsGenerator::buildAudioPes(Stream &stream) {
+    size_t size = std::max(stream.frameBytes, (size_t)16);
+    if (size > 0x1fff) {
+        size = 0x1fff;
+    }
+    std::vector<unsigned char> frame;
+    frame.push_back(0xff);
+    frame.push_back(0xf1);                  // MPEG-4, no CRC
+    frame.push_back((1 << 6) | (3 << 2));   // LC, 48kHz
+    frame.push_back((unsigned char)((2 << 6) | (size >> 11)));   // 2 channels
+    frame.push_back((unsigned char)(size >> 3));
+    frame.push_back((unsigned char)(((size & 7) << 5) | 0x1f));  // buffer fullness 0x7ff
+    frame.push_back(0xfc);                  // one raw data block
+    fillPayload(frame, size - frame.size());
+
+    uint64_t pts = ((mBaseTime + frameTime(stream, stream.frame)) / 300 + stream.delay) % PTS_WRAP;
+    stream.pes.clear();
+    writePesHeader(stream.pes, 0xc0, pts, pts, false, frame.size());
+    stream.pes.insert(stream.pes.end(), frame.begin(), frame.end());
+}
+
+// a section split over as many TS packets as it needs
+void TsGenerator::queueSection(uint16_t pid, uint8_t &cc, const std::vector<unsigned char> &section) {
+    size_t pos = 0;
+    while (pos < section.size()) {
+        std::vector<unsigned char> packet(TS_PACKET, 0xff);
+        bool unitStart = pos == 0;
+        packetHeader(&packet[0], pid, unitStart, cc, true);
+        size_t offset = 4;
+        if (unitStart) {
+            packet[offset++] = 0x00;        // pointer_field
+        }
+        size_t n = std::min(section.size() - pos, TS_PACKET - offset);
+        memcpy(&packet[offset], &section[pos], n);
+        pos += n;
+        mPsi.push_back(packet);
+    }
+}
+
+void TsGenerator::queuePsi() {
+    std::vector<unsigned char> pat;
+    size_t length = 5 + 4 * mPrograms.size() + 4;
+    pat.push_back(0x00);
+    pat.push_back((unsigned char)(0xb0 | (length >> 8)));
+    pat.push_back((unsigned char)length);
+    pat.push_back(0x00);
+    pat.push_back(0x01);                    // transport_stream_id
+    pat.push_back(0xc1);
+    pat.push_back(0x00);
+    pat.push_back(0x00);
+    for (std::vector<ProgramState>::const_iterator it = mPrograms.begin(); it != mPrograms.end(); ++it) {
+        pat.push_back((unsigned char)(it->number >> 8));
+        pat.push_back((unsigned char)it->number);
+        pat.push_back((unsigned char)(0xe0 | (it->pmtPid >> 8)));
+        pat.push_back((unsigned char)it->pmtPid);
+    }
+    uint32_t crc = TSDemux::SectionDemux::crc32(&pat[0], pat.size());
+    for (int i = 3; i >= 0; i--) {
+        pat.push_back((unsigned char)(crc >> (i * 8)));
+    }
+    queueSection(0x0000, mPatCc, pat);
+
+    for (std::vector<ProgramState>::iterator it = mPrograms.begin(); it != mPrograms.end(); ++it) {
+        std::vector<unsigned char> pmt;
+        uint16_t pcrPid = mStreams[it->streams[0]].pid;
+        length = 9 + 5 * it->streams.size() + 4;
+        pmt.push_back(0x02);
+        pmt.push_back((unsigned char)(0xb0 | (length >> 8)));
+        pmt.push_back((unsigned char)length);
+        pmt.push_back((unsigned char)(it->number >> 8));
+        pmt.push_back((unsigned char)it->number);
+        pmt.push_back((unsigned char)(0xc1 | (mPmtVersion << 1)));
+        pmt.push_back(0x00);
+        pmt.push_back(0x00);
+        pmt.push_back((unsigned char)(0xe0 | (pcrPid >> 8)));
+        pmt.push_back((unsigned char)pcrPid);
+        pmt.push_back(0xf0);                // program_info_length 0
+        pmt.push_back(0x00);
+        for (std::vector<size_t>::const_iterator s = it->streams.begin(); s != it->streams.end(); ++s) {
+            const Stream &stream = mStreams[*s];
+            pmt.push_back(stream.video ? 0x1b : 0x0f);   // H.264, AAC ADTS
+            pmt.push_back((unsigned char)(0xe0 | (stream.pid >> 8)));
+            pmt.push_back((unsigned char)stream.pid);
+            pmt.push_back(0xf0);            // ES_info_length 0
+            pmt.push_back(0x00);
+        }
+        crc = TSDemux::SectionDemux::crc32(&pmt[0], pmt.size());
+        for (int i = 3; i >= 0; i--) {
+            pmt.push_back((unsigned char)(crc >> (i * 8)));
+        }
+        queueSection(it->pmtPid, it->pmtCc, pmt);
+    }
+}
+
+void TsGenerator::packetHeader(unsigned char *p, uint16_t pid, bool unitStart, uint8_t &cc, bool payload) {
+    p[0] = 0x47;
+    p[1] = (unsigned char)((unitStart ? 0x40 : 0x00) | (pid >> 8));
+    p[2] = (unsigned char)pid;
+    p[3] = (unsigned char)(0x10 | cc);
+    if (payload) {
+        cc = (cc + 1) & 0x0f;
+    }
+}
+
+static void writePcr(unsigned char *p, uint64_t pcr) {
+    uint64_t base = pcr / 300 % PTS_WRAP;
+    uint32_t ext = (uint32_t)(pcr % 300);
+    p[0] = (unsigned char)(base >> 25);
+    p[1] = (unsigned char)(base >> 17);
+    p[2] = (unsigned char)(base >> 9);
+    p[3] = (unsigned char)(base >> 1);
+    p[4] = (unsigned char)(((base & 1) << 7) | 0x7e | (ext >> 8));
+    p[5] = (unsigned char)ext;
+}
+
+// the next bytes of the PES, the last packet stuffed through its adaptation field
+void TsGenerator::streamPacket(unsigned char *p, Stream &stream, bool withPcr, uint64_t pcr) {
+    size_t remaining = stream.pes.size() - stream.pos;
+    size_t adaptation = withPcr ? 8 : 0;
+    if (remaining < TS_PAYLOAD - adaptation) {
+        adaptation = TS_PAYLOAD - remaining;
+    }
+    packetHeader(p, stream.pid, stream.pos == 0, stream.cc, true);
+    if (adaptation > 0) {
+        p[3] |= 0x20;
+        p[4] = (unsigned char)(adaptation - 1);
+        if (adaptation > 1) {
+            p[5] = withPcr ? 0x10 : 0x00;
+            memset(p + 6, 0xff, adaptation - 2);
+            if (withPcr) {
+                writePcr(p + 6, pcr);
+            }
+        }
+    }
+    size_t n = TS_PAYLOAD - adaptation;
+    memcpy(p + 4 + adaptation, &stream.pes[stream.pos], n);
+    stream.pos += n;
+}
+
+// adaptation field only, the continuity counter is not incremented
+void TsGenerator::pcrPacket(unsigned char *p, uint16_t pid, uint8_t cc, uint64_t pcr) {
+    p[0] = 0x47;
+    p[1] = (unsigned char)(pid >> 8);
+    p[2] = (unsigned char)pid;
+    p[3] = (unsigned char)(0x20 | ((cc - 1) & 0x0f));
+    p[4] = TS_PAYLOAD - 1;
+    p[5] = 0x10;
+    writePcr(p + 6, pcr);
+    memset(p + 12, 0xff, TS_PACKET - 12);
+}
+
+void TsGenerator::nullPacket(unsigned char *p) {
+    p[0] = 0x47;
+    p[1] = 0x1f;
+    p[2] = 0xff;
+    p[3] = 0x10;
+    memset(p + 4, 0xff, TS_PAYLOAD);
+}
+
+bool TsGenerator::writePacket(FILE *out, const unsigned char *p, uint64_t time) {
+    unsigned char prefix[4];
+    static const unsigned char parity[16] = { 0 };
+    if (mParam.packetSize == 192) {
+        // TP_extra_header: copy permission 0, 30-bit arrival time stamp
+        uint32_t ats = (uint32_t)(time & 0x3fffffff);
+        prefix[0] = (unsigned char)(ats >> 24);
+        prefix[1] = (unsigned char)(ats >> 16);
+        prefix[2] = (unsigned char)(ats >> 8);
+        prefix[3] = (unsigned char)ats;
+        if (fwrite(prefix, 1, sizeof(prefix), out) != sizeof(prefix)) {
+            return false;
+        }
+    }
+    if (fwrite(p, 1, TS_PACKET, out) != TS_PACKET) {
+        return false;
+    }
+    if (mParam.packetSize == 204 && fwrite(parity, 1, sizeof(parity), out) != sizeof(parity)) {
+        return false;
+    }
+    mPackets++;
+    mBytes += mParam.packetSize;
+    return true;
+}
+
+// random bytes between two packets, 0x47 included, for the resync
+bool TsGenerator::writeGarbage(FILE *out) {
+    size_t size = 1 + (size_t)(random() % (2 * mParam.packetSize));
+    std::vector<unsigned char> garbage(size);
+    for (size_t i = 0; i < size; i++) {
+        garbage[i] = (unsigned char)random();
+    }
+    mGarbageRuns++;
+    mBytes += size;
+    return fwrite(&garbage[0], 1, size, out) == size;
+}
+
+bool TsGenerator::generate(FILE *out) {
+    uint64_t end = (uint64_t)mParam.durationMs * (CLOCK_27MHZ / 1000);
+    uint64_t psiInterval = (uint64_t)mParam.psiIntervalMs * (CLOCK_27MHZ / 1000);
+    uint64_t pcrInterval = (uint64_t)mParam.pcrIntervalMs * (CLOCK_27MHZ / 1000);
+    uint64_t bumpInterval = (uint64_t)mParam.pmtBumpMs * (CLOCK_27MHZ / 1000);
+    uint64_t nextPsi = 0;
+    uint64_t nextBump = bumpInterval;
+    uint64_t ccCountdown = mParam.ccErrorInterval ? randomInterval(mParam.ccErrorInterval) : 0;
+    uint64_t garbageCountdown = mParam.garbageInterval ? randomInterval(mParam.garbageInterval) : 0;
+    unsigned char packet[TS_PACKET];
+
+    for (uint64_t index = 0; ; index++) {
+        uint64_t time = timeOf(index);
+        if (time >= end || (mParam.maxBytes > 0 && mBytes >= mParam.maxBytes)) {
+            break;
+        }
+
+        if (bumpInterval > 0 && time >= nextBump) {
+            mPmtVersion = (mPmtVersion + 1) & 0x1f;
+            nextBump += bumpInterval;
+            nextPsi = time;
+        }
+        if (time >= nextPsi) {
+            queuePsi();
+            nextPsi = time + psiInterval;
+        }
+        for (std::vector<Stream>::iterator it = mStreams.begin(); it != mStreams.end(); ++it) {
+            if (it->pos == it->pes.size() && frameTime(*it, it->frame) <= time) {
+                if (it->video) {
+                    buildVideoPes(*it);
+                } else {
+                    buildAudioPes(*it);
+                }
+                it->sendTime = frameTime(*it, it->frame);
+                it->pos = 0;
+                it->frame++;
+            }
+        }
+
+        bool data = false;
+        uint64_t pcr = (mBaseTime + time) % PCR_WRAP;
+        if (!mPsi.empty()) {
+            memcpy(packet, &mPsi.front()[0], TS_PACKET);
+            mPsi.erase(mPsi.begin());
+        } else {
+            ProgramState *pcrProgram = NULL;
+            for (std::vector<ProgramState>::iterator it = mPrograms.begin(); it != mPrograms.end(); ++it) {
+                if (time >= it->nextPcr) {
+                    pcrProgram = &*it;
+                    break;
+                }
+            }
+            if (pcrProgram != NULL) {
+                Stream &video = mStreams[pcrProgram->streams[0]];
+                if (video.pos < video.pes.size() && time >= video.nextPacket) {
+                    streamPacket(packet, video, true, pcr);
+                    video.nextPacket = time + video.spacing;
+                    data = true;
+                } else {
+                    pcrPacket(packet, video.pid, video.cc, pcr);
+                }
+                pcrProgram->nextPcr = time + pcrInterval;
+            } else {
+                // the PES decoded the earliest goes first, so audio with its short delay is not held
+                // behind a large video PES; no stream is sent faster than its buffers drain
+                Stream *next = NULL;
+                for (std::vector<Stream>::iterator it = mStreams.begin(); it != mStreams.end(); ++it) {
+                    if (it->pos < it->pes.size() && time >= it->nextPacket
+                        && (next == NULL || it->sendTime + it->delay * 300 < next->sendTime + next->delay * 300)) {
+                        next = &*it;
+                    }
+                }
+                if (next != NULL) {
+                    next->nextPacket = time + next->spacing;
+                    // as encoders do, a PCR with each video PES start
+                    bool withPcr = next->video && next->pos == 0;
+                    if (withPcr) {
+                        mPrograms[next->program].nextPcr = time + pcrInterval;
+                    }
+                    streamPacket(packet, *next, withPcr, pcr);
+                    data = true;
+                } else {
+                    nullPacket(packet);
+                }
+            }
+        }
+
+        if (data && ccCountdown > 0 && --ccCountdown == 0) {
+            // lost on the way: the data and the continuity counter step are gone
+            nullPacket(packet);
+            mLost++;
+            ccCountdown = randomInterval(mParam.ccErrorInterval);
+        }
+        if (garbageCountdown > 0 && --garbageCountdown == 0) {
+            if (!writeGarbage(out)) {
+                return false;
+            }
+            garbageCountdown = randomInterval(mParam.garbageInterval);
+        }
+        if (!writePacket(out, packet, mBaseTime + time)) {
+            return false;
+        }
+    }
+    return fflush(out) == 0;
+}
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <inttypes.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace GYJ {
+
+#define GEN_VIDEO_WIDTH         1280
+#define GEN_VIDEO_HEIGHT        720
+#define GEN_VIDEO_FRAME         3600    // 90kHz, 25 fps
+#define GEN_AUDIO_FRAME         1920    // 90kHz, 1024 samples at 48kHz
+#define GEN_VIDEO_DELAY         63000   // 90kHz, from the PCR to the DTS of a video frame sent on time
+#define GEN_AUDIO_DELAY         9000    // 90kHz, the same for audio, less if the bytes in flight would not fit GEN_AUDIO_BUFFER
+#define GEN_AUDIO_BUFFER        3584    // Bn of an AAC stream up to 2 channels
+#define GEN_AUDIO_RX            2000000 // bit/s, Rxn of the audio transport buffer, audio packets are not sent faster
+#define GEN_POOL_SIZE           1048576 // random payload bytes, reused
+
+typedef struct GeneratorParam {
+    GeneratorParam() : seed(1), packetSize(188), programs(1), audioStreams(1), bitrate(8000000), videoBitrate(0), audioBitrate(128000)
+        , pcrIntervalMs(30), psiIntervalMs(100), gop(25), durationMs(60000), maxBytes(0), ccErrorInterval(0), ptsWrapMs(-1)
+        , pmtBumpMs(0), garbageInterval(0) {}
+    uint64_t seed;
+    int packetSize;                     // 188, 192 (M2TS arrival time prefix) or 204 (RS parity)
+    int programs;
+    int audioStreams;                   // by program
+    int64_t bitrate;                    // bit/s of the TS, null packets fill the rest
+    int64_t videoBitrate;               // bit/s by program, 0: 70% of the TS shared by the programs
+    int64_t audioBitrate;               // bit/s by audio stream
+    int pcrIntervalMs;                  // at the latest, the first packet of each video PES has one too
+    int psiIntervalMs;                  // PAT and PMT repetition
+    int gop;                            // frames from an IDR to the next
+    int64_t durationMs;
+    uint64_t maxBytes;                  // 0: no limit
+    uint64_t ccErrorInterval;           // a lost packet about every that many packets, 0: none
+    int64_t ptsWrapMs;                  // the 33-bit timestamps wrap that far into the stream, -1: no wrap
+    int64_t pmtBumpMs;                  // PMT version bumped that often, 0: never
+    uint64_t garbageInterval;           // a run of garbage bytes about every that many packets, 0: none
+} GeneratorParam;
+
+/*
+ * Writes a valid, constant bitrate transport stream: PAT, one PMT, an
+ * H.264 video stream and AAC ADTS audio streams by program, PCR on the
+ * video PID. The H.264 parameter sets and slice headers are real, the
+ * slice data and the audio payloads are random bytes that cannot form a
+ * start code or a sync word, so the parsers frame them as real media.
+ * Faults are injected on request. The output only depends on the
+ * parameters: the same seed gives the same bytes.
+ */
+class TsGenerator
+{
+public:
+    explicit TsGenerator(const GeneratorParam &param);
+    ~TsGenerator();
+
+    // false on a write error
+    bool generate(FILE *out);
+
+    uint64_t getPackets() const { return mPackets; }
+    uint64_t getBytes() const { return mBytes; }
+    uint64_t getLostPackets() const { return mLost; }
+    uint64_t getGarbageRuns() const { return mGarbageRuns; }
+
+private:
+    typedef struct Stream {
+        Stream() : pid(0), program(0), video(false), cc(0), pos(0), frame(0), firstGop(0), frameBytes(0), delay(0), spacing(0), sendTime(0), nextPacket(0) {}
+        uint16_t pid;
+        size_t program;                     // into mPrograms
+        bool video;
+        uint8_t cc;
+        std::vector<unsigned char> pes;     // PES being sent
+        size_t pos;                         // sent bytes of pes
+        uint64_t frame;                     // next frame to put in a PES
+        uint64_t firstGop;                  // frames, shortened so the programs do not send their IDRs together
+        size_t frameBytes;                  // average frame size
+        uint64_t delay;                     // 90kHz, from the send time to the DTS of a frame
+        uint64_t spacing;                   // 27MHz, between two packets at the rate the buffers drain
+        uint64_t sendTime;                  // 27MHz, of the PES being sent
+        uint64_t nextPacket;                // 27MHz, no packet before
+    } Stream;
+
+    typedef struct ProgramState {
+        ProgramState() : number(0), pmtPid(0), pmtCc(0), nextPcr(0) {}
+        uint16_t number;
+        uint16_t pmtPid;
+        uint8_t pmtCc;
+        uint64_t nextPcr;                   // 27MHz
+        std::vector<size_t> streams;        // into mStreams, the video first
+    } ProgramState;
+
+    uint64_t random();
+    uint64_t randomInterval(uint64_t mean);
+    uint64_t timeOf(uint64_t packet) const;
+    uint64_t frameTime(const Stream &stream, uint64_t frame) const;
+    uint64_t audioDelay(size_t frameBytes) const;
+    void fillPayload(std::vector<unsigned char> &out, size_t size);
+
+    void buildVideoPes(Stream &stream);
+    void buildAudioPes(Stream &stream);
+    void writePesHeader(std::vector<unsigned char> &out, uint8_t streamId, uint64_t pts, uint64_t dts, bool withDts, size_t payload);
+
+    void queuePsi();
+    void queueSection(uint16_t pid, uint8_t &cc, const std::vector<unsigned char> &section);
+
+    void packetHeader(unsigned char *p, uint16_t pid, bool unitStart, uint8_t &cc, bool payload);
+    void streamPacket(unsigned char *p, Stream &stream, bool withPcr, uint64_t pcr);
+    void pcrPacket(unsigned char *p, uint16_t pid, uint8_t cc, uint64_t pcr);
+    void nullPacket(unsigned char *p);
+    bool writePacket(FILE *out, const unsigned char *p, uint64_t time);
+    bool writeGarbage(FILE *out);
+
+    GeneratorParam mParam;
+    uint64_t mRandom;
+    std::vector<unsigned char> mPool;
+    size_t mPoolPos;
+    std::vector<Stream> mStreams;
+    std::vector<ProgramState> mPrograms;
+    std::vector<std::vector<unsigned char> > mPsi;  // TS packets waiting
+    uint8_t mPatCc;
+    uint8_t mPmtVersion;
+    int mVideoLevel;                                // level_idc of the SPS
+    int64_t mVideoRmax;                             // bit/s, MaxBR (NAL) of that level, video packets are not sent faster
+    uint64_t mBaseTime;                             // 27MHz, the clock at the first packet
+    uint64_t mPackets;
+    uint64_t mBytes;
+    uint64_t mLost;
+    uint64_t mGarbageRuns;
+};
+}
@@ -0,0 +1,61 @@
+#include "TsInput.h"
+
+#include <cstring>
+
+TsFileInput::TsFileInput(FILE *file, uint64_t offset, uint64_t length)
+    : mFile(file), mOffset(offset), mLength(length), mPos(0), mRange(true) {
+    if (fseek(mFile, (int64_t)offset, SEEK_SET) != 0) {
+        // nothing to read
+        mLength = 0;
+    }
+}
+
+size_t TsFileInput::read(unsigned char *buf, size_t n) {
+    if (mRange) {
+        if (n > mLength - mPos) {
+            n = (size_t)(mLength - mPos);
+        }
+        size_t c = fread(buf, 1, n, mFile);
+        mPos += c;
+        return c;
+    }
+    // the file may have grown since its end was read (follow mode)
+    clearerr(mFile);
+    return fread(buf, 1, n, mFile);
+}
+
+bool TsFileInput::seek(uint64_t pos) {
+    if (mRange) {
+        if (pos > mLength || fseek(mFile, (int64_t)(mOffset + pos), SEEK_SET) != 0) {
+            return false;
+        }
+        mPos = pos;
+        return true;
+    }
+    return fseek(mFile, (int64_t)pos, SEEK_SET) == 0;
+}
+
+size_t TsMemoryInput::read(unsigned char *buf, size_t n) {
+    if (n > mSize - mPos) {
+        n = mSize - mPos;
+    }
+    memcpy(buf, mData + mPos, n);
+    mPos += n;
+    return n;
+}
+
+bool TsMemoryInput::seek(uint64_t pos) {
+    if (pos > mSize) {
+        return false;
+    }
+    mPos = (size_t)pos;
+    return true;
+}
+
+size_t TsCallbackInput::read(unsigned char *buf, size_t n) {
+    return mRead(mOpaque, buf, n);
+}
+
+bool TsCallbackInput::seek(uint64_t pos) {
+    return mSeek != NULL && mSeek(mOpaque, pos) == 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <inttypes.h>
+#include <cstddef>
+#include <cstdio>
+
+/*
+ * Byte source of a TsLayer: a file, a memory buffer or the callbacks of an
+ * embedding application. Reads are sequential, seek() only happens when the
+ * demux goes back before its buffer.
+ */
+class TsInput
+{
+public:
+    virtual ~TsInput() {}
+    // up to n bytes, 0 at the end of the input
+    virtual size_t read(unsigned char *buf, size_t n) = 0;
+    virtual bool seek(uint64_t pos) = 0;
+};
+
+// not owned, the caller closes the file
+class TsFileInput : public TsInput
+{
+public:
+    explicit TsFileInput(FILE *file) : mFile(file), mOffset(0), mLength(0), mPos(0), mRange(false) {}
+    // the length bytes at offset only (a byte range segment), positions relative to offset
+    TsFileInput(FILE *file, uint64_t offset, uint64_t length);
+    virtual size_t read(unsigned char *buf, size_t n);
+    virtual bool seek(uint64_t pos);
+private:
+    FILE *mFile;
+    uint64_t mOffset;
+    uint64_t mLength;
+    uint64_t mPos;
+    bool mRange;
+};
+
+// not copied, the data must outlive the demux
+class TsMemoryInput : public TsInput
+{
+public:
+    TsMemoryInput(const unsigned char *data, size_t size) : mData(data), mSize(size), mPos(0) {}
+    virtual size_t read(unsigned char *buf, size_t n);
+    virtual bool seek(uint64_t pos);
+private:
+    const unsigned char *mData;
+    size_t mSize;
+    size_t mPos;
+};
+
+// seek may be NULL for a stream that cannot go back
+class TsCallbackInput : public TsInput
+{
+public:
+    typedef size_t (*ReadFunc)(void *opaque, unsigned char *buf, size_t n);
+    typedef int (*SeekFunc)(void *opaque, uint64_t pos);   // 0 on success
+
+    TsCallbackInput(ReadFunc readFunc, SeekFunc seekFunc, void *opaque) : mRead(readFunc), mSeek(seekFunc), mOpaque(opaque) {}
+    virtual size_t read(unsigned char *buf, size_t n);
+    virtual bool seek(uint64_t pos);
+private:
+    ReadFunc mRead;
+    SeekFunc mSeek;
+    void *mOpaque;
+};
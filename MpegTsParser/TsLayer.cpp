@@ -1,23 +1,37 @@
-#include "StdAfx.h"
+#include "stdafx.h"
 #include "TsLayer.h"
+#include "timeutils.h"
+#include "ChromeTrace.h"
+
+#include <cstdlib>
+#include <cstring>
 
 extern int g_parseonly;
 #define LOGTAG ""
-TsLayer::TsLayer(FILE* file, uint16_t channel, int fileIndex) : m_channel(channel), mFileIndex(fileIndex) {
-    m_ifile = file;
+TsLayer::TsLayer(FILE* file, const TSDemux::ProgramSelection &selection, int fileIndex, TSDemux::Logger *logger)
+    : mInput(new TsFileInput(file)), mOwnInput(true), mFileIndex(fileIndex), mLogger(logger ? logger : &TSDemux::Logger::Default()), mWallClock(false), mReadTime(0), mTrace(NULL) {
+    init(selection, fileIndex);
+}
+
+TsLayer::TsLayer(TsInput* input, const TSDemux::ProgramSelection &selection, int fileIndex, TSDemux::Logger *logger)
+    : mInput(input), mOwnInput(false), mFileIndex(fileIndex), mLogger(logger ? logger : &TSDemux::Logger::Default()), mWallClock(false), mReadTime(0), mTrace(NULL) {
+    init(selection, fileIndex);
+}
+
+void TsLayer::init(const TSDemux::ProgramSelection &selection, int fileIndex) {
+    mTsContext = NULL;
     mBufferSize = AV_BUFFER_SIZE;
     mBuffer = (unsigned char*)malloc(sizeof(*mBuffer) * (mBufferSize + 1));
     if (mBuffer){
         m_av_pos = 0;
         mBufferStart = mBuffer;
         mBufferEnd = mBuffer;
-        m_channel = channel;
 
         mVideoPid = 0xffff;
         mAudioPid = 0xffff;
 
         mPinTime = mCurTime = mEndTime = 0;
-        mTsContext = new TSDemux::TsLayerContext(this, 0, m_channel, fileIndex);
+        mTsContext = new TSDemux::TsLayerContext(this, 0, selection, fileIndex, mLogger);
     }
     else
     {
@@ -30,6 +44,10 @@ TsLayer::~TsLayer()
     if (mTsContext) {
         delete mTsContext;
     }
+    delete mTrace;
+    if (mOwnInput) {
+        delete mInput;
+    }
 
     if (mBuffer != NULL){
         free(mBuffer);
@@ -48,8 +66,7 @@ const unsigned char* TsLayer::ReadAV(uint64_t pos, size_t n)
     if (pos < m_av_pos || pos > (m_av_pos + sz))
     {
         // seek and reset buffer
-        int ret = fseek(m_ifile, (int64_t)pos, SEEK_SET);
-        if (ret != 0)
+        if (!mInput->seek(pos))
             return NULL;
         m_av_pos = (uint64_t)pos;
         mBufferStart = mBufferEnd = mBuffer;
@@ -70,9 +87,14 @@ const unsigned char* TsLayer::ReadAV(uint64_t pos, size_t n)
     m_av_pos = pos;
     unsigned int len = (unsigned int)(mBufferSize - dataread);
 
+    PERF_SCOPE(mTsContext->GetPerfCounters(), TSDemux::PERF_STAGE_READ);
+    TRACE_SPAN("read", TRACE_IO);
     while (len > 0)
     {
-        size_t c = fread(mBufferEnd, sizeof(*mBuffer), len, m_ifile);
+        // live input: do not wait for a full buffer, arrival time is the read time
+        size_t c = mInput->read(mBufferEnd, mWallClock && len > AV_LIVE_READ_SIZE ? AV_LIVE_READ_SIZE : len);
+        if (mWallClock)
+            mReadTime = TSDemux::PLATFORM::GetTimeUs();
         if (c > 0)
         {
             mBufferEnd += c;
@@ -85,18 +107,89 @@ const unsigned char* TsLayer::ReadAV(uint64_t pos, size_t n)
     return dataread >= n ? mBufferStart : NULL;
 }
 
-int TsLayer::doDemux(){
+void TsLayer::enablePcrAnalysis(bool wallClock) {
+    mWallClock = wallClock;
+    mTsContext->EnablePcrAnalysis(wallClock ? TSDemux::PCR_ARRIVAL_WALLCLOCK : TSDemux::PCR_ARRIVAL_BYTES);
+}
+
+std::map<uint16_t, TSDemux::PCR_STATS> TsLayer::getPcrStats() {
+    std::map<uint16_t, TSDemux::PCR_STATS> stats;
+    const TSDemux::PcrAnalyzer &analyzer = mTsContext->GetPcrAnalyzer();
+    std::vector<uint16_t> pids = analyzer.getPids();
+    for (std::vector<uint16_t>::iterator it = pids.begin(); it != pids.end(); ++it) {
+        stats.insert(std::make_pair(*it, *analyzer.getStats(*it)));
+    }
+    return stats;
+}
+
+std::map<uint16_t, TSDemux::GOP_STATS> TsLayer::getGopStats() {
+    std::map<uint16_t, TSDemux::GOP_STATS> stats;
+    const TSDemux::GopAnalyzer &analyzer = mTsContext->GetGopAnalyzer();
+    std::vector<uint16_t> pids = analyzer.getPids();
+    for (std::vector<uint16_t>::iterator it = pids.begin(); it != pids.end(); ++it) {
+        stats.insert(std::make_pair(*it, *analyzer.getStats(*it)));
+    }
+    return stats;
+}
+
+std::map<uint16_t, TSDemux::MEDIA_DURATION> TsLayer::getDurations() {
+    std::map<uint16_t, TSDemux::MEDIA_DURATION> durations;
+    const TSDemux::DurationCounter &counter = mTsContext->GetDurationCounter();
+    std::vector<uint16_t> pids = counter.getPids();
+    for (std::vector<uint16_t>::iterator it = pids.begin(); it != pids.end(); ++it) {
+        durations.insert(std::make_pair(*it, *counter.getStats(*it)));
+    }
+    return durations;
+}
+
+bool TsLayer::enableTrace(const std::string &path, const std::string &name) {
+    delete mTrace;
+    mTrace = new TSDemux::TraceWriter(mLogger);
+    if (!mTrace->open(path, name)) {
+        delete mTrace;
+        mTrace = NULL;
+    }
+    mTsContext->SetTraceWriter(mTrace);
+    return mTrace != NULL;
+}
+
+bool TsLayer::closeTrace() {
+    if (mTrace == NULL) {
+        return false;
+    }
+    mTsContext->SetTraceWriter(NULL);
+    bool ok = mTrace->close(mTsContext->GetPrograms(), mTsContext->getTsStartTimeStamp());
+    delete mTrace;
+    mTrace = NULL;
+    return ok;
+}
+
+int TsLayer::doDemux(uint64_t maxPackets){
     int ret = 0;
-    int indexCount = 0;
+    uint64_t indexCount = 0;
+    TSDemux::PerfCounters &perf = mTsContext->GetPerfCounters();
+    TSDemux::TraceSpan batch("demux", TRACE_CPU);
 
     while (true){
-        ret = mTsContext->tsSync();
+        {
+            PERF_SCOPE(perf, TSDemux::PERF_STAGE_SYNC);
+            ret = mTsContext->tsSync();
+        }
         if (ret != TSDemux::AVCONTEXT_CONTINUE){
             break;
         }
 
-        ret = mTsContext->ProcessTSPacket();
+        {
+            PERF_SCOPE(perf, TSDemux::PERF_STAGE_PACKET);
+            ret = mTsContext->ProcessTSPacket();
+        }
         indexCount++;
+        if (batch.active() && indexCount % TRACE_BATCH_PACKETS == 0) {
+            batch.restart();
+        }
+        if (mTsContext->TakeProgramChange()) {
+            registerPMT();
+        }
         if (mTsContext->HasPIDStreamData()){
             TSDemux::STREAM_PKT pkt;
             while (getStreamData(&pkt)){
@@ -122,6 +215,10 @@ int TsLayer::doDemux(){
         } else {
             mTsContext->goNext();
         }
+
+        if (maxPackets > 0 && indexCount >= maxPackets) {
+            return TSDemux::AVCONTEXT_CONTINUE;
+        }
     }
 
     return ret;
@@ -133,8 +230,18 @@ bool TsLayer::getStreamData(TSDemux::STREAM_PKT* pkt) {
         return false;
     }
 
-    if (!es->GetStreamPacket(pkt))
-        return false;
+    TSDemux::PerfCounters &perf = mTsContext->GetPerfCounters();
+    {
+        PERF_SCOPE(perf, TSDemux::PERF_STAGE_ES);
+        TRACE_SPAN("es parse", TRACE_CPU);
+        if (!es->GetStreamPacket(pkt))
+            return false;
+    }
+    {
+        PERF_SCOPE(perf, TSDemux::PERF_STAGE_FRAME);
+        mTsContext->UnwrapStreamPacket(pkt);
+        mTsContext->AddStreamFrame(pkt);
+    }
 
     if (pkt->duration > 180000){
         pkt->duration = 0;
@@ -167,18 +274,23 @@ void TsLayer::resetPosmap(){
 }
 
 void TsLayer::registerPMT(){
-    const std::vector<TSDemux::ElementaryStream*> es_streams = mTsContext->GetStreams();
-    if (!es_streams.empty()) {
-        mVideoPid = es_streams[0]->pid;
+    const std::vector<TSDemux::Program> programs = mTsContext->GetPrograms();
+    bool mainProgram = true;
+
+    for (std::vector<TSDemux::Program>::const_iterator pg = programs.begin(); pg != programs.end(); ++pg) {
+        if (!pg->selected || pg->streams.empty()) {
+            continue;
+        }
 
-        if (es_streams.size() > 1) {
-            mAudioPid = es_streams[1]->pid;
+        // position map follows the first selected program
+        if (mainProgram) {
+            mVideoPid = pg->GetVideoPid();
+            mAudioPid = pg->GetAudioPid();
+            mainProgram = false;
         }
 
-        for (std::vector<TSDemux::ElementaryStream*>::const_iterator it = es_streams.begin(); it != es_streams.end(); ++it) {
-            uint16_t channel = mTsContext->GetChannel((*it)->pid);
-            const char* codec_name = (*it)->GetStreamCodecName();
-            mTsContext->StartStreaming((*it)->pid);
+        for (std::vector<TSDemux::PROGRAM_STREAM>::const_iterator it = pg->streams.begin(); it != pg->streams.end(); ++it) {
+            mTsContext->StartStreaming(it->pid);
         }
     }
 }
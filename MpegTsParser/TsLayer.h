@@ -1,21 +1,66 @@
 #pragma once
 #include "TsLayerContext.h"
+#include "TsInput.h"
 
 #define AV_BUFFER_SIZE          131072
 #define POSMAP_PTS_INTERVAL     270000LL
+#define AV_LIVE_READ_SIZE       1316    // 7 TS packets, one UDP datagram
 
 class TsLayer : public TSDemux::TSDemuxer
 {
 public:
-    TsLayer(FILE* file, uint16_t channel, int fileIndex);
+    // logger of this demux and its streams, the default logger if NULL
+    TsLayer(FILE* file, const TSDemux::ProgramSelection &selection, int fileIndex, TSDemux::Logger *logger = NULL);
+    // input not owned, it must outlive the demux
+    TsLayer(TsInput* input, const TSDemux::ProgramSelection &selection, int fileIndex, TSDemux::Logger *logger = NULL);
     ~TsLayer(void);
 
-    int doDemux();
+    // to the end of the input, or AVCONTEXT_CONTINUE after maxPackets TS packets; resumes where it stopped
+    int doDemux(uint64_t maxPackets = 0);
     const unsigned char* ReadAV(uint64_t pos, size_t n);
+    int64_t GetArrivalTime(uint64_t /*pos*/) { return mWallClock ? mReadTime : -1; }
     std::list<TSDemux::STREAM_PKT*> *getParseredData() { return mTsContext->getMediaPkts(); }
     int64_t getTsStartTimeStamp() { return mTsContext->getTsStartTimeStamp(); }
+    TSDemux::Logger *getLogger() { return mLogger; }
+    std::vector<TSDemux::Program> getPrograms() { return mTsContext->GetPrograms(); }
+    const TSDemux::ElementaryStream *getStream(uint16_t pid) { return mTsContext->GetStream(pid); }
+
+    int addSectionFilter(uint16_t pid, uint8_t tableId, uint8_t mask, int flags, TSDemux::SectionListener *listener) {
+        return mTsContext->AddSectionFilter(pid, tableId, mask, flags, listener);
+    }
+    void removeSectionFilter(int filterId) { mTsContext->RemoveSectionFilter(filterId); }
+
+    // live input takes the PCR arrival time from the wall clock, files from the byte position
+    void enablePcrAnalysis(bool wallClock);
+    std::map<uint16_t, TSDemux::PCR_STATS> getPcrStats();
+
+    void enableBitrateAnalysis(int bucketMs) { mTsContext->EnableBitrateAnalysis(bucketMs); }
+    TSDemux::BitrateMeter *takeBitrateMeter() { return mTsContext->TakeBitrateMeter(); }
+
+    void enableBufferModel() { mTsContext->EnableBufferModel(); }
+    std::map<uint16_t, TSDemux::TSTD_STATS> getBufferStats() { return mTsContext->FinishBufferModel(); }
+
+    void enableGopAnalysis() { mTsContext->EnableGopAnalysis(); }
+    std::map<uint16_t, TSDemux::GOP_STATS> getGopStats();
+
+    void enableDurationCount() { mTsContext->EnableDurationCount(); }
+    std::map<uint16_t, TSDemux::MEDIA_DURATION> getDurations();
+    // PES timestamps not kept: getParseredData() stays empty
+    void setKeepParseredData(bool keep) { mTsContext->SetKeepMediaPkts(keep); }
+
+    // timestamp trace of the demux, complete once closed after doDemux()
+    bool enableTrace(const std::string &path, const std::string &name);
+    bool closeTrace();
+
+    // PES headers and frames as they come out of the demux, not owned
+    void setListener(TSDemux::TraceListener *listener) { mTsContext->SetListener(listener); }
+
+    // counters are always kept, the stage timers from this call on
+    void enablePerfTimers() { mTsContext->EnablePerfTimers(); }
+    TSDemux::PERF_STATS getPerfStats() { return mTsContext->GetPerfStats(); }
 
 private:
+    void init(const TSDemux::ProgramSelection &selection, int fileIndex);
     bool getStreamData(TSDemux::STREAM_PKT* pkt);
     void resetPosmap();
     void registerPMT();
@@ -23,9 +68,10 @@ private:
     void writeStreamData(TSDemux::STREAM_PKT* pkt);
 
 private:
-    FILE* m_ifile;
+    TsInput* mInput;
+    bool mOwnInput;
     int mFileIndex;
-    uint16_t m_channel;
+    TSDemux::Logger *mLogger;
 
     // AV raw buffer
     size_t mBufferSize;         ///< size of av buffer
@@ -33,9 +79,12 @@ private:
     unsigned char *mBuffer;      ///< buffer
     unsigned char *mBufferStart;      ///< raw data start in buffer
     unsigned char *mBufferEnd;      ///< raw data end in buffer
+    bool mWallClock;            ///< small reads, stamped with the wall clock
+    int64_t mReadTime;          ///< wall clock of the last read (us)
 
     // Playback context
     TSDemux::TsLayerContext *mTsContext;
+    TSDemux::TraceWriter *mTrace;
     uint16_t mVideoPid;
     uint16_t mAudioPid;
  
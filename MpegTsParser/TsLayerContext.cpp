@@ -29,19 +29,23 @@
 #include "ES_Subtitle.h"
 #include "ES_Teletext.h"
 #include "debug.h"
+#include "ChromeTrace.h"
 
 #include <cassert>
+#include <set>
 
 #define MAX_RESYNC_SIZE         65536
 
 using namespace TSDemux;
 
-TsLayerContext::TsLayerContext(TSDemuxer* const demux, uint64_t pos, uint16_t channel, int fileIndex)
+TsLayerContext::TsLayerContext(TSDemuxer* const demux, uint64_t pos, const ProgramSelection& selection, int fileIndex, Logger* logger)
   : av_pos(pos)
   , av_data_len(FLUTS_NORMAL_TS_PACKETSIZE)
   , av_pkt_size(0)
   , is_configured(false)
-  , channel(channel)
+  , mSelection(selection)
+  , mProgramChange(false)
+  , mSdtReceived(false)
   , pid(0xffff)
   , transport_error(false)
   , mHasPayload(false)
@@ -56,13 +60,33 @@ TsLayerContext::TsLayerContext(TSDemuxer* const demux, uint64_t pos, uint16_t ch
   , mAudioPid(0)
   , mFileIndex(fileIndex)
   , mTsStartTimeStamp(-1)
+  , mPcrAnalysis(false)
+  , mBitrateMeter(NULL)
+  , mTStd(NULL)
+  , mGopAnalysis(false)
+  , mDurationCount(false)
+  , mKeepMediaPkts(true)
+  , mTrace(NULL)
+  , mListener(NULL)
+  , mLogger(logger)
 {
   m_demux = demux;
   memset(av_buf, 0, sizeof(av_buf));
+  mSectionDemux.setLogger(mLogger);
+  mPcrAnalyzer.setLogger(mLogger);
 
   mMediaPkts = new std::list<TSDemux::STREAM_PKT*>;
+
+  // SDT actual gives the service names of the program table
+  mSectionDemux.addFilter(0x0011, 0x42, 0xff, SECTION_FILTER_TABLES | SECTION_FILTER_VERSION_CHANGE, this);
 };
 
+TsLayerContext::~TsLayerContext()
+{
+  delete mBitrateMeter;
+  delete mTStd;
+}
+
 void TsLayerContext::Reset(void)
 {
   PLATFORM::CLockObject lock(mutex);
@@ -160,6 +184,152 @@ void TsLayerContext::ResetPackets()
   {
     it->second.Reset();
   }
+  mSectionDemux.reset();
+}
+
+void TsLayerContext::EnablePcrAnalysis(PCR_ARRIVAL_MODE mode)
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  mPcrAnalyzer.setMode(mode);
+  mPcrAnalysis = true;
+}
+
+void TsLayerContext::EnableBitrateAnalysis(int bucket_ms)
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  delete mBitrateMeter;
+  mBitrateMeter = new BitrateMeter(bucket_ms);
+  mBitrateMeter->setLogger(mLogger);
+}
+
+BitrateMeter* TsLayerContext::TakeBitrateMeter()
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  BitrateMeter* meter = mBitrateMeter;
+  mBitrateMeter = NULL;
+  if (meter)
+    meter->finish();
+  return meter;
+}
+
+void TsLayerContext::EnableBufferModel()
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  delete mTStd;
+  mTStd = new TStdModel();
+  mTStd->setLogger(mLogger);
+}
+
+std::map<uint16_t, TSTD_STATS> TsLayerContext::FinishBufferModel()
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  std::map<uint16_t, TSTD_STATS> stats;
+  if (!mTStd)
+    return stats;
+  mTStd->finish();
+  std::vector<uint16_t> pids = mTStd->getPids();
+  for (std::vector<uint16_t>::const_iterator it = pids.begin(); it != pids.end(); ++it)
+    stats[*it] = *mTStd->getStats(*it);
+  return stats;
+}
+
+void TsLayerContext::EnableGopAnalysis()
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  mGopAnalysis = true;
+}
+
+void TsLayerContext::EnableDurationCount()
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  mDurationCount = true;
+}
+
+void TsLayerContext::SetKeepMediaPkts(bool keep)
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  mKeepMediaPkts = keep;
+}
+
+void TsLayerContext::SetTraceWriter(TraceWriter* trace)
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  mTrace = trace;
+}
+
+void TsLayerContext::SetListener(TraceListener* listener)
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  mListener = listener;
+}
+
+void TsLayerContext::EnablePerfTimers()
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  mPerf.enableTimers();
+}
+
+PERF_STATS TsLayerContext::GetPerfStats() const
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  return mPerf.getStats();
+}
+
+std::vector<Program> TsLayerContext::GetPrograms() const
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  std::vector<Program> v;
+  for (std::map<uint16_t, Program>::const_iterator it = mPrograms.begin(); it != mPrograms.end(); ++it)
+    v.push_back(it->second);
+  return v;
+}
+
+bool TsLayerContext::IsProgramSelected(uint16_t program_number) const
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  std::map<uint16_t, Program>::const_iterator it = mPrograms.find(program_number);
+  return it != mPrograms.end() && it->second.selected;
+}
+
+/*
+ * Selection changed outside of a PMT (service names from the SDT).
+ * Client must inspect programs again and enable streaming for them.
+ */
+bool TsLayerContext::TakeProgramChange()
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  bool change = mProgramChange;
+  mProgramChange = false;
+  return change;
+}
+
+int TsLayerContext::AddSectionFilter(uint16_t pid, uint8_t table_id, uint8_t mask, int flags, SectionListener* listener)
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  return mSectionDemux.addFilter(pid, table_id, mask, flags, listener);
+}
+
+void TsLayerContext::RemoveSectionFilter(int filter_id)
+{
+  PLATFORM::CLockObject lock(mutex);
+
+  mSectionDemux.removeFilter(filter_id);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -283,7 +453,7 @@ int TsLayerContext::configure_ts()
       // One and only one is eligible
       if (count == 1)
       {
-        DBG(DEMUX_DBG_DEBUG, "%s: packet size is %d\n", __FUNCTION__, fluts[found][0]);
+        DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: packet size is %d\n", __FUNCTION__, fluts[found][0]);
         av_pkt_size = fluts[found][0];
         av_pos = pos;
         return AVCONTEXT_CONTINUE;
@@ -300,18 +470,20 @@ int TsLayerContext::configure_ts()
       pos++;
   }
 
-  DBG(DEMUX_DBG_ERROR, "%s: invalid stream\n", __FUNCTION__);
+  DEMUX_LOG(mLogger, DEMUX_DBG_ERROR, "%s: invalid stream\n", __FUNCTION__);
   return AVCONTEXT_TS_NOSYNC;
 }
 
 int TsLayerContext::tsSync(){
   if (!is_configured)
   {
+    TRACE_SPAN("sync", TRACE_CPU);
     int ret = configure_ts();
     if (ret != AVCONTEXT_CONTINUE)
       return ret;
     is_configured = true;
   }
+  int64_t resyncStart = 0;
   for (int i = 0; i < MAX_RESYNC_SIZE; i++)
   {
     const unsigned char* data = m_demux->ReadAV(av_pos, av_pkt_size);
@@ -319,13 +491,24 @@ int TsLayerContext::tsSync(){
       return AVCONTEXT_IO_ERROR;
     if (data[0] == 0x47)
     {
+      if (i > 0)
+      {
+        mPerf.stats.resyncs++;
+        mPerf.stats.resyncBytes += i;
+        if (ChromeTrace::enabled())
+          ChromeTrace::record("sync", TRACE_CPU, resyncStart, PLATFORM::GetTimeUs());
+      }
       memcpy(av_buf, data, av_pkt_size);
       Reset();
       return AVCONTEXT_CONTINUE;
     }
+    // sync lost: the search is a span of its own
+    if (i == 0 && ChromeTrace::enabled())
+      resyncStart = PLATFORM::GetTimeUs();
     av_pos++;
   }
 
+  mPerf.stats.resyncBytes += MAX_RESYNC_SIZE;
   return AVCONTEXT_TS_NOSYNC;
 }
 
@@ -384,6 +567,7 @@ int TsLayerContext::ProcessTSPacket()
   if (av_rb8(av_buf) != 0x47){
     return AVCONTEXT_TS_NOSYNC;
   }
+  mPerf.stats.packets++;
 
   uint16_t header = av_rb16(av_buf + 1);
   pid = header & 0x1fff;
@@ -396,7 +580,19 @@ int TsLayerContext::ProcessTSPacket()
   payload_len = 0;
 
   if (transport_error)
+  {
+    if (mBitrateMeter)
+      mBitrateMeter->countErrored();
     return AVCONTEXT_CONTINUE;
+  }
+
+  if (mBitrateMeter)
+  {
+    // every packet counts by PID, null ones included
+    uint8_t flags = av_buf[3];
+    size_t adaptation = (flags & 0x20) ? (size_t)av_buf[4] + 1 : 0;
+    mBitrateMeter->countPacket(pid, (flags & 0x10) && adaptation < 184 ? 184 - adaptation : 0, (flags & 0xc0) != 0);
+  }
   // Null packet
   if (pid == 0x1fff)
     return AVCONTEXT_CONTINUE;
@@ -407,6 +603,7 @@ int TsLayerContext::ProcessTSPacket()
   uint8_t continuity_counter = flags & 0x0f;
   bool has_adaptation = (flags & 0x20) != 0;
   TS_PCR pcr;
+  bool has_pcr = false;
   size_t n = 0;
   if (has_adaptation) {
     size_t len = (size_t)av_rb8(av_buf + 4);
@@ -426,16 +623,32 @@ int TsLayerContext::ProcessTSPacket()
             pcr.pcr_base = (pcr_high << 1) | (av_buf[10] >> 7);
             pcr.pcr_ext = ((av_buf[10] & 1) << 8) | av_buf[11];
             pcr.pcr = pcr.pcr_base * 300 + pcr.pcr_ext;
+            pcr.present = true;
+            has_pcr = true;
         }
 
       is_discontinuity = (av_rb8(av_buf + 5) & 0x80) != 0;
     }
   }
+  if (has_pcr)
+  {
+    unwrap_pcr(pid, pcr, is_discontinuity);
+    if (mPcrAnalysis)
+      mPcrAnalyzer.addPcr(pid, pcr.pcr, av_pos, m_demux->GetArrivalTime(av_pos), is_discontinuity);
+    if (mBitrateMeter)
+      mBitrateMeter->addPcr(pid, pcr.pcr, is_discontinuity);
+    if (mTStd)
+      mTStd->addPcr(pid, pcr.pcr, av_pos, is_discontinuity);
+  }
   if (is_payload)
   {
     // Payload start after adaptation fields
     mTsPayload = av_buf + n + 4;
     payload_len = av_data_len - n - 4;
+
+    // Section filters run alongside PES/PSI processing of the PID
+    if (mSectionDemux.hasFilter(pid))
+      mSectionDemux.pushPayload(pid, payload_unit_start, continuity_counter, is_discontinuity, mTsPayload, payload_len);
   }
 
   it = mTsTypePkts.find(pid);
@@ -469,12 +682,13 @@ int TsLayerContext::ProcessTSPacket()
       uint8_t expected_cc = is_payload ? (it->second.continuity + 1) & 0x0f : it->second.continuity;
       if (!is_discontinuity && expected_cc != continuity_counter)
       {
+        mPerf.stats.ccErrors++;
         this->discontinuity = true;
         // If unit is not start then reset PID and wait the next unit start
         if (!this->payload_unit_start)
         {
           it->second.Reset();
-          DBG(DEMUX_DBG_WARN, "PID %.4x discontinuity detected: found %u, expected %u\n", this->pid, continuity_counter, expected_cc);
+          DEMUX_LOG(mLogger, DEMUX_DBG_WARN, "PID %.4x discontinuity detected: found %u, expected %u\n", this->pid, continuity_counter, expected_cc);
           return AVCONTEXT_DISCONTINUITY;
         }
       }
@@ -516,11 +730,17 @@ int TsLayerContext::ProcessTSPayload()
   switch (mCurrentPkt->packet_type)
   {
     case PACKET_TYPE_PSI:
+    {
+      PERF_SCOPE(mPerf, PERF_STAGE_PSI);
       ret = parse_ts_psi();
       break;
+    }
     case PACKET_TYPE_PES:
+    {
+      PERF_SCOPE(mPerf, PERF_STAGE_PES);
       ret = parse_ts_pes();
       break;
+    }
     case PACKET_TYPE_UNKNOWN:
       break;
   }
@@ -528,25 +748,18 @@ int TsLayerContext::ProcessTSPayload()
   return ret;
 }
 
-void TsLayerContext::clear_pmt()
+void TsLayerContext::clear_pmt(uint16_t channel, uint16_t pmt_pid)
 {
-  DBG(DEMUX_DBG_DEBUG, "%s\n", __FUNCTION__);
-  std::vector<uint16_t> pid_list;
-  for (std::map<uint16_t, Packet>::iterator it = mTsTypePkts.begin(); it != mTsTypePkts.end(); ++it)
-  {
-    if (it->second.packet_type == PACKET_TYPE_PSI && it->second.packet_table.table_id == 0x02)
-    {
-      pid_list.push_back(it->first);
-      clear_pes(it->second.channel);
-    }
-  }
-  for (std::vector<uint16_t>::iterator it = pid_list.begin(); it != pid_list.end(); ++it)
-    mTsTypePkts.erase(*it);
+  DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s(%u, %.4x)\n", __FUNCTION__, channel, pmt_pid);
+  clear_pes(channel);
+  std::map<uint16_t, Packet>::iterator it = mTsTypePkts.find(pmt_pid);
+  if (it != mTsTypePkts.end() && it->second.packet_type == PACKET_TYPE_PSI && it->second.channel == channel)
+    mTsTypePkts.erase(it);
 }
 
 void TsLayerContext::clear_pes(uint16_t channel)
 {
-  DBG(DEMUX_DBG_DEBUG, "%s(%u)\n", __FUNCTION__, channel);
+  DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s(%u)\n", __FUNCTION__, channel);
   std::vector<uint16_t> pid_list;
   for (std::map<uint16_t, Packet>::iterator it = mTsTypePkts.begin(); it != mTsTypePkts.end(); ++it)
   {
@@ -557,6 +770,67 @@ void TsLayerContext::clear_pes(uint16_t channel)
     mTsTypePkts.erase(*it);
 }
 
+void TsLayerContext::unwrap_pcr(uint16_t pcr_pid, TS_PCR& pcr, bool discontinuity)
+{
+  for (std::map<uint16_t, Program>::const_iterator it = mPrograms.begin(); it != mPrograms.end(); ++it)
+  {
+    if (it->second.pcr_pid != pcr_pid)
+      continue;
+    if (discontinuity)
+      DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: program %u new time base, PCR %.4x\n", __FUNCTION__, it->first, pcr_pid);
+    // programs sharing a PCR PID share the same clock
+    uint64_t extended = mTimelines[it->first].UnwrapPcr(pcr, discontinuity);
+    pcr.pcr = extended;
+    pcr.pcr_base = extended / 300;
+  }
+}
+
+void TsLayerContext::UnwrapStreamPacket(STREAM_PKT* pkt)
+{
+  std::map<uint16_t, Packet>::const_iterator it = mTsTypePkts.find(pkt->pid);
+  if (it == mTsTypePkts.end() || it->second.packet_type != PACKET_TYPE_PES)
+    return;
+  Timeline& timeline = mTimelines[it->second.channel];
+  pkt->dts = timeline.Unwrap(pkt->dts);
+  pkt->pts = timeline.Unwrap(pkt->pts);
+}
+
+void TsLayerContext::AddStreamFrame(const STREAM_PKT* pkt)
+{
+  if (mGopAnalysis && pkt->frame_type != FRAME_TYPE_UNKNOWN)
+    mGopAnalyzer.addFrame(pkt);
+
+  if (!mTStd && !mDurationCount && !mTrace && !mListener)
+    return;
+  std::map<uint16_t, Packet>::const_iterator it = mTsTypePkts.find(pkt->pid);
+  if (it == mTsTypePkts.end() || !it->second.stream)
+    return;
+  const ElementaryStream* es = it->second.stream;
+  bool video = ElementaryStream::IsVideoType(es->stream_type);
+
+  if (video || ElementaryStream::IsAudioType(es->stream_type))
+  {
+    if (mDurationCount)
+      mDurationCounter.addFrame(pkt, video, es->stream_info.sample_rate);
+    if (mTrace)
+      mTrace->addFrame(*pkt, es->stream_info.sample_rate);
+    if (mListener)
+      mListener->onFrame(*pkt, es->stream_info.sample_rate);
+  }
+
+  if (!mTStd || pkt->dts == PTS_UNSET)
+    return;
+  std::map<uint16_t, Program>::const_iterator pg = mPrograms.find(it->second.channel);
+  if (pg == mPrograms.end() || es->buffer_size <= 0)
+    return;
+
+  // buffer sizes and rates are known once the ES parser saw a sequence header
+  if (video && es->max_bitrate <= 0)
+    return;
+  mTStd->configure(pkt->pid, pg->second.pcr_pid, video, es->buffer_size, es->max_bitrate, es->stream_info.channels);
+  mTStd->addFrame(pkt->pid, pkt->dts, pkt->size);
+}
+
 /*
  * Parse PSI payload
  *
@@ -675,7 +949,7 @@ STREAM_INFO TsLayerContext::parse_pes_descriptor(const unsigned char* p, size_t
     uint8_t desc_tag = av_rb8(p);
     uint8_t desc_len = av_rb8(p + 1);
     p += 2;
-    DBG(DEMUX_DBG_DEBUG, "%s: tag %.2x len %d\n", __FUNCTION__, desc_tag, desc_len);
+    DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: tag %.2x len %d\n", __FUNCTION__, desc_tag, desc_len);
     switch (desc_tag)
     {
       case 0x02:
@@ -753,11 +1027,15 @@ int TsLayerContext::parse_ts_pes()
   if (!mHasPayload|| !mTsPayload || !this->payload_len || !mCurrentPkt)
     return AVCONTEXT_CONTINUE;
 
-  if (!mCurrentPkt->stream)
+  if (!mCurrentPkt->stream || !mCurrentPkt->selected)
     return AVCONTEXT_CONTINUE;
 
+  if (mTStd)
+    mTStd->addPacket(mCurrentPkt->pid, av_pos, this->payload_len, this->payload_unit_start);
+
   if (this->payload_unit_start)
   {
+    mPerf.stats.pesStarts++;
     // Wait for unit start: Reset frame buffer to clear old data
     if (mCurrentPkt->wait_unit_start)
     {
@@ -863,10 +1141,13 @@ int TsLayerContext::parse_ts_pes()
       }
       break;
     }
+    if (mTStd)
+      mTStd->addPesHeader(mCurrentPkt->pid, mCurrentPkt->packet_table.len);
     mCurrentPkt->packet_table.Reset();
 
-    curPkt->dts = mCurrentPkt->stream->c_dts;
-    curPkt->pts = mCurrentPkt->stream->c_pts;
+    Timeline& timeline = mTimelines[mCurrentPkt->channel];
+    curPkt->dts = timeline.Unwrap(mCurrentPkt->stream->c_dts);
+    curPkt->pts = timeline.Unwrap(mCurrentPkt->stream->c_pts);
     curPkt->pcr = mCurrentPkt->pcr;
 
     if (curPkt->pid == mVideoPid) {
@@ -879,7 +1160,15 @@ int TsLayerContext::parse_ts_pes()
         mTsStartTimeStamp = curPkt->dts;
     }
 
-    mMediaPkts->push_back(curPkt);
+    if (mTrace)
+      mTrace->addPes(*curPkt, av_pos);
+    if (mListener)
+      mListener->onPes(*curPkt, av_pos);
+
+    if (mKeepMediaPkts)
+      mMediaPkts->push_back(curPkt);
+    else
+      delete curPkt;
   }
 
   if (mCurrentPkt->streaming)
@@ -905,10 +1194,7 @@ int TsLayerContext::parsePat(const unsigned char *data, const unsigned char *dat
     uint8_t version = (av_rb8(data + 2) & 0x3e) >> 1;
     if (id == mCurrentPkt->packet_table.id && version == mCurrentPkt->packet_table.version)
         return AVCONTEXT_CONTINUE;
-    DBG(DEMUX_DBG_DEBUG, "%s: new PAT version %u\n", __FUNCTION__, version);
-
-    // clear old associated pmt
-    clear_pmt();
+    DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: new PAT version %u\n", __FUNCTION__, version);
 
     // parse new version of PAT
     data += 5;
@@ -936,6 +1222,7 @@ int TsLayerContext::parsePat(const unsigned char *data, const unsigned char *dat
     }
 
     size_t n = len / 4;
+    std::map<uint16_t, Program> programs;
 
     for (size_t i = 0; i < n; i++, data += 4)
     {
@@ -948,16 +1235,54 @@ int TsLayerContext::parsePat(const unsigned char *data, const unsigned char *dat
 
         pmt_pid &= 0x1fff;
 
-        DBG(DEMUX_DBG_DEBUG, "%s: PAT version %u: new PMT %.4x channel %u\n", __FUNCTION__, version, pmt_pid, channel);
-        if (this->channel == 0 || this->channel == channel)
+        // program 0 is the network PID
+        if (channel == 0)
+            continue;
+
+        DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: PAT version %u: new PMT %.4x channel %u\n", __FUNCTION__, version, pmt_pid, channel);
+        Program& program = programs[channel];
+        std::map<uint16_t, Program>::const_iterator old = mPrograms.find(channel);
+        if (old != mPrograms.end())
+        {
+            // keep service names across PAT versions
+            program.service_name = old->second.service_name;
+            program.provider_name = old->second.provider_name;
+        }
+        program.program_number = channel;
+        program.pmt_pid = pmt_pid;
+        program.selected = isSelected(program);
+    }
+
+    // clear the PMT of removed or moved programs, unchanged ones keep their streams
+    for (std::map<uint16_t, Program>::const_iterator it = mPrograms.begin(); it != mPrograms.end(); ++it)
+    {
+        std::map<uint16_t, Program>::const_iterator next = programs.find(it->first);
+        if (next == programs.end() || next->second.pmt_pid != it->second.pmt_pid)
+            clear_pmt(it->second.program_number, it->second.pmt_pid);
+    }
+
+    for (std::map<uint16_t, Program>::iterator it = programs.begin(); it != programs.end(); ++it)
+    {
+        Program& program = it->second;
+        // service names are known from the SDT only: every PMT is needed then
+        if (program.selected || !mSelection.names.empty())
         {
-            Packet& pmt = mTsTypePkts[pmt_pid];
-            pmt.pid = pmt_pid;
+            std::map<uint16_t, Program>::const_iterator old = mPrograms.find(program.program_number);
+            if (old != mPrograms.end() && old->second.pmt_pid == program.pmt_pid)
+            {
+                // PMT already registered, keep the last parsed version
+                program.pcr_pid = old->second.pcr_pid;
+                program.streams = old->second.streams;
+            }
+            Packet& pmt = mTsTypePkts[program.pmt_pid];
+            pmt.pid = program.pmt_pid;
             pmt.packet_type = PACKET_TYPE_PSI;
-            pmt.channel = channel;
-            DBG(DEMUX_DBG_DEBUG, "%s: PAT version %u: register PMT %.4x channel %u\n", __FUNCTION__, version, pmt_pid, channel);
+            pmt.channel = program.program_number;
+            DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: PAT version %u: register PMT %.4x channel %u\n", __FUNCTION__, version, program.pmt_pid, program.program_number);
         }
     }
+    mPrograms.swap(programs);
+
     // PAT is processed. New version is available
     mCurrentPkt->packet_table.id = id;
     mCurrentPkt->packet_table.version = version;
@@ -980,10 +1305,15 @@ int TsLayerContext::parsePmt(const unsigned char *data, const unsigned char *dat
     uint8_t version = (av_rb8(psi + 2) & 0x3e) >> 1;
     if (id == mCurrentPkt->packet_table.id && version == mCurrentPkt->packet_table.version)
         return AVCONTEXT_CONTINUE;
-    DBG(DEMUX_DBG_DEBUG, "%s: PMT(%.4x) version %u\n", __FUNCTION__, mCurrentPkt->pid, version);
+    DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: PMT(%.4x) version %u\n", __FUNCTION__, mCurrentPkt->pid, version);
 
-    // clear old pes
-    clear_pes(mCurrentPkt->channel);
+    // PES of the previous version, those still listed are kept
+    std::set<uint16_t> stale_pids;
+    for (std::map<uint16_t, Packet>::const_iterator it = mTsTypePkts.begin(); it != mTsTypePkts.end(); ++it)
+    {
+        if (it->second.packet_type == PACKET_TYPE_PES && it->second.channel == mCurrentPkt->channel)
+            stale_pids.insert(it->first);
+    }
 
     // parse new version of PMT
     psi += 7;
@@ -999,6 +1329,12 @@ int TsLayerContext::parsePmt(const unsigned char *data, const unsigned char *dat
 #endif
     }
 
+    Program& program = mPrograms[mCurrentPkt->channel];
+    program.program_number = mCurrentPkt->channel;
+    program.pmt_pid = mCurrentPkt->pid;
+    program.pcr_pid = av_rb16(psi - 2) & 0x1fff;
+    program.streams.clear();
+
     int len = (size_t)(av_rb16(psi) & 0x0fff);
     psi += 2 + len;
 
@@ -1024,70 +1360,103 @@ int TsLayerContext::parsePmt(const unsigned char *data, const unsigned char *dat
 
         // ignore unknown streams
         STREAM_TYPE stream_type = get_stream_type(pes_type);
-        DBG(DEMUX_DBG_DEBUG, "%s: PMT(%.4x) version %u: new PES %.4x %s\n", __FUNCTION__,
+        DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: PMT(%.4x) version %u: new PES %.4x %s\n", __FUNCTION__,
             mCurrentPkt->pid, version, pes_pid, ElementaryStream::GetStreamCodecName(stream_type));
         if (stream_type != STREAM_TYPE_UNKNOWN)
         {
-            Packet& pes = mTsTypePkts[pes_pid];
-            pes.pid = pes_pid;
-            pes.packet_type = PACKET_TYPE_PES;
-            pes.channel = mCurrentPkt->channel;
-            // Disable streaming by default
-            pes.streaming = false;
             // Get basic stream infos from PMT table
             STREAM_INFO stream_info;
             stream_info = parse_pes_descriptor(psi, len, &stream_type);
 
-            ElementaryStream* es;
-            switch (stream_type)
+            std::map<uint16_t, Packet>::iterator it = mTsTypePkts.find(pes_pid);
+            if (it != mTsTypePkts.end() && it->second.packet_type == PACKET_TYPE_PES &&
+                it->second.channel == mCurrentPkt->channel && it->second.stream_type == stream_type && it->second.stream)
             {
-            case STREAM_TYPE_VIDEO_MPEG1:
-            case STREAM_TYPE_VIDEO_MPEG2:
-                mVideoPid = pes_pid;
-                es = new ES_MPEG2Video(pes_pid);
-                break;
-            case STREAM_TYPE_AUDIO_MPEG1:
-            case STREAM_TYPE_AUDIO_MPEG2:
-                mAudioPid = pes_pid;
-                es = new ES_MPEG2Audio(pes_pid);
-                break;
-            case STREAM_TYPE_AUDIO_AAC:
-            case STREAM_TYPE_AUDIO_AAC_ADTS:
-            case STREAM_TYPE_AUDIO_AAC_LATM:
-                mAudioPid = pes_pid;
-                es = new ES_AAC(pes_pid);
-                break;
-            case STREAM_TYPE_VIDEO_H264:
-                mVideoPid = pes_pid;
-                es = new ES_h264(pes_pid);
-                break;
-            case STREAM_TYPE_VIDEO_HEVC:
+                // Unchanged stream: keep parser state and buffers, refresh the descriptor infos only
+                Packet& pes = it->second;
+                ElementaryStream* es = pes.stream;
+                memcpy(es->stream_info.language, stream_info.language, sizeof(stream_info.language));
+                es->stream_info.composition_id = stream_info.composition_id;
+                es->stream_info.ancillary_id = stream_info.ancillary_id;
+                pes.selected = program.selected;
+                stale_pids.erase(pes_pid);
+                DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: PMT(%.4x) version %u: keep PES %.4x %s\n", __FUNCTION__,
+                    mCurrentPkt->pid, version, pes_pid, es->GetStreamCodecName());
+            }
+            else
+            {
+                // New or retyped stream
+                if (it != mTsTypePkts.end() && it->second.packet_type == PACKET_TYPE_PES)
+                {
+                    mTsTypePkts.erase(it);
+                    stale_pids.erase(pes_pid);
+                }
+                Packet& pes = mTsTypePkts[pes_pid];
+                pes.pid = pes_pid;
+                pes.packet_type = PACKET_TYPE_PES;
+                pes.channel = mCurrentPkt->channel;
+                pes.stream_type = stream_type;
+                // Disable streaming by default
+                pes.streaming = false;
+
+                ElementaryStream* es;
+                switch (stream_type)
+                {
+                case STREAM_TYPE_VIDEO_MPEG1:
+                case STREAM_TYPE_VIDEO_MPEG2:
+                    es = new ES_MPEG2Video(pes_pid);
+                    break;
+                case STREAM_TYPE_AUDIO_MPEG1:
+                case STREAM_TYPE_AUDIO_MPEG2:
+                    es = new ES_MPEG2Audio(pes_pid);
+                    break;
+                case STREAM_TYPE_AUDIO_AAC:
+                case STREAM_TYPE_AUDIO_AAC_ADTS:
+                case STREAM_TYPE_AUDIO_AAC_LATM:
+                    es = new ES_AAC(pes_pid);
+                    break;
+                case STREAM_TYPE_VIDEO_H264:
+                    es = new ES_h264(pes_pid);
+                    break;
+                case STREAM_TYPE_VIDEO_HEVC:
+                    es = new ES_hevc(pes_pid);
+                    break;
+                case STREAM_TYPE_AUDIO_AC3:
+                case STREAM_TYPE_AUDIO_EAC3:
+                    es = new ES_AC3(pes_pid);
+                    break;
+                case STREAM_TYPE_DVB_SUBTITLE:
+                    es = new ES_Subtitle(pes_pid);
+                    break;
+                case STREAM_TYPE_DVB_TELETEXT:
+                    es = new ES_Teletext(pes_pid);
+                    break;
+                default:
+                    // No parser: pass-through
+                    es = new ElementaryStream(pes_pid);
+                    es->has_stream_info = true;
+                    break;
+                }
+
+                es->stream_type = stream_type;
+                es->stream_info = stream_info;
+                es->logger = mLogger;
+                es->perf = &mPerf;
+                pes.stream = es;
+                pes.selected = program.selected;
+                DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: PMT(%.4x) version %u: register PES %.4x %s\n", __FUNCTION__,
+                    mCurrentPkt->pid, version, pes_pid, es->GetStreamCodecName());
+            }
+
+            if (ElementaryStream::IsVideoType(stream_type))
                 mVideoPid = pes_pid;
-                es = new ES_hevc(pes_pid);
-                break;
-            case STREAM_TYPE_AUDIO_AC3:
-            case STREAM_TYPE_AUDIO_EAC3:
+            else if (ElementaryStream::IsAudioType(stream_type))
                 mAudioPid = pes_pid;
-                es = new ES_AC3(pes_pid);
-                break;
-            case STREAM_TYPE_DVB_SUBTITLE:
-                es = new ES_Subtitle(pes_pid);
-                break;
-            case STREAM_TYPE_DVB_TELETEXT:
-                es = new ES_Teletext(pes_pid);
-                break;
-            default:
-                // No parser: pass-through
-                es = new ElementaryStream(pes_pid);
-                es->has_stream_info = true;
-                break;
-            }
 
-            es->stream_type = stream_type;
-            es->stream_info = stream_info;
-            pes.stream = es;
-            DBG(DEMUX_DBG_DEBUG, "%s: PMT(%.4x) version %u: register PES %.4x %s\n", __FUNCTION__,
-                mCurrentPkt->pid, version, pes_pid, es->GetStreamCodecName());
+            PROGRAM_STREAM program_stream;
+            program_stream.pid = pes_pid;
+            program_stream.stream_type = stream_type;
+            program.streams.push_back(program_stream);
         }
         psi += len;
     }
@@ -1101,9 +1470,135 @@ int TsLayerContext::parsePmt(const unsigned char *data, const unsigned char *dat
 #endif
     }
 
+    // streams removed from the program
+    for (std::set<uint16_t>::const_iterator it = stale_pids.begin(); it != stale_pids.end(); ++it)
+    {
+        DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: PMT(%.4x) version %u: remove PES %.4x\n", __FUNCTION__, mCurrentPkt->pid, version, *it);
+        mTsTypePkts.erase(*it);
+    }
+
     // PMT is processed. New version is available
     mCurrentPkt->packet_table.id = id;
     mCurrentPkt->packet_table.version = version;
     return AVCONTEXT_PROGRAM_CHANGE;
 
 }
+
+static std::string decode_dvb_string(const unsigned char* p, size_t len)
+{
+  // skip the character table selector (EN 300 468 annex A)
+  if (len > 0 && p[0] < 0x20)
+  {
+    size_t skip = p[0] == 0x10 ? 3 : (p[0] == 0x1f ? 2 : 1);
+    if (skip > len)
+      skip = len;
+    p += skip;
+    len -= skip;
+  }
+  std::string str;
+  for (size_t i = 0; i < len; i++)
+  {
+    // control codes (emphasis, CR/LF) are not part of the name
+    if (p[i] >= 0x20 && (p[i] < 0x80 || p[i] >= 0xa0))
+      str.push_back((char)p[i]);
+  }
+  return str;
+}
+
+void TsLayerContext::onTable(int /*filterId*/, const PSI_TABLE &table)
+{
+  if (table.table_id == 0x42)
+    parseSdt(table);
+}
+
+void TsLayerContext::parseSdt(const PSI_TABLE &table)
+{
+  for (std::vector<const PSI_SECTION*>::const_iterator it = table.sections.begin(); it != table.sections.end(); ++it)
+  {
+    const unsigned char* p = (*it)->data + 11;
+    const unsigned char* end = (*it)->data + (*it)->len - 4; // CRC32
+
+    while (p + 5 <= end)
+    {
+      uint16_t service_id = av_rb16(p);
+      size_t loop_len = av_rb16(p + 3) & 0x0fff;
+      const unsigned char* desc = p + 5;
+      const unsigned char* desc_end = desc + loop_len;
+      if (desc_end > end)
+        break;
+
+      while (desc + 2 <= desc_end)
+      {
+        uint8_t desc_tag = av_rb8(desc);
+        uint8_t desc_len = av_rb8(desc + 1);
+        if (desc + 2 + desc_len > desc_end)
+          break;
+        if (desc_tag == 0x48 && desc_len >= 3) /* service descriptor */
+        {
+          const unsigned char* d = desc + 2;
+          size_t provider_len = d[1];
+          if (2 + provider_len + 1 <= desc_len)
+          {
+            size_t name_len = d[2 + provider_len];
+            if (3 + provider_len + name_len <= desc_len)
+            {
+              std::map<uint16_t, Program>::iterator pg = mPrograms.find(service_id);
+              if (pg != mPrograms.end())
+              {
+                pg->second.provider_name = decode_dvb_string(d + 2, provider_len);
+                pg->second.service_name = decode_dvb_string(d + 3 + provider_len, name_len);
+                DEMUX_LOG(mLogger, DEMUX_DBG_DEBUG, "%s: program %u service '%s'\n", __FUNCTION__, service_id, pg->second.service_name.c_str());
+              }
+            }
+          }
+        }
+        desc += 2 + desc_len;
+      }
+      p = desc_end;
+    }
+  }
+
+  mSdtReceived = true;
+  if (updateSelection())
+    mProgramChange = true;
+}
+
+/*
+ * Until the SDT is received, a selection by service name keeps every
+ * program so the start of the stream is not lost.
+ */
+bool TsLayerContext::isSelected(const Program& program) const
+{
+  if (!mSdtReceived && !mSelection.names.empty())
+    return true;
+  return mSelection.Matches(program);
+}
+
+/*
+ * Apply the selection set to the program table and to the registered PES.
+ *
+ * returns true if a program became selected.
+ */
+bool TsLayerContext::updateSelection()
+{
+  bool added = false;
+  for (std::map<uint16_t, Program>::iterator it = mPrograms.begin(); it != mPrograms.end(); ++it)
+  {
+    bool selected = isSelected(it->second);
+    if (selected && !it->second.selected)
+      added = true;
+    it->second.selected = selected;
+  }
+
+  for (std::map<uint16_t, Packet>::iterator it = mTsTypePkts.begin(); it != mTsTypePkts.end(); ++it)
+  {
+    if (it->second.packet_type != PACKET_TYPE_PES)
+      continue;
+    std::map<uint16_t, Program>::const_iterator pg = mPrograms.find(it->second.channel);
+    bool selected = pg != mPrograms.end() && pg->second.selected;
+    if (!selected)
+      it->second.streaming = false;
+    it->second.selected = selected;
+  }
+  return added;
+}
@@ -23,7 +23,17 @@
 #define TSDEMUXER_H
 
 #include "tsPacket.h"
+#include "tsProgram.h"
+#include "tsTimeline.h"
 #include "elementaryStream.h"
+#include "SectionFilter.h"
+#include "PcrAnalyzer.h"
+#include "BitrateMeter.h"
+#include "TStdModel.h"
+#include "GopAnalyzer.h"
+#include "DurationCounter.h"
+#include "TraceFile.h"
+#include "PerfCounters.h"
 #include "mutex.h"
 
 #include <map>
@@ -46,6 +56,8 @@ namespace TSDemux
   {
   public:
     virtual const unsigned char* ReadAV(uint64_t pos, size_t len) = 0;
+    // wall clock arrival (us) of the data at pos, -1 when the input is not live
+    virtual int64_t GetArrivalTime(uint64_t /*pos*/) { return -1; }
   };
 
   enum {
@@ -58,10 +70,12 @@ namespace TSDemux
     AVCONTEXT_DISCONTINUITY       = 3
   };
 
-  class TsLayerContext
+  class TsLayerContext : private SectionListener
   {
   public:
-    TsLayerContext(TSDemuxer* const demux, uint64_t pos, uint16_t channel, int fileIndex);
+    // logger: logging context of this demuxer and its streams, outlives the context
+    TsLayerContext(TSDemuxer* const demux, uint64_t pos, const ProgramSelection& selection, int fileIndex, Logger* logger);
+    ~TsLayerContext();
     void Reset(void);
 
     bool HasPIDStreamData() const;
@@ -75,6 +89,16 @@ namespace TSDemux
     uint16_t GetChannel(uint16_t pid) const;
     void ResetPackets();
 
+    // Program table (PAT/PMT/SDT) and selection
+    std::vector<Program> GetPrograms() const;
+    bool IsProgramSelected(uint16_t program_number) const;
+    bool TakeProgramChange();
+
+    // Timestamps of a stream packet moved to the extended timeline of its program
+    void UnwrapStreamPacket(STREAM_PKT* pkt);
+    // Frame of a stream packet (extended timestamps) into the buffer model, GOP analysis and duration count
+    void AddStreamFrame(const STREAM_PKT* pkt);
+
     const Packet *getCurrentPacket() { return mCurrentPkt; }
     std::list<TSDemux::STREAM_PKT*> *getMediaPkts() { return mMediaPkts; }
 
@@ -88,6 +112,45 @@ namespace TSDemux
     int ProcessTSPayload();
 
     int64_t getTsStartTimeStamp() { return mTsStartTimeStamp; }
+
+    // Section filters (SDT, NIT, EIT, CAT, private tables)
+    int AddSectionFilter(uint16_t pid, uint8_t table_id, uint8_t mask, int flags, SectionListener* listener);
+    void RemoveSectionFilter(int filter_id);
+
+    // PCR accuracy/jitter analysis of the PCR PIDs
+    void EnablePcrAnalysis(PCR_ARRIVAL_MODE mode);
+    const PcrAnalyzer& GetPcrAnalyzer() const { return mPcrAnalyzer; }
+
+    // per PID counters and bitrate over time, the caller owns the taken meter
+    void EnableBitrateAnalysis(int bucket_ms);
+    BitrateMeter* TakeBitrateMeter();
+
+    // T-STD buffer model of the selected streams, finished on the first call
+    void EnableBufferModel();
+    std::map<uint16_t, TSTD_STATS> FinishBufferModel();
+
+    // GOP structure and frame types of the video streams
+    void EnableGopAnalysis();
+    const GopAnalyzer& GetGopAnalyzer() const { return mGopAnalyzer; }
+
+    // media duration of the streams, summed frame by frame
+    void EnableDurationCount();
+    const DurationCounter& GetDurationCounter() const { return mDurationCounter; }
+
+    // without the PES timestamp list, the analyses run on the fly only
+    void SetKeepMediaPkts(bool keep);
+
+    // PES headers and frames into a timestamp trace, owned by the caller
+    void SetTraceWriter(TraceWriter* trace);
+    // PES headers and frames of the selected streams to an embedding application, not owned
+    void SetListener(TraceListener* listener);
+
+    Logger* GetLogger() const { return mLogger; }
+
+    // hot path counters of the demux and its ES parsers, stage timers once enabled
+    void EnablePerfTimers();
+    PerfCounters& GetPerfCounters() { return mPerf; }
+    PERF_STATS GetPerfStats() const;
   private:
     TsLayerContext(const TsLayerContext&);
     TsLayerContext& operator=(const TsLayerContext&);
@@ -98,14 +161,19 @@ namespace TSDemux
     static uint16_t av_rb16(const unsigned char* p);
     static uint32_t av_rb32(const unsigned char* p);
     static uint64_t decode_pts(const unsigned char* p);
-     static STREAM_INFO parse_pes_descriptor(const unsigned char* p, size_t len, STREAM_TYPE* st);
-    void clear_pmt();
+     STREAM_INFO parse_pes_descriptor(const unsigned char* p, size_t len, STREAM_TYPE* st);
+    void clear_pmt(uint16_t channel, uint16_t pmt_pid);
     void clear_pes(uint16_t channel);
+    void unwrap_pcr(uint16_t pcr_pid, TS_PCR& pcr, bool discontinuity);
     int parse_ts_psi();
     int parse_ts_pes();
 
     int parsePat(const unsigned char *data, const unsigned char *dataEnd);
     int parsePmt(const unsigned char *data, const unsigned char *dataEnd);
+    void parseSdt(const PSI_TABLE &table);
+    bool updateSelection();
+    bool isSelected(const Program& program) const;
+    virtual void onTable(int filterId, const PSI_TABLE &table);
 
     // Critical section
     mutable PLATFORM::CMutex mutex;
@@ -128,10 +196,28 @@ namespace TSDemux
 
     // TS Streams context
     bool is_configured;
-    uint16_t channel;
+    ProgramSelection mSelection;
+    std::map<uint16_t, Program> mPrograms;
+    bool mProgramChange;
+    bool mSdtReceived;
+    std::map<uint16_t, Timeline> mTimelines;   ///< 64-bit clock by program number
     int64_t mTsStartTimeStamp; // first video packet dts;
     std::map<uint16_t, Packet> mTsTypePkts;
     std::list<TSDemux::STREAM_PKT*> *mMediaPkts;
+    SectionDemux mSectionDemux;
+    bool mPcrAnalysis;
+    PcrAnalyzer mPcrAnalyzer;
+    BitrateMeter* mBitrateMeter;
+    TStdModel* mTStd;
+    bool mGopAnalysis;
+    GopAnalyzer mGopAnalyzer;
+    bool mDurationCount;
+    DurationCounter mDurationCounter;
+    bool mKeepMediaPkts;
+    TraceWriter* mTrace;
+    TraceListener* mListener;
+    Logger* mLogger;
+    PerfCounters mPerf;
 
     // Packet context
     uint16_t pid;
@@ -31,46 +31,51 @@
 #define snprintf _snprintf
 #endif
 
-typedef struct
-{
-  const char* name;
-  int cur_level;
-  void (*msg_callback)(int level, char* msg);
-} debug_ctx_t;
+using namespace TSDemux;
 
-static debug_ctx_t debug_ctx = {"", DEMUX_DBG_NONE, NULL};
+static Logger default_logger;
+static void (*legacy_callback)(int level, char* msg) = NULL;
 
-/**
- * Set the debug level to be used for the subsystem
- * \param ctx the subsystem debug context to use
- * \param level the debug level for the subsystem
- * \return an integer subsystem id used for future interaction
- */
-static inline void __dbg_setlevel(debug_ctx_t* ctx, int level)
+Logger::Logger(const std::string& tag, int level)
+  : m_tag(tag)
+  , m_level(level)
+  , m_sink(NULL)
+  , m_opaque(NULL)
 {
-  if (ctx != NULL)
-  {
-    ctx->cur_level = level;
-  }
+}
+
+Logger& Logger::Default()
+{
+  return default_logger;
 }
 
 /**
  * Generate a debug message at a given debug level
- * \param ctx the subsystem debug context to use
  * \param level the debug level of the debug message
  * \param fmt a printf style format string for the message
  * \param ... arguments to the format
  */
-static inline void __dbg(debug_ctx_t* ctx, int level, const char* fmt, va_list ap)
+void Logger::Log(int level, const char* fmt, ...) const
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  VLog(level, fmt, ap);
+  va_end(ap);
+}
+
+void Logger::VLog(int level, const char* fmt, va_list ap) const
 {
-  if (ctx != NULL && level <= ctx->cur_level)
+  if (level <= m_level)
   {
     char msg[4096];
-    int len = snprintf(msg, sizeof (msg), "%s", ctx->name);
+    int len = snprintf(msg, sizeof (msg), "%s", m_tag.c_str());
+    if (len < 0 || len >= (int)sizeof (msg))
+      len = 0;
     vsnprintf(msg + len, sizeof (msg) - len, fmt, ap);
-    if (ctx->msg_callback)
+    if (m_sink)
     {
-      ctx->msg_callback(level, msg);
+      m_sink(m_opaque, level, msg);
     }
     else
     {
@@ -79,19 +84,25 @@ static inline void __dbg(debug_ctx_t* ctx, int level, const char* fmt, va_list a
   }
 }
 
+static void legacy_sink(void* opaque, int level, const char* msg)
+{
+  (void)opaque;
+  legacy_callback(level, const_cast<char*>(msg));
+}
+
 void TSDemux::DBGLevel(int l)
 {
-  __dbg_setlevel(&debug_ctx, l);
+  default_logger.SetLevel(l);
 }
 
 void TSDemux::DBGAll()
 {
-  __dbg_setlevel(&debug_ctx, DEMUX_DBG_ALL);
+  default_logger.SetLevel(DEMUX_DBG_ALL);
 }
 
 void TSDemux::DBGNone()
 {
-  __dbg_setlevel(&debug_ctx, DEMUX_DBG_NONE);
+  default_logger.SetLevel(DEMUX_DBG_NONE);
 }
 
 void TSDemux::DBG(int level, const char* fmt, ...)
@@ -99,11 +110,12 @@ void TSDemux::DBG(int level, const char* fmt, ...)
   va_list ap;
 
   va_start(ap, fmt);
-  __dbg(&debug_ctx, level, fmt, ap);
+  default_logger.VLog(level, fmt, ap);
   va_end(ap);
 }
 
 void TSDemux::SetDBGMsgCallback(void (*msgcb)(int level, char*))
 {
-  debug_ctx.msg_callback = msgcb;
+  legacy_callback = msgcb;
+  default_logger.SetSink(msgcb ? legacy_sink : NULL, NULL);
 }
@@ -30,13 +30,74 @@
 #define DEMUX_DBG_PARSE  4
 #define DEMUX_DBG_ALL    6
 
+/*
+ * Messages above this level are compiled out of DEMUX_LOG() call sites,
+ * arguments included. Define it lower in release builds, e.g.
+ * -DDEMUX_DBG_COMPILE_LEVEL=DEMUX_DBG_INFO.
+ */
+#ifndef DEMUX_DBG_COMPILE_LEVEL
+#define DEMUX_DBG_COMPILE_LEVEL DEMUX_DBG_ALL
+#endif
+
+/*
+ * printf format checking of the log calls by GCC/Clang, fmt and args are the
+ * argument positions (1 is this for a member function)
+ */
+#if defined(__GNUC__)
+#define DEMUX_PRINTF(fmt, args) __attribute__((format(printf, fmt, args)))
+#else
+#define DEMUX_PRINTF(fmt, args)
+#endif
+
+#include <cstdarg>
+#include <string>
+
 namespace TSDemux
 {
+  typedef void (*LogSink)(void* opaque, int level, const char* msg);
+
+  /*
+   * Logging context of one demuxer: level, sink and a tag prefixed to each
+   * message. Loggers share nothing, concurrent demuxers each log through
+   * their own; the sink is called from the thread that logs.
+   */
+  class Logger
+  {
+  public:
+    explicit Logger(const std::string& tag = "", int level = DEMUX_DBG_NONE);
+
+    void SetLevel(int level) { m_level = level; }
+    int GetLevel() const { return m_level; }
+    void SetTag(const std::string& tag) { m_tag = tag; }
+    const std::string& GetTag() const { return m_tag; }
+    // no sink: messages go to stderr
+    void SetSink(LogSink sink, void* opaque) { m_sink = sink; m_opaque = opaque; }
+
+    bool Enabled(int level) const { return level <= m_level; }
+    void Log(int level, const char* fmt, ...) const DEMUX_PRINTF(3, 4);
+    void VLog(int level, const char* fmt, va_list ap) const;
+
+    // the logger of DBG() and of the components not given one
+    static Logger& Default();
+
+  private:
+    std::string m_tag;
+    int m_level;
+    LogSink m_sink;
+    void* m_opaque;
+  };
+
   void DBGLevel(int l);
   void DBGAll(void);
   void DBGNone(void);
-  void DBG(int level, const char* fmt, ...);
+  void DBG(int level, const char* fmt, ...) DEMUX_PRINTF(2, 3);
   void SetDBGMsgCallback(void (*msgcb)(int level, char*));
 }
 
+#define DEMUX_LOG(logger, level, ...) \
+  do { \
+    if ((level) <= DEMUX_DBG_COMPILE_LEVEL && (logger)->Enabled(level)) \
+      (logger)->Log((level), __VA_ARGS__); \
+  } while (0)
+
 #endif /* TS_DEBUG_H */
@@ -20,6 +20,7 @@
  */
 
 #include "elementaryStream.h"
+#include "PerfCounters.h"
 #include "debug.h"
 
 #include <cstdlib>    // for malloc free size_t
@@ -37,6 +38,10 @@ ElementaryStream::ElementaryStream(uint16_t pes_pid)
   , p_dts(PTS_UNSET)
   , p_pts(PTS_UNSET)
   , has_stream_info(false)
+  , buffer_size(0)
+  , max_bitrate(0)
+  , logger(&Logger::Default())
+  , perf(NULL)
   , es_alloc_init(ES_INIT_BUFFER_SIZE)
   , es_buf(NULL)
   , es_alloc(0)
@@ -54,7 +59,7 @@ ElementaryStream::~ElementaryStream(void)
 {
   if (es_buf)
   {
-    DBG(DEMUX_DBG_DEBUG, "free stream buffer %.4x: allocated size was %zu\n", pid, es_alloc);
+    DEMUX_LOG(logger, DEMUX_DBG_DEBUG, "free stream buffer %.4x: allocated size was %zu\n", pid, es_alloc);
     free(es_buf);
     es_buf = NULL;
   }
@@ -83,6 +88,8 @@ int ElementaryStream::Append(const unsigned char* buf, size_t len, bool new_pts)
     if (es_consumed < es_len)
     {
       memmove(es_buf, es_buf + es_consumed, es_len - es_consumed);
+      if (perf)
+        perf->stats.esMovedBytes += es_len - es_consumed;
       es_len -= es_consumed;
       es_parsed -= es_consumed;
       if (es_pts_pointer > es_consumed)
@@ -104,7 +111,9 @@ int ElementaryStream::Append(const unsigned char* buf, size_t len, bool new_pts)
     if (n > ES_MAX_BUFFER_SIZE)
       n = ES_MAX_BUFFER_SIZE;
 
-    DBG(DEMUX_DBG_DEBUG, "realloc buffer size to %zu for stream %.4x\n", n, pid);
+    DEMUX_LOG(logger, DEMUX_DBG_DEBUG, "realloc buffer size to %zu for stream %.4x\n", n, pid);
+    if (perf)
+      perf->stats.esReallocs++;
     unsigned char* p = es_buf;
     es_buf = (unsigned char*)realloc(es_buf, n * sizeof(*es_buf));
     if (es_buf)
@@ -125,6 +134,8 @@ int ElementaryStream::Append(const unsigned char* buf, size_t len, bool new_pts)
 
   memcpy(es_buf + es_len, buf, len);
   es_len += len;
+  if (perf)
+    perf->stats.esAppendBytes += len;
 
   return 0;
 }
@@ -178,12 +189,51 @@ const char* ElementaryStream::GetStreamCodecName() const
   return GetStreamCodecName(stream_type);
 }
 
+bool ElementaryStream::IsVideoType(STREAM_TYPE stream_type)
+{
+  switch (stream_type)
+  {
+    case STREAM_TYPE_VIDEO_MPEG1:
+    case STREAM_TYPE_VIDEO_MPEG2:
+    case STREAM_TYPE_VIDEO_H264:
+    case STREAM_TYPE_VIDEO_HEVC:
+    case STREAM_TYPE_VIDEO_MPEG4:
+    case STREAM_TYPE_VIDEO_VC1:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool ElementaryStream::IsAudioType(STREAM_TYPE stream_type)
+{
+  switch (stream_type)
+  {
+    case STREAM_TYPE_AUDIO_MPEG1:
+    case STREAM_TYPE_AUDIO_MPEG2:
+    case STREAM_TYPE_AUDIO_AAC:
+    case STREAM_TYPE_AUDIO_AAC_ADTS:
+    case STREAM_TYPE_AUDIO_AAC_LATM:
+    case STREAM_TYPE_AUDIO_AC3:
+    case STREAM_TYPE_AUDIO_EAC3:
+    case STREAM_TYPE_AUDIO_LPCM:
+    case STREAM_TYPE_AUDIO_DTS:
+      return true;
+    default:
+      return false;
+  }
+}
+
 bool ElementaryStream::GetStreamPacket(STREAM_PKT* pkt)
 {
   ResetStreamPacket(pkt);
   Parse(pkt);
   if (pkt->data)
+  {
+    if (perf)
+      perf->stats.frames[stream_type]++;
     return true;
+  }
   return false;
 }
 
@@ -209,11 +259,16 @@ void ElementaryStream::Parse(STREAM_PKT* pkt)
 void ElementaryStream::ResetStreamPacket(STREAM_PKT* pkt)
 {
   pkt->pid                = 0xffff;
+  pkt->slice_type         = 0;
+  pkt->frame_type         = FRAME_TYPE_UNKNOWN;
+  pkt->random_access      = false;
+  pkt->closed_gop         = false;
   pkt->size               = 0;
   pkt->data               = NULL;
   pkt->dts                = PTS_UNSET;
   pkt->pts                = PTS_UNSET;
   pkt->duration           = 0;
+  pkt->samples            = 0;
   pkt->streamChange       = false;
 }
 
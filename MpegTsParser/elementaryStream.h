@@ -24,6 +24,7 @@
 
 #include <inttypes.h>
 #include <cstddef>    // for size_t
+#include "debug.h"
 
 #define ES_INIT_BUFFER_SIZE     64000
 #define ES_MAX_BUFFER_SIZE      1048576
@@ -34,6 +35,8 @@
 
 namespace TSDemux
 {
+  class PerfCounters;
+
   enum STREAM_TYPE
   {
     STREAM_TYPE_UNKNOWN = 0,
@@ -75,22 +78,37 @@ namespace TSDemux
     bool                  interlaced;
   };
 
+  // coding type of a video frame, values of the MPEG-2 picture_coding_type
+  enum FRAME_TYPE
+  {
+    FRAME_TYPE_UNKNOWN = 0,
+    FRAME_TYPE_I,
+    FRAME_TYPE_P,
+    FRAME_TYPE_B,
+    FRAME_TYPE_COUNT
+  };
+
   struct TS_PCR {
-      TS_PCR() : pcr(0), pcr_base(0), pcr_ext(0) {}
+      TS_PCR() : pcr(0), pcr_base(0), pcr_ext(0), present(false) {}
       uint64_t pcr;
       uint64_t pcr_base;
       uint64_t pcr_ext;
+      bool present;       ///< PCR_flag of the packet, 0 is a valid PCR
   };
 
   struct STREAM_PKT
   {
     uint16_t              pid;
     uint16_t              slice_type;
+    FRAME_TYPE            frame_type;     ///< video only, H.264: B if any slice is B, else P if any is P, HEVC: first slice
+    bool                  random_access;  ///< IDR/IRAP picture, I picture after a sequence header
+    bool                  closed_gop;     ///< random access point without leading pictures referencing before it
     size_t                size;
     const unsigned char*  data;
     uint64_t              dts;
     uint64_t              pts;
     uint64_t              duration;
+    uint32_t              samples;        ///< audio samples of the frame, 0 for video
     bool                  streamChange;
     TS_PCR                pcr;
   };
@@ -105,6 +123,8 @@ namespace TSDemux
     int Append(const unsigned char* buf, size_t len, bool new_pts = false);
     const char* GetStreamCodecName() const;
     static const char* GetStreamCodecName(STREAM_TYPE stream_type);
+    static bool IsVideoType(STREAM_TYPE stream_type);
+    static bool IsAudioType(STREAM_TYPE stream_type);
 
     uint16_t pid;
     STREAM_TYPE stream_type;
@@ -114,6 +134,10 @@ namespace TSDemux
     uint64_t p_pts;               ///< previous MPEG stream PTS (presentation time for audio and video)
 
     bool has_stream_info;         ///< true if stream info is completed else it requires parsing of iframe
+    int buffer_size;              ///< T-STD decoder buffer (EBn for video, Bn for audio) in bytes, 0 if unknown
+    int max_bitrate;              ///< maximum bitrate of the stream (bit/s) from its level/header, 0 if unknown
+    Logger* logger;               ///< logging context of the demuxer, never NULL
+    PerfCounters* perf;           ///< counters of the demuxer, NULL if not counted
 
     STREAM_INFO stream_info;
 
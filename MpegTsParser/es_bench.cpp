@@ -0,0 +1,395 @@
+/*
+ * es_bench: the ES parsers alone, without the TS layer. The elementary
+ * streams of TS files (captures or ts_gen output) are extracted in memory
+ * and fed to the parser of their codec through Append/GetStreamPacket:
+ *
+ *   ts         the TS payloads, as the TS layer appends them
+ *   <n>        <n> bytes per Append, a PES never shares an Append with the next
+ *   whole      a PES per Append
+ *
+ * The frames are taken at each PES start, as the TS layer does, or after
+ * each Append with --poll. Each feed is first checked against the frames of
+ * the ts feed, or against a reference saved by an earlier build (--ref):
+ * same count, sizes, timestamps, frame types and bytes, exit status 2 if
+ * one differs. Then it runs warmup times untimed and reps times timed, the
+ * table gives the median run.
+ */
+
+#define __STDC_FORMAT_MACROS 1
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "debug.h"
+#include "BenchInput.h"
+#include "timeutils.h"
+
+#define CHUNK_TS                ((size_t)-1)
+#define CHUNK_WHOLE             0
+
+using namespace GYJ;
+
+// one PES of a stream, its payload in EsStream::data
+typedef struct EsUnit {
+    size_t offset;
+    size_t size;
+    bool hasPts;
+    uint64_t pts;
+    uint64_t dts;
+} EsUnit;
+
+// payloads of a track in one buffer, so that an Append may span TS packets
+typedef struct EsStream {
+    const EsTrack *track;
+    std::vector<unsigned char> data;
+    std::vector<EsUnit> units;
+} EsStream;
+
+// what is compared of a frame, its bytes by hash
+typedef struct FrameRecord {
+    size_t size;
+    uint64_t pts;
+    uint64_t dts;
+    int type;
+    uint64_t hash;
+    bool operator==(const FrameRecord &other) const {
+        return size == other.size && pts == other.pts && dts == other.dts && type == other.type && hash == other.hash;
+    }
+} FrameRecord;
+
+typedef std::map<uint16_t, std::vector<FrameRecord> > FrameReference;
+
+static TSDemux::Logger g_quiet;
+
+static void usage(const char *cmd) {
+    printf("Usage: %s [options] <file>...\n\n"
+        "  --chunk <n>      bytes per Append, repeatable, 0 for a PES per Append (16 184 4096 0)\n"
+        "  --poll           frames taken after each Append, not only at the PES starts\n"
+        "  --codec <name>   only the streams of codec <name>, repeatable: h264 hevc mpeg2video aac ac3 mp2...\n"
+        "  --warmup <n>     untimed runs of each feed (%d)\n"
+        "  --reps <n>       timed runs of each feed (%d)\n"
+        "  --save_ref <file> write the frames of the ts feed to <file>\n"
+        "  --ref <file>     check the feeds against the frames of <file>, not the ts feed\n"
+        "  --csv            one CSV line by feed instead of the table\n",
+        cmd, BENCH_WARMUP, BENCH_REPS);
+}
+
+// FNV-1a
+static uint64_t hashBytes(const unsigned char *data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void buildStream(const EsTrack &track, EsStream &stream) {
+    stream.track = &track;
+    stream.data.reserve((size_t)track.bytes);
+    for (std::vector<EsChunk>::const_iterator it = track.chunks.begin(); it != track.chunks.end(); ++it) {
+        if (it->unitStart || stream.units.empty()) {
+            EsUnit unit;
+            unit.offset = stream.data.size();
+            unit.size = 0;
+            unit.hasPts = it->unitStart && it->hasPts;
+            unit.pts = it->pts;
+            unit.dts = it->dts;
+            stream.units.push_back(unit);
+        }
+        stream.data.insert(stream.data.end(), it->data, it->data + it->size);
+        stream.units.back().size += it->size;
+    }
+}
+
+// the frames the parser has, recorded if opaque, a std::vector<FrameRecord>, is not NULL
+static uint64_t takeFrames(TSDemux::ElementaryStream *es, void *opaque) {
+    std::vector<FrameRecord> *frames = static_cast<std::vector<FrameRecord>*>(opaque);
+    uint64_t count = 0;
+    TSDemux::STREAM_PKT pkt;
+    while (es->GetStreamPacket(&pkt)) {
+        count++;
+        if (frames != NULL) {
+            FrameRecord frame;
+            frame.size = pkt.size;
+            frame.pts = pkt.pts;
+            frame.dts = pkt.dts;
+            frame.type = pkt.frame_type;
+            frame.hash = hashBytes(pkt.data, pkt.size);
+            frames->push_back(frame);
+        }
+    }
+    return count;
+}
+
+static uint64_t feedChunks(TSDemux::ElementaryStream *es, const EsStream &stream, size_t chunk, bool poll, std::vector<FrameRecord> *frames, uint64_t &appends) {
+    uint64_t count = 0;
+    for (std::vector<EsUnit>::const_iterator it = stream.units.begin(); it != stream.units.end(); ++it) {
+        count += takeFrames(es, frames);
+        beginUnit(es, it->hasPts, it->pts, it->dts);
+        const unsigned char *data = stream.data.empty() ? NULL : &stream.data[it->offset];
+        size_t step = chunk == CHUNK_WHOLE ? it->size : chunk;
+        for (size_t pos = 0; pos < it->size; pos += step) {
+            es->Append(data + pos, std::min(step, it->size - pos), pos == 0 && it->hasPts);
+            appends++;
+            if (poll) {
+                count += takeFrames(es, frames);
+            }
+        }
+    }
+    return count + takeFrames(es, frames);
+}
+
+static uint64_t feed(TSDemux::ElementaryStream *es, const EsStream &stream, size_t chunk, bool poll, std::vector<FrameRecord> *frames, uint64_t &appends) {
+    return chunk == CHUNK_TS ? feedPayloads(es, *stream.track, poll, takeFrames, frames, appends) : feedChunks(es, stream, chunk, poll, frames, appends);
+}
+
+static TSDemux::ElementaryStream *newParser(const EsStream &stream) {
+    return createParser(stream.track->pid, stream.track->type, &g_quiet);
+}
+
+// "ok", else where the frames part from the reference
+static std::string compareFrames(const std::vector<FrameRecord> &frames, const std::vector<FrameRecord> &reference) {
+    char text[128];
+    for (size_t i = 0; i < frames.size() && i < reference.size(); i++) {
+        if (frames[i] == reference[i]) {
+            continue;
+        }
+        if (frames[i].size != reference[i].size) {
+            snprintf(text, sizeof(text), "frame %u: %u bytes, ref %u", (unsigned)i, (unsigned)frames[i].size, (unsigned)reference[i].size);
+        } else if (frames[i].pts != reference[i].pts || frames[i].dts != reference[i].dts) {
+            snprintf(text, sizeof(text), "frame %u: timestamps", (unsigned)i);
+        } else if (frames[i].type != reference[i].type) {
+            snprintf(text, sizeof(text), "frame %u: type", (unsigned)i);
+        } else {
+            snprintf(text, sizeof(text), "frame %u: bytes", (unsigned)i);
+        }
+        return text;
+    }
+    if (frames.size() != reference.size()) {
+        snprintf(text, sizeof(text), "%u frames, ref %u", (unsigned)frames.size(), (unsigned)reference.size());
+        return text;
+    }
+    return "ok";
+}
+
+static bool saveReference(const std::string &path, const std::vector<EsStream> &streams, const FrameReference &reference) {
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "# es_bench frames: size pts dts type hash\n");
+    for (std::vector<EsStream>::const_iterator st = streams.begin(); st != streams.end(); ++st) {
+        FrameReference::const_iterator ref = reference.find(st->track->pid);
+        if (ref == reference.end()) {
+            continue;
+        }
+        fprintf(file, "stream %u %s %u\n", (unsigned)st->track->pid, TSDemux::ElementaryStream::GetStreamCodecName(st->track->type), (unsigned)ref->second.size());
+        for (std::vector<FrameRecord>::const_iterator it = ref->second.begin(); it != ref->second.end(); ++it) {
+            fprintf(file, "%u %" PRIu64 " %" PRIu64 " %d %016" PRIx64 "\n", (unsigned)it->size, it->pts, it->dts, it->type, it->hash);
+        }
+    }
+    bool ok = ferror(file) == 0;
+    return fclose(file) == 0 && ok;
+}
+
+static bool loadReference(const std::string &path, FrameReference &reference) {
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == NULL) {
+        return false;
+    }
+    char line[256];
+    std::vector<FrameRecord> *frames = NULL;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        unsigned pid = 0;
+        unsigned count = 0;
+        char codec[32];
+        unsigned size = 0;
+        FrameRecord frame;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        } else if (sscanf(line, "stream %u %31s %u", &pid, codec, &count) == 3) {
+            frames = &reference[(uint16_t)pid];
+            frames->reserve(count);
+        } else if (frames != NULL && sscanf(line, "%u %" SCNu64 " %" SCNu64 " %d %" SCNx64, &size, &frame.pts, &frame.dts, &frame.type, &frame.hash) == 5) {
+            frame.size = size;
+            frames->push_back(frame);
+        } else {
+            ok = false;
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+static std::string chunkName(size_t chunk) {
+    if (chunk == CHUNK_TS) {
+        return "ts";
+    }
+    if (chunk == CHUNK_WHOLE) {
+        return "whole";
+    }
+    char text[32];
+    snprintf(text, sizeof(text), "%u", (unsigned)chunk);
+    return text;
+}
+
+int main(int argc, char* argv[]) {
+    int warmup = BENCH_WARMUP;
+    int reps = BENCH_REPS;
+    bool poll = false;
+    bool csv = false;
+    std::vector<size_t> chunks;
+    std::set<std::string> codecs;
+    std::string saveRef;
+    std::string refFile;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--chunk") == 0 && ++i < argc) {
+            chunks.push_back((size_t)atoi(argv[i]));
+        } else if (strcmp(argv[i], "--poll") == 0) {
+            poll = true;
+        } else if (strcmp(argv[i], "--codec") == 0 && ++i < argc) {
+            codecs.insert(argv[i]);
+        } else if (strcmp(argv[i], "--warmup") == 0 && ++i < argc) {
+            warmup = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--reps") == 0 && ++i < argc) {
+            reps = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--save_ref") == 0 && ++i < argc) {
+            saveRef = argv[i];
+        } else if (strcmp(argv[i], "--ref") == 0 && ++i < argc) {
+            refFile = argv[i];
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty() || reps < 1 || warmup < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (chunks.empty()) {
+        chunks.push_back(16);
+        chunks.push_back(184);
+        chunks.push_back(4096);
+        chunks.push_back(CHUNK_WHOLE);
+    }
+    chunks.insert(chunks.begin(), CHUNK_TS);
+
+    BenchInput input;
+    for (std::vector<std::string>::iterator it = files.begin(); it != files.end(); ++it) {
+        if (!loadFile(*it, input.data)) {
+            printf("cannot open file: '%s'\n", it->c_str());
+            return 1;
+        }
+    }
+    if (!prepareInput(input, &g_quiet)) {
+        printf("no TS packets found \n");
+        return 1;
+    }
+
+    // the streams with a parser of their own
+    std::vector<EsStream> streams;
+    for (std::vector<EsTrack>::const_iterator it = input.tracks.begin(); it != input.tracks.end(); ++it) {
+        std::string codec = TSDemux::ElementaryStream::GetStreamCodecName(it->type);
+        if (codec == "data" || it->chunks.empty() || (!codecs.empty() && codecs.find(codec) == codecs.end())) {
+            continue;
+        }
+        streams.push_back(EsStream());
+        buildStream(*it, streams.back());
+    }
+    if (streams.empty()) {
+        printf("no elementary stream to parse \n");
+        return 1;
+    }
+
+    FrameReference reference;
+    FrameReference tsFrames;
+    bool savedReference = !refFile.empty();
+    if (savedReference && !loadReference(refFile, reference)) {
+        printf("cannot read reference: '%s'\n", refFile.c_str());
+        return 1;
+    }
+
+    if (csv) {
+        printf("pid,codec,chunk,bytes,appends,frames,median_us,best_us,mb_s,frames_s,ns_frame,check\n");
+    } else {
+        printf("%.1f MB, %u streams, %s, warmup %d, reps %d\n\n", input.data.size() / 1e6, (unsigned)streams.size(),
+            poll ? "frames taken after each Append" : "frames taken at the PES starts", warmup, reps);
+        printf("%-6s %-10s %-6s %10s %12s %10s %10s  %s\n", "pid", "codec", "chunk", "MB/s", "frames/s", "ns/frame", "appends", "check");
+    }
+
+    int mismatches = 0;
+    for (std::vector<EsStream>::const_iterator st = streams.begin(); st != streams.end(); ++st) {
+        uint16_t pid = st->track->pid;
+        const char *codec = TSDemux::ElementaryStream::GetStreamCodecName(st->track->type);
+        for (std::vector<size_t>::const_iterator ch = chunks.begin(); ch != chunks.end(); ++ch) {
+            // the check run, untimed
+            std::vector<FrameRecord> frames;
+            uint64_t appends = 0;
+            TSDemux::ElementaryStream *es = newParser(*st);
+            feed(es, *st, *ch, poll, &frames, appends);
+            delete es;
+            if (*ch == CHUNK_TS) {
+                tsFrames[pid] = frames;
+            }
+            std::string check;
+            FrameReference::const_iterator ref = reference.find(pid);
+            if (ref != reference.end()) {
+                check = compareFrames(frames, ref->second);
+            } else if (*ch == CHUNK_TS && !savedReference) {
+                check = "ref";
+                reference[pid] = frames;
+            } else {
+                check = "no ref";
+            }
+            if (check != "ok" && check != "ref" && check != "no ref") {
+                mismatches++;
+            }
+
+            std::vector<int64_t> times;
+            uint64_t count = 0;
+            for (int i = 0; i < warmup + reps; i++) {
+                uint64_t runAppends = 0;
+                es = newParser(*st);
+                int64_t start = TSDemux::PLATFORM::GetTimeUs();
+                count = feed(es, *st, *ch, poll, NULL, runAppends);
+                int64_t elapsed = TSDemux::PLATFORM::GetTimeUs() - start;
+                delete es;
+                if (i >= warmup) {
+                    times.push_back(elapsed);
+                }
+            }
+            BenchTimes runTimes = benchTimes(times);
+            double median = runTimes.median;
+            double best = runTimes.best;
+            double mbps = st->data.size() / median;            // bytes/us = MB/s
+            double fps = count * 1000000.0 / median;
+            double nsFrame = count ? median * 1000.0 / count : 0;
+            if (csv) {
+                printf("%u,%s,%s,%u,%" PRIu64 ",%" PRIu64 ",%.0f,%.0f,%.2f,%.0f,%.1f,%s\n", (unsigned)pid, codec, chunkName(*ch).c_str(),
+                    (unsigned)st->data.size(), appends, count, median, best, mbps, fps, nsFrame, check.c_str());
+            } else {
+                printf("0x%04x %-10s %-6s %10.1f %12.0f %10.0f %10" PRIu64 "  %s\n", (unsigned)pid, codec, chunkName(*ch).c_str(),
+                    mbps, fps, nsFrame, appends, check.c_str());
+            }
+        }
+    }
+
+    if (!saveRef.empty() && !saveReference(saveRef, streams, tsFrames)) {
+        printf("cannot write reference: '%s'\n", saveRef.c_str());
+        return 1;
+    }
+    return mismatches ? 2 : 0;
+}
@@ -89,6 +89,7 @@ namespace PLATFORM
     }
 
   private:
+    friend class CCondition;
     pthread_mutex_t m_mutex;
   };
 
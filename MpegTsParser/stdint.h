@@ -17,6 +17,11 @@
  */
 
 
+#if !defined(_MSC_VER)
+/* the toolchain provides stdint.h, this one stands in for older Visual C++ */
+#include_next <stdint.h>
+#else
+
 #ifndef _STDINT_H
 #define _STDINT_H
 #define __need_wint_t
@@ -209,3 +214,5 @@ typedef unsigned long long uintmax_t;
 #endif  /* !defined ( __cplusplus) || defined __STDC_CONSTANT_MACROS */
 
 #endif
+
+#endif /* _MSC_VER */
@@ -23,14 +23,25 @@
 #include <assert.h>
 #include <stdio.h>
 #include <string>
+#include <algorithm>
 #include <inttypes.h>
+#include <signal.h>
 
 #include "debug.h"
-#include <io.h>
 #include "ParserdDataContainer.h"
 #include "TsLayer.h"
 #include "CommandLine.h"
 #include "Tool.h"
+#include "RenditionAligner.h"
+#include "HlsPlaylist.h"
+#include "SegmentPrefetcher.h"
+#include "EventWriter.h"
+#include "FolderWatcher.h"
+#include "ResultCache.h"
+#include "FileFollower.h"
+#include "HwCounters.h"
+#include "ChromeTrace.h"
+#include "timeutils.h"
 
 #define LOGTAG  "[DEMUX] "
 
@@ -44,30 +55,709 @@ static void usage(const char* cmd)
         "  Enter '-' instead a file name will process stream from standard input\n\n"
         "  --debug            enable debug output\n"
         "  --parseonly        only parse streams\n"
-        "  --channel <id>     process channel <id>. Default 0 for all channels\n"
+        "  --channel <id,...> process programs <id,...>. Default 0 for all channels\n"
+        "  --service <name>   process the program of service <name> (SDT), may be repeated\n"
+        "  --print_si         log SI tables (NIT, SDT, EIT, CAT, TDT/TOT)\n"
+        "  --pcr_analysis     PCR accuracy, jitter and interval per PCR PID\n"
+        "  --pcr_wallclock    PCR analysis against the wall clock (live input, default for stdin)\n"
+        "  --bitrate          per PID counters and bitrate over time\n"
+        "  --bitrate_csv      --bitrate, and write <file>_program<id>_bitrate.csv per program\n"
+        "  --bitrate_bucket <ms> time bucket of the bitrate series. Default 100\n"
+        "  --ts_folder_path <dir> process the .ts, .dbts, .265ts and .bbts files of <dir>\n"
+        "  --recursive        --ts_folder_path also walks the subdirectories of <dir>\n"
+        "  --cache <file>     skip the files unchanged since the run that wrote <file>, timestamp checks only\n"
+        "  --follow           <file> is still being written: demux it as it grows, until stopped\n"
+        "  --follow_idle <s>  --follow ends once <file> has not grown for <s> seconds\n"
+        "  --watch            --ts_folder_path as a daemon: analyze each new segment once it is written\n"
+        "  --align <dir>      IDR alignment of the renditions <dir>, may be repeated\n"
+        "  --hls <m3u8>       analyze the segments of a local HLS playlist in playlist order\n"
+        "  --gop              GOP structure, frame types and sizes of the video streams\n"
+        "  --duration         media duration of the streams from the frame and sample counts\n"
+        "  --duration_only    --duration without the PES timestamp checks, nothing buffered\n"
+        "  --trace <dir>      write a timestamp trace <file>.tstrace per input to <dir>\n"
+        "  --from_trace       inputs are timestamp traces, re-run the checks without demux\n"
+        "  --json <file>      timestamps and discontinuities as JSON lines to <file>, not to the log\n"
+        "  --csv <file>       timestamps and discontinuities as CSV to <file>, not to the log\n"
+        "  --check_buffer_out check the pts-dts delay and simulate the T-STD buffers of the streams\n"
+        "  --counters         demux counters and time per stage, as a table at exit\n"
+        "  --perf_report      CPU counters of the demux of each file (Linux perf_event), per packet and frame\n"
+        "  --chrome_trace <file> timeline of the stages of each thread, Chrome trace JSON written to <file> at exit\n"
         "  -h, --help         print this help\n"
         "\n", cmd
         );
 }
 
-FILE *g_logFile = NULL;
-void  LogOut(int level, char *log) {
+class SiTableLogger : public TSDemux::SectionListener {
+public:
+    virtual void onTable(int /*filterId*/, const TSDemux::PSI_TABLE &table) {
+        TSDemux::DBG(DEMUX_DBG_INFO, "[SI] pid:0x%.4x table:0x%.2x ext:%u version:%u sections:%u \n",
+            table.pid, table.table_id, table.table_id_extension, table.version, (unsigned)table.sections.size());
+    }
+};
+
+static void registerSiFilters(TsLayer *demux, SiTableLogger *logger) {
+    int flags = TSDemux::SECTION_FILTER_TABLES | TSDemux::SECTION_FILTER_VERSION_CHANGE;
+    demux->addSectionFilter(0x0001, 0x01, 0xff, flags, logger); // CAT
+    demux->addSectionFilter(0x0010, 0x40, 0xfe, flags, logger); // NIT actual/other
+    demux->addSectionFilter(0x0011, 0x42, 0xfb, flags, logger); // SDT actual/other
+    demux->addSectionFilter(0x0012, 0x4e, 0xfe, flags, logger); // EIT p/f actual/other
+    demux->addSectionFilter(0x0012, 0x50, 0xf0, flags, logger); // EIT schedule actual
+    demux->addSectionFilter(0x0012, 0x60, 0xf0, flags, logger); // EIT schedule other
+    demux->addSectionFilter(0x0014, 0x70, 0xfc, flags, logger); // TDT/TOT
+}
+
+// the analyses of the command line on a new demux
+static void configureDemux(TsLayer *demux, const GYJ::CommandLineParam &cmdLine, SiTableLogger *siLogger, bool live) {
+    if (cmdLine.printSi) {
+        registerSiFilters(demux, siLogger);
+    }
+    if (cmdLine.pcrAnalysis) {
+        demux->enablePcrAnalysis(cmdLine.pcrWallClock != 0 || live);
+    }
+    if (cmdLine.bitrate) {
+        demux->enableBitrateAnalysis(cmdLine.bitrateBucketMs);
+    }
+    if (cmdLine.checkPacketBufferOut) {
+        demux->enableBufferModel();
+    }
+    if (cmdLine.gop) {
+        demux->enableGopAnalysis();
+    }
+    if (cmdLine.duration) {
+        demux->enableDurationCount();
+    }
+    if (cmdLine.durationOnly) {
+        demux->setKeepParseredData(false);
+    }
+    if (cmdLine.counters) {
+        demux->enablePerfTimers();
+    }
+}
+
+// --counters: the counters of every demux of the run, printed at exit
+static TSDemux::PERF_STATS g_perf;
+static int g_perfDemuxes = 0;
+static TSDemux::PLATFORM::CMutex g_perfMutex;
+
+// demuxes of a playlist run on the prefetch workers
+static void addPerfStats(TsLayer *demux) {
+    TSDemux::PERF_STATS stats = demux->getPerfStats();
+    TSDemux::PLATFORM::CLockObject lock(g_perfMutex);
+    g_perf.add(stats);
+    g_perfDemuxes++;
+}
+
+static void printPerfStats() {
+    const TSDemux::PERF_STATS &st = g_perf;
+    double total = st.totalMs();
+    printf("[COUNTERS] %d demux \n", g_perfDemuxes);
+    printf("%-10s %12s %12s %7s %10s \n", "stage", "calls", "ms", "%", "ns/packet");
+    for (int i = 0; i < TSDemux::PERF_STAGE_COUNT; i++) {
+        double ms = st.stageMs(i);
+        printf("%-10s %12" PRIu64 " %12.1f %6.1f%% %10.1f \n", TSDemux::PERF_STATS::stageName(i), st.stageCalls[i], ms,
+            total > 0 ? ms * 100 / total : 0.0, st.packets > 0 ? ms * 1000000 / st.packets : 0.0);
+    }
+    printf("%-10s %12s %12.1f %6.1f%% %10.1f \n", "total", "", total, total > 0 ? 100.0 : 0.0,
+        st.packets > 0 ? total * 1000000 / st.packets : 0.0);
+    printf("packets:%" PRIu64 " resyncs:%" PRIu64 " (%" PRIu64 " bytes) cc errors:%" PRIu64 " pes starts:%" PRIu64 " \n",
+        st.packets, st.resyncs, st.resyncBytes, st.ccErrors, st.pesStarts);
+    printf("es append:%" PRIu64 " bytes memmove:%" PRIu64 " bytes (%.1f%%) reallocs:%" PRIu64 " \n", st.esAppendBytes, st.esMovedBytes,
+        st.esAppendBytes > 0 ? st.esMovedBytes * 100.0 / st.esAppendBytes : 0.0, st.esReallocs);
+    printf("frames:%" PRIu64, st.totalFrames());
+    for (int i = 0; i < PERF_STREAM_TYPES; i++) {
+        if (st.frames[i] > 0) {
+            printf(" %s:%" PRIu64, TSDemux::ElementaryStream::GetStreamCodecName((TSDemux::STREAM_TYPE)i), st.frames[i]);
+        }
+    }
+    printf(" \n");
+}
+
+// --perf_report: CPU counters around the demux of each file, and their sum at exit
+static GYJ::HwSample g_hw;
+static bool g_hwReported = false;
+
+// false when nothing can be counted, said once
+static bool openHwCounters(GYJ::HwCounters &hw) {
+    bool ok = hw.open();
+    TSDemux::PLATFORM::CLockObject lock(g_perfMutex);
+    if (!g_hwReported && !hw.getError().empty()) {
+        printf("[PERF] %s%s \n", ok ? "" : "no CPU counters, ", hw.getError().c_str());
+    }
+    g_hwReported = true;
+    return ok;
+}
+
+static void printHwSample(const std::string &name, const GYJ::HwSample &hw) {
+    const uint64_t *v = hw.values;
+    double packets = hw.packets > 0 ? (double)hw.packets : 1.0;
+    std::string line = "[PERF] " + name;
+    char field[128];
+    sprintf(field, " packets:%" PRIu64 " frames:%" PRIu64, hw.packets, hw.frames);
+    line += field;
+    if (hw.counted[GYJ::HW_CYCLES]) {
+        sprintf(field, " cycles/packet:%.1f cycles/frame:%.0f", v[GYJ::HW_CYCLES] / packets,
+            hw.frames > 0 ? (double)v[GYJ::HW_CYCLES] / hw.frames : 0.0);
+        line += field;
+    }
+    if (hw.counted[GYJ::HW_INSTRUCTIONS]) {
+        sprintf(field, " instructions/packet:%.1f", v[GYJ::HW_INSTRUCTIONS] / packets);
+        line += field;
+        if (hw.counted[GYJ::HW_CYCLES] && v[GYJ::HW_CYCLES] > 0) {
+            sprintf(field, " IPC:%.2f", (double)v[GYJ::HW_INSTRUCTIONS] / v[GYJ::HW_CYCLES]);
+            line += field;
+        }
+    }
+    if (hw.counted[GYJ::HW_CACHE_MISSES]) {
+        sprintf(field, " cache misses/packet:%.2f", v[GYJ::HW_CACHE_MISSES] / packets);
+        line += field;
+        if (hw.counted[GYJ::HW_CACHE_REFERENCES] && v[GYJ::HW_CACHE_REFERENCES] > 0) {
+            sprintf(field, " (%.1f%% of references)", v[GYJ::HW_CACHE_MISSES] * 100.0 / v[GYJ::HW_CACHE_REFERENCES]);
+            line += field;
+        }
+    }
+    if (hw.counted[GYJ::HW_BRANCH_MISSES]) {
+        sprintf(field, " branch misses/packet:%.2f", v[GYJ::HW_BRANCH_MISSES] / packets);
+        line += field;
+        if (hw.counted[GYJ::HW_BRANCHES] && v[GYJ::HW_BRANCHES] > 0) {
+            sprintf(field, " (%.2f%% of branches)", v[GYJ::HW_BRANCH_MISSES] * 100.0 / v[GYJ::HW_BRANCHES]);
+            line += field;
+        }
+    }
+    if (hw.counted[GYJ::HW_TASK_CLOCK]) {
+        sprintf(field, " cpu ns/packet:%.1f cpu ms:%.1f", v[GYJ::HW_TASK_CLOCK] / packets, v[GYJ::HW_TASK_CLOCK] / 1000000.0);
+        line += field;
+    }
+    if (hw.counted[GYJ::HW_PAGE_FAULTS]) {
+        sprintf(field, " page faults:%" PRIu64, v[GYJ::HW_PAGE_FAULTS]);
+        line += field;
+    }
+    if (hw.scaled) {
+        line += " (multiplexed, estimated)";
+    }
+    printf("%s \n", line.c_str());
+}
+
+// a demux of a playlist runs on a prefetch worker, the counters are those of its thread
+static void addHwSample(const std::string &name, TsLayer *demux, GYJ::HwSample &sample) {
+    TSDemux::PERF_STATS stats = demux->getPerfStats();
+    sample.packets = stats.packets;
+    sample.frames = stats.totalFrames();
+    TSDemux::PLATFORM::CLockObject lock(g_perfMutex);
+    printHwSample(name, sample);
+    g_hw.add(sample);
+}
+
+static void printHwTotal() {
+    if (g_hw.packets > 0) {
+        printHwSample("total", g_hw);
+    }
+}
+
+// --chrome_trace: the spans of every thread, written once they are joined
+static std::string g_chromeTrace;
+
+static void writeChromeTrace() {
+    // the buffers are gone once written
+    uint64_t dropped = TSDemux::ChromeTrace::dropped();
+    if (!TSDemux::ChromeTrace::write(g_chromeTrace)) {
+        printf("cannot write trace: '%s'\n", g_chromeTrace.c_str());
+        return;
+    }
+    if (dropped > 0) {
+        printf("[TRACE] %" PRIu64 " spans dropped, over %d per thread \n", dropped, TRACE_MAX_EVENTS);
+    }
+}
+
+// the analysis results of a finished demux
+static void collectStats(TsLayer *demux, GYJ::tsParam *param) {
+    param->pcrStats = demux->getPcrStats();
+    param->bitrate = demux->takeBitrateMeter();
+    param->bufferStats = demux->getBufferStats();
+    param->gopStats = demux->getGopStats();
+    param->durations = demux->getDurations();
+}
+
+// demux of one file of the list, with the analyses of the command line
+class FileDemuxer : public GYJ::SegmentDemuxer {
+public:
+    FileDemuxer(const std::vector<std::string> &paths, const std::vector<std::string> &names,
+        const TSDemux::ProgramSelection &selection, const GYJ::CommandLineParam &cmdLine, SiTableLogger *siLogger, TSDemux::Logger *logger, GYJ::ResultCache *cache = NULL)
+        : mPaths(paths), mNames(names), mSelection(selection), mCmdLine(cmdLine), mSiLogger(siLogger), mLogger(logger), mCache(cache), mSegments(NULL) {}
+
+    // playlist segments, their byte ranges are demuxed instead of the whole file
+    void setSegments(const std::vector<GYJ::HlsSegment> *segments) { mSegments = segments; }
+
+    virtual GYJ::tsParam *demux(size_t index) {
+        const std::string &curFile = mPaths[index];
+
+        // an unchanged file of an earlier run is not demuxed again
+        GYJ::FileFingerprint fingerprint;
+        bool cacheable = mCache != NULL && strcmp(curFile.c_str(), "-") != 0;
+        if (cacheable) {
+            GYJ::tsParam *cached = mCache->lookup(curFile, mNames[index], fingerprint);
+            if (cached != NULL) {
+                return cached;
+            }
+        }
+
+        FILE* file = NULL;
+        if (strcmp(curFile.c_str(), "-") == 0){
+            file = stdin;
+        } else {
+            TSDemux::TraceSpan span("open", TRACE_IO);
+            span.setDetail(mNames[index]);
+            file = fopen(curFile.c_str(), "rb");
+        }
+        if (file == NULL) {
+            printf("cannot open file: '%s'\n", curFile.c_str());
+            return NULL;
+        }
+
+        GYJ::tsParam *param = NULL;
+        TsLayer* demux = NULL;
+        TsFileInput *range = NULL;
+        if (mSegments != NULL && (*mSegments)[index].byteRange) {
+            range = new TsFileInput(file, (*mSegments)[index].byteOffset, (*mSegments)[index].byteLength);
+            demux = new TsLayer(range, mSelection, 0, mLogger);
+        } else {
+            demux = new TsLayer(file, mSelection, 0, mLogger);
+        }
+        if (demux != NULL) {
+            configureDemux(demux, mCmdLine, mSiLogger, file == stdin);
+            std::string trace;
+            if (!mCmdLine.traceDir.empty()) {
+                trace = mCmdLine.traceDir + traceFileName(mNames[index]);
+                demux->enableTrace(trace, mNames[index]);
+            }
+            GYJ::HwCounters hw;
+            bool counting = mCmdLine.perfReport && openHwCounters(hw);
+            if (counting) {
+                hw.start();
+            }
+            demux->doDemux();
+            if (counting) {
+                GYJ::HwSample sample = hw.stop();
+                addHwSample(mNames[index], demux, sample);
+            }
+            if (mCmdLine.counters) {
+                addPerfStats(demux);
+            }
+            if (!trace.empty() && !demux->closeTrace()) {
+                printf("cannot write trace: '%s'\n", trace.c_str());
+            }
+            std::list<TSDemux::STREAM_PKT*> *lst = demux->getParseredData();
+            param = new GYJ::tsParam(mNames[index], demux->getTsStartTimeStamp(), lst, demux->getPrograms());
+            if (param != NULL) {
+                collectStats(demux, param);
+                if (cacheable) {
+                    mCache->store(curFile, fingerprint, param);
+                }
+            }
+
+            delete demux;
+        }
+        delete range;
+
+        fclose(file);
+        return param;
+    }
+
+private:
+    static std::string traceFileName(const std::string &name) {
+        std::string::size_type pos = name.find_last_of("/\\");
+        std::string base = pos == std::string::npos ? name : name.substr(pos + 1);
+        return (base == "-" ? "stdin" : base) + ".tstrace";
+    }
+
+    const std::vector<std::string> &mPaths;
+    const std::vector<std::string> &mNames;
+    const TSDemux::ProgramSelection &mSelection;
+    const GYJ::CommandLineParam &mCmdLine;
+    SiTableLogger *mSiLogger;
+    TSDemux::Logger *mLogger;
+    GYJ::ResultCache *mCache;
+    const std::vector<GYJ::HlsSegment> *mSegments;
+};
+
+// reload of a timestamp trace: PES list and the frame analyses, without demux
+class TraceDemuxer : public GYJ::SegmentDemuxer {
+public:
+    TraceDemuxer(const std::vector<std::string> &paths, const GYJ::CommandLineParam &cmdLine, TSDemux::Logger *logger)
+        : mPaths(paths), mCmdLine(cmdLine), mLogger(logger) {}
+
+    virtual GYJ::tsParam *demux(size_t index) {
+        TSDemux::TraceReader reader(mLogger);
+        if (!reader.open(mPaths[index])) {
+            printf("cannot open trace: '%s'\n", mPaths[index].c_str());
+            return NULL;
+        }
+
+        Replay replay(mCmdLine, reader.getPrograms());
+        if (!reader.replay(replay)) {
+            printf("corrupt trace: '%s'\n", mPaths[index].c_str());
+        }
+
+        GYJ::tsParam *param = new GYJ::tsParam(reader.getName(), reader.getStartTime(), replay.packets, reader.getPrograms());
+        std::vector<uint16_t> pids = replay.gop.getPids();
+        for (std::vector<uint16_t>::iterator it = pids.begin(); it != pids.end(); ++it) {
+            param->gopStats.insert(std::make_pair(*it, *replay.gop.getStats(*it)));
+        }
+        pids = replay.durations.getPids();
+        for (std::vector<uint16_t>::iterator it = pids.begin(); it != pids.end(); ++it) {
+            param->durations.insert(std::make_pair(*it, *replay.durations.getStats(*it)));
+        }
+        return param;
+    }
+
+private:
+    class Replay : public TSDemux::TraceListener {
+    public:
+        Replay(const GYJ::CommandLineParam &cmdLine, const std::vector<TSDemux::Program> &programs)
+            : packets(new std::list<TSDemux::STREAM_PKT*>), mCmdLine(cmdLine) {
+            for (std::vector<TSDemux::Program>::const_iterator pg = programs.begin(); pg != programs.end(); ++pg) {
+                for (std::vector<TSDemux::PROGRAM_STREAM>::const_iterator it = pg->streams.begin(); it != pg->streams.end(); ++it) {
+                    if (TSDemux::ElementaryStream::IsVideoType(it->stream_type)) {
+                        mVideoPids.insert(it->pid);
+                    }
+                }
+            }
+        }
+
+        virtual void onPes(const TSDemux::STREAM_PKT &pkt, uint64_t /*position*/) {
+            if (mCmdLine.durationOnly == 0) {
+                packets->push_back(new TSDemux::STREAM_PKT(pkt));
+            }
+        }
+
+        virtual void onFrame(const TSDemux::STREAM_PKT &pkt, int sampleRate) {
+            if (mCmdLine.gop && pkt.frame_type != TSDemux::FRAME_TYPE_UNKNOWN) {
+                gop.addFrame(&pkt);
+            }
+            if (mCmdLine.duration) {
+                durations.addFrame(&pkt, mVideoPids.find(pkt.pid) != mVideoPids.end(), sampleRate);
+            }
+        }
+
+        std::list<TSDemux::STREAM_PKT*> *packets;
+        TSDemux::GopAnalyzer gop;
+        TSDemux::DurationCounter durations;
+    private:
+        const GYJ::CommandLineParam &mCmdLine;
+        std::set<uint16_t> mVideoPids;
+    };
+
+    const std::vector<std::string> &mPaths;
+    const GYJ::CommandLineParam &mCmdLine;
+    TSDemux::Logger *mLogger;
+};
+
+// segments of a media playlist, or of every media playlist of a master playlist
+static int processPlaylist(const std::string &path, const TSDemux::ProgramSelection &selection,
+    const GYJ::CommandLineParam &cmdLine, SiTableLogger *siLogger, GYJ::EventWriter *events, TSDemux::Logger *logger, bool variant) {
+    GYJ::HlsPlaylist playlist(logger);
+    if (!playlist.load(path)) {
+        return 1;
+    }
+
+    int errors = 0;
+    if (playlist.isMaster()) {
+        if (variant) {
+            printf("[HLS] nested master playlist '%s' ignored \n", path.c_str());
+            return 1;
+        }
+        const std::vector<GYJ::HlsVariant> &variants = playlist.getVariants();
+        for (std::vector<GYJ::HlsVariant>::const_iterator it = variants.begin(); it != variants.end(); ++it) {
+            DEMUX_LOG(logger, DEMUX_DBG_INFO, "[HLS] variant %s bandwidth:%d resolution:%s \n", it->uri.c_str(), it->bandwidth,
+                it->resolution.empty() ? "-" : it->resolution.c_str());
+            errors += processPlaylist(it->path, selection, cmdLine, siLogger, events, logger, true);
+        }
+        return errors;
+    }
+
+    const std::vector<GYJ::HlsSegment> &segments = playlist.getSegments();
+    DEMUX_LOG(logger, DEMUX_DBG_INFO, "[HLS] %s: %u segments, target duration %d%s \n", path.c_str(), (unsigned)segments.size(),
+        playlist.getTargetDuration(), playlist.hasEndList() ? "" : ", no EXT-X-ENDLIST");
+    std::vector<std::string> paths;
+    std::vector<std::string> names;
+    for (std::vector<GYJ::HlsSegment>::const_iterator it = segments.begin(); it != segments.end(); ++it) {
+        paths.push_back(it->path);
+        if (it->byteRange) {
+            char range[32];
+            snprintf(range, sizeof(range), "@%" PRIu64, it->byteOffset);
+            names.push_back(it->uri + range);
+        } else {
+            names.push_back(it->uri);
+        }
+    }
+
+    // segments are demuxed ahead on the prefetch workers and analyzed in playlist order,
+    // so the continuity checks run from one segment to the next
+    GYJ::ParseredDataContainer dataContainer(cmdLine.getPrintParam(), logger);
+    dataContainer.setEventWriter(events);
+    FileDemuxer demuxer(paths, names, selection, cmdLine, siLogger, logger);
+    demuxer.setSegments(&segments);
+    GYJ::SegmentPrefetcher prefetcher(demuxer, segments.size());
+    for (size_t n = 0; n < segments.size(); n++) {
+        GYJ::tsParam *param = prefetcher.take(n);
+        if (param == NULL) {
+            errors++;
+            continue;
+        }
+        param->discontinuity = segments[n].discontinuity;
+        if (!playlist.validateSegment(segments[n], param)) {
+            errors++;
+        }
+        dataContainer.addData((int64_t)n, param);
+    }
+    dataContainer.printInfo();
+    return errors;
+}
+
+// --watch and --follow run until SIGINT/SIGTERM
+static volatile sig_atomic_t g_stop = 0;
+
+static void onStopSignal(int /*sig*/) {
+    g_stop = 1;
+}
+
+// --watch: each segment completed in the folder is analyzed once, in completion order,
+// the continuity checks carry on from the previous segment
+static int watchFolder(const TSDemux::ProgramSelection &selection, const GYJ::CommandLineParam &cmdLine,
+    SiTableLogger *siLogger, GYJ::ParseredDataContainer &dataContainer, TSDemux::Logger *logger, FILE *logFile, GYJ::ResultCache *cache) {
+    GYJ::FolderWatcher watcher;
+    if (!watcher.open(cmdLine.filePath)) {
+        printf("cannot watch '%s'\n", cmdLine.filePath.c_str());
+        return 1;
+    }
+    signal(SIGINT, onStopSignal);
+    signal(SIGTERM, onStopSignal);
+    printf("[WATCH] %s \n", cmdLine.filePath.c_str());
+    fflush(stdout);
+
+    std::vector<std::string> paths(1);
+    std::vector<std::string> names(1);
+    FileDemuxer demuxer(paths, names, selection, cmdLine, siLogger, logger, cache);
+    int64_t segment = 0;
+    while (!g_stop) {
+        std::string name;
+        // the timeout only bounds the reaction to a stop signal
+        GYJ::WatchResult result = watcher.next(name, 500);
+        if (watcher.overflowed()) {
+            printf("[WATCH] event queue overflow, segments missed \n");
+        }
+        if (result == GYJ::WATCH_ERROR) {
+            printf("[WATCH] %s is gone \n", cmdLine.filePath.c_str());
+            return 1;
+        }
+        if (result != GYJ::WATCH_FILE || !GYJ::isTsFile(name)) {
+            continue;
+        }
+
+        paths[0] = cmdLine.filePath + name;
+        names[0] = name;
+        GYJ::tsParam *param = demuxer.demux(0);
+        if (param == NULL) {
+            continue;
+        }
+        dataContainer.addData(segment++, param);
+        dataContainer.printInfo();
+        fflush(stdout);
+        if (logFile != NULL) {
+            fflush(logFile);
+        }
+        if (cache != NULL && !cache->save(cmdLine.cacheFile)) {
+            printf("cannot write cache: '%s'\n", cmdLine.cacheFile.c_str());
+        }
+    }
+    return 0;
+}
+
+#define FOLLOW_CHUNK_PACKETS    50000   // TS packets demuxed before the PES are handed over (9.4MB)
+#define FOLLOW_REPORT_MS        2000    // PES demuxed at the end of the file are checked after this delay
+#define FOLLOW_WAIT_MS          500     // growth wait between two checks of the stop flag and the idle time
+
+// end of the part of the pending PES that can be checked now: before it, every pts of a video PID
+// is below the pts of its PES still pending, so no frame to come reorders in front of the cut
+static size_t followCut(const std::list<TSDemux::STREAM_PKT*> &pending, const std::set<uint16_t> &videoPids) {
+    std::vector<const TSDemux::STREAM_PKT*> packets(pending.begin(), pending.end());
+    size_t n = packets.size();
+    if (n < 2) {
+        return 0;
+    }
+    const int64_t none = (int64_t)(~0ULL >> 1);
+    std::vector<bool> valid(n, true);
+    std::vector<int64_t> minAfter(n + 1);
+    for (std::set<uint16_t>::const_iterator pid = videoPids.begin(); pid != videoPids.end(); ++pid) {
+        minAfter[n] = none;
+        for (size_t i = n; i-- > 0; ) {
+            int64_t pts = packets[i]->pid == *pid ? (int64_t)packets[i]->pts : none;
+            minAfter[i] = std::min(minAfter[i + 1], pts);
+        }
+        bool seen = false;
+        int64_t maxBefore = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (minAfter[i] == none || (seen && maxBefore >= minAfter[i])) {
+                valid[i] = false;
+            }
+            if (packets[i]->pid == *pid) {
+                maxBefore = seen ? std::max(maxBefore, (int64_t)packets[i]->pts) : (int64_t)packets[i]->pts;
+                seen = true;
+            }
+        }
+    }
+    for (size_t i = n - 1; i > 0; i--) {
+        if (valid[i]) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+// the checkable part of the pending PES as a segment for the container, all of it when last
+static GYJ::tsParam *takeFollowChunk(TsLayer *demux, std::list<TSDemux::STREAM_PKT*> &pending, const std::string &name, bool last) {
+    std::vector<TSDemux::Program> programs = demux->getPrograms();
+    size_t cut = pending.size();
+    if (!last) {
+        std::set<uint16_t> videoPids;
+        for (std::vector<TSDemux::Program>::const_iterator pg = programs.begin(); pg != programs.end(); ++pg) {
+            if (pg->selected && pg->GetVideoPid() != 0xffff) {
+                videoPids.insert(pg->GetVideoPid());
+            }
+        }
+        cut = followCut(pending, videoPids);
+        if (cut == 0) {
+            return NULL;
+        }
+    }
+
+    std::list<TSDemux::STREAM_PKT*>::iterator end = pending.begin();
+    std::advance(end, cut);
+    std::list<TSDemux::STREAM_PKT*> *lst = new std::list<TSDemux::STREAM_PKT*>;
+    lst->splice(lst->end(), pending, pending.begin(), end);
+    return new GYJ::tsParam(name, demux->getTsStartTimeStamp(), lst, programs);
+}
+
+// --follow: a recording still being written is demuxed as it grows, with all the demux state kept;
+// the PES are checked in chunks and the continuity checks carry on from one chunk to the next
+static int followFile(const std::string &path, const TSDemux::ProgramSelection &selection, const GYJ::CommandLineParam &cmdLine,
+    SiTableLogger *siLogger, GYJ::ParseredDataContainer &dataContainer, TSDemux::Logger *logger, FILE *logFile) {
+    FILE *file = fopen(path.c_str(), "rb");
+    GYJ::FileFollower follower;
+    if (file == NULL || !follower.open(path)) {
+        printf("cannot follow '%s'\n", path.c_str());
+        if (file != NULL) {
+            fclose(file);
+        }
+        return 1;
+    }
+    signal(SIGINT, onStopSignal);
+    signal(SIGTERM, onStopSignal);
+    printf("[FOLLOW] %s \n", path.c_str());
+    fflush(stdout);
+
+    TsLayer *demux = new TsLayer(file, selection, 0, logger);
+    configureDemux(demux, cmdLine, siLogger, false);
+
+    std::list<TSDemux::STREAM_PKT*> pending;
+    int64_t chunk = 0;
+    int64_t lastReport = TSDemux::PLATFORM::GetTimeUs();
+    int idleMs = 0;
+    bool more = true;
+    while (!g_stop) {
+        if (more) {
+            int ret = demux->doDemux(FOLLOW_CHUNK_PACKETS);
+            pending.splice(pending.end(), *demux->getParseredData());
+            more = ret == TSDemux::AVCONTEXT_CONTINUE;
+        }
+
+        int64_t now = TSDemux::PLATFORM::GetTimeUs();
+        if (more || now - lastReport >= FOLLOW_REPORT_MS * 1000LL) {
+            GYJ::tsParam *param = takeFollowChunk(demux, pending, path, false);
+            if (param != NULL) {
+                dataContainer.addData(chunk++, param);
+                dataContainer.printInfo();
+                fflush(stdout);
+                if (logFile != NULL) {
+                    fflush(logFile);
+                }
+                lastReport = now;
+            }
+        }
+        if (more) {
+            continue;
+        }
+
+        GYJ::FollowResult result = follower.wait(FOLLOW_WAIT_MS);
+        if (result == GYJ::FOLLOW_GONE) {
+            printf("[FOLLOW] %s removed or truncated \n", path.c_str());
+            break;
+        }
+        if (result == GYJ::FOLLOW_IDLE) {
+            idleMs += FOLLOW_WAIT_MS;
+            if (cmdLine.followIdle > 0 && idleMs >= cmdLine.followIdle * 1000) {
+                break;
+            }
+            continue;
+        }
+        idleMs = 0;
+        more = true;
+    }
+
+    // the rest, with the analyses of the whole recording
+    GYJ::tsParam *param = takeFollowChunk(demux, pending, path, true);
+    collectStats(demux, param);
+    if (cmdLine.counters) {
+        addPerfStats(demux);
+    }
+    dataContainer.addData(chunk++, param);
+    dataContainer.printInfo();
+
+    delete demux->getParseredData();
+    delete demux;
+    fclose(file);
+    return 0;
+}
+
+// the summaries of the result cache hold the timestamp checks only, and depend on the program selection
+static bool isCacheable(const GYJ::CommandLineParam &cmdLine) {
+    return !cmdLine.printSi && !cmdLine.pcrAnalysis && !cmdLine.bitrate && !cmdLine.checkPacketBufferOut && !cmdLine.gop
+        && !cmdLine.duration && !cmdLine.durationOnly && !cmdLine.fromTrace && cmdLine.traceDir.empty();
+}
+
+static std::string cacheConfig(const TSDemux::ProgramSelection &selection) {
+    std::string config = "programs:";
+    char number[16];
+    for (std::set<uint16_t>::const_iterator it = selection.numbers.begin(); it != selection.numbers.end(); ++it) {
+        sprintf(number, "%u,", *it);
+        config += number;
+    }
+    config += " services:";
+    for (std::set<std::string>::const_iterator it = selection.names.begin(); it != selection.names.end(); ++it) {
+        config += *it + ",";
+    }
+    return config;
+}
+
+// log sink: the INFO lines into the log file given as opaque
+static void LogOut(void *opaque, int level, const char *log) {
     if (log != NULL && level == DEMUX_DBG_INFO) {
-       std::string str(log);
-       fwrite(log, 1, str.size(), g_logFile);
+       fwrite(log, 1, strlen(log), (FILE*)opaque);
     }
 }
 
 using namespace GYJ;
 int main(int argc, char* argv[])
 {
-  const char* filename = NULL;
-  uint16_t channel = 0;
+  TSDemux::ProgramSelection selection;
   int i = 0;
 
   CommandLineParam cmdLine;
   std::string videoFileLocation;
   std::vector<std::string> localFiles;
+  std::vector<std::string> renditions;
+  std::string playlist;
+  std::string eventFile;
+  GYJ::EventFormat eventFormat = GYJ::EVENT_FORMAT_JSON;
 
   while (++i < argc)
   {
@@ -79,8 +769,23 @@ int main(int argc, char* argv[])
     }
     else if (strcmp(argv[i], "--channel") == 0 && ++i < argc)
     {
-      channel = atoi(argv[i]);
-      fprintf(stderr, "channel=%d, ",channel);
+      const char* p = argv[i];
+      while (*p)
+      {
+        int channel = atoi(p);
+        if (channel > 0)
+          selection.numbers.insert((uint16_t)channel);
+        fprintf(stderr, "channel=%d, ", channel);
+        p = strchr(p, ',');
+        if (p == NULL)
+          break;
+        ++p;
+      }
+    }
+    else if (strcmp(argv[i], "--service") == 0 && ++i < argc)
+    {
+      selection.names.insert(argv[i]);
+      fprintf(stderr, "service=%s, ", argv[i]);
     }
     else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
     {
@@ -100,10 +805,62 @@ int main(int argc, char* argv[])
     } else if (strcmp(argv[i], "--ts_folder_path") == 0 && ++i < argc) {
         cmdLine.filePath = argv[i];
         cmdLine.filePath = regulateFilePath(cmdLine.filePath);
+    } else if (strcmp(argv[i], "--recursive") == 0) {
+        cmdLine.recursive = 1;
+    } else if (strcmp(argv[i], "--cache") == 0 && ++i < argc) {
+        cmdLine.cacheFile = argv[i];
+    } else if (strcmp(argv[i], "--follow") == 0) {
+        cmdLine.follow = 1;
+    } else if (strcmp(argv[i], "--follow_idle") == 0 && ++i < argc) {
+        cmdLine.followIdle = atoi(argv[i]);
+    } else if (strcmp(argv[i], "--watch") == 0) {
+        cmdLine.watch = 1;
     } else if (strcmp(argv[i], "--check_buffer_out") == 0){
         cmdLine.checkPacketBufferOut = 1;
+    } else if (strcmp(argv[i], "--counters") == 0) {
+        cmdLine.counters = 1;
+    } else if (strcmp(argv[i], "--perf_report") == 0) {
+        cmdLine.perfReport = 1;
+    } else if (strcmp(argv[i], "--chrome_trace") == 0 && ++i < argc) {
+        cmdLine.chromeTrace = argv[i];
     } else if (strcmp(argv[i], "--print_pcr") == 0) {
         cmdLine.printPcr = 1;
+    } else if (strcmp(argv[i], "--print_si") == 0) {
+        cmdLine.printSi = 1;
+    } else if (strcmp(argv[i], "--pcr_analysis") == 0) {
+        cmdLine.pcrAnalysis = 1;
+    } else if (strcmp(argv[i], "--pcr_wallclock") == 0) {
+        cmdLine.pcrAnalysis = 1;
+        cmdLine.pcrWallClock = 1;
+    } else if (strcmp(argv[i], "--bitrate") == 0) {
+        cmdLine.bitrate = 1;
+    } else if (strcmp(argv[i], "--bitrate_csv") == 0) {
+        cmdLine.bitrate = 1;
+        cmdLine.bitrateCsv = 1;
+    } else if (strcmp(argv[i], "--bitrate_bucket") == 0 && ++i < argc) {
+        cmdLine.bitrateBucketMs = atoi(argv[i]);
+    } else if (strcmp(argv[i], "--trace") == 0 && ++i < argc) {
+        cmdLine.traceDir = argv[i];
+        cmdLine.traceDir = regulateFilePath(cmdLine.traceDir);
+    } else if (strcmp(argv[i], "--json") == 0 && ++i < argc) {
+        eventFile = argv[i];
+        eventFormat = GYJ::EVENT_FORMAT_JSON;
+    } else if (strcmp(argv[i], "--csv") == 0 && ++i < argc) {
+        eventFile = argv[i];
+        eventFormat = GYJ::EVENT_FORMAT_CSV;
+    } else if (strcmp(argv[i], "--from_trace") == 0) {
+        cmdLine.fromTrace = 1;
+    } else if (strcmp(argv[i], "--gop") == 0) {
+        cmdLine.gop = 1;
+    } else if (strcmp(argv[i], "--duration") == 0) {
+        cmdLine.duration = 1;
+    } else if (strcmp(argv[i], "--duration_only") == 0) {
+        cmdLine.duration = 1;
+        cmdLine.durationOnly = 1;
+    } else if (strcmp(argv[i], "--align") == 0 && ++i < argc) {
+        renditions.push_back(argv[i]);
+    } else if (strcmp(argv[i], "--hls") == 0 && ++i < argc) {
+        playlist = argv[i];
     } else {
       localFiles.push_back(argv[i]);
     }
@@ -111,75 +868,174 @@ int main(int argc, char* argv[])
 
   //cmdLine.filePath = "D:/data/8.6/test/";
 
-  if (localFiles.empty() && cmdLine.filePath.empty()) {
+  if (localFiles.empty() && cmdLine.filePath.empty() && renditions.empty() && playlist.empty()) {
       printf("should specify ts files \n");
       return 0;
   }
 
-  TSDemux::DBGLevel(DEMUX_DBG_INFO);
-  CommandLine::getInstance()->setCommandLineParam(cmdLine);
+  if (cmdLine.follow && (localFiles.size() != 1 || localFiles[0] == "-")) {
+      printf("--follow needs one file \n");
+      return 1;
+  }
+
+  if (cmdLine.watch && cmdLine.filePath.empty()) {
+      printf("--watch needs --ts_folder_path \n");
+      return 1;
+  }
+
+  // after the demuxes, whichever way the run ends
+  if (cmdLine.counters) {
+      atexit(printPerfStats);
+  }
+  if (cmdLine.perfReport) {
+      atexit(printHwTotal);
+  }
+  if (!cmdLine.chromeTrace.empty()) {
+      g_chromeTrace = cmdLine.chromeTrace;
+      TSDemux::ChromeTrace::enable();
+      TSDemux::ChromeTrace::setThreadName("main");
+      atexit(writeChromeTrace);
+  }
+
+  // EXTINF is checked against the counted media duration
+  if (!playlist.empty()) {
+      cmdLine.duration = 1;
+  }
 
-  if (!cmdLine.filePath.empty()) {
-      std::string destLocaltion = cmdLine.filePath + "*.*";
-      listFiles(destLocaltion.c_str(), localFiles);
+  // the report logger, also the one of DBG() for the SI tables
+  TSDemux::Logger &logger = TSDemux::Logger::Default();
+  logger.SetLevel(DEMUX_DBG_INFO);
+
+  // a watched folder is never listed, only its new segments are analyzed
+  if (!cmdLine.filePath.empty() && !cmdLine.watch) {
+      if (!listFiles(cmdLine.filePath, localFiles, cmdLine.recursive != 0)) {
+          printf("cannot read directory: '%s'\n", cmdLine.filePath.c_str());
+          return 1;
+      }
   }
 
-  if (localFiles.empty()) {
+  if (localFiles.empty() && renditions.empty() && playlist.empty() && !cmdLine.watch) {
       printf("cannot find any ts files!");
       return 0;
   }
 
-  GYJ::ParseredDataContainer dataContainer(GYJ::printParam(cmdLine.printMediaType, cmdLine.printPtsType));
-  std::string logFile = "TsParserInfo.log";
+  GYJ::ParseredDataContainer dataContainer(cmdLine.getPrintParam(), &logger);
+  std::string logFileName = "TsParserInfo.log";
 
 
-  g_logFile = fopen(logFile.c_str(), "w");
-  if (g_logFile != NULL) {
-      TSDemux::SetDBGMsgCallback(LogOut);
+  FILE *logFile = fopen(logFileName.c_str(), "w");
+  if (logFile != NULL) {
+      logger.SetSink(LogOut, logFile);
   }
 
-  if (!localFiles.empty()){
-      int index = 0;
-    for (std::vector<std::string>::iterator it = localFiles.begin(); it != localFiles.end(); it++) {
-        std::string curFile = cmdLine.filePath + *it;
+  if (!renditions.empty()) {
+      GYJ::RenditionAligner aligner(selection, &logger);
+      int errors = 0;
+      for (std::vector<std::string>::iterator it = renditions.begin(); it != renditions.end(); it++) {
+          if (!aligner.addRendition(*it)) {
+              errors++;
+          }
+      }
+      aligner.run();
+      errors += aligner.report();
+      if (logFile != NULL) {
+          fclose(logFile);
+      }
+      return errors ? 1 : 0;
+  }
 
-        FILE* file = NULL;
-        if (strcmp(curFile.c_str(), "-") == 0){
-            file = stdin;
-            filename = "[stdin]";
-        } else {
-            file = fopen(curFile.c_str(), "rb");
-        }
+  // formatted and written on its own thread
+  GYJ::EventWriter events;
+  if (!eventFile.empty() && events.open(eventFile, eventFormat)) {
+      dataContainer.setEventWriter(&events);
+  }
 
-        if (file){
-            TsLayer* demux = new TsLayer(file, channel, 0);
-            if (demux != NULL) {
-                demux->doDemux();
-                std::list<TSDemux::STREAM_PKT*> *lst = demux->getParseredData();
-                GYJ::tsParam *param = new GYJ::tsParam(*it, demux->getTsStartTimeStamp(), lst);
-                if (param != NULL) {
-                    dataContainer.addData(param->tsStartTime, param);
-                }
+  GYJ::ResultCache *cache = NULL;
+  if (!cmdLine.cacheFile.empty()) {
+      if (isCacheable(cmdLine) && playlist.empty() && renditions.empty()) {
+          cache = new GYJ::ResultCache(cacheConfig(selection));
+          if (!cache->load(cmdLine.cacheFile)) {
+              printf("corrupt cache '%s', rebuilt \n", cmdLine.cacheFile.c_str());
+          }
+      } else {
+          printf("--cache ignored: only the timestamp checks of files and folders are cached \n");
+      }
+  }
+
+  SiTableLogger siLogger;
+  if (cmdLine.follow) {
+      delete cache;
+      int errors = followFile(cmdLine.filePath + localFiles[0], selection, cmdLine, &siLogger, dataContainer, &logger, logFile);
+      events.close();
+      if (logFile != NULL) {
+          fclose(logFile);
+      }
+      return errors ? 1 : 0;
+  }
+
+  if (cmdLine.watch) {
+      int errors = watchFolder(selection, cmdLine, &siLogger, dataContainer, &logger, logFile, cache);
+      delete cache;
+      events.close();
+      if (logFile != NULL) {
+          fclose(logFile);
+      }
+      return errors ? 1 : 0;
+  }
 
-                delete demux;
+  if (!playlist.empty()) {
+      int errors = processPlaylist(playlist, selection, cmdLine, &siLogger, eventFile.empty() ? NULL : &events, &logger, false);
+      events.close();
+      if (logFile != NULL) {
+          fclose(logFile);
+      }
+      return errors ? 1 : 0;
+  }
+
+  if (!localFiles.empty()){
+    std::vector<std::string> paths;
+    for (std::vector<std::string>::iterator it = localFiles.begin(); it != localFiles.end(); it++) {
+        paths.push_back(cmdLine.filePath + *it);
+    }
+
+    if (cmdLine.fromTrace) {
+        // traces load on the prefetch workers, the container orders them by start time
+        TraceDemuxer demuxer(paths, cmdLine, &logger);
+        GYJ::SegmentPrefetcher prefetcher(demuxer, paths.size());
+        for (size_t n = 0; n < paths.size(); n++) {
+            GYJ::tsParam *param = prefetcher.take(n);
+            if (param != NULL) {
+                dataContainer.addSegment(param);
             }
-            
-            fclose(file);
         }
-        else{
-            printf("cannot open file: '%s'\n", curFile.c_str());
+    } else {
+        FileDemuxer demuxer(paths, localFiles, selection, cmdLine, &siLogger, &logger, cache);
+        for (size_t n = 0; n < paths.size(); n++) {
+            GYJ::tsParam *param = demuxer.demux(n);
+            if (param != NULL) {
+                dataContainer.addSegment(param);
+            }
         }
     }
 
     dataContainer.printInfo();
+
+    if (cache != NULL) {
+        printf("[CACHE] %u unchanged, %u demuxed \n", (unsigned)cache->getHits(), (unsigned)cache->getMisses());
+        if (!cache->save(cmdLine.cacheFile)) {
+            printf("cannot write cache: '%s'\n", cmdLine.cacheFile.c_str());
+        }
+        delete cache;
+    }
   }
   else {
     printf("no file specified \n");
     usage(argv[0]);
   }
 
-  if (g_logFile != NULL) {
-      fclose(g_logFile);
+  events.close();
+  if (logFile != NULL) {
+      fclose(logFile);
   }
   return 0;
 }
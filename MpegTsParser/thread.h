@@ -0,0 +1,173 @@
+/*
+ *      Copyright (C) 2005-2013 Team XBMC
+ *      http://www.xbmc.org
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TS_THREAD_H
+#define TS_THREAD_H
+
+#include <inttypes.h>
+#include "mutex.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace TSDemux
+{
+namespace PLATFORM
+{
+  /*
+   * Index shared by a single producer and a single consumer thread: the
+   * store publishes the writes made before it to the acquiring load.
+   */
+  inline uint32_t AtomicLoadAcquire(const volatile uint32_t *p)
+  {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    // x86 loads are not reordered with later accesses, the compiler must not either
+    uint32_t v = *p;
+    _ReadWriteBarrier();
+    return v;
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+    return __ldar32((volatile unsigned __int32 *)p);
+#elif defined(_MSC_VER)
+#error "AtomicLoadAcquire: unsupported MSVC target"
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+  }
+
+  inline void AtomicStoreRelease(volatile uint32_t *p, uint32_t v)
+  {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    // x86 stores are not reordered with earlier accesses, the compiler must not either
+    _ReadWriteBarrier();
+    *p = v;
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+    __stlr32((volatile unsigned __int32 *)p, v);
+#elif defined(_MSC_VER)
+#error "AtomicStoreRelease: unsupported MSVC target"
+#else
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#endif
+  }
+
+  inline void ThreadSleep(uint32_t ms)
+  {
+#if defined(_MSC_VER)
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+  }
+
+  /*
+   * Condition variable on a CMutex locked once by the caller.
+   */
+  class CCondition : public PreventCopy
+  {
+  public:
+#if defined(_MSC_VER)
+    CCondition(void) { InitializeConditionVariable(&m_cond); }
+    ~CCondition(void) {}
+
+    void Wait(CMutex &mutex) { SleepConditionVariableCS(&m_cond, &mutex.m_mutex, INFINITE); }
+    void Broadcast(void) { WakeAllConditionVariable(&m_cond); }
+
+  private:
+    CONDITION_VARIABLE m_cond;
+#else
+    CCondition(void) { pthread_cond_init(&m_cond, NULL); }
+    ~CCondition(void) { pthread_cond_destroy(&m_cond); }
+
+    void Wait(CMutex &mutex) { pthread_cond_wait(&m_cond, &mutex.m_mutex); }
+    void Broadcast(void) { pthread_cond_broadcast(&m_cond); }
+
+  private:
+    pthread_cond_t m_cond;
+#endif
+  };
+
+  /*
+   * Joinable worker thread: Process() runs on the new thread once Start()
+   * succeeds, Join() waits for it. The destructor joins a running thread.
+   */
+  class CThread : public PreventCopy
+  {
+  public:
+    CThread(void) : m_started(false) {}
+    virtual ~CThread(void) { Join(); }
+
+    bool Start(void)
+    {
+      if (m_started)
+        return false;
+#if defined(_MSC_VER)
+      m_thread = (HANDLE)_beginthreadex(NULL, 0, ThreadHandler, this, 0, NULL);
+      m_started = m_thread != 0;
+#else
+      m_started = pthread_create(&m_thread, NULL, ThreadHandler, this) == 0;
+#endif
+      return m_started;
+    }
+
+    void Join(void)
+    {
+      if (!m_started)
+        return;
+#if defined(_MSC_VER)
+      WaitForSingleObject(m_thread, INFINITE);
+      CloseHandle(m_thread);
+#else
+      pthread_join(m_thread, NULL);
+#endif
+      m_started = false;
+    }
+
+    bool IsStarted(void) const { return m_started; }
+
+  protected:
+    virtual void Process(void) = 0;
+
+  private:
+#if defined(_MSC_VER)
+    static unsigned __stdcall ThreadHandler(void *param)
+    {
+      static_cast<CThread*>(param)->Process();
+      return 0;
+    }
+
+    HANDLE m_thread;
+#else
+    static void *ThreadHandler(void *param)
+    {
+      static_cast<CThread*>(param)->Process();
+      return NULL;
+    }
+
+    pthread_t m_thread;
+#endif
+    bool m_started;
+  };
+}
+}
+
+#endif /* TS_THREAD_H */
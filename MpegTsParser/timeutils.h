@@ -0,0 +1,36 @@
+#ifndef TS_TIMEUTILS_H
+#define TS_TIMEUTILS_H
+
+#include <inttypes.h>
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace TSDemux
+{
+namespace PLATFORM
+{
+  // Monotonic wall clock in microseconds, for arrival time of live input
+  inline int64_t GetTimeUs(void)
+  {
+#if defined(_MSC_VER)
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0)
+      QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (int64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+      (int64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+  }
+}
+}
+
+#endif /* TS_TIMEUTILS_H */
@@ -45,6 +45,8 @@ namespace TSDemux
     , wait_unit_start(true)
     , has_stream_data(false)
     , streaming(false)
+    , selected(true)
+    , stream_type(STREAM_TYPE_UNKNOWN)
     , stream(NULL)
     , packet_table()
     {
@@ -73,6 +75,8 @@ namespace TSDemux
     bool wait_unit_start;
     bool has_stream_data;
     bool streaming;
+    bool selected;                ///< program of the PID is in the selection set
+    STREAM_TYPE stream_type;      ///< type declared by the PMT, the parser may refine its own
     ElementaryStream* stream;
     TSTable packet_table;
   };
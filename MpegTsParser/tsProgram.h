@@ -0,0 +1,83 @@
+#ifndef TSPROGRAM_H
+#define TSPROGRAM_H
+
+#include "elementaryStream.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+namespace TSDemux
+{
+  struct PROGRAM_STREAM
+  {
+    uint16_t pid;
+    STREAM_TYPE stream_type;
+  };
+
+  /*
+   * One entry of the program table built from the PAT, completed by the PMT
+   * (PCR PID and elementary streams) and the SDT (service names).
+   */
+  class Program
+  {
+  public:
+    Program(void)
+    : program_number(0)
+    , pmt_pid(0xffff)
+    , pcr_pid(0xffff)
+    , selected(false)
+    {
+    }
+
+    uint16_t GetVideoPid(void) const
+    {
+      for (std::vector<PROGRAM_STREAM>::const_iterator it = streams.begin(); it != streams.end(); ++it)
+        if (ElementaryStream::IsVideoType(it->stream_type))
+          return it->pid;
+      return 0xffff;
+    }
+
+    uint16_t GetAudioPid(void) const
+    {
+      for (std::vector<PROGRAM_STREAM>::const_iterator it = streams.begin(); it != streams.end(); ++it)
+        if (ElementaryStream::IsAudioType(it->stream_type))
+          return it->pid;
+      return 0xffff;
+    }
+
+    uint16_t program_number;
+    uint16_t pmt_pid;
+    uint16_t pcr_pid;
+    bool selected;
+    std::string service_name;
+    std::string provider_name;
+    std::vector<PROGRAM_STREAM> streams;
+  };
+
+  /*
+   * Programs to demux, by program number or by service name.
+   * An empty selection means all programs.
+   */
+  struct ProgramSelection
+  {
+    std::set<uint16_t> numbers;
+    std::set<std::string> names;
+
+    bool IsEmpty(void) const
+    {
+      return numbers.empty() && names.empty();
+    }
+
+    bool Matches(const Program& program) const
+    {
+      if (IsEmpty())
+        return true;
+      if (numbers.find(program.program_number) != numbers.end())
+        return true;
+      return !program.service_name.empty() && names.find(program.service_name) != names.end();
+    }
+  };
+}
+
+#endif /* TSPROGRAM_H */
@@ -0,0 +1,136 @@
+#ifndef TSTIMELINE_H
+#define TSTIMELINE_H
+
+#include "elementaryStream.h"
+
+#define PTS_WRAP                0x200000000LL
+#define PTS_HALF_WRAP           0x100000000LL
+#define PCR_MAX_GAP             90000LL
+
+namespace TSDemux
+{
+  /*
+   * Extends the 33-bit 90kHz clock of one program to a monotonic 64-bit
+   * timeline. The PCR is the anchor: PTS/DTS are taken as a signed 33-bit
+   * offset from the last PCR, so a wrap of the PCR carries over to the
+   * timestamps of the program. Until the first PCR the timestamps anchor
+   * the timeline themselves.
+   * A PCR flagged by discontinuity_indicator starts a new time base, it is
+   * joined to the last extended PCR so the timeline stays monotonic.
+   */
+  class Timeline
+  {
+  public:
+    Timeline(void)
+    {
+      Reset();
+    }
+
+    void Reset(void)
+    {
+      has_anchor = false;
+      has_pcr = false;
+      anchor_raw = 0;
+      anchor = 0;
+    }
+
+    // returns the extended PCR (27MHz)
+    uint64_t UnwrapPcr(const TS_PCR& pcr, bool discontinuity)
+    {
+      uint64_t base = pcr.pcr_base & PTS_MASK;
+      if (!has_anchor)
+        anchor = base;
+      else
+      {
+        int64_t value = extend(base);
+        // new time base: joined to the last PCR unless it carries on
+        if (discontinuity && has_pcr && (value < anchor || value - anchor > PCR_MAX_GAP))
+          value = anchor;
+        anchor = value;
+      }
+      anchor_raw = base;
+      has_anchor = true;
+      has_pcr = true;
+      return (uint64_t)anchor * 300 + pcr.pcr_ext;
+    }
+
+    // returns the extended PTS/DTS (90kHz), PTS_UNSET is kept
+    uint64_t Unwrap(uint64_t ts)
+    {
+      if (ts == PTS_UNSET)
+        return ts;
+      ts &= PTS_MASK;
+      if (!has_anchor)
+      {
+        anchor = ts;
+        anchor_raw = ts;
+        has_anchor = true;
+        return ts;
+      }
+      int64_t value = extend(ts);
+      if (!has_pcr)
+      {
+        anchor = value;
+        anchor_raw = ts;
+      }
+      return (uint64_t)value;
+    }
+
+  private:
+    int64_t extend(uint64_t ts) const
+    {
+      int64_t delta = (int64_t)((ts - anchor_raw) & PTS_MASK);
+      if (delta >= PTS_HALF_WRAP)
+        delta -= PTS_WRAP;
+      return anchor + delta;
+    }
+
+    bool has_anchor;
+    bool has_pcr;
+    uint64_t anchor_raw;    ///< last anchor as read from the stream (33 bits)
+    int64_t anchor;         ///< same anchor on the extended timeline
+  };
+
+  /*
+   * Arrival time of the bytes of the mux, from the PCR of one program: the
+   * last PCR and the rate between the last two PCRs extrapolate the time of
+   * any later byte position, so a single pass needs no lookahead.
+   */
+  class MuxClock
+  {
+  public:
+    MuxClock(void)
+    : pcr_count(0)
+    , last_pcr(0)
+    , last_pos(0)
+    , ticks_per_byte(0.0)
+    {
+    }
+
+    // pcr on 27MHz (extended timeline)
+    void AddPcr(uint64_t pcr, uint64_t pos, bool discontinuity)
+    {
+      if (pcr_count > 0 && !discontinuity && pcr > last_pcr && pos > last_pos)
+        ticks_per_byte = (double)(pcr - last_pcr) / (double)(pos - last_pos);
+      last_pcr = pcr;
+      last_pos = pos;
+      pcr_count++;
+    }
+
+    bool IsValid(void) const { return ticks_per_byte > 0.0; }
+
+    // arrival of the byte at pos (27MHz), valid clock only
+    int64_t GetTime(uint64_t pos) const
+    {
+      return (int64_t)last_pcr + (int64_t)(((double)pos - (double)last_pos) * ticks_per_byte);
+    }
+
+  private:
+    uint64_t pcr_count;
+    uint64_t last_pcr;
+    uint64_t last_pos;
+    double ticks_per_byte;
+  };
+}
+
+#endif /* TSTIMELINE_H */
@@ -0,0 +1,493 @@
+/*
+ * ts_bench: throughput of each stage of the demux pipeline, on TS files
+ * loaded in memory so that no stage waits for I/O.
+ *
+ * Each stage runs warmup times untimed, then reps times timed; the table
+ * gives the median run and the best one. Stages that cannot run alone go
+ * through the stages before them, the "scope" column tells which:
+ *
+ *   sync       packet alignment (tsSync/goNext)
+ *   packet     + TS header, adaptation field, PCR, continuity (ProcessTSPacket)
+ *   psi        + PAT/PMT/SI sections, on the PSI packets only
+ *   pes        + PES headers of all the streams, no ES parsing
+ *   append     ElementaryStream::Append of the PES payloads, pass-through parse
+ *   es <codec> Append/GetStreamPacket of the PES payloads into the codec parser
+ *   analysis   ParseredDataContainer checks of the demuxed PES timestamps
+ *   demux      TsLayer::doDemux, the whole demux as the tool runs it
+ *
+ * frames/s counts the frames out of the parsers for the ES stages, the PES
+ * for analysis and demux.
+ */
+
+#define __STDC_FORMAT_MACROS 1
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#if defined(_MSC_VER)
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "TsLayer.h"
+#include "BenchInput.h"
+#include "ParserdDataContainer.h"
+#include "timeutils.h"
+
+// TS layer fed straight from the loaded input, no copy
+class MemoryDemuxer : public TSDemux::TSDemuxer {
+public:
+    MemoryDemuxer(const unsigned char *data, size_t size) : mData(data), mSize(size) {}
+    virtual ~MemoryDemuxer() {}
+    virtual const unsigned char* ReadAV(uint64_t pos, size_t len) {
+        return pos + len <= mSize ? mData + pos : NULL;
+    }
+private:
+    const unsigned char *mData;
+    size_t mSize;
+};
+
+// one line of the table
+typedef struct StageResult {
+    StageResult() : bytes(0), packets(0), frames(0) {}
+    std::string name;
+    std::string scope;
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t frames;
+    std::vector<int64_t> times;         // us, by rep
+} StageResult;
+
+using namespace GYJ;
+
+static TSDemux::Logger g_quiet;
+
+static void usage(const char *cmd) {
+    printf("Usage: %s [options] <file>...\n\n"
+        "  --warmup <n>     untimed runs of each stage (%d)\n"
+        "  --reps <n>       timed runs of each stage (%d)\n"
+        "  --repeat <n>     input made of <n> copies of the files, for larger runs (1)\n"
+        "  --stage <name>   only the stages named so, repeatable: sync packet psi pes append es analysis demux\n"
+        "  --csv            one CSV line by stage instead of the table\n",
+        cmd, BENCH_WARMUP, BENCH_REPS);
+}
+
+/*
+ * One stage: setup and teardown stay out of the timing, run is timed.
+ */
+class BenchStage {
+public:
+    BenchStage(const std::string &name, const std::string &scope) { mResult.name = name; mResult.scope = scope; }
+    virtual ~BenchStage() {}
+    virtual void setup() {}
+    virtual void run() = 0;
+    virtual void teardown() {}
+    // why the stage cannot run on this input, empty if it can
+    virtual std::string skipReason() const { return ""; }
+    StageResult &result() { return mResult; }
+protected:
+    StageResult mResult;
+};
+
+class SyncStage : public BenchStage {
+public:
+    explicit SyncStage(const BenchInput &input) : BenchStage("sync", "sync"), mInput(input) {
+        mResult.bytes = input.data.size();
+        mResult.packets = input.packets;
+    }
+    virtual void run() {
+        MemoryDemuxer demuxer(&mInput.data[0], mInput.data.size());
+        TSDemux::TsLayerContext context(&demuxer, 0, TSDemux::ProgramSelection(), 0, &g_quiet);
+        while (context.tsSync() == TSDemux::AVCONTEXT_CONTINUE) {
+            context.goNext();
+        }
+    }
+private:
+    const BenchInput &mInput;
+};
+
+// the TS headers once the PSI is known, as in the steady state of a demux
+class PacketStage : public BenchStage {
+public:
+    explicit PacketStage(const BenchInput &input) : BenchStage("packet", "sync+header"), mInput(input), mDemuxer(NULL), mContext(NULL) {
+        mResult.bytes = input.data.size();
+        mResult.packets = input.packets;
+    }
+    virtual void setup() {
+        mDemuxer = new MemoryDemuxer(&mInput.data[0], mInput.data.size());
+        mContext = new TSDemux::TsLayerContext(mDemuxer, 0, TSDemux::ProgramSelection(), 0, &g_quiet);
+        mContext->SetKeepMediaPkts(false);
+        while (mContext->tsSync() == TSDemux::AVCONTEXT_CONTINUE) {
+            mContext->ProcessTSPacket();
+            if (mContext->HasPIDPayload()) {
+                mContext->ProcessTSPayload();
+            }
+            mContext->goNext();
+        }
+        mContext->GoPosition(0);
+    }
+    virtual void run() {
+        while (mContext->tsSync() == TSDemux::AVCONTEXT_CONTINUE) {
+            if (mContext->ProcessTSPacket() == TSDemux::AVCONTEXT_TS_ERROR) {
+                mContext->Shift();
+            } else {
+                mContext->goNext();
+            }
+        }
+    }
+    virtual void teardown() {
+        delete mContext;
+        delete mDemuxer;
+        mContext = NULL;
+        mDemuxer = NULL;
+    }
+private:
+    const BenchInput &mInput;
+    MemoryDemuxer *mDemuxer;
+    TSDemux::TsLayerContext *mContext;
+};
+
+// sync, TS headers and payloads of data, nothing streamed to the ES parsers
+static void runPayloads(const std::vector<unsigned char> &data) {
+    MemoryDemuxer demuxer(&data[0], data.size());
+    TSDemux::TsLayerContext context(&demuxer, 0, TSDemux::ProgramSelection(), 0, &g_quiet);
+    context.SetKeepMediaPkts(false);
+    while (context.tsSync() == TSDemux::AVCONTEXT_CONTINUE) {
+        int ret = context.ProcessTSPacket();
+        context.TakeProgramChange();
+        if (context.HasPIDPayload()) {
+            ret = context.ProcessTSPayload();
+        }
+        if (ret == TSDemux::AVCONTEXT_TS_ERROR) {
+            context.Shift();
+        } else {
+            context.goNext();
+        }
+    }
+}
+
+class PsiStage : public BenchStage {
+public:
+    explicit PsiStage(const BenchInput &input) : BenchStage("psi", "sync+header+psi"), mInput(input) {
+        mResult.bytes = input.psi.size();
+        mResult.packets = input.psiPackets;
+    }
+    virtual void run() {
+        runPayloads(mInput.psi);
+    }
+    // the sync search of the demux needs more packets than that
+    virtual std::string skipReason() const {
+        if (mInput.psiPackets > TS_CHECK_MAX_SCORE) {
+            return "";
+        }
+        char reason[64];
+        snprintf(reason, sizeof(reason), "%" PRIu64 " PSI packets, sync needs %d", mInput.psiPackets, TS_CHECK_MAX_SCORE + 1);
+        return reason;
+    }
+private:
+    const BenchInput &mInput;
+};
+
+class PesStage : public BenchStage {
+public:
+    explicit PesStage(const BenchInput &input) : BenchStage("pes", "sync+header+psi+pes"), mInput(input) {
+        mResult.bytes = input.data.size();
+        mResult.packets = input.packets;
+    }
+    virtual void run() {
+        runPayloads(mInput.data);
+    }
+private:
+    const BenchInput &mInput;
+};
+
+// the streams of a codec, or all of them into the pass-through parser
+class EsStage : public BenchStage {
+public:
+    EsStage(const BenchInput &input, const std::string &codec, bool passThrough)
+        : BenchStage(passThrough ? "append" : "es " + codec, passThrough ? "append" : "append+parse"), mInput(input), mCodec(codec), mPassThrough(passThrough) {
+        for (std::vector<EsTrack>::const_iterator it = input.tracks.begin(); it != input.tracks.end(); ++it) {
+            if (selects(*it)) {
+                mResult.bytes += it->bytes;
+                mResult.packets += it->packets;
+            }
+        }
+    }
+    virtual void setup() {
+        for (std::vector<EsTrack>::const_iterator it = mInput.tracks.begin(); it != mInput.tracks.end(); ++it) {
+            if (selects(*it)) {
+                mStreams.push_back(createParser(it->pid, mPassThrough ? TSDemux::STREAM_TYPE_UNKNOWN : it->type, &g_quiet));
+                mTracks.push_back(&*it);
+            }
+        }
+    }
+    virtual void run() {
+        mResult.frames = 0;
+        for (size_t i = 0; i < mStreams.size(); i++) {
+            uint64_t appends = 0;
+            mResult.frames += feedPayloads(mStreams[i], *mTracks[i], false, NULL, NULL, appends);
+        }
+    }
+    virtual void teardown() {
+        for (size_t i = 0; i < mStreams.size(); i++) {
+            delete mStreams[i];
+        }
+        mStreams.clear();
+        mTracks.clear();
+    }
+private:
+    bool selects(const EsTrack &track) const {
+        return mPassThrough || TSDemux::ElementaryStream::GetStreamCodecName(track.type) == mCodec;
+    }
+    const BenchInput &mInput;
+    std::string mCodec;
+    bool mPassThrough;
+    std::vector<TSDemux::ElementaryStream*> mStreams;
+    std::vector<const EsTrack*> mTracks;
+};
+
+static void discardLog(void *, int, const char *) {
+}
+
+// the report goes to stdout, muted while the checks run
+class StdoutMute {
+public:
+    StdoutMute() : mSaved(-1) {}
+    void mute() {
+        fflush(stdout);
+#if defined(_MSC_VER)
+        int null = _open("NUL", _O_WRONLY);
+        mSaved = _dup(1);
+        _dup2(null, 1);
+        _close(null);
+#else
+        int null = open("/dev/null", O_WRONLY);
+        mSaved = dup(1);
+        dup2(null, 1);
+        close(null);
+#endif
+    }
+    void restore() {
+        fflush(stdout);
+#if defined(_MSC_VER)
+        _dup2(mSaved, 1);
+        _close(mSaved);
+#else
+        dup2(mSaved, 1);
+        close(mSaved);
+#endif
+        mSaved = -1;
+    }
+private:
+    int mSaved;
+};
+
+// the timestamp checks of the tool on a copy of the demuxed PES, log formatted then dropped
+class AnalysisStage : public BenchStage {
+public:
+    explicit AnalysisStage(const BenchInput &input) : BenchStage("analysis", "analysis"), mInput(input), mLoaded(false), mStartTime(0), mContainer(NULL) {
+        mResult.bytes = input.data.size();
+        mResult.packets = input.packets;
+        mLogger.SetLevel(DEMUX_DBG_INFO);
+        mLogger.SetSink(discardLog, NULL);
+    }
+    virtual void setup() {
+        if (!mLoaded) {
+            load();
+        }
+        std::list<TSDemux::STREAM_PKT*> *lst = new std::list<TSDemux::STREAM_PKT*>;
+        for (std::vector<TSDemux::STREAM_PKT>::const_iterator it = mPackets.begin(); it != mPackets.end(); ++it) {
+            lst->push_back(new TSDemux::STREAM_PKT(*it));
+        }
+        mContainer = new GYJ::ParseredDataContainer(GYJ::printParam(GYJ::PRINT_MEDIA_ALL, GYJ::PRINT_PARTLY_PTS), &mLogger);
+        mContainer->addData(mStartTime, new GYJ::tsParam("bench", mStartTime, lst, mPrograms));
+        mResult.frames = mPackets.size();
+        mMute.mute();
+    }
+    virtual void run() {
+        mContainer->printInfo();
+    }
+    virtual void teardown() {
+        mMute.restore();
+        delete mContainer;
+        mContainer = NULL;
+    }
+private:
+    // the packets of a demux of the input, once, on the first run of the stage
+    void load() {
+        TsMemoryInput memory(&mInput.data[0], mInput.data.size());
+        TsLayer demux(&memory, TSDemux::ProgramSelection(), 0, &g_quiet);
+        demux.doDemux();
+        std::list<TSDemux::STREAM_PKT*> *lst = demux.getParseredData();
+        for (std::list<TSDemux::STREAM_PKT*>::iterator it = lst->begin(); it != lst->end(); ++it) {
+            mPackets.push_back(**it);
+            delete *it;
+        }
+        lst->clear();
+        delete lst;
+        mStartTime = demux.getTsStartTimeStamp();
+        mPrograms = demux.getPrograms();
+        mLoaded = true;
+    }
+
+    const BenchInput &mInput;
+    TSDemux::Logger mLogger;
+    bool mLoaded;
+    std::vector<TSDemux::STREAM_PKT> mPackets;
+    int64_t mStartTime;
+    std::vector<TSDemux::Program> mPrograms;
+    GYJ::ParseredDataContainer *mContainer;
+    StdoutMute mMute;
+};
+
+class DemuxStage : public BenchStage {
+public:
+    explicit DemuxStage(const BenchInput &input) : BenchStage("demux", "all but analysis"), mInput(input) {
+        mResult.bytes = input.data.size();
+        mResult.packets = input.packets;
+    }
+    virtual void run() {
+        TsMemoryInput memory(&mInput.data[0], mInput.data.size());
+        TsLayer demux(&memory, TSDemux::ProgramSelection(), 0, &g_quiet);
+        demux.doDemux();
+        std::list<TSDemux::STREAM_PKT*> *lst = demux.getParseredData();
+        mResult.frames = lst->size();
+        for (std::list<TSDemux::STREAM_PKT*>::iterator it = lst->begin(); it != lst->end(); ++it) {
+            delete *it;
+        }
+        delete lst;
+    }
+private:
+    const BenchInput &mInput;
+};
+
+static void runStage(BenchStage &stage, int warmup, int reps) {
+    StageResult &result = stage.result();
+    for (int i = 0; i < warmup + reps; i++) {
+        stage.setup();
+        int64_t start = TSDemux::PLATFORM::GetTimeUs();
+        stage.run();
+        int64_t elapsed = TSDemux::PLATFORM::GetTimeUs() - start;
+        stage.teardown();
+        if (i >= warmup) {
+            result.times.push_back(elapsed);
+        }
+    }
+}
+
+static void printResult(const StageResult &result, bool csv) {
+    BenchTimes times = benchTimes(result.times);
+    double median = times.median;
+    double best = times.best;
+    double mbps = result.bytes / median;                // bytes/us = MB/s
+    double kpps = result.packets * 1000.0 / median;
+    double nsMedian = result.packets ? median * 1000.0 / result.packets : 0;
+    double nsBest = result.packets ? best * 1000.0 / result.packets : 0;
+    double fps = result.frames * 1000000.0 / median;
+    if (csv) {
+        printf("%s,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.0f,%.0f,%.2f,%.0f,%.2f,%.2f,%.0f\n", result.name.c_str(), result.scope.c_str(),
+            result.bytes, result.packets, result.frames, median, best, mbps, kpps * 1000, nsMedian, nsBest, fps);
+    } else {
+        printf("%-12s %-20s %10.1f %10.0f %10.1f %10.1f %12.0f\n", result.name.c_str(), result.scope.c_str(), mbps, kpps, nsMedian, nsBest, fps);
+    }
+}
+
+static void printSkipped(const StageResult &result, const std::string &reason, bool csv) {
+    if (csv) {
+        printf("%s,%s,,,,,,,,,,\n", result.name.c_str(), result.scope.c_str());
+        fprintf(stderr, "%s skipped: %s\n", result.name.c_str(), reason.c_str());
+    } else {
+        printf("%-12s %-20s skipped: %s\n", result.name.c_str(), result.scope.c_str(), reason.c_str());
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int warmup = BENCH_WARMUP;
+    int reps = BENCH_REPS;
+    int repeat = 1;
+    bool csv = false;
+    std::set<std::string> stages;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--warmup") == 0 && ++i < argc) {
+            warmup = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--reps") == 0 && ++i < argc) {
+            reps = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--repeat") == 0 && ++i < argc) {
+            repeat = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--stage") == 0 && ++i < argc) {
+            stages.insert(argv[i]);
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty() || reps < 1 || warmup < 0 || repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    BenchInput input;
+    for (int r = 0; r < repeat; r++) {
+        for (std::vector<std::string>::iterator it = files.begin(); it != files.end(); ++it) {
+            if (!loadFile(*it, input.data)) {
+                printf("cannot open file: '%s'\n", it->c_str());
+                return 1;
+            }
+        }
+    }
+    if (!prepareInput(input, &g_quiet)) {
+        printf("no TS packets found \n");
+        return 1;
+    }
+
+    std::vector<BenchStage*> bench;
+    bench.push_back(new SyncStage(input));
+    bench.push_back(new PacketStage(input));
+    bench.push_back(new PsiStage(input));
+    bench.push_back(new PesStage(input));
+    bench.push_back(new EsStage(input, "", true));
+    std::set<std::string> codecs;
+    for (std::vector<EsTrack>::const_iterator it = input.tracks.begin(); it != input.tracks.end(); ++it) {
+        codecs.insert(TSDemux::ElementaryStream::GetStreamCodecName(it->type));
+    }
+    for (std::set<std::string>::const_iterator it = codecs.begin(); it != codecs.end(); ++it) {
+        bench.push_back(new EsStage(input, *it, false));
+    }
+    bench.push_back(new AnalysisStage(input));
+    bench.push_back(new DemuxStage(input));
+
+    if (csv) {
+        printf("stage,scope,bytes,packets,frames,median_us,best_us,mb_s,packets_s,ns_packet,ns_packet_best,frames_s\n");
+    } else {
+        printf("%.1f MB, %" PRIu64 " packets of %u bytes, %u streams, warmup %d, reps %d\n\n", input.data.size() / 1e6, input.packets,
+            (unsigned)input.packetSize, (unsigned)input.tracks.size(), warmup, reps);
+        printf("%-12s %-20s %10s %10s %10s %10s %12s\n", "stage", "scope", "MB/s", "kpkt/s", "ns/pkt", "ns/pkt min", "frames/s");
+    }
+    for (std::vector<BenchStage*>::iterator it = bench.begin(); it != bench.end(); ++it) {
+        const std::string &name = (*it)->result().name;
+        if (stages.empty() || stages.count(name) || (name.compare(0, 3, "es ") == 0 && stages.count("es"))) {
+            std::string reason = (*it)->skipReason();
+            if (!reason.empty()) {
+                printSkipped((*it)->result(), reason, csv);
+            } else {
+                runStage(**it, warmup, reps);
+                printResult((*it)->result(), csv);
+            }
+        }
+        delete *it;
+    }
+    return 0;
+}
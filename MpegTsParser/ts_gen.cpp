@@ -0,0 +1,120 @@
+/*
+ * ts_gen: synthetic transport streams for the benchmarks and the stress
+ * tests, the same bytes for the same options and seed.
+ */
+
+#define __STDC_FORMAT_MACROS 1
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <string>
+
+#include "TsGenerator.h"
+
+#define GEN_OUTPUT_BUFFER       (4 * 1048576)
+
+static void usage(const char *cmd) {
+    printf("Usage: %s -o <file> [options]\n\n"
+        "  --seed <n>            the same seed gives the same stream (1)\n"
+        "  --packet_size <n>     188, 192 (M2TS) or 204 (RS parity) (188)\n"
+        "  --programs <n>        programs, one H.264 video each (1)\n"
+        "  --audio <n>           AAC audio streams by program (1)\n"
+        "  --bitrate <kbps>      TS bitrate, null packets fill it (8000)\n"
+        "  --video_kbps <kbps>   video bitrate by program (70%% of the TS, shared)\n"
+        "  --audio_kbps <kbps>   audio bitrate by stream (128)\n"
+        "  --pcr_interval <ms>   and with each video PES start (30)\n"
+        "  --psi_interval <ms>   PAT/PMT repetition (100)\n"
+        "  --gop <frames>        IDR interval (25)\n"
+        "  --duration <s>        (60, no limit with --size alone)\n"
+        "  --size <MB>           stop at this size, before --duration if smaller\n"
+        "  --cc_errors <n>       a packet lost about every <n> packets\n"
+        "  --pts_wrap <s>        the PCR/PTS/DTS wrap <s> seconds into the stream\n"
+        "  --pmt_bump <s>        PMT version bumped every <s> seconds\n"
+        "  --garbage <n>         a run of garbage bytes about every <n> packets\n",
+        cmd);
+}
+
+int main(int argc, char* argv[]) {
+    GYJ::GeneratorParam param;
+    std::string output;
+    bool duration = false;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-o") == 0 && hasValue) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+            param.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--packet_size") == 0 && hasValue) {
+            param.packetSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--programs") == 0 && hasValue) {
+            param.programs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--audio") == 0 && hasValue) {
+            param.audioStreams = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bitrate") == 0 && hasValue) {
+            param.bitrate = atoll(argv[++i]) * 1000;
+        } else if (strcmp(argv[i], "--video_kbps") == 0 && hasValue) {
+            param.videoBitrate = atoll(argv[++i]) * 1000;
+        } else if (strcmp(argv[i], "--audio_kbps") == 0 && hasValue) {
+            param.audioBitrate = atoll(argv[++i]) * 1000;
+        } else if (strcmp(argv[i], "--pcr_interval") == 0 && hasValue) {
+            param.pcrIntervalMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--psi_interval") == 0 && hasValue) {
+            param.psiIntervalMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gop") == 0 && hasValue) {
+            param.gop = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--duration") == 0 && hasValue) {
+            param.durationMs = (int64_t)(atof(argv[++i]) * 1000);
+            duration = true;
+        } else if (strcmp(argv[i], "--size") == 0 && hasValue) {
+            param.maxBytes = strtoull(argv[++i], NULL, 10) * 1000000;
+        } else if (strcmp(argv[i], "--cc_errors") == 0 && hasValue) {
+            param.ccErrorInterval = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--pts_wrap") == 0 && hasValue) {
+            param.ptsWrapMs = (int64_t)(atof(argv[++i]) * 1000);
+        } else if (strcmp(argv[i], "--pmt_bump") == 0 && hasValue) {
+            param.pmtBumpMs = (int64_t)(atof(argv[++i]) * 1000);
+        } else if (strcmp(argv[i], "--garbage") == 0 && hasValue) {
+            param.garbageInterval = strtoull(argv[++i], NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // --size alone: the size is the only limit
+    if (param.maxBytes > 0 && !duration) {
+        param.durationMs = INT64_MAX / 27000;
+    }
+
+    if (output.empty() || (param.packetSize != 188 && param.packetSize != 192 && param.packetSize != 204)
+        || param.programs < 1 || param.programs > 256 || param.audioStreams < 0 || param.audioStreams > 15
+        || param.bitrate <= 0 || param.pcrIntervalMs <= 0 || param.psiIntervalMs <= 0 || param.gop < 1 || param.durationMs <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int64_t video = param.videoBitrate > 0 ? param.videoBitrate * param.programs : param.bitrate * 7 / 10;
+    int64_t load = video + param.audioBitrate * param.audioStreams * param.programs;
+    if (load > param.bitrate * 9 / 10) {
+        printf("warning: %lld kbps of media in a %lld kbps TS, the PES will be late \n", (long long)(load / 1000), (long long)(param.bitrate / 1000));
+    }
+
+    FILE *out = fopen(output.c_str(), "wb");
+    if (out == NULL) {
+        printf("cannot open file: '%s'\n", output.c_str());
+        return 1;
+    }
+    setvbuf(out, NULL, _IOFBF, GEN_OUTPUT_BUFFER);
+
+    GYJ::TsGenerator generator(param);
+    bool written = generator.generate(out);
+    written = fclose(out) == 0 && written;
+    if (!written) {
+        printf("cannot write file: '%s'\n", output.c_str());
+        return 1;
+    }
+    printf("%s: %" PRIu64 " packets, %" PRIu64 " bytes, %" PRIu64 " lost, %" PRIu64 " garbage runs \n", output.c_str(),
+        generator.getPackets(), generator.getBytes(), generator.getLostPackets(), generator.getGarbageRuns());
+    return 0;
+}
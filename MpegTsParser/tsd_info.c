@@ -0,0 +1,78 @@
+/*
+ * Streams and statistics of a transport stream through the C API, built as C
+ * so that tsdemux.h stays a C header.
+ *
+ *   tsd_info <file>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "tsdemux.h"
+
+int main(int argc, char *argv[])
+{
+  tsd_demux *demux;
+  tsd_perf_stats perf;
+  size_t i;
+
+  if (argc != 2) {
+    printf("Usage: %s <file>\n", argv[0]);
+    return 2;
+  }
+  if (tsd_version() != TSD_VERSION) {
+    printf("library version %d, header version %d\n", tsd_version(), TSD_VERSION);
+    return 1;
+  }
+
+  demux = tsd_open_file(argv[1]);
+  if (demux == NULL) {
+    printf("cannot open file: '%s'\n", argv[1]);
+    return 1;
+  }
+  tsd_enable(demux, TSD_ANALYSIS_BITRATE | TSD_ANALYSIS_DURATION | TSD_ANALYSIS_PCR);
+  if (tsd_run(demux) != TSD_OK) {
+    printf("demux failed: '%s'\n", argv[1]);
+    tsd_close(demux);
+    return 1;
+  }
+
+  for (i = 0; i < tsd_stream_count(demux); i++) {
+    tsd_stream stream;
+    tsd_stream_stats stats;
+    tsd_pcr_stats pcr;
+
+    memset(&stream, 0, sizeof(stream));
+    stream.struct_size = sizeof(stream);
+    if (tsd_get_stream(demux, i, &stream) != TSD_OK) {
+      continue;
+    }
+    printf("program:%u pid:0x%04x %s", stream.program, stream.pid, stream.codec);
+    if (stream.video) {
+      printf(" %dx%d", stream.width, stream.height);
+    } else if (stream.audio) {
+      printf(" %dHz %dch", stream.sample_rate, stream.channels);
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    stats.struct_size = sizeof(stats);
+    if (tsd_get_stream_stats(demux, stream.pid, &stats) == TSD_OK) {
+      printf(" packets:%" PRIu64 " frames:%" PRIu64 " duration:%.3fs", stats.packets, stats.frames, stats.duration);
+    }
+    printf("\n");
+
+    memset(&pcr, 0, sizeof(pcr));
+    pcr.struct_size = sizeof(pcr);
+    if (stream.pid == stream.pcr_pid && tsd_get_pcr_stats(demux, stream.pcr_pid, &pcr) == TSD_OK) {
+      printf("  pcr count:%" PRIu64 " interval max:%.3fms mux rate:%.0fbit/s\n", pcr.count, pcr.interval_max_ms, pcr.mux_rate);
+    }
+  }
+
+  memset(&perf, 0, sizeof(perf));
+  perf.struct_size = sizeof(perf);
+  if (tsd_get_perf_stats(demux, &perf) == TSD_OK) {
+    printf("packets:%" PRIu64 " cc errors:%" PRIu64 "\n", perf.packets, perf.cc_errors);
+  }
+
+  tsd_close(demux);
+  return 0;
+}
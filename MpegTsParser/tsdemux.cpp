@@ -0,0 +1,396 @@
+#include "tsdemux.h"
+#include "TsLayer.h"
+
+#include <cstring>
+
+using namespace TSDemux;
+
+// a struct_size that cannot even hold itself is an uninitialized structure
+template <typename T>
+static bool validSize(const T *out) {
+    return out != NULL && out->struct_size >= sizeof(out->struct_size);
+}
+
+// the caller's structure may be older and smaller than the library's
+template <typename T>
+static void copyOut(T *out, T &full) {
+    size_t size = out->struct_size < sizeof(T) ? out->struct_size : sizeof(T);
+    full.struct_size = out->struct_size;
+    memcpy(out, &full, size);
+}
+
+/*
+ * Handle of the C API: the input, the demux created by tsd_run() with the
+ * selection and analyses set up until then, and the statistics taken at the
+ * end of the run. The PES list is not kept, timestamps go to the event
+ * callback instead.
+ */
+struct tsd_demux : private TraceListener
+{
+    tsd_demux(FILE *file, TsInput *input)
+        : mFile(file), mInput(input), mLayer(NULL), mAnalyses(0), mEvent(NULL), mEventOpaque(NULL)
+        , mDone(false), mBitrate(NULL), mStartTime(-1) {}
+
+    ~tsd_demux() {
+        delete mLayer;
+        delete mBitrate;
+        delete mInput;
+        if (mFile != NULL) {
+            fclose(mFile);
+        }
+    }
+
+    int run();
+    void collectStreams();
+
+    virtual void onPes(const STREAM_PKT &pkt, uint64_t position);
+    virtual void onFrame(const STREAM_PKT &pkt, int sampleRate);
+
+    FILE *mFile;
+    TsInput *mInput;
+    TsLayer *mLayer;
+    ProgramSelection mSelection;
+    Logger mLogger;
+    unsigned mAnalyses;
+    tsd_event_fn mEvent;
+    void *mEventOpaque;
+
+    bool mDone;
+    std::vector<tsd_stream> mStreams;
+    BitrateMeter *mBitrate;
+    std::map<uint16_t, PCR_STATS> mPcrStats;
+    std::map<uint16_t, TSTD_STATS> mBufferStats;
+    std::map<uint16_t, GOP_STATS> mGopStats;
+    std::map<uint16_t, MEDIA_DURATION> mDurations;
+    PERF_STATS mPerf;
+    int64_t mStartTime;
+};
+
+// the C stage and stream type numbering follows the library's
+typedef char tsd_stage_check[TSD_STAGE_COUNT == PERF_STAGE_COUNT ? 1 : -1];
+typedef char tsd_stream_type_check[TSD_STREAM_TYPES >= PERF_STREAM_TYPES ? 1 : -1];
+
+int tsd_demux::run() {
+    mLayer = new TsLayer(mInput, mSelection, 0, &mLogger);
+    if (mAnalyses & (TSD_ANALYSIS_PCR | TSD_ANALYSIS_PCR_WALLCLOCK)) {
+        mLayer->enablePcrAnalysis((mAnalyses & TSD_ANALYSIS_PCR_WALLCLOCK) != 0);
+    }
+    if (mAnalyses & TSD_ANALYSIS_BITRATE) {
+        mLayer->enableBitrateAnalysis(BITRATE_BUCKET_MS);
+    }
+    if (mAnalyses & TSD_ANALYSIS_BUFFER) {
+        mLayer->enableBufferModel();
+    }
+    if (mAnalyses & TSD_ANALYSIS_GOP) {
+        mLayer->enableGopAnalysis();
+    }
+    if (mAnalyses & TSD_ANALYSIS_DURATION) {
+        mLayer->enableDurationCount();
+    }
+    if (mAnalyses & TSD_ANALYSIS_TIMERS) {
+        mLayer->enablePerfTimers();
+    }
+    mLayer->setKeepParseredData(false);
+    if (mEvent != NULL) {
+        mLayer->setListener(this);
+    }
+
+    mLayer->doDemux();
+    mLayer->setListener(NULL);
+    delete mLayer->getParseredData();
+
+    mPcrStats = mLayer->getPcrStats();
+    mBitrate = mLayer->takeBitrateMeter();
+    mBufferStats = mLayer->getBufferStats();
+    mGopStats = mLayer->getGopStats();
+    mDurations = mLayer->getDurations();
+    mPerf = mLayer->getPerfStats();
+    mStartTime = mLayer->getTsStartTimeStamp();
+    collectStreams();
+    mDone = true;
+    return TSD_OK;
+}
+
+void tsd_demux::collectStreams() {
+    std::vector<Program> programs = mLayer->getPrograms();
+    for (std::vector<Program>::const_iterator pg = programs.begin(); pg != programs.end(); ++pg) {
+        for (std::vector<PROGRAM_STREAM>::const_iterator it = pg->streams.begin(); it != pg->streams.end(); ++it) {
+            tsd_stream stream;
+            memset(&stream, 0, sizeof(stream));
+            stream.struct_size = sizeof(stream);
+            stream.program = pg->program_number;
+            stream.pid = it->pid;
+            stream.pcr_pid = pg->pcr_pid;
+            stream.selected = pg->selected;
+            stream.stream_type = it->stream_type;
+            stream.codec = ElementaryStream::GetStreamCodecName(it->stream_type);
+            stream.video = ElementaryStream::IsVideoType(it->stream_type);
+            stream.audio = ElementaryStream::IsAudioType(it->stream_type);
+
+            const ElementaryStream *es = mLayer->getStream(it->pid);
+            if (es != NULL) {
+                const STREAM_INFO &info = es->stream_info;
+                memcpy(stream.language, info.language, sizeof(stream.language));
+                stream.width = info.width;
+                stream.height = info.height;
+                stream.fps_scale = info.fps_scale;
+                stream.fps_rate = info.fps_rate;
+                stream.interlaced = info.interlaced;
+                stream.aspect = info.aspect;
+                stream.channels = info.channels;
+                stream.sample_rate = info.sample_rate;
+                stream.bit_rate = info.bit_rate;
+            }
+            mStreams.push_back(stream);
+        }
+    }
+}
+
+void tsd_demux::onPes(const STREAM_PKT &pkt, uint64_t position) {
+    tsd_event event;
+    memset(&event, 0, sizeof(event));
+    event.type = TSD_EVENT_PES;
+    event.pid = pkt.pid;
+    event.position = position;
+    event.pts = pkt.pts;
+    event.dts = pkt.dts;
+    event.pcr = pkt.pcr.present ? pkt.pcr.pcr : TSD_TIMESTAMP_UNSET;
+    mEvent(mEventOpaque, &event);
+}
+
+void tsd_demux::onFrame(const STREAM_PKT &pkt, int sampleRate) {
+    tsd_event event;
+    memset(&event, 0, sizeof(event));
+    event.type = TSD_EVENT_FRAME;
+    event.pid = pkt.pid;
+    event.pts = pkt.pts;
+    event.dts = pkt.dts;
+    event.duration = pkt.duration;
+    event.size = (uint32_t)pkt.size;
+    event.samples = pkt.samples;
+    event.sample_rate = sampleRate;
+    event.frame_type = pkt.frame_type;
+    event.random_access = pkt.random_access;
+    mEvent(mEventOpaque, &event);
+}
+
+int tsd_version(void) {
+    return TSD_VERSION;
+}
+
+tsd_demux *tsd_open_file(const char *path) {
+    if (path == NULL) {
+        return NULL;
+    }
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    return new tsd_demux(file, new TsFileInput(file));
+}
+
+tsd_demux *tsd_open_buffer(const void *data, size_t size) {
+    if (data == NULL && size > 0) {
+        return NULL;
+    }
+    return new tsd_demux(NULL, new TsMemoryInput((const unsigned char*)data, size));
+}
+
+tsd_demux *tsd_open_callbacks(tsd_read_fn read, tsd_seek_fn seek, void *opaque) {
+    if (read == NULL) {
+        return NULL;
+    }
+    return new tsd_demux(NULL, new TsCallbackInput(read, seek, opaque));
+}
+
+void tsd_close(tsd_demux *demux) {
+    delete demux;
+}
+
+void tsd_set_log(tsd_demux *demux, int level, tsd_log_fn log, void *opaque, const char *tag) {
+    if (demux == NULL) {
+        return;
+    }
+    demux->mLogger.SetLevel(level);
+    demux->mLogger.SetSink(log, opaque);
+    demux->mLogger.SetTag(tag != NULL ? tag : "");
+}
+
+int tsd_select_program(tsd_demux *demux, uint16_t program_number) {
+    if (demux == NULL || demux->mLayer != NULL) {
+        return TSD_ERROR;
+    }
+    demux->mSelection.numbers.insert(program_number);
+    return TSD_OK;
+}
+
+int tsd_select_service(tsd_demux *demux, const char *service_name) {
+    if (demux == NULL || service_name == NULL || demux->mLayer != NULL) {
+        return TSD_ERROR;
+    }
+    demux->mSelection.names.insert(service_name);
+    return TSD_OK;
+}
+
+int tsd_enable(tsd_demux *demux, unsigned analyses) {
+    if (demux == NULL || demux->mLayer != NULL) {
+        return TSD_ERROR;
+    }
+    demux->mAnalyses |= analyses;
+    return TSD_OK;
+}
+
+void tsd_set_event_callback(tsd_demux *demux, tsd_event_fn event, void *opaque) {
+    if (demux == NULL) {
+        return;
+    }
+    demux->mEvent = event;
+    demux->mEventOpaque = opaque;
+}
+
+int tsd_run(tsd_demux *demux) {
+    if (demux == NULL || demux->mLayer != NULL) {
+        return TSD_ERROR;
+    }
+    return demux->run();
+}
+
+size_t tsd_stream_count(tsd_demux *demux) {
+    return demux != NULL ? demux->mStreams.size() : 0;
+}
+
+int tsd_get_stream(tsd_demux *demux, size_t index, tsd_stream *stream) {
+    if (demux == NULL || !validSize(stream)) {
+        return TSD_ERROR;
+    }
+    if (index >= demux->mStreams.size()) {
+        return TSD_NOT_FOUND;
+    }
+    tsd_stream full = demux->mStreams[index];
+    copyOut(stream, full);
+    return TSD_OK;
+}
+
+int tsd_get_stream_stats(tsd_demux *demux, uint16_t pid, tsd_stream_stats *out) {
+    if (demux == NULL || !validSize(out) || !demux->mDone) {
+        return TSD_ERROR;
+    }
+    tsd_stream_stats full;
+    tsd_stream_stats *stats = &full;
+    memset(stats, 0, sizeof(*stats));
+    stats->pid = pid;
+    bool found = false;
+
+    if (demux->mBitrate != NULL && demux->mBitrate->getPackets(pid) > 0) {
+        stats->packets = demux->mBitrate->getPackets(pid);
+        stats->payload_bytes = demux->mBitrate->getPayloadBytes(pid);
+        stats->scrambled = demux->mBitrate->getScrambled(pid);
+        found = true;
+    }
+
+    std::map<uint16_t, MEDIA_DURATION>::const_iterator duration = demux->mDurations.find(pid);
+    if (duration != demux->mDurations.end()) {
+        stats->frames = duration->second.frames;
+        stats->samples = duration->second.samples;
+        stats->duration = duration->second.seconds();
+        stats->pts_span = duration->second.ptsSpan();
+        found = true;
+    }
+
+    std::map<uint16_t, GOP_STATS>::const_iterator gop = demux->mGopStats.find(pid);
+    if (gop != demux->mGopStats.end()) {
+        const GOP_STATS &st = gop->second;
+        if (stats->frames == 0) {
+            stats->frames = st.frames;
+        }
+        stats->gops = st.gops;
+        stats->random_access = st.randomAccess;
+        stats->closed_gops = st.closedGops;
+        stats->open_gops = st.openGops;
+        stats->gop_frames_avg = st.gops > 0 ? (double)st.gopFramesSum / st.gops : 0.0;
+        stats->gop_ms_avg = st.gopTimed > 0 ? st.gopMsSum / st.gopTimed : 0.0;
+        found = true;
+    }
+
+    std::map<uint16_t, TSTD_STATS>::const_iterator buffer = demux->mBufferStats.find(pid);
+    if (buffer != demux->mBufferStats.end()) {
+        const TSTD_STATS &st = buffer->second;
+        stats->buffer_overflows = st.tbOverflows + st.mbOverflows + st.ebOverflows;
+        stats->buffer_underflows = st.ebUnderflows;
+        found = true;
+    }
+    if (!found) {
+        return TSD_NOT_FOUND;
+    }
+    copyOut(out, full);
+    return TSD_OK;
+}
+
+int tsd_get_pcr_stats(tsd_demux *demux, uint16_t pcr_pid, tsd_pcr_stats *out) {
+    if (demux == NULL || !validSize(out) || !demux->mDone) {
+        return TSD_ERROR;
+    }
+    std::map<uint16_t, PCR_STATS>::const_iterator it = demux->mPcrStats.find(pcr_pid);
+    if (it == demux->mPcrStats.end()) {
+        return TSD_NOT_FOUND;
+    }
+
+    const PCR_STATS &st = it->second;
+    tsd_pcr_stats full;
+    tsd_pcr_stats *stats = &full;
+    memset(stats, 0, sizeof(*stats));
+    stats->pid = pcr_pid;
+    stats->count = st.count;
+    stats->discontinuities = st.discontinuities;
+    stats->discontinuity_errors = st.discontinuityErrors;
+    stats->repetition_errors = st.repetitionErrors;
+    stats->accuracy_errors = st.accuracyErrors;
+    if (st.intervalCount > 0) {
+        stats->interval_min_ms = st.intervalMinMs;
+        stats->interval_avg_ms = st.intervalSumMs / st.intervalCount;
+        stats->interval_max_ms = st.intervalMaxMs;
+    }
+    stats->mux_rate = st.muxRate;
+    if (st.accuracyCount > 0) {
+        stats->accuracy_min_ns = st.accuracyMinNs;
+        stats->accuracy_max_ns = st.accuracyMaxNs;
+    }
+    if (st.jitterCount > 0) {
+        stats->jitter_min_ns = st.jitterMinNs;
+        stats->jitter_max_ns = st.jitterMaxNs;
+    }
+    copyOut(out, full);
+    return TSD_OK;
+}
+
+int tsd_get_perf_stats(tsd_demux *demux, tsd_perf_stats *out) {
+    if (demux == NULL || !validSize(out) || !demux->mDone) {
+        return TSD_ERROR;
+    }
+
+    const PERF_STATS &st = demux->mPerf;
+    tsd_perf_stats full;
+    tsd_perf_stats *stats = &full;
+    memset(stats, 0, sizeof(*stats));
+    stats->packets = st.packets;
+    stats->resyncs = st.resyncs;
+    stats->resync_bytes = st.resyncBytes;
+    stats->cc_errors = st.ccErrors;
+    stats->pes_starts = st.pesStarts;
+    stats->es_append_bytes = st.esAppendBytes;
+    stats->es_moved_bytes = st.esMovedBytes;
+    stats->es_reallocs = st.esReallocs;
+    for (int i = 0; i < PERF_STREAM_TYPES; i++) {
+        stats->frames[i] = st.frames[i];
+    }
+    for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+        stats->stage_calls[i] = st.stageCalls[i];
+        stats->stage_ms[i] = st.stageMs(i);
+    }
+    copyOut(out, full);
+    return TSD_OK;
+}
+
+int64_t tsd_start_time(tsd_demux *demux) {
+    return demux != NULL ? demux->mStartTime : -1;
+}
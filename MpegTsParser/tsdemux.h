@@ -0,0 +1,240 @@
+/*
+ * C API of the demux library, for the applications embedding it in-process.
+ *
+ * A demux reads one transport stream from a file, a memory buffer or read
+ * callbacks. Program selection, analyses, logging and the event callback are
+ * set up after the open, tsd_run() then demuxes to the end of the input and
+ * delivers the events on the calling thread. Streams and statistics are read
+ * once the run is done.
+ *
+ * Handles are independent: several demuxes may run at the same time on
+ * different threads, a handle is used from one thread at a time.
+ *
+ * Structures only grow at their end, the library version is checked with
+ * tsd_version() against TSD_VERSION. The structures the library fills in
+ * begin with struct_size, set by the caller to the sizeof of its own
+ * definition: a newer library writes no further than that, an older one
+ * leaves the fields it does not know untouched.
+ */
+
+#ifndef TSDEMUX_H
+#define TSDEMUX_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#if defined(TSD_SHARED)
+#  if defined(_WIN32)
+#    if defined(TSD_BUILD)
+#      define TSD_API __declspec(dllexport)
+#    else
+#      define TSD_API __declspec(dllimport)
+#    endif
+#  elif defined(__GNUC__)
+#    define TSD_API __attribute__((visibility("default")))
+#  endif
+#endif
+#ifndef TSD_API
+#  define TSD_API
+#endif
+
+#define TSD_VERSION             3
+
+#define TSD_OK                  0
+#define TSD_ERROR               -1      /* invalid argument or state */
+#define TSD_NOT_FOUND           -2      /* no such stream or statistics */
+
+#define TSD_TIMESTAMP_UNSET     0x1ffffffffULL
+
+/* analyses, enabled before tsd_run() */
+#define TSD_ANALYSIS_PCR            0x01    /* PCR interval, accuracy and jitter */
+#define TSD_ANALYSIS_PCR_WALLCLOCK  0x02    /* PCR arrival on the wall clock, for live callbacks */
+#define TSD_ANALYSIS_BITRATE        0x04    /* packet counters per PID */
+#define TSD_ANALYSIS_BUFFER         0x08    /* T-STD buffer model */
+#define TSD_ANALYSIS_GOP            0x10    /* GOP structure of the video streams */
+#define TSD_ANALYSIS_DURATION       0x20    /* frame and sample counted media duration */
+#define TSD_ANALYSIS_TIMERS         0x40    /* stage timers of tsd_get_perf_stats() */
+
+/* stages of tsd_perf_stats, timed exclusive of each other */
+#define TSD_STAGE_READ          0       /* input reads */
+#define TSD_STAGE_SYNC          1       /* sync byte search */
+#define TSD_STAGE_PACKET        2       /* TS header, adaptation field, PCR */
+#define TSD_STAGE_PSI           3       /* PAT and PMT */
+#define TSD_STAGE_PES           4       /* PES headers, ES buffer appends */
+#define TSD_STAGE_ES            5       /* ES parsers */
+#define TSD_STAGE_FRAME         6       /* timestamp unwrap, frame analyses */
+#define TSD_STAGE_COUNT         7
+
+#define TSD_STREAM_TYPES        32      /* frame counters by tsd_stream.stream_type */
+
+/* log levels */
+#define TSD_LOG_NONE            -1
+#define TSD_LOG_ERROR           0
+#define TSD_LOG_WARN            1
+#define TSD_LOG_INFO            2
+#define TSD_LOG_DEBUG           3
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tsd_demux tsd_demux;
+
+/* returns the bytes read, 0 at the end of the input */
+typedef size_t (*tsd_read_fn)(void *opaque, unsigned char *buf, size_t size);
+/* returns 0 on success */
+typedef int (*tsd_seek_fn)(void *opaque, uint64_t pos);
+typedef void (*tsd_log_fn)(void *opaque, int level, const char *msg);
+
+enum tsd_event_type
+{
+  TSD_EVENT_PES = 0,            /* PES header: position, pts, dts, pcr */
+  TSD_EVENT_FRAME = 1           /* frame of an ES parser: pts, dts, size, duration, samples, frame type */
+};
+
+enum tsd_frame_type
+{
+  TSD_FRAME_UNKNOWN = 0,
+  TSD_FRAME_I,
+  TSD_FRAME_P,
+  TSD_FRAME_B
+};
+
+typedef struct tsd_event
+{
+  int type;                     /* tsd_event_type */
+  uint16_t pid;
+  uint64_t position;            /* PES: byte position in the input */
+  uint64_t pts;                 /* 90kHz, extended past the 33 bit wrap, TSD_TIMESTAMP_UNSET if absent */
+  uint64_t dts;
+  uint64_t pcr;                 /* PES: PCR of the TS packet starting the PES, 27MHz, TSD_TIMESTAMP_UNSET if none */
+  uint64_t duration;            /* frame: 90kHz */
+  uint32_t size;                /* frame: bytes */
+  uint32_t samples;             /* frame: audio samples, 0 for video */
+  int sample_rate;              /* frame: audio */
+  int frame_type;               /* frame: tsd_frame_type, video */
+  int random_access;            /* frame: IDR/IRAP picture */
+} tsd_event;
+
+typedef void (*tsd_event_fn)(void *opaque, const tsd_event *event);
+
+typedef struct tsd_stream
+{
+  size_t struct_size;           /* sizeof(tsd_stream), set by the caller */
+  uint16_t program;
+  uint16_t pid;
+  uint16_t pcr_pid;             /* of the program */
+  int selected;
+  int stream_type;              /* STREAM_TYPE of the ES parsers */
+  const char *codec;            /* static string */
+  int video;
+  int audio;
+  char language[4];
+  int width;
+  int height;
+  int fps_scale;
+  int fps_rate;
+  int interlaced;
+  float aspect;
+  int channels;
+  int sample_rate;
+  int bit_rate;
+} tsd_stream;
+
+typedef struct tsd_stream_stats
+{
+  size_t struct_size;           /* sizeof(tsd_stream_stats), set by the caller */
+  uint16_t pid;
+  /* TSD_ANALYSIS_BITRATE */
+  uint64_t packets;
+  uint64_t payload_bytes;
+  uint64_t scrambled;
+  /* TSD_ANALYSIS_DURATION */
+  uint64_t frames;
+  uint64_t samples;
+  double duration;              /* seconds, from the sample counts for audio */
+  double pts_span;              /* seconds, from the presentation timestamps */
+  /* TSD_ANALYSIS_GOP, video */
+  uint64_t gops;
+  uint64_t random_access;
+  uint64_t closed_gops;
+  uint64_t open_gops;
+  double gop_frames_avg;
+  double gop_ms_avg;
+  /* TSD_ANALYSIS_BUFFER */
+  uint64_t buffer_overflows;    /* TB, MB and EB */
+  uint64_t buffer_underflows;
+} tsd_stream_stats;
+
+typedef struct tsd_pcr_stats
+{
+  size_t struct_size;           /* sizeof(tsd_pcr_stats), set by the caller */
+  uint16_t pid;
+  uint64_t count;
+  uint64_t discontinuities;
+  uint64_t discontinuity_errors;
+  uint64_t repetition_errors;
+  uint64_t accuracy_errors;
+  double interval_min_ms;
+  double interval_avg_ms;
+  double interval_max_ms;
+  double mux_rate;              /* bit/s */
+  int64_t accuracy_min_ns;      /* PCR_AC */
+  int64_t accuracy_max_ns;
+  int64_t jitter_min_ns;        /* PCR_OJ */
+  int64_t jitter_max_ns;
+} tsd_pcr_stats;
+
+typedef struct tsd_perf_stats
+{
+  size_t struct_size;           /* sizeof(tsd_perf_stats), set by the caller */
+  uint64_t packets;             /* TS packets, null and errored ones included */
+  uint64_t resyncs;             /* sync regained after skipped bytes */
+  uint64_t resync_bytes;
+  uint64_t cc_errors;           /* continuity counter mismatches */
+  uint64_t pes_starts;          /* of the selected streams */
+  uint64_t es_append_bytes;     /* copied into the ES buffers */
+  uint64_t es_moved_bytes;      /* moved back to the start of the ES buffers */
+  uint64_t es_reallocs;
+  uint64_t frames[TSD_STREAM_TYPES];    /* emitted by the ES parsers, by stream type */
+  /* TSD_ANALYSIS_TIMERS */
+  uint64_t stage_calls[TSD_STAGE_COUNT];
+  double stage_ms[TSD_STAGE_COUNT];
+} tsd_perf_stats;
+
+TSD_API int tsd_version(void);
+
+/* NULL on failure */
+TSD_API tsd_demux *tsd_open_file(const char *path);
+/* data is not copied, it must outlive the demux */
+TSD_API tsd_demux *tsd_open_buffer(const void *data, size_t size);
+/* seek may be NULL for a stream that cannot go back */
+TSD_API tsd_demux *tsd_open_callbacks(tsd_read_fn read, tsd_seek_fn seek, void *opaque);
+TSD_API void tsd_close(tsd_demux *demux);
+
+/* messages up to level, prefixed with tag (may be NULL); to stderr without callback */
+TSD_API void tsd_set_log(tsd_demux *demux, int level, tsd_log_fn log, void *opaque, const char *tag);
+/* all programs by default, before tsd_run() */
+TSD_API int tsd_select_program(tsd_demux *demux, uint16_t program_number);
+TSD_API int tsd_select_service(tsd_demux *demux, const char *service_name);
+TSD_API int tsd_enable(tsd_demux *demux, unsigned analyses);
+TSD_API void tsd_set_event_callback(tsd_demux *demux, tsd_event_fn event, void *opaque);
+
+/* demuxes to the end of the input, once per handle */
+TSD_API int tsd_run(tsd_demux *demux);
+
+/* TSD_ERROR if struct_size is smaller than the struct_size member itself */
+TSD_API size_t tsd_stream_count(tsd_demux *demux);
+TSD_API int tsd_get_stream(tsd_demux *demux, size_t index, tsd_stream *stream);
+TSD_API int tsd_get_stream_stats(tsd_demux *demux, uint16_t pid, tsd_stream_stats *stats);
+TSD_API int tsd_get_pcr_stats(tsd_demux *demux, uint16_t pcr_pid, tsd_pcr_stats *stats);
+/* counters of the run, always kept */
+TSD_API int tsd_get_perf_stats(tsd_demux *demux, tsd_perf_stats *stats);
+/* DTS of the first video frame (90kHz), -1 if none */
+TSD_API int64_t tsd_start_time(tsd_demux *demux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TSDEMUX_H */